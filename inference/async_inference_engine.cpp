@@ -0,0 +1,147 @@
+#include "inference/async_inference_engine.h"
+
+namespace inference {
+
+struct AsyncInferenceEngine::Frame {
+  cv::Mat source;
+  cv::Mat blob;
+  std::vector<cv::Mat> network_output;
+  absl::Status status;
+
+  // Exactly one of the two is used to hand out the result.
+  std::promise<Result> promise;
+  Callback callback;
+
+  void Deliver(Result result) {
+    if (callback) {
+      callback(std::move(result));
+    } else {
+      promise.set_value(std::move(result));
+    }
+  }
+};
+
+absl::StatusOr<std::unique_ptr<AsyncInferenceEngine>>
+AsyncInferenceEngine::Create(const InferenceParams &params) {
+  if (params.async_queue_depth <= 0) {
+    return absl::InvalidArgumentError("async_queue_depth must be positive");
+  }
+
+  auto engine = InferenceEngine::Create(params);
+  if (!engine.ok()) {
+    return engine.status();
+  }
+
+  return std::unique_ptr<AsyncInferenceEngine>(
+      new AsyncInferenceEngine(std::move(*engine), params));
+}
+
+AsyncInferenceEngine::AsyncInferenceEngine(
+    std::unique_ptr<InferenceEngine> engine, const InferenceParams &params)
+    : engine_(std::move(engine)), backpressure_(params.async_backpressure),
+      submitted_(params.async_queue_depth),
+      preprocessed_(params.async_queue_depth),
+      forwarded_(params.async_queue_depth),
+      free_blobs_(params.async_queue_depth) {
+  preprocess_thread_ = std::thread(&AsyncInferenceEngine::PreprocessLoop, this);
+  forward_thread_ = std::thread(&AsyncInferenceEngine::ForwardLoop, this);
+  postprocess_thread_ =
+      std::thread(&AsyncInferenceEngine::PostprocessLoop, this);
+}
+
+AsyncInferenceEngine::~AsyncInferenceEngine() {
+  // Closing the first queue lets every stage drain and close the next one.
+  submitted_.Close();
+  preprocess_thread_.join();
+  forward_thread_.join();
+  postprocess_thread_.join();
+}
+
+std::future<AsyncInferenceEngine::Result>
+AsyncInferenceEngine::Submit(const cv::Mat &source) {
+  auto frame = std::make_unique<Frame>();
+  frame->source = source;
+  auto future = frame->promise.get_future();
+
+  auto status = Enqueue(frame);
+  if (!status.ok()) {
+    frame->promise.set_value(status);
+  }
+  return future;
+}
+
+absl::Status AsyncInferenceEngine::Submit(const cv::Mat &source,
+                                          Callback callback) {
+  if (!callback) {
+    return absl::InvalidArgumentError("callback is empty");
+  }
+
+  auto frame = std::make_unique<Frame>();
+  frame->source = source;
+  frame->callback = std::move(callback);
+  return Enqueue(frame);
+}
+
+absl::Status AsyncInferenceEngine::Enqueue(std::unique_ptr<Frame> &frame) {
+  if (frame->source.empty()) {
+    return absl::InvalidArgumentError("source image is empty");
+  }
+
+  std::lock_guard<std::mutex> lock(submit_mutex_);
+  if (backpressure_ == BackpressurePolicy::kReject) {
+    if (submitted_.TryPush(frame)) {
+      return absl::OkStatus();
+    }
+    if (submitted_.Closed()) {
+      return absl::FailedPreconditionError("engine is shutting down");
+    }
+    return absl::ResourceExhaustedError("inference pipeline is full");
+  }
+
+  if (!submitted_.Push(frame)) {
+    return absl::FailedPreconditionError("engine is shutting down");
+  }
+  return absl::OkStatus();
+}
+
+void AsyncInferenceEngine::PreprocessLoop() {
+  std::unique_ptr<Frame> frame;
+  while (submitted_.Pop(frame)) {
+    // Reuse a blob the forward stage is done with, if there is one.
+    free_blobs_.TryPop(frame->blob);
+
+    frame->status = engine_->Preprocess(absl::MakeConstSpan(&frame->source, 1),
+                                        &frame->blob);
+    preprocessed_.Push(frame);
+  }
+  preprocessed_.Close();
+}
+
+void AsyncInferenceEngine::ForwardLoop() {
+  std::unique_ptr<Frame> frame;
+  while (preprocessed_.Pop(frame)) {
+    if (frame->status.ok()) {
+      frame->status = engine_->Forward(frame->blob, &frame->network_output);
+    }
+
+    // The network copies its input, so the blob can be recycled right away.
+    free_blobs_.TryPush(frame->blob);
+    forwarded_.Push(frame);
+  }
+  forwarded_.Close();
+}
+
+void AsyncInferenceEngine::PostprocessLoop() {
+  std::unique_ptr<Frame> frame;
+  while (forwarded_.Pop(frame)) {
+    if (!frame->status.ok()) {
+      frame->Deliver(frame->status);
+      continue;
+    }
+
+    frame->Deliver(
+        engine_->Postprocess(frame->network_output, 0, frame->source));
+  }
+}
+
+} // namespace inference
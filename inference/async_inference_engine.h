@@ -0,0 +1,89 @@
+#ifndef INFERENCE_ASYNC_INFERENCE_ENGINE_H_
+#define INFERENCE_ASYNC_INFERENCE_ENGINE_H_
+
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "opencv2/core.hpp"
+
+#include "inference/detection.h"
+#include "inference/inference_engine.h"
+#include "inference/inference_params.h"
+#include "inference/spsc_queue.h"
+
+namespace inference {
+
+// Runs the InferenceEngine stages as a three stage pipeline, preprocess ->
+// forward -> postprocess, each stage on its own thread and connected by
+// bounded lock-free queues. Frame N + 1 is letterboxed while frame N is in
+// the network and frame N - 1 is being decoded.
+//
+// Every stage handles frames one at a time in FIFO order, so results are
+// delivered in submission order. Queue depth and what happens when the
+// pipeline is full are set by InferenceParams::async_queue_depth and
+// InferenceParams::async_backpressure.
+class AsyncInferenceEngine {
+public:
+  using Result = absl::StatusOr<std::vector<Detection>>;
+  using Callback = std::function<void(Result)>;
+
+  static absl::StatusOr<std::unique_ptr<AsyncInferenceEngine>>
+  Create(const InferenceParams &params);
+
+  // Finishes every frame already submitted, then stops the stage threads.
+  ~AsyncInferenceEngine();
+
+  // Queues `source` for inference. The pipeline keeps a reference to the
+  // pixels of `source`, so they must not be written until the result is
+  // delivered. Thread-safe.
+  std::future<Result> Submit(const cv::Mat &source);
+
+  // Same as above, but `callback` is invoked on the postprocessing thread
+  // with the result. Returns an error, and never invokes `callback`, if the
+  // frame could not be queued.
+  absl::Status Submit(const cv::Mat &source, Callback callback);
+
+  // Metrics of the wrapped engine, recorded by all three stage threads. Null
+  // unless InferenceParams::enable_metrics is set.
+  InferenceMetrics *metrics() const { return engine_->metrics(); }
+
+private:
+  struct Frame;
+
+  AsyncInferenceEngine(std::unique_ptr<InferenceEngine> engine,
+                       const InferenceParams &params);
+
+  absl::Status Enqueue(std::unique_ptr<Frame> &frame);
+
+  void PreprocessLoop();
+  void ForwardLoop();
+  void PostprocessLoop();
+
+  std::unique_ptr<InferenceEngine> engine_;
+  const BackpressurePolicy backpressure_;
+
+  // Submit may be called from several threads, but the first queue has a
+  // single producer.
+  std::mutex submit_mutex_;
+
+  SpscQueue<std::unique_ptr<Frame>> submitted_;
+  SpscQueue<std::unique_ptr<Frame>> preprocessed_;
+  SpscQueue<std::unique_ptr<Frame>> forwarded_;
+
+  // Input blobs handed back by the forward stage once the network copied
+  // them, so preprocessing reuses them instead of allocating.
+  SpscQueue<cv::Mat> free_blobs_;
+
+  std::thread preprocess_thread_;
+  std::thread forward_thread_;
+  std::thread postprocess_thread_;
+};
+
+} // namespace inference
+
+#endif
@@ -0,0 +1,288 @@
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <numeric>
+#include <string_view>
+
+#include "absl/log/check.h"
+
+#include "inference/benchmarks/benchmark_data.h"
+
+namespace inference {
+namespace {
+
+// Just enough of the protobuf wire format to serialize an ONNX model.
+class ProtoWriter {
+public:
+  void Varint(int field, uint64_t value) {
+    Tag(field, /*wire_type=*/0);
+    AppendVarint(value);
+  }
+
+  void Bytes(int field, std::string_view bytes) {
+    Tag(field, /*wire_type=*/2);
+    AppendVarint(bytes.size());
+    out_.append(bytes);
+  }
+
+  void Message(int field, const ProtoWriter &message) {
+    Bytes(field, message.out_);
+  }
+
+  const std::string &data() const { return out_; }
+
+private:
+  void Tag(int field, int wire_type) {
+    AppendVarint((static_cast<uint64_t>(field) << 3) | wire_type);
+  }
+
+  void AppendVarint(uint64_t value) {
+    while (value >= 0x80) {
+      out_.push_back(static_cast<char>(value | 0x80));
+      value >>= 7;
+    }
+    out_.push_back(static_cast<char>(value));
+  }
+
+  std::string out_;
+};
+
+// Field numbers and enum values from onnx.proto.
+constexpr int kFloat = 1;
+constexpr int kInt64 = 7;
+constexpr int kAttributeInts = 7;
+
+template <typename T>
+ProtoWriter Tensor(const std::string &name, int data_type,
+                   const std::vector<int64_t> &dims,
+                   const std::vector<T> &values) {
+  ProtoWriter tensor;
+  for (int64_t dim : dims) {
+    tensor.Varint(1, static_cast<uint64_t>(dim));
+  }
+  tensor.Varint(2, data_type);
+  tensor.Bytes(8, name);
+  // raw_data is little endian, as are all targets we run on.
+  tensor.Bytes(9,
+               std::string_view(reinterpret_cast<const char *>(values.data()),
+                                values.size() * sizeof(T)));
+  return tensor;
+}
+
+ProtoWriter IntsAttribute(const std::string &name,
+                          const std::vector<int64_t> &values) {
+  ProtoWriter attribute;
+  attribute.Bytes(1, name);
+  for (int64_t value : values) {
+    attribute.Varint(8, static_cast<uint64_t>(value));
+  }
+  attribute.Varint(20, kAttributeInts);
+  return attribute;
+}
+
+ProtoWriter Node(const std::string &op_type,
+                 const std::vector<std::string> &inputs,
+                 const std::string &output,
+                 const std::vector<ProtoWriter> &attributes = {}) {
+  ProtoWriter node;
+  for (const auto &input : inputs) {
+    node.Bytes(1, input);
+  }
+  node.Bytes(2, output);
+  node.Bytes(3, output);
+  node.Bytes(4, op_type);
+  for (const auto &attribute : attributes) {
+    node.Message(5, attribute);
+  }
+  return node;
+}
+
+// Float tensor value info whose first dimension is the symbolic batch size.
+ProtoWriter BatchedValueInfo(const std::string &name,
+                             const std::vector<int64_t> &dims) {
+  ProtoWriter shape;
+  ProtoWriter batch;
+  batch.Bytes(2, "batch");
+  shape.Message(1, batch);
+  for (int64_t value : dims) {
+    ProtoWriter dim;
+    dim.Varint(1, static_cast<uint64_t>(value));
+    shape.Message(1, dim);
+  }
+
+  ProtoWriter tensor_type;
+  tensor_type.Varint(1, kFloat);
+  tensor_type.Message(2, shape);
+  ProtoWriter type;
+  type.Message(1, tensor_type);
+
+  ProtoWriter value_info;
+  value_info.Bytes(1, name);
+  value_info.Message(2, type);
+  return value_info;
+}
+
+// Tiny detector models written by this process, one per input size, so
+// benchmark binaries running side by side never read each other's files.
+// Removed when the process exits.
+class TinyDetectorFiles {
+public:
+  ~TinyDetectorFiles() {
+    for (const auto &[input_size, path] : paths_) {
+      std::error_code error;
+      std::filesystem::remove(path, error);
+    }
+  }
+
+  std::string Get(int input_size) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = paths_.find(input_size);
+    if (it != paths_.end()) {
+      return it->second;
+    }
+    std::string path = (std::filesystem::temp_directory_path() /
+                        ("tiny_detector_" + std::to_string(input_size) +
+                         "_XXXXXX.onnx"))
+                           .string();
+    const int fd = mkstemps(path.data(), /*suffixlen=*/5);
+    PCHECK(fd >= 0) << "Cannot create " << path;
+    close(fd);
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file << MakeTinyDetectorOnnx(input_size, /*num_classes=*/80);
+    CHECK(file.flush()) << "Cannot write " << path;
+    paths_.emplace(input_size, path);
+    return path;
+  }
+
+private:
+  std::mutex mutex_;
+  std::map<int, std::string> paths_;
+};
+
+} // namespace
+
+cv::Mat MakeRandomImage(int width, int height, unsigned seed) {
+  cv::Mat image(height, width, CV_8UC3);
+  cv::RNG rng(seed);
+  rng.fill(image, cv::RNG::UNIFORM, cv::Scalar::all(0), cv::Scalar::all(256));
+  return image;
+}
+
+cv::Mat MakeNetworkOutput(int num_anchors, int num_classes, int num_candidates,
+                          float confidence_threshold, int input_size,
+                          unsigned seed) {
+  const int num_channels = 4 + num_classes;
+  cv::Mat output(std::vector<int>{1, num_channels, num_anchors}, CV_32F);
+  cv::Mat planes(num_channels, num_anchors, CV_32F, output.ptr<float>());
+  cv::RNG rng(seed);
+
+  // Background anchors stay below the threshold in every class.
+  rng.fill(planes.rowRange(4, num_channels), cv::RNG::UNIFORM,
+           cv::Scalar::all(0.0), cv::Scalar::all(confidence_threshold * 0.9));
+  for (int anchor = 0; anchor < num_anchors; ++anchor) {
+    planes.at<float>(0, anchor) = rng.uniform(0.0f, float(input_size));
+    planes.at<float>(1, anchor) = rng.uniform(0.0f, float(input_size));
+    planes.at<float>(2, anchor) = rng.uniform(8.0f, input_size / 4.0f);
+    planes.at<float>(3, anchor) = rng.uniform(8.0f, input_size / 4.0f);
+  }
+
+  std::vector<int> anchors(num_anchors);
+  std::iota(anchors.begin(), anchors.end(), 0);
+  cv::randShuffle(anchors, 1.0, &rng);
+  for (int i = 0; i < std::min(num_candidates, num_anchors); ++i) {
+    const int class_id = rng.uniform(0, num_classes);
+    planes.at<float>(4 + class_id, anchors[i]) =
+        rng.uniform(confidence_threshold, 1.0f);
+  }
+
+  return output;
+}
+
+std::vector<Detection> MakeDetections(int count, int cluster_size,
+                                      int num_classes, unsigned seed) {
+  cv::RNG rng(seed);
+  std::vector<Detection> detections;
+  detections.reserve(count);
+
+  cv::Point center;
+  for (int i = 0; i < count; ++i) {
+    if (i % cluster_size == 0) {
+      center = cv::Point(rng.uniform(0, 1920), rng.uniform(0, 1080));
+    }
+    const int w = rng.uniform(32, 128);
+    const int h = rng.uniform(32, 128);
+    const int x = center.x + cvRound(rng.gaussian(8.0)) - w / 2;
+    const int y = center.y + cvRound(rng.gaussian(8.0)) - h / 2;
+    detections.push_back(Detection{.class_id = rng.uniform(0, num_classes),
+                                   .confidence = rng.uniform(0.25f, 1.0f),
+                                   .bbox = cv::Rect(x, y, w, h)});
+  }
+
+  return detections;
+}
+
+std::string MakeTinyDetectorOnnx(int input_size, int num_classes) {
+  const int num_channels = 4 + num_classes;
+  const float size = static_cast<float>(input_size);
+
+  // Box channels are centered in the letterbox and move with the pooled
+  // color, class scores spread around typical confidence thresholds.
+  cv::RNG rng(0x5eed);
+  std::vector<float> weight(num_channels * 3);
+  std::vector<float> bias(num_channels);
+  const float box_bias[] = {size / 2, size / 2, size / 8, size / 8};
+  const float box_gain[] = {size / 6, size / 6, size / 16, size / 16};
+  for (int c = 0; c < num_channels; ++c) {
+    const float gain = (c < 4) ? box_gain[c] : 1.0f;
+    for (int i = 0; i < 3; ++i) {
+      weight[c * 3 + i] = gain * rng.uniform(-1.0f, 1.0f);
+    }
+    bias[c] = (c < 4) ? box_bias[c] : rng.uniform(-1.0f, 0.5f);
+  }
+  const std::vector<int64_t> output_shape = {0, num_channels, -1};
+
+  ProtoWriter graph;
+  graph.Message(1, Node("AveragePool", {"images"}, "pooled",
+                        {IntsAttribute("kernel_shape", {32, 32}),
+                         IntsAttribute("strides", {32, 32})}));
+  graph.Message(1, Node("Conv", {"pooled", "conv.weight", "conv.bias"},
+                        "features", {IntsAttribute("kernel_shape", {1, 1})}));
+  graph.Message(1, Node("Reshape", {"features", "output_shape"}, "output0"));
+  graph.Bytes(2, "tiny_detector");
+  graph.Message(5, Tensor("conv.weight", kFloat, {num_channels, 3, 1, 1},
+                          weight));
+  graph.Message(5, Tensor("conv.bias", kFloat, {num_channels}, bias));
+  graph.Message(5, Tensor("output_shape", kInt64, {3}, output_shape));
+  graph.Message(11, BatchedValueInfo("images", {3, input_size, input_size}));
+  const int num_anchors = (input_size / 32) * (input_size / 32);
+  graph.Message(12, BatchedValueInfo("output0", {num_channels, num_anchors}));
+
+  ProtoWriter opset;
+  opset.Bytes(1, "");
+  opset.Varint(2, 13);
+
+  ProtoWriter model;
+  model.Varint(1, 8); // IR version
+  model.Bytes(2, "inference_benchmarks");
+  model.Message(7, graph);
+  model.Message(8, opset);
+  return model.data();
+}
+
+InferenceParams TinyDetectorParams(int input_size) {
+  static TinyDetectorFiles files;
+  return InferenceParams{.model_path = files.Get(input_size),
+                         .input_image_width = input_size,
+                         .input_image_height = input_size,
+                         .padding_value = cv::Scalar(114, 114, 114),
+                         .confidence_threshold = 0.25,
+                         .iou_threshold = 0.5};
+}
+
+} // namespace inference
@@ -0,0 +1,44 @@
+#ifndef INFERENCE_BENCHMARKS_BENCHMARK_DATA_H_
+#define INFERENCE_BENCHMARKS_BENCHMARK_DATA_H_
+
+#include <string>
+#include <vector>
+
+#include "opencv2/core.hpp"
+
+#include "inference/detection.h"
+#include "inference/inference_params.h"
+
+namespace inference {
+
+// Random 8-bit BGR image.
+cv::Mat MakeRandomImage(int width, int height, unsigned seed);
+
+// [1, 4 + num_classes, num_anchors] head output in which exactly
+// `num_candidates` anchors have a class score of at least
+// `confidence_threshold`. Boxes lie inside an input_size x input_size
+// letterbox.
+cv::Mat MakeNetworkOutput(int num_anchors, int num_classes, int num_candidates,
+                          float confidence_threshold, int input_size,
+                          unsigned seed);
+
+// `count` detections of `num_classes` classes in clusters of `cluster_size`
+// jittered boxes. Larger clusters overlap more and make NMS suppress more.
+std::vector<Detection> MakeDetections(int count, int cluster_size,
+                                      int num_classes, unsigned seed);
+
+// Serialized ONNX model with the output layout of a YOLOv8/v11 head: input
+// "images" [N, 3, input_size, input_size], output [N, 4 + num_classes,
+// (input_size / 32)^2]. It is a 32x32 average pool followed by a 1x1
+// convolution with fixed pseudo-random weights, so it runs in microseconds
+// and needs no downloaded weights. `input_size` must be a multiple of 32.
+std::string MakeTinyDetectorOnnx(int input_size, int num_classes);
+
+// Writes the 80 class tiny detector to a file of this process in the temp
+// directory, once per input size, and returns params for an InferenceEngine
+// that runs it at input_size x input_size. The files are removed at exit.
+InferenceParams TinyDetectorParams(int input_size);
+
+} // namespace inference
+
+#endif
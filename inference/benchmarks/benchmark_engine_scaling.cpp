@@ -0,0 +1,145 @@
+#include <chrono>
+#include <map>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "absl/log/check.h"
+#include "benchmark/benchmark.h"
+#include "opencv2/core.hpp"
+
+#include "inference/benchmarks/benchmark_data.h"
+#include "inference/cpu_topology.h"
+#include "inference/inference_engine.h"
+#include "inference/pinned_thread_pool.h"
+
+namespace inference {
+namespace {
+
+// Throughput of 1 to N engines running side by side in one process, one
+// calling thread each, as a multi-stream server runs them. Engines either
+// share OpenCV's process-wide pool, or each gets a disjoint set of CPUs from
+// CpuTopology::Partition with a thread budget of its own. The efficiency
+// counter is throughput over N times the single engine throughput, 1 for
+// perfectly linear scaling.
+//
+// OpenCV runs one parallel_for_ region at a time in the whole process: a
+// region started while another one is running runs serially on its caller.
+// Engines with more than one thread each mostly take turns on their
+// threads, so their efficiency falls well short of 1 however they are
+// placed, and their runs are labelled as such. Only single-thread engines
+// can scale close to linearly.
+//
+// The pinned runs install PinnedThreadPool's parallel_for_ backend for the
+// rest of the process, so the shared pool runs are registered first.
+
+constexpr int kInputSize = 640;
+constexpr int kFramesPerRound = 16;
+
+const CpuTopology &Topology() {
+  static const CpuTopology *topology = [] {
+    auto detected = CpuTopology::Detect();
+    CHECK(detected.ok()) << detected.status();
+    return new CpuTopology(std::move(*detected));
+  }();
+  return *topology;
+}
+
+// Engine counts doubling up to one per physical core, and per-engine
+// budgets of 1 and 2 threads that fit on the cores.
+void EngineCounts(benchmark::internal::Benchmark *benchmark) {
+  const int cores = Topology().NumCores();
+  for (int threads : {1, 2}) {
+    const int max_engines = cores / threads;
+    int engines = 1;
+    for (; engines <= max_engines; engines *= 2) {
+      benchmark->Args({engines, threads});
+    }
+    if (max_engines > 0 && engines / 2 != max_engines) {
+      benchmark->Args({max_engines, threads});
+    }
+  }
+}
+
+template <bool kPinned> void BM_EngineScaling(benchmark::State &state) {
+  const int num_engines = static_cast<int>(state.range(0));
+  const int threads_per_engine = static_cast<int>(state.range(1));
+
+  InferenceParams params = TinyDetectorParams(kInputSize);
+  std::vector<std::vector<int>> cpu_sets(num_engines);
+  if (kPinned) {
+    PinnedThreadPool::InstallParallelBackend();
+    auto sets = Topology().Partition(num_engines, threads_per_engine);
+    CHECK(sets.ok()) << sets.status();
+    cpu_sets = std::move(*sets);
+  }
+  std::vector<std::unique_ptr<InferenceEngine>> engines;
+  std::vector<cv::Mat> sources;
+  params.num_threads = kPinned ? threads_per_engine : 0;
+  for (int i = 0; i < num_engines; ++i) {
+    params.cpus = cpu_sets[i];
+    auto engine = InferenceEngine::Create(params);
+    CHECK(engine.ok()) << engine.status();
+    engines.push_back(std::move(*engine));
+    sources.push_back(MakeRandomImage(1920, 1080, i));
+  }
+  // Shared pool engines split the threads they would get pinned.
+  if (!kPinned) {
+    cv::setNumThreads(num_engines * threads_per_engine);
+  }
+
+  double seconds = 0.0;
+  for (auto _ : state) {
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_engines; ++i) {
+      threads.emplace_back([&engines, &sources, i] {
+        std::vector<Detection> detections;
+        for (int frame = 0; frame < kFramesPerRound; ++frame) {
+          auto status = engines[i]->RunInference(sources[i], &detections);
+          CHECK(status.ok()) << status;
+        }
+      });
+    }
+    for (std::thread &thread : threads) {
+      thread.join();
+    }
+    seconds += std::chrono::duration<double>(
+                   std::chrono::steady_clock::now() - start)
+                   .count();
+  }
+
+  const double frames = static_cast<double>(state.iterations()) *
+                        num_engines * kFramesPerRound;
+  state.SetItemsProcessed(static_cast<int64_t>(frames));
+  state.counters["frames_per_engine"] =
+      benchmark::Counter(frames / num_engines, benchmark::Counter::kIsRate);
+
+  static std::map<int, double> single_engine_rate;
+  const double rate = frames / seconds;
+  if (num_engines == 1) {
+    single_engine_rate[threads_per_engine] = rate;
+  }
+  const auto single = single_engine_rate.find(threads_per_engine);
+  if (single != single_engine_rate.end()) {
+    state.counters["efficiency"] = rate / (num_engines * single->second);
+  }
+  if (num_engines > 1 && threads_per_engine > 1) {
+    state.SetLabel("parallel_for_ regions serialized across engines");
+  }
+  cv::setNumThreads(-1);
+}
+BENCHMARK_TEMPLATE(BM_EngineScaling, false)
+    ->ArgNames({"engines", "threads"})
+    ->Apply(EngineCounts)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_EngineScaling, true)
+    ->ArgNames({"engines", "threads"})
+    ->Apply(EngineCounts)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+} // namespace
+} // namespace inference
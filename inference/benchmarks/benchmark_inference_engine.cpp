@@ -0,0 +1,146 @@
+#include <memory>
+
+#include "absl/log/check.h"
+#include "benchmark/benchmark.h"
+#include "opencv2/core.hpp"
+
+#include "inference/benchmarks/benchmark_data.h"
+#include "inference/inference_engine.h"
+#include "inference/tiled_inference_engine.h"
+
+namespace inference {
+namespace {
+
+// End to end benchmarks on the generated tiny detector, so they run without
+// the YOLO weights. The network is cheap, which puts the cost of the stages
+// around it in the foreground.
+
+constexpr int kInputSize = 640;
+
+InferenceEngine &Engine() {
+  static InferenceEngine *engine = [] {
+    auto created = InferenceEngine::Create(TinyDetectorParams(kInputSize));
+    CHECK(created.ok()) << created.status();
+    return created->release();
+  }();
+  return *engine;
+}
+
+void BM_Forward(benchmark::State &state) {
+  InferenceEngine &engine = Engine();
+  std::vector<cv::Mat> sources;
+  for (int i = 0; i < state.range(0); ++i) {
+    sources.push_back(MakeRandomImage(1920, 1080, i));
+  }
+  cv::Mat blob;
+  CHECK(engine.Preprocess(sources, &blob).ok());
+  std::vector<cv::Mat> network_output;
+
+  for (auto _ : state) {
+    auto status = engine.Forward(blob, &network_output);
+    benchmark::DoNotOptimize(status);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Forward)
+    ->ArgName("batch")
+    ->RangeMultiplier(2)
+    ->Range(1, 8)
+    ->Unit(benchmark::kMicrosecond);
+
+void BM_RunInference(benchmark::State &state) {
+  InferenceEngine &engine = Engine();
+  const cv::Mat source = MakeRandomImage(state.range(0), state.range(1), 1);
+  std::vector<Detection> detections;
+
+  for (auto _ : state) {
+    auto status = engine.RunInference(source, &detections);
+    benchmark::DoNotOptimize(status);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_RunInference)
+    ->ArgNames({"width", "height"})
+    ->Args({640, 480})
+    ->Args({1920, 1080})
+    ->Args({3840, 2160})
+    ->Unit(benchmark::kMicrosecond);
+
+void BM_RunInferenceBatch(benchmark::State &state) {
+  InferenceEngine &engine = Engine();
+  std::vector<cv::Mat> sources;
+  for (int i = 0; i < state.range(0); ++i) {
+    sources.push_back(MakeRandomImage(1920, 1080, i));
+  }
+
+  for (auto _ : state) {
+    auto detections = engine.RunInferenceBatch(sources);
+    benchmark::DoNotOptimize(detections);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_RunInferenceBatch)
+    ->ArgName("batch")
+    ->RangeMultiplier(2)
+    ->Range(1, 8)
+    ->Unit(benchmark::kMicrosecond);
+
+// Letterboxes into the smallest stride 32 rectangle rather than the full
+// square. Every iteration alternates a landscape and a portrait frame, so
+// the engine switches between its cached networks for 640x384 and 384x640.
+void BM_RunInferenceRectangular(benchmark::State &state) {
+  static InferenceEngine *engine = [] {
+    InferenceParams params = TinyDetectorParams(kInputSize);
+    params.letterbox_stride = 32;
+    auto created = InferenceEngine::Create(params);
+    CHECK(created.ok()) << created.status();
+    return created->release();
+  }();
+  const bool rectangular = state.range(0) != 0;
+  InferenceEngine &selected = rectangular ? *engine : Engine();
+  const cv::Mat landscape = MakeRandomImage(1920, 1080, 1);
+  const cv::Mat portrait = MakeRandomImage(1080, 1920, 2);
+  std::vector<Detection> detections;
+
+  for (auto _ : state) {
+    auto status = selected.RunInference(landscape, &detections);
+    CHECK(status.ok()) << status;
+    status = selected.RunInference(portrait, &detections);
+    CHECK(status.ok()) << status;
+  }
+  state.SetItemsProcessed(state.iterations() * 2);
+}
+BENCHMARK(BM_RunInferenceRectangular)
+    ->ArgName("rectangular")
+    ->Arg(0)
+    ->Arg(1)
+    ->Unit(benchmark::kMicrosecond);
+
+void BM_RunTiled(benchmark::State &state) {
+  static TiledInferenceEngine *engine = [] {
+    auto created = TiledInferenceEngine::Create(
+        TinyDetectorParams(kInputSize), TilingOptions{});
+    CHECK(created.ok()) << created.status();
+    return created->release();
+  }();
+  const cv::Mat source = MakeRandomImage(state.range(0), state.range(1), 1);
+  std::vector<Detection> detections;
+
+  for (auto _ : state) {
+    auto status = engine->RunInference(source, &detections);
+    benchmark::DoNotOptimize(status);
+  }
+  // Tiles grow with the image area, so time per megapixel should stay flat.
+  state.counters["megapixels"] = benchmark::Counter(
+      state.range(0) * state.range(1) * 1e-6 * state.iterations(),
+      benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_RunTiled)
+    ->ArgNames({"width", "height"})
+    ->Args({1280, 720})
+    ->Args({1920, 1080})
+    ->Args({3840, 2160})
+    ->Unit(benchmark::kMillisecond);
+
+} // namespace
+} // namespace inference
@@ -0,0 +1,220 @@
+#include <algorithm>
+#include <memory>
+
+#include "absl/log/check.h"
+#include "benchmark/benchmark.h"
+#include "opencv2/core.hpp"
+
+#include "inference/benchmarks/benchmark_data.h"
+#include "inference/blob_preprocessor.h"
+#include "inference/detection_batch.h"
+#include "inference/inference_engine.h"
+#include "inference/multi_object_tracker.h"
+#include "inference/non_max_suppression.h"
+#include "inference/output_decoder.h"
+
+namespace inference {
+namespace {
+
+constexpr int kInputSize = 640;
+constexpr int kNumClasses = 80;
+constexpr int kNumAnchors = 8400;
+constexpr float kConfidenceThreshold = 0.25f;
+
+InferenceEngine &Engine() {
+  static InferenceEngine *engine = [] {
+    auto created = InferenceEngine::Create(TinyDetectorParams(kInputSize));
+    CHECK(created.ok()) << created.status();
+    return created->release();
+  }();
+  return *engine;
+}
+
+// Head output with `candidates` anchors above the threshold. There are never
+// fewer anchors than in a 640x640 YOLO head.
+cv::Mat NetworkOutput(int candidates) {
+  return MakeNetworkOutput(std::max(kNumAnchors, candidates), kNumClasses,
+                           candidates, kConfidenceThreshold, kInputSize, 1);
+}
+
+cv::Mat ChannelMajorPlanes(const cv::Mat &output) {
+  return cv::Mat(output.size[1], output.size[2], CV_32F,
+                 const_cast<float *>(output.ptr<float>()));
+}
+
+void CandidateCounts(benchmark::internal::Benchmark *benchmark) {
+  benchmark->ArgName("candidates");
+  for (int candidates : {10, 100, 1000, 10000}) {
+    benchmark->Arg(candidates);
+  }
+}
+
+// Candidate counts crossed with boxes per cluster, from sparse scenes where
+// little is suppressed to crowded ones where most boxes overlap.
+void CandidatesAndDensity(benchmark::internal::Benchmark *benchmark) {
+  benchmark->ArgNames({"candidates", "cluster"});
+  for (int candidates : {10, 100, 1000, 10000}) {
+    for (int cluster : {1, 8, 64}) {
+      benchmark->Args({candidates, cluster});
+    }
+  }
+}
+
+// Original scalar decoder, including the transpose it needs.
+void BM_DecodeRowMajor(benchmark::State &state) {
+  const cv::Mat output = NetworkOutput(state.range(0));
+  const cv::Mat planes = ChannelMajorPlanes(output);
+
+  for (auto _ : state) {
+    cv::Mat rows = planes.t();
+    auto detections =
+        OutputDecoder::DecodeRowMajor(rows, kConfidenceThreshold);
+    benchmark::DoNotOptimize(detections.data());
+  }
+}
+BENCHMARK(BM_DecodeRowMajor)
+    ->Apply(CandidateCounts)
+    ->Unit(benchmark::kMicrosecond);
+
+void BM_DecodeChannelMajor(benchmark::State &state) {
+  const cv::Mat output = NetworkOutput(state.range(0));
+  const cv::Mat planes = ChannelMajorPlanes(output);
+  std::vector<Detection> detections;
+
+  for (auto _ : state) {
+    OutputDecoder::DecodeChannelMajor(planes, kConfidenceThreshold,
+                                      &detections);
+    benchmark::DoNotOptimize(detections.data());
+  }
+}
+BENCHMARK(BM_DecodeChannelMajor)
+    ->Apply(CandidateCounts)
+    ->Unit(benchmark::kMicrosecond);
+
+void BM_NmsReference(benchmark::State &state) {
+  const auto detections =
+      MakeDetections(state.range(0), state.range(1), kNumClasses, 1);
+
+  for (auto _ : state) {
+    auto result = NonMaxSuppression::Apply(detections, 0.5f);
+    benchmark::DoNotOptimize(result.data());
+  }
+}
+BENCHMARK(BM_NmsReference)
+    ->Apply(CandidatesAndDensity)
+    ->Unit(benchmark::kMicrosecond);
+
+// Class-aware NMS on a reused workspace, dense or spatially bucketed.
+template <bool kBucketing> void BM_NmsClassAware(benchmark::State &state) {
+  const auto detections =
+      MakeDetections(state.range(0), state.range(1), kNumClasses, 1);
+  const NmsOptions options{.iou_threshold = 0.5f,
+                           .mode = NmsMode::kClassAware,
+                           .max_detections = 300,
+                           .spatial_bucketing = kBucketing};
+  NmsWorkspace workspace;
+  std::vector<Detection> result;
+
+  for (auto _ : state) {
+    NonMaxSuppression::Apply(detections, options, &workspace, &result);
+    benchmark::DoNotOptimize(result.data());
+  }
+}
+BENCHMARK_TEMPLATE(BM_NmsClassAware, false)
+    ->Apply(CandidatesAndDensity)
+    ->Unit(benchmark::kMicrosecond);
+BENCHMARK_TEMPLATE(BM_NmsClassAware, true)
+    ->Apply(CandidatesAndDensity)
+    ->Unit(benchmark::kMicrosecond);
+
+// Includes restoring the letterboxed boxes, a copy into reserved storage.
+void BM_UnscaleDetections(benchmark::State &state) {
+  const auto letterboxed = MakeDetections(state.range(0), 1, kNumClasses, 1);
+  const cv::Mat source = MakeRandomImage(1920, 1080, 1);
+  InferenceEngine &engine = Engine();
+  std::vector<Detection> detections;
+
+  for (auto _ : state) {
+    detections.assign(letterboxed.begin(), letterboxed.end());
+    engine.UnscaleDetections(source, &detections);
+    benchmark::DoNotOptimize(detections.data());
+  }
+}
+BENCHMARK(BM_UnscaleDetections)
+    ->Apply(CandidateCounts)
+    ->Unit(benchmark::kMicrosecond);
+
+// Same on float boxes, with the geometry recorded by preprocessing.
+void BM_UnscaleDetectionBatch(benchmark::State &state) {
+  DetectionBatch letterboxed;
+  for (const Detection &det :
+       MakeDetections(state.range(0), 1, kNumClasses, 1)) {
+    letterboxed.Add(det);
+  }
+  const ImageInfo image_info =
+      BlobPreprocessor::Geometry(cv::Size(1920, 1080), 640, 640);
+  DetectionBatch detections;
+  detections.Reserve(letterboxed.Size());
+
+  for (auto _ : state) {
+    detections = letterboxed;
+    InferenceEngine::UnscaleDetections(image_info, &detections);
+    benchmark::DoNotOptimize(detections.x1.data());
+  }
+}
+BENCHMARK(BM_UnscaleDetectionBatch)
+    ->Apply(CandidateCounts)
+    ->Unit(benchmark::kMicrosecond);
+
+// Parse, decode, NMS and unscale, as run for every frame.
+void BM_Postprocess(benchmark::State &state) {
+  const std::vector<cv::Mat> network_output = {NetworkOutput(state.range(0))};
+  const cv::Mat source = MakeRandomImage(1920, 1080, 1);
+  InferenceEngine &engine = Engine();
+  std::vector<Detection> detections;
+
+  for (auto _ : state) {
+    auto status = engine.Postprocess(network_output, 0, source, &detections);
+    benchmark::DoNotOptimize(status);
+  }
+  state.counters["kept"] = static_cast<double>(detections.size());
+}
+BENCHMARK(BM_Postprocess)
+    ->Apply(CandidateCounts)
+    ->Unit(benchmark::kMicrosecond);
+
+// One tracker update with `tracks` objects jittering by 2 px, on top of
+// a steady state where every object already has a confirmed track.
+void BM_TrackerUpdate(benchmark::State &state) {
+  const int num_objects = static_cast<int>(state.range(0));
+  auto tracker = MultiObjectTracker::Create(TrackerOptions{});
+  CHECK(tracker.ok()) << tracker.status();
+  std::vector<Detection> frames[2] = {
+      MakeDetections(num_objects, 1, kNumClasses, 1), {}};
+  for (Detection &det : frames[0]) {
+    det.confidence = std::max(det.confidence, 0.5f);
+  }
+  frames[1] = frames[0];
+  for (Detection &det : frames[1]) {
+    det.bbox.x += 2;
+  }
+
+  std::vector<TrackedObject> tracks;
+  for (int i = 0; i < 4; ++i) {
+    (*tracker)->Update(frames[i % 2], &tracks);
+  }
+  int frame = 0;
+  for (auto _ : state) {
+    (*tracker)->Update(frames[frame++ % 2], &tracks);
+    benchmark::DoNotOptimize(tracks.data());
+  }
+  state.counters["tracks"] = static_cast<double>(tracks.size());
+}
+BENCHMARK(BM_TrackerUpdate)
+    ->ArgName("tracks")
+    ->RangeMultiplier(4)
+    ->Range(16, 1024)
+    ->Unit(benchmark::kMicrosecond);
+
+} // namespace
+} // namespace inference
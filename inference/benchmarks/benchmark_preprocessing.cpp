@@ -0,0 +1,193 @@
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "absl/log/check.h"
+#include "benchmark/benchmark.h"
+#include "opencv2/core.hpp"
+#include "opencv2/dnn.hpp"
+#include "opencv2/imgcodecs.hpp"
+#include "opencv2/imgproc.hpp"
+
+#include "inference/benchmarks/benchmark_data.h"
+#include "inference/blob_preprocessor.h"
+#include "inference/image_decoder.h"
+#include "inference/inference_engine.h"
+#include "inference/yuv_image.h"
+
+namespace inference {
+namespace {
+
+constexpr int kInputSize = 640;
+
+InferenceEngine &Engine() {
+  static InferenceEngine *engine = [] {
+    auto created = InferenceEngine::Create(TinyDetectorParams(kInputSize));
+    CHECK(created.ok()) << created.status();
+    return created->release();
+  }();
+  return *engine;
+}
+
+// Source resolutions, as width x height pairs.
+void SourceSizes(benchmark::internal::Benchmark *benchmark) {
+  benchmark->ArgNames({"width", "height"});
+  benchmark->Args({320, 240});
+  benchmark->Args({640, 480});
+  benchmark->Args({1280, 720});
+  benchmark->Args({1920, 1080});
+  benchmark->Args({3840, 2160});
+}
+
+// The original path: LetterBox followed by blobFromImage.
+void BM_LetterBoxThenBlob(benchmark::State &state) {
+  const cv::Mat source = MakeRandomImage(state.range(0), state.range(1), 1);
+  InferenceEngine &engine = Engine();
+
+  for (auto _ : state) {
+    auto letterboxed = engine.LetterBox(source, kInputSize, kInputSize);
+    cv::Mat blob = cv::dnn::blobFromImage(
+        *letterboxed, 1.0 / 255.0, cv::Size(kInputSize, kInputSize),
+        cv::Scalar(), /*swapRB*/ true, /*crop*/ false);
+    benchmark::DoNotOptimize(blob.data);
+  }
+}
+BENCHMARK(BM_LetterBoxThenBlob)
+    ->Apply(SourceSizes)
+    ->Unit(benchmark::kMicrosecond);
+
+void BM_LetterBox(benchmark::State &state) {
+  const cv::Mat source = MakeRandomImage(state.range(0), state.range(1), 1);
+  InferenceEngine &engine = Engine();
+
+  for (auto _ : state) {
+    auto letterboxed = engine.LetterBox(source, kInputSize, kInputSize);
+    benchmark::DoNotOptimize(letterboxed->data);
+  }
+}
+BENCHMARK(BM_LetterBox)->Apply(SourceSizes)->Unit(benchmark::kMicrosecond);
+
+void BM_BlobPreprocessor(benchmark::State &state) {
+  const cv::Mat source = MakeRandomImage(state.range(0), state.range(1), 1);
+  BlobPreprocessor preprocessor(cv::Scalar(114, 114, 114));
+  cv::Mat blob(std::vector<int>{1, 3, kInputSize, kInputSize}, CV_32F);
+
+  for (auto _ : state) {
+    auto status =
+        preprocessor.Run(source, kInputSize, kInputSize, blob.ptr<float>());
+    benchmark::DoNotOptimize(status);
+  }
+}
+BENCHMARK(BM_BlobPreprocessor)
+    ->Apply(SourceSizes)
+    ->Unit(benchmark::kMicrosecond);
+
+// NV12 frames as video decoders produce them: converted to BGR by cvtColor
+// first, against the conversion fused into the letterbox kernel.
+void BM_Nv12ConvertThenBlob(benchmark::State &state) {
+  const cv::Mat nv12 =
+      MakeRandomImage(state.range(0), state.range(1) * 3 / 2, 1)
+          .reshape(1)
+          .colRange(0, state.range(0))
+          .clone();
+  BlobPreprocessor preprocessor(cv::Scalar(114, 114, 114));
+  cv::Mat blob(std::vector<int>{1, 3, kInputSize, kInputSize}, CV_32F);
+  cv::Mat bgr;
+
+  for (auto _ : state) {
+    cv::cvtColor(nv12, bgr, cv::COLOR_YUV2BGR_NV12);
+    auto status =
+        preprocessor.Run(bgr, kInputSize, kInputSize, blob.ptr<float>());
+    benchmark::DoNotOptimize(status);
+  }
+}
+BENCHMARK(BM_Nv12ConvertThenBlob)
+    ->Apply(SourceSizes)
+    ->Unit(benchmark::kMicrosecond);
+
+void BM_Nv12BlobPreprocessor(benchmark::State &state) {
+  const cv::Mat nv12 =
+      MakeRandomImage(state.range(0), state.range(1) * 3 / 2, 1)
+          .reshape(1)
+          .colRange(0, state.range(0))
+          .clone();
+  const YuvImage source = YuvImage::Nv12(
+      state.range(0), state.range(1), nv12.ptr<uint8_t>(0), nv12.step,
+      nv12.ptr<uint8_t>(state.range(1)), nv12.step);
+  BlobPreprocessor preprocessor(cv::Scalar(114, 114, 114));
+  cv::Mat blob(std::vector<int>{1, 3, kInputSize, kInputSize}, CV_32F);
+  ImageInfo info;
+
+  for (auto _ : state) {
+    auto status = preprocessor.Run(source, kInputSize, kInputSize,
+                                   blob.ptr<float>(), &info);
+    benchmark::DoNotOptimize(status);
+  }
+}
+BENCHMARK(BM_Nv12BlobPreprocessor)
+    ->Apply(SourceSizes)
+    ->Unit(benchmark::kMicrosecond);
+
+// Full Preprocess stage over a batch of 1080p frames.
+void BM_PreprocessBatch(benchmark::State &state) {
+  std::vector<cv::Mat> sources;
+  for (int i = 0; i < state.range(0); ++i) {
+    sources.push_back(MakeRandomImage(1920, 1080, i));
+  }
+  InferenceEngine &engine = Engine();
+  cv::Mat blob;
+
+  for (auto _ : state) {
+    auto status = engine.Preprocess(sources, &blob);
+    benchmark::DoNotOptimize(status);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_PreprocessBatch)
+    ->ArgName("batch")
+    ->RangeMultiplier(2)
+    ->Range(1, 8)
+    ->Unit(benchmark::kMicrosecond);
+
+// JPEG decoding of a source at full resolution, as cv::imread does, against
+// ImageDecoder's reduced decode for a kInputSize input.
+std::vector<uint8_t> EncodeJpeg(int width, int height) {
+  std::vector<uint8_t> encoded;
+  CHECK(cv::imencode(".jpg", MakeRandomImage(width, height, 1), encoded));
+  return encoded;
+}
+
+void BM_DecodeJpegFull(benchmark::State &state) {
+  const std::vector<uint8_t> encoded =
+      EncodeJpeg(state.range(0), state.range(1));
+  cv::Mat decoded;
+
+  for (auto _ : state) {
+    cv::imdecode(encoded, cv::IMREAD_COLOR, &decoded);
+    benchmark::DoNotOptimize(decoded.data);
+  }
+}
+BENCHMARK(BM_DecodeJpegFull)
+    ->Apply(SourceSizes)
+    ->Args({4000, 3000})
+    ->Unit(benchmark::kMicrosecond);
+
+void BM_DecodeJpegReduced(benchmark::State &state) {
+  const std::vector<uint8_t> encoded =
+      EncodeJpeg(state.range(0), state.range(1));
+  DecodedImage decoded;
+
+  for (auto _ : state) {
+    auto status =
+        ImageDecoder::Decode(encoded, kInputSize, kInputSize, &decoded);
+    benchmark::DoNotOptimize(status);
+  }
+  state.counters["reduction"] = decoded.reduction;
+}
+BENCHMARK(BM_DecodeJpegReduced)
+    ->Apply(SourceSizes)
+    ->Args({4000, 3000})
+    ->Unit(benchmark::kMicrosecond);
+
+} // namespace
+} // namespace inference
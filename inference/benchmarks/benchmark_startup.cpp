@@ -0,0 +1,94 @@
+#include <unistd.h>
+
+#include <fstream>
+#include <memory>
+#include <vector>
+
+#include "absl/log/check.h"
+#include "benchmark/benchmark.h"
+
+#include "inference/benchmarks/benchmark_data.h"
+#include "inference/inference_engine.h"
+#include "inference/shared_model.h"
+
+namespace inference {
+namespace {
+
+// Startup cost of engines: time to create them and the resident memory they
+// add, with and without the process-wide ModelCache.
+
+constexpr int kInputSize = 640;
+
+size_t ResidentBytes() {
+  std::ifstream statm("/proc/self/statm");
+  size_t total_pages = 0;
+  size_t resident_pages = 0;
+  if (!(statm >> total_pages >> resident_pages)) {
+    return 0;
+  }
+  return resident_pages * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+// Creates and destroys one engine. With the cache, the network released by
+// the previous iteration is taken over, without it the model is read and
+// parsed every time.
+void BM_CreateEngine(benchmark::State &state) {
+  InferenceParams params = TinyDetectorParams(kInputSize);
+  params.use_model_cache = state.range(0) != 0;
+  ModelCache::Global().Clear();
+
+  for (auto _ : state) {
+    auto engine = InferenceEngine::Create(params);
+    CHECK(engine.ok()) << engine.status();
+  }
+  state.SetItemsProcessed(state.iterations());
+  ModelCache::Global().Clear();
+}
+BENCHMARK(BM_CreateEngine)
+    ->ArgName("cached")
+    ->Arg(0)
+    ->Arg(1)
+    ->Unit(benchmark::kMillisecond);
+
+// Creates `engines` engines that live at the same time, as a server with
+// one engine per worker would. Every engine needs its own network, so the
+// cache only saves reading the model here, and the counters show how
+// resident memory grows with the number of engines.
+void BM_CreateEngines(benchmark::State &state) {
+  InferenceParams params = TinyDetectorParams(kInputSize);
+  params.use_model_cache = state.range(1) != 0;
+  const int num_engines = static_cast<int>(state.range(0));
+
+  size_t added_bytes = 0;
+  for (auto _ : state) {
+    state.PauseTiming();
+    ModelCache::Global().Clear();
+    std::vector<std::unique_ptr<InferenceEngine>> engines;
+    const size_t before = ResidentBytes();
+    state.ResumeTiming();
+
+    for (int i = 0; i < num_engines; ++i) {
+      auto engine = InferenceEngine::Create(params);
+      CHECK(engine.ok()) << engine.status();
+      engines.push_back(std::move(*engine));
+    }
+
+    state.PauseTiming();
+    const size_t after = ResidentBytes();
+    added_bytes = after > before ? after - before : 0;
+    engines.clear();
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * num_engines);
+  state.counters["rss_added_bytes"] = static_cast<double>(added_bytes);
+  state.counters["rss_bytes_per_engine"] =
+      static_cast<double>(added_bytes) / num_engines;
+  ModelCache::Global().Clear();
+}
+BENCHMARK(BM_CreateEngines)
+    ->ArgNames({"engines", "cached"})
+    ->ArgsProduct({{1, 2, 4, 8}, {0, 1}})
+    ->Unit(benchmark::kMillisecond);
+
+} // namespace
+} // namespace inference
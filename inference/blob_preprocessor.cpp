@@ -0,0 +1,440 @@
+#include <algorithm>
+#include <cmath>
+
+#include "absl/strings/str_format.h"
+#include "opencv2/core/hal/intrin.hpp"
+
+#include "inference/blob_preprocessor.h"
+
+namespace inference {
+namespace {
+
+constexpr float kNormalization = 1.0f / 255.0f;
+
+// Minimum number of output rows handed to one parallel stripe, below this the
+// scheduling overhead outweighs the work.
+constexpr int kMinRowsPerStripe = 32;
+
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+// Widens the 8-bit lanes of `value` to float, normalizes them and stores them
+// at `dst`, which receives 4 float vectors.
+inline void StoreNormalized(const cv::v_uint8 &value,
+                            const cv::v_float32 &normalization, float *dst) {
+  const int lanes = cv::VTraits<cv::v_float32>::vlanes();
+
+  cv::v_uint16 low, high;
+  cv::v_expand(value, low, high);
+
+  cv::v_uint32 q0, q1, q2, q3;
+  cv::v_expand(low, q0, q1);
+  cv::v_expand(high, q2, q3);
+
+  cv::v_store(dst, cv::v_mul(cv::v_cvt_f32(cv::v_reinterpret_as_s32(q0)),
+                             normalization));
+  cv::v_store(dst + lanes,
+              cv::v_mul(cv::v_cvt_f32(cv::v_reinterpret_as_s32(q1)),
+                        normalization));
+  cv::v_store(dst + 2 * lanes,
+              cv::v_mul(cv::v_cvt_f32(cv::v_reinterpret_as_s32(q2)),
+                        normalization));
+  cv::v_store(dst + 3 * lanes,
+              cv::v_mul(cv::v_cvt_f32(cv::v_reinterpret_as_s32(q3)),
+                        normalization));
+}
+#endif
+
+// Splits a BGR row into normalized R, G and B planes without resampling.
+void DeinterleaveRow(const uchar *src, int width, float *r, float *g,
+                     float *b) {
+  int x = 0;
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+  const int step = cv::VTraits<cv::v_uint8>::vlanes();
+  const cv::v_float32 normalization = cv::vx_setall_f32(kNormalization);
+  for (; x <= width - step; x += step) {
+    cv::v_uint8 blue, green, red;
+    cv::v_load_deinterleave(src + 3 * x, blue, green, red);
+    StoreNormalized(red, normalization, r + x);
+    StoreNormalized(green, normalization, g + x);
+    StoreNormalized(blue, normalization, b + x);
+  }
+#endif
+  for (; x < width; ++x) {
+    b[x] = src[3 * x] * kNormalization;
+    g[x] = src[3 * x + 1] * kNormalization;
+    r[x] = src[3 * x + 2] * kNormalization;
+  }
+}
+
+// Bilinearly resamples a BGR row to `width` columns using the precomputed
+// tables, writing normalized R, G and B planes.
+void ResampleRow(const uchar *src, int width, const int *offsets,
+                 const int *next_offsets, const float *weights, float *r,
+                 float *g, float *b) {
+  for (int x = 0; x < width; ++x) {
+    const uchar *p0 = src + offsets[x];
+    const uchar *p1 = src + next_offsets[x];
+    const float w = weights[x];
+
+    b[x] = (p0[0] + (p1[0] - p0[0]) * w) * kNormalization;
+    g[x] = (p0[1] + (p1[1] - p0[1]) * w) * kNormalization;
+    r[x] = (p0[2] + (p1[2] - p0[2]) * w) * kNormalization;
+  }
+}
+
+// dst = row0 + (row1 - row0) * weight
+void BlendRows(const float *row0, const float *row1, float weight, int width,
+               float *dst) {
+  if (weight == 0.0f) {
+    std::copy(row0, row0 + width, dst);
+    return;
+  }
+
+  int x = 0;
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+  const int lanes = cv::VTraits<cv::v_float32>::vlanes();
+  const cv::v_float32 v_weight = cv::vx_setall_f32(weight);
+  for (; x <= width - lanes; x += lanes) {
+    const cv::v_float32 a = cv::vx_load(row0 + x);
+    const cv::v_float32 b = cv::vx_load(row1 + x);
+    cv::v_store(dst + x, cv::v_fma(cv::v_sub(b, a), v_weight, a));
+  }
+#endif
+  for (; x < width; ++x) {
+    dst[x] = row0[x] + (row1[x] - row0[x]) * weight;
+  }
+}
+
+// Converts row `row` of `source` to BGR with the fixed-point BT.601
+// coefficients of cv::cvtColor, so converting on the fly produces the same
+// pixels as converting the whole frame first.
+void YuvRowToBgr(const YuvImage &source, int row, uchar *dst) {
+  constexpr int kShift = 20;
+  constexpr int kRound = 1 << (kShift - 1);
+  constexpr int kCy = 1220542;
+  constexpr int kCub = 2116026;
+  constexpr int kCug = -409993;
+  constexpr int kCvg = -852492;
+  constexpr int kCvr = 1673527;
+
+  const uint8_t *y = source.y + row * source.y_stride;
+  const uint8_t *u = source.u + (row / 2) * source.u_stride;
+  const uint8_t *v = source.v + (row / 2) * source.v_stride;
+  const int step = source.chroma_step();
+  for (int x = 0; x < source.width; x += 2, u += step, v += step) {
+    const int u_offset = *u - 128;
+    const int v_offset = *v - 128;
+    const int ruv = kRound + kCvr * v_offset;
+    const int guv = kRound + kCvg * v_offset + kCug * u_offset;
+    const int buv = kRound + kCub * u_offset;
+    for (int i = x; i < x + 2; ++i) {
+      const int luma = std::max(0, y[i] - 16) * kCy;
+      dst[3 * i] = cv::saturate_cast<uchar>((luma + buv) >> kShift);
+      dst[3 * i + 1] = cv::saturate_cast<uchar>((luma + guv) >> kShift);
+      dst[3 * i + 2] = cv::saturate_cast<uchar>((luma + ruv) >> kShift);
+    }
+  }
+}
+
+// Maps a destination coordinate to its source neighbour and weight, using the
+// same pixel-center convention and border clamping as cv::resize.
+void MapCoordinate(int dst, double inverse_scale, int src_size, int *src,
+                   float *weight) {
+  float f = static_cast<float>((dst + 0.5) * inverse_scale - 0.5);
+  int s = static_cast<int>(std::floor(f));
+  f -= static_cast<float>(s);
+
+  if (s < 0) {
+    s = 0;
+    f = 0.0f;
+  }
+  if (s >= src_size - 1) {
+    s = src_size - 1;
+    f = 0.0f;
+  }
+
+  *src = s;
+  *weight = f;
+}
+
+} // namespace
+
+// Processes a contiguous range of output rows per stripe. Each stripe owns two
+// cached, horizontally resampled source rows, so every source row a stripe
+// needs is read and resampled exactly once. The source is either a BGR Mat
+// or a YUV frame whose rows are converted to BGR as they are cached.
+class BlobPreprocessor::RowsBody : public cv::ParallelLoopBody {
+public:
+  RowsBody(BlobPreprocessor &owner, const cv::Mat *bgr, const YuvImage *yuv,
+           const cv::Size &source_size, int target_w, int target_h,
+           int resized_w, int resized_h, int left, int top,
+           int rows_per_stripe, float *dst)
+      : owner_(owner), bgr_(bgr), yuv_(yuv), source_size_(source_size),
+        target_w_(target_w), target_h_(target_h), resized_w_(resized_w),
+        resized_h_(resized_h), left_(left), top_(top),
+        rows_per_stripe_(rows_per_stripe), dst_(dst),
+        inverse_scale_y_(static_cast<double>(source_size.height) /
+                         resized_h) {}
+
+  void operator()(const cv::Range &range) const override {
+    const size_t plane_size = static_cast<size_t>(target_w_) * target_h_;
+    const size_t cache_row_size = 3 * static_cast<size_t>(target_w_);
+
+    for (int stripe = range.start; stripe < range.end; ++stripe) {
+      float *cache = owner_.row_cache_.data() + stripe * 2 * cache_row_size;
+      int cached_rows[2] = {-1, -1};
+      uchar *converted_row =
+          (yuv_ == nullptr)
+              ? nullptr
+              : owner_.converted_rows_.data() +
+                    static_cast<size_t>(stripe) * 3 * source_size_.width;
+
+      const int row_begin = stripe * rows_per_stripe_;
+      const int row_end = std::min(target_h_, row_begin + rows_per_stripe_);
+      for (int y = row_begin; y < row_end; ++y) {
+        float *planes[3] = {dst_ + y * target_w_,
+                            dst_ + plane_size + y * target_w_,
+                            dst_ + 2 * plane_size + y * target_w_};
+
+        const int dy = y - top_;
+        if (dy < 0 || dy >= resized_h_) {
+          for (int c = 0; c < 3; ++c) {
+            std::fill(planes[c], planes[c] + target_w_, owner_.padding_rgb_[c]);
+          }
+          continue;
+        }
+
+        for (int c = 0; c < 3; ++c) {
+          std::fill(planes[c], planes[c] + left_, owner_.padding_rgb_[c]);
+          std::fill(planes[c] + left_ + resized_w_, planes[c] + target_w_,
+                    owner_.padding_rgb_[c]);
+        }
+
+        int sy;
+        float weight;
+        MapCoordinate(dy, inverse_scale_y_, source_size_.height, &sy,
+                      &weight);
+
+        const float *row0 =
+            CachedRow(sy, /*keep*/ -1, cache, cached_rows, converted_row);
+        const float *row1 =
+            (weight == 0.0f)
+                ? row0
+                : CachedRow(sy + 1, sy, cache, cached_rows, converted_row);
+
+        for (int c = 0; c < 3; ++c) {
+          BlendRows(row0 + c * target_w_, row1 + c * target_w_, weight,
+                    resized_w_, planes[c] + left_);
+        }
+      }
+    }
+  }
+
+private:
+  // Returns the resampled RGB planes of source row `sy`, resampling it into
+  // one of the two cache slots if needed. The slot holding `keep` is never
+  // evicted. YUV rows are converted into `converted_row` first.
+  const float *CachedRow(int sy, int keep, float *cache, int *cached_rows,
+                         uchar *converted_row) const {
+    const size_t cache_row_size = 3 * static_cast<size_t>(target_w_);
+    for (int slot = 0; slot < 2; ++slot) {
+      if (cached_rows[slot] == sy) {
+        return cache + slot * cache_row_size;
+      }
+    }
+
+    // Rows are visited top to bottom, so the older row is the one to evict.
+    int victim = (cached_rows[0] <= cached_rows[1]) ? 0 : 1;
+    if (cached_rows[victim] == keep) {
+      victim = 1 - victim;
+    }
+
+    float *r = cache + victim * cache_row_size;
+    float *g = r + target_w_;
+    float *b = g + target_w_;
+    const uchar *src = converted_row;
+    if (yuv_ != nullptr) {
+      YuvRowToBgr(*yuv_, sy, converted_row);
+    } else {
+      src = bgr_->ptr<uchar>(sy);
+    }
+    if (source_size_.width == resized_w_) {
+      DeinterleaveRow(src, resized_w_, r, g, b);
+    } else {
+      ResampleRow(src, resized_w_, owner_.x_offsets_.data(),
+                  owner_.x_offsets_next_.data(), owner_.x_weights_.data(), r,
+                  g, b);
+    }
+
+    cached_rows[victim] = sy;
+    return r;
+  }
+
+  BlobPreprocessor &owner_;
+  const cv::Mat *const bgr_;
+  const YuvImage *const yuv_;
+  const cv::Size source_size_;
+  const int target_w_;
+  const int target_h_;
+  const int resized_w_;
+  const int resized_h_;
+  const int left_;
+  const int top_;
+  const int rows_per_stripe_;
+  float *const dst_;
+  const double inverse_scale_y_;
+};
+
+BlobPreprocessor::BlobPreprocessor(const cv::Scalar &padding_value)
+    : padding_rgb_{static_cast<float>(padding_value[2]) * kNormalization,
+                   static_cast<float>(padding_value[1]) * kNormalization,
+                   static_cast<float>(padding_value[0]) * kNormalization} {}
+
+ImageInfo BlobPreprocessor::Geometry(const cv::Size &source_size,
+                                    int target_w, int target_h) {
+  // Same geometry as LetterBox, so both paths produce identical layouts.
+  const float scale_w =
+      static_cast<float>(target_w) / static_cast<float>(source_size.width);
+  const float scale_h =
+      static_cast<float>(target_h) / static_cast<float>(source_size.height);
+  const float scale = std::min(scale_w, scale_h);
+
+  const int resized_w = static_cast<int>(source_size.width * scale);
+  const int resized_h = static_cast<int>(source_size.height * scale);
+  return ImageInfo{.width = source_size.width,
+                   .height = source_size.height,
+                   .scale = scale,
+                   .w_padding = std::abs(target_w - resized_w) / 2,
+                   .h_padding = std::abs(target_h - resized_h) / 2};
+}
+
+cv::Size BlobPreprocessor::InputSize(const cv::Size &source_size,
+                                     int target_w, int target_h, int stride) {
+  if (stride <= 0 || source_size.empty()) {
+    return cv::Size(target_w, target_h);
+  }
+  // The side limiting the scale keeps its full length, so letterboxing into
+  // the smaller input keeps the scale and only drops padding. The other side
+  // is rounded up rather than down so it never becomes the limiting one; the
+  // slack absorbs float error in whole products like 1152 * (640 / 1920.0f).
+  const float scale = Geometry(source_size, target_w, target_h).scale;
+  const auto round_up = [stride, scale](int length, int target) {
+    const int scaled = static_cast<int>(std::ceil(length * scale - 1e-3f));
+    return std::min((std::max(scaled, 1) + stride - 1) / stride * stride,
+                    target);
+  };
+  return cv::Size(round_up(source_size.width, target_w),
+                  round_up(source_size.height, target_h));
+}
+
+absl::Status BlobPreprocessor::Run(const cv::Mat &source, int target_w,
+                                   int target_h, float *dst) {
+  ImageInfo info;
+  return Run(source, target_w, target_h, dst, &info);
+}
+
+absl::Status BlobPreprocessor::Run(const cv::Mat &source, int target_w,
+                                   int target_h, float *dst,
+                                   ImageInfo *info) {
+  if (source.empty()) {
+    return absl::InvalidArgumentError("source image is empty");
+  }
+  if (source.type() != CV_8UC3) {
+    return absl::InvalidArgumentError(absl::StrFormat(
+        "source image must be CV_8UC3, got type %d", source.type()));
+  }
+  return RunRows(&source, nullptr, source.size(), target_w, target_h, dst,
+                 info);
+}
+
+absl::Status BlobPreprocessor::Run(const YuvImage &source, int target_w,
+                                   int target_h, float *dst,
+                                   ImageInfo *info) {
+  if (source.width <= 0 || source.height <= 0 || source.width % 2 != 0 ||
+      source.height % 2 != 0) {
+    return absl::InvalidArgumentError(
+        absl::StrFormat("YUV 4:2:0 image must have a positive even size, "
+                        "got %dx%d",
+                        source.width, source.height));
+  }
+  const size_t chroma_row = static_cast<size_t>(source.width / 2) *
+                            static_cast<size_t>(source.chroma_step());
+  if (source.y == nullptr || source.u == nullptr || source.v == nullptr ||
+      source.y_stride < static_cast<size_t>(source.width) ||
+      source.u_stride < chroma_row || source.v_stride < chroma_row) {
+    return absl::InvalidArgumentError(
+        "YUV image planes are missing or their strides are too small");
+  }
+
+  const size_t converted_size = static_cast<size_t>(MaxStripes(target_h)) *
+                                3 * static_cast<size_t>(source.width);
+  if (converted_rows_.size() < converted_size) {
+    converted_rows_.resize(converted_size);
+  }
+  return RunRows(nullptr, &source, cv::Size(source.width, source.height),
+                 target_w, target_h, dst, info);
+}
+
+int BlobPreprocessor::MaxStripes(int target_h) {
+  return std::max(1,
+                  std::min(cv::getNumThreads(), target_h / kMinRowsPerStripe));
+}
+
+absl::Status BlobPreprocessor::RunRows(const cv::Mat *bgr,
+                                       const YuvImage *yuv,
+                                       const cv::Size &source_size,
+                                       int target_w, int target_h, float *dst,
+                                       ImageInfo *info) {
+  if (target_w <= 0 || target_h <= 0) {
+    return absl::InvalidArgumentError(
+        absl::StrFormat("invalid target size %dx%d", target_w, target_h));
+  }
+
+  *info = Geometry(source_size, target_w, target_h);
+  const int resized_w = static_cast<int>(source_size.width * info->scale);
+  const int resized_h = static_cast<int>(source_size.height * info->scale);
+  if (resized_w <= 0 || resized_h <= 0) {
+    return absl::InvalidArgumentError(
+        absl::StrFormat("source image %dx%d is too thin to letterbox",
+                        source_size.width, source_size.height));
+  }
+
+  const int top = info->h_padding;
+  const int left = info->w_padding;
+
+  const int source_w = source_size.width;
+  if (source_w != resized_w) {
+    x_offsets_.resize(resized_w);
+    x_offsets_next_.resize(resized_w);
+    x_weights_.resize(resized_w);
+
+    const double inverse_scale_x = static_cast<double>(source_w) / resized_w;
+    for (int x = 0; x < resized_w; ++x) {
+      int sx;
+      MapCoordinate(x, inverse_scale_x, source_w, &sx, &x_weights_[x]);
+      x_offsets_[x] = 3 * sx;
+      x_offsets_next_[x] = 3 * std::min(sx + 1, source_w - 1);
+    }
+  }
+
+  const int num_stripes = MaxStripes(target_h);
+  const int rows_per_stripe = (target_h + num_stripes - 1) / num_stripes;
+
+  const size_t cache_size =
+      static_cast<size_t>(num_stripes) * 2 * 3 * target_w;
+  if (row_cache_.size() < cache_size) {
+    row_cache_.resize(cache_size);
+  }
+
+  RowsBody body(*this, bgr, yuv, source_size, target_w, target_h, resized_w,
+                resized_h, left, top, rows_per_stripe, dst);
+  if (num_stripes == 1) {
+    // Skips the thread pool, which allocates a job for every parallel region.
+    body(cv::Range(0, 1));
+  } else {
+    cv::parallel_for_(cv::Range(0, num_stripes), body, num_stripes);
+  }
+
+  return absl::OkStatus();
+}
+
+} // namespace inference
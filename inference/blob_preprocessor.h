@@ -0,0 +1,83 @@
+#ifndef INFERENCE_BLOB_PREPROCESSOR_H_
+#define INFERENCE_BLOB_PREPROCESSOR_H_
+
+#include <vector>
+
+#include "absl/status/status.h"
+#include "opencv2/core.hpp"
+
+#include "inference/image_info.h"
+#include "inference/yuv_image.h"
+
+namespace inference {
+
+// Fused letterbox + blob conversion.
+//
+// Produces the same tensor as LetterBox followed by cv::dnn::blobFromImage
+// (1/255 scaling, BGR to RGB swap), but reads every source row at most once
+// and writes normalized float CHW planes straight into the destination
+// tensor, without the intermediate canvas, resized image or blob.
+//
+// The object keeps its interpolation tables and row caches between calls, so
+// it is not safe to call Run concurrently on the same instance.
+class BlobPreprocessor {
+public:
+  explicit BlobPreprocessor(const cv::Scalar &padding_value);
+
+  // Letterboxes the BGR `source` (CV_8UC3) into a target_w x target_h RGB
+  // image, written as three contiguous float planes starting at `dst`. `dst`
+  // must hold 3 * target_w * target_h floats.
+  absl::Status Run(const cv::Mat &source, int target_w, int target_h,
+                   float *dst);
+
+  // Same as above, and records the letterbox geometry in `info`.
+  absl::Status Run(const cv::Mat &source, int target_w, int target_h,
+                   float *dst, ImageInfo *info);
+
+  // Same as above, for a 4:2:0 YUV frame. Rows are converted to RGB with
+  // the BT.601 coefficients of cv::cvtColor as they are resampled, so only
+  // the rows the letterbox samples are ever converted and the frame is never
+  // copied. Produces the same tensor as cv::cvtColor to BGR followed by Run.
+  absl::Status Run(const YuvImage &source, int target_w, int target_h,
+                   float *dst, ImageInfo *info);
+
+  // Letterbox geometry of a source_size image in a target_w x target_h
+  // input, the one Run and InferenceEngine::LetterBox use.
+  static ImageInfo Geometry(const cv::Size &source_size, int target_w,
+                            int target_h);
+
+  // Smallest input with sides a multiple of `stride` that holds a
+  // source_size image letterboxed at the scale of a target_w x target_h
+  // input, at most target_w x target_h. The full target for a `stride` of 0.
+  static cv::Size InputSize(const cv::Size &source_size, int target_w,
+                            int target_h, int stride);
+
+private:
+  class RowsBody;
+
+  // Parallel stripes Run splits a target_h high input into.
+  static int MaxStripes(int target_h);
+
+  // Shared by the Run overloads, exactly one of `bgr` and `yuv` is set.
+  absl::Status RunRows(const cv::Mat *bgr, const YuvImage *yuv,
+                       const cv::Size &source_size, int target_w,
+                       int target_h, float *dst, ImageInfo *info);
+
+  // Pixel values of the padding, already normalized and in RGB plane order.
+  float padding_rgb_[3];
+
+  // Horizontal interpolation tables, one entry per resized column.
+  std::vector<int> x_offsets_;
+  std::vector<int> x_offsets_next_;
+  std::vector<float> x_weights_;
+
+  // Two horizontally resampled RGB rows per parallel stripe.
+  std::vector<float> row_cache_;
+
+  // One YUV source row converted to BGR per parallel stripe.
+  std::vector<uchar> converted_rows_;
+};
+
+} // namespace inference
+
+#endif
@@ -0,0 +1,521 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#include "absl/strings/ascii.h"
+#include "absl/strings/str_format.h"
+
+#include "inference/bulk_image_runner.h"
+#include "inference/inference_metrics.h"
+#include "inference/server_protocol.h"
+
+namespace inference {
+namespace {
+
+bool IsImageFile(const std::filesystem::path &path) {
+  const std::string extension =
+      absl::AsciiStrToLower(path.extension().string());
+  return extension == ".jpg" || extension == ".jpeg" || extension == ".png" ||
+         extension == ".bmp" || extension == ".webp" || extension == ".tif" ||
+         extension == ".tiff";
+}
+
+absl::Status ErrnoStatus(const std::string &what) {
+  return absl::InternalError(
+      absl::StrFormat("%s: %s", what, std::strerror(errno)));
+}
+
+absl::Status ReadFile(const std::string &path, std::vector<uint8_t> *bytes) {
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  if (!file) {
+    return absl::NotFoundError(absl::StrFormat("cannot open %s", path));
+  }
+  const std::streamsize size = file.tellg();
+  file.seekg(0);
+  bytes->resize(static_cast<size_t>(std::max<std::streamsize>(size, 0)));
+  if (!file.read(reinterpret_cast<char *>(bytes->data()), size)) {
+    return absl::DataLossError(absl::StrFormat("cannot read %s", path));
+  }
+  return absl::OkStatus();
+}
+
+void AppendJsonString(const std::string &value, std::string *out) {
+  out->push_back('"');
+  for (const char c : value) {
+    switch (c) {
+    case '"':
+      *out += "\\\"";
+      break;
+    case '\\':
+      *out += "\\\\";
+      break;
+    case '\n':
+      *out += "\\n";
+      break;
+    default:
+      if (static_cast<unsigned char>(c) < 0x20) {
+        absl::StrAppendFormat(out, "\\u%04x", static_cast<int>(c));
+      } else {
+        out->push_back(c);
+      }
+    }
+  }
+  out->push_back('"');
+}
+
+template <typename T> void AppendBytes(const T &value, std::string *out) {
+  out->append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+double Fraction(int64_t busy_ns, int64_t wall_ns) {
+  return wall_ns > 0 ? static_cast<double>(busy_ns) / wall_ns : 0.0;
+}
+
+} // namespace
+
+absl::StatusOr<std::unique_ptr<BulkImageRunner>>
+BulkImageRunner::Create(const InferenceParams &params,
+                        const BulkOptions &options) {
+  if (options.io_threads <= 0) {
+    return absl::InvalidArgumentError("io_threads must be positive");
+  }
+  if (options.batch_size <= 0) {
+    return absl::InvalidArgumentError("batch_size must be positive");
+  }
+  if (options.prefetch_depth < options.batch_size) {
+    return absl::InvalidArgumentError(
+        "prefetch_depth must be at least batch_size");
+  }
+  if (options.checkpoint_interval <= 0) {
+    return absl::InvalidArgumentError("checkpoint_interval must be positive");
+  }
+
+  auto engine = InferenceEngine::Create(params);
+  if (!engine.ok()) {
+    return engine.status();
+  }
+  return std::unique_ptr<BulkImageRunner>(
+      new BulkImageRunner(std::move(*engine), params, options));
+}
+
+absl::StatusOr<std::vector<std::string>>
+BulkImageRunner::ListImages(const std::string &input) {
+  std::vector<std::string> images;
+  std::error_code error;
+  if (std::filesystem::is_directory(input, error)) {
+    const auto options =
+        std::filesystem::directory_options::skip_permission_denied;
+    for (std::filesystem::recursive_directory_iterator it(input, options,
+                                                          error),
+         end;
+         !error && it != end; it.increment(error)) {
+      if (it->is_regular_file(error) && IsImageFile(it->path())) {
+        images.push_back(it->path().string());
+      }
+    }
+    if (error) {
+      return absl::InternalError(absl::StrFormat(
+          "cannot list %s: %s", input, error.message()));
+    }
+    std::sort(images.begin(), images.end());
+    return images;
+  }
+
+  std::ifstream list(input);
+  if (!list) {
+    return absl::NotFoundError(
+        absl::StrFormat("%s is neither a directory nor a file list", input));
+  }
+  std::string line;
+  while (std::getline(list, line)) {
+    const std::string path(absl::StripAsciiWhitespace(line));
+    if (!path.empty()) {
+      images.push_back(path);
+    }
+  }
+  return images;
+}
+
+BulkImageRunner::BulkImageRunner(std::unique_ptr<InferenceEngine> engine,
+                                 const InferenceParams &params,
+                                 const BulkOptions &options)
+    : engine_(std::move(engine)), params_(params), options_(options),
+      slots_(options.prefetch_depth) {
+  write_buffer_.reserve(options.write_buffer_bytes);
+}
+
+BulkImageRunner::~BulkImageRunner() {
+  StopIo();
+  if (output_fd_ >= 0) {
+    ::close(output_fd_);
+  }
+}
+
+absl::StatusOr<BulkStats>
+BulkImageRunner::Run(const std::vector<std::string> &images,
+                     const std::string &output_path) {
+  if (!io_threads_.empty() || output_fd_ >= 0) {
+    return absl::FailedPreconditionError("runner was already run");
+  }
+
+  BulkStats stats;
+  int64_t resume_bytes = 0;
+  if (!options_.checkpoint_path.empty() &&
+      std::filesystem::exists(options_.checkpoint_path)) {
+    auto status = ReadCheckpoint(&stats.resumed, &resume_bytes);
+    if (!status.ok()) {
+      return status;
+    }
+    if (stats.resumed > static_cast<int64_t>(images.size())) {
+      return absl::FailedPreconditionError(absl::StrFormat(
+          "checkpoint %s covers %d images, the list has %d",
+          options_.checkpoint_path, stats.resumed, images.size()));
+    }
+  }
+
+  // Whatever was written after the checkpoint is written again.
+  output_fd_ = ::open(output_path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC,
+                      0644);
+  if (output_fd_ < 0) {
+    return ErrnoStatus("cannot open " + output_path);
+  }
+  if (::ftruncate(output_fd_, resume_bytes) != 0 ||
+      ::lseek(output_fd_, resume_bytes, SEEK_SET) < 0) {
+    return ErrnoStatus("cannot truncate " + output_path);
+  }
+  output_bytes_ = resume_bytes;
+
+  images_ = &images;
+  end_ = static_cast<int64_t>(images.size());
+  if (options_.max_images > 0) {
+    end_ = std::min(end_, stats.resumed + options_.max_images);
+  }
+  next_claim_ = stats.resumed;
+  next_release_ = stats.resumed;
+
+  const int64_t start_ns = InferenceMetrics::NowNanos();
+  for (int i = 0; i < options_.io_threads; ++i) {
+    io_threads_.emplace_back(&BulkImageRunner::IoLoop, this);
+  }
+
+  const int64_t depth = options_.prefetch_depth;
+  int64_t starved_ns = 0;
+  int64_t next_checkpoint = next_release_ + options_.checkpoint_interval;
+  absl::Status status;
+  while (next_release_ < end_) {
+    // Waits for the next image only, then batches whatever follows it and
+    // is already decoded.
+    int count = 0;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      const int64_t wait_start_ns = InferenceMetrics::NowNanos();
+      slot_ready_.wait(lock,
+                       [&] { return slots_[next_release_ % depth].ready; });
+      starved_ns += InferenceMetrics::NowNanos() - wait_start_ns;
+      while (count < options_.batch_size && next_release_ + count < end_ &&
+             slots_[(next_release_ + count) % depth].ready) {
+        ++count;
+      }
+    }
+
+    status = ProcessBatch(next_release_, count, &stats);
+    if (!status.ok()) {
+      break;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (int i = 0; i < count; ++i) {
+        slots_[(next_release_ + i) % depth].ready = false;
+      }
+      next_release_ += count;
+    }
+    slot_released_.notify_all();
+
+    if (!options_.checkpoint_path.empty() && next_release_ >= next_checkpoint) {
+      status = WriteCheckpoint(next_release_);
+      if (!status.ok()) {
+        break;
+      }
+      next_checkpoint = next_release_ + options_.checkpoint_interval;
+    }
+  }
+
+  StopIo();
+  if (status.ok()) {
+    status = options_.checkpoint_path.empty() ? FlushOutput(/*force=*/true)
+                                              : WriteCheckpoint(next_release_);
+  }
+  if (!status.ok()) {
+    return status;
+  }
+
+  const int64_t wall_ns = InferenceMetrics::NowNanos() - start_ns;
+  const int64_t io_wall_ns = wall_ns * options_.io_threads;
+  stats.elapsed_seconds = wall_ns * 1e-9;
+  if (stats.elapsed_seconds > 0.0) {
+    stats.images_per_second = stats.images / stats.elapsed_seconds;
+  }
+  stats.read_utilization = Fraction(read_ns_.load(), io_wall_ns);
+  stats.decode_utilization = Fraction(decode_ns_.load(), io_wall_ns);
+  stats.preprocess_utilization = Fraction(preprocess_ns_, wall_ns);
+  stats.forward_utilization = Fraction(forward_ns_, wall_ns);
+  stats.postprocess_utilization = Fraction(postprocess_ns_, wall_ns);
+  stats.write_utilization = Fraction(write_ns_, wall_ns);
+  stats.inference_starved = Fraction(starved_ns, wall_ns);
+  return stats;
+}
+
+void BulkImageRunner::IoLoop() {
+  const int64_t depth = options_.prefetch_depth;
+  std::vector<uint8_t> encoded;
+  while (true) {
+    int64_t index;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      slot_released_.wait(lock, [&] {
+        return stopping_ || next_claim_ >= end_ ||
+               next_claim_ < next_release_ + depth;
+      });
+      if (stopping_ || next_claim_ >= end_) {
+        return;
+      }
+      index = next_claim_++;
+    }
+
+    // The slot is this thread's until it is marked ready.
+    Slot &slot = slots_[index % depth];
+    const int64_t read_start_ns = InferenceMetrics::NowNanos();
+    slot.status = ReadFile((*images_)[index], &encoded);
+    const int64_t decode_start_ns = InferenceMetrics::NowNanos();
+    if (slot.status.ok()) {
+      slot.status = ImageDecoder::Decode(encoded, params_.input_image_width,
+                                         params_.input_image_height,
+                                         &slot.decoded);
+    }
+    const int64_t end_ns = InferenceMetrics::NowNanos();
+    read_ns_.fetch_add(decode_start_ns - read_start_ns,
+                       std::memory_order_relaxed);
+    decode_ns_.fetch_add(end_ns - decode_start_ns, std::memory_order_relaxed);
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      slot.ready = true;
+    }
+    slot_ready_.notify_one();
+  }
+}
+
+absl::Status BulkImageRunner::ProcessBatch(int64_t first, int count,
+                                           BulkStats *stats) {
+  const int64_t depth = options_.prefetch_depth;
+  batch_images_.clear();
+  batch_indices_.clear();
+  for (int64_t i = first; i < first + count; ++i) {
+    const Slot &slot = slots_[i % depth];
+    if (slot.status.ok()) {
+      batch_images_.push_back(slot.decoded.image);
+      batch_indices_.push_back(i);
+    }
+  }
+
+  int64_t start_ns = InferenceMetrics::NowNanos();
+  absl::Status status;
+  if (!batch_images_.empty()) {
+    status = engine_->Preprocess(batch_images_, &blob_, &image_info_);
+  }
+  if (!status.ok() && batch_images_.size() > 1) {
+    // One image the preprocessor rejects fails the whole batch, so the
+    // batch is run again one image at a time.
+    for (int64_t i = first; i < first + count; ++i) {
+      auto single_status = ProcessBatch(i, 1, stats);
+      if (!single_status.ok()) {
+        return single_status;
+      }
+    }
+    return absl::OkStatus();
+  }
+  // A single image failing preprocessing is recorded like a decode error.
+  const absl::Status preprocess_status = status;
+  int64_t end_ns = InferenceMetrics::NowNanos();
+  preprocess_ns_ += end_ns - start_ns;
+
+  if (!batch_images_.empty() && preprocess_status.ok()) {
+    start_ns = end_ns;
+    status = engine_->Forward(blob_, &network_output_);
+    if (!status.ok()) {
+      return status;
+    }
+    end_ns = InferenceMetrics::NowNanos();
+    forward_ns_ += end_ns - start_ns;
+  }
+
+  int batch_index = 0;
+  for (int64_t i = first; i < first + count; ++i) {
+    const Slot &slot = slots_[i % depth];
+    detections_.Clear();
+    absl::Status image_status = slot.status;
+    if (image_status.ok()) {
+      image_status = preprocess_status;
+    }
+    if (image_status.ok()) {
+      start_ns = InferenceMetrics::NowNanos();
+      status = engine_->Postprocess(
+          network_output_, batch_index,
+          ImageDecoder::OriginalGeometry(slot.decoded,
+                                         image_info_[batch_index]),
+          &detections_);
+      if (!status.ok()) {
+        return status;
+      }
+      postprocess_ns_ += InferenceMetrics::NowNanos() - start_ns;
+      ++batch_index;
+    } else {
+      ++stats->failed;
+    }
+
+    start_ns = InferenceMetrics::NowNanos();
+    AppendRecord(i, image_status, slot.decoded.original_size, detections_);
+    status = FlushOutput(/*force=*/false);
+    write_ns_ += InferenceMetrics::NowNanos() - start_ns;
+    if (!status.ok()) {
+      return status;
+    }
+    ++stats->images;
+  }
+  return absl::OkStatus();
+}
+
+void BulkImageRunner::AppendRecord(int64_t index, const absl::Status &status,
+                                   const cv::Size &size,
+                                   const DetectionBatch &detections) {
+  const std::string &path = (*images_)[index];
+  const size_t n = status.ok() ? detections.Size() : 0;
+
+  if (options_.output_format == BulkOutputFormat::kBinary) {
+    AppendBytes(BulkRecordHeader{.magic = kBulkRecordMagic,
+                                 .status_code =
+                                     static_cast<int32_t>(status.code()),
+                                 .width = status.ok() ? size.width : 0,
+                                 .height = status.ok() ? size.height : 0,
+                                 .path_size =
+                                     static_cast<uint32_t>(path.size()),
+                                 .num_detections = static_cast<uint32_t>(n)},
+                &write_buffer_);
+    write_buffer_ += path;
+    for (size_t i = 0; i < n; ++i) {
+      AppendBytes(WireDetection{.class_id = detections.class_ids[i],
+                                .confidence = detections.confidences[i],
+                                .x1 = detections.x1[i],
+                                .y1 = detections.y1[i],
+                                .x2 = detections.x2[i],
+                                .y2 = detections.y2[i]},
+                  &write_buffer_);
+    }
+    return;
+  }
+
+  write_buffer_ += "{\"image\":";
+  AppendJsonString(path, &write_buffer_);
+  if (!status.ok()) {
+    write_buffer_ += ",\"error\":";
+    AppendJsonString(std::string(status.message()), &write_buffer_);
+    write_buffer_ += "}\n";
+    return;
+  }
+  absl::StrAppendFormat(&write_buffer_,
+                        ",\"width\":%d,\"height\":%d,\"detections\":[",
+                        size.width, size.height);
+  for (size_t i = 0; i < n; ++i) {
+    absl::StrAppendFormat(
+        &write_buffer_,
+        "%s{\"class_id\":%d,\"confidence\":%.4f,"
+        "\"bbox\":[%.1f,%.1f,%.1f,%.1f]}",
+        i == 0 ? "" : ",", detections.class_ids[i], detections.confidences[i],
+        detections.x1[i], detections.y1[i], detections.x2[i],
+        detections.y2[i]);
+  }
+  write_buffer_ += "]}\n";
+}
+
+absl::Status BulkImageRunner::FlushOutput(bool force) {
+  if (write_buffer_.empty() ||
+      (!force && write_buffer_.size() < options_.write_buffer_bytes)) {
+    return absl::OkStatus();
+  }
+  const char *data = write_buffer_.data();
+  size_t remaining = write_buffer_.size();
+  while (remaining > 0) {
+    const ssize_t written = ::write(output_fd_, data, remaining);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return ErrnoStatus("cannot write the output");
+    }
+    data += written;
+    remaining -= static_cast<size_t>(written);
+  }
+  output_bytes_ += static_cast<int64_t>(write_buffer_.size());
+  write_buffer_.clear();
+  return absl::OkStatus();
+}
+
+absl::Status BulkImageRunner::ReadCheckpoint(int64_t *completed,
+                                             int64_t *output_bytes) {
+  std::ifstream file(options_.checkpoint_path);
+  if (!(file >> *completed >> *output_bytes) || *completed < 0 ||
+      *output_bytes < 0) {
+    return absl::DataLossError(absl::StrFormat(
+        "malformed checkpoint %s", options_.checkpoint_path));
+  }
+  return absl::OkStatus();
+}
+
+absl::Status BulkImageRunner::WriteCheckpoint(int64_t completed) {
+  auto status = FlushOutput(/*force=*/true);
+  if (!status.ok()) {
+    return status;
+  }
+  // The output has to be on disk before the checkpoint claims it is.
+  if (::fdatasync(output_fd_) != 0) {
+    return ErrnoStatus("cannot sync the output");
+  }
+
+  // Written next to the checkpoint and renamed over it, so a crash leaves
+  // either the old or the new one.
+  const std::string temporary = options_.checkpoint_path + ".tmp";
+  {
+    std::ofstream file(temporary, std::ios::trunc);
+    file << completed << " " << output_bytes_ << "\n";
+    if (!file.flush()) {
+      return absl::InternalError(
+          absl::StrFormat("cannot write checkpoint %s", temporary));
+    }
+  }
+  if (std::rename(temporary.c_str(), options_.checkpoint_path.c_str()) != 0) {
+    return ErrnoStatus("cannot rename " + temporary);
+  }
+  return absl::OkStatus();
+}
+
+void BulkImageRunner::StopIo() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  slot_released_.notify_all();
+  for (std::thread &thread : io_threads_) {
+    if (thread.joinable()) {
+      thread.join();
+    }
+  }
+}
+
+} // namespace inference
@@ -0,0 +1,189 @@
+#ifndef INFERENCE_BULK_IMAGE_RUNNER_H_
+#define INFERENCE_BULK_IMAGE_RUNNER_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "opencv2/core.hpp"
+
+#include "inference/detection_batch.h"
+#include "inference/image_decoder.h"
+#include "inference/image_info.h"
+#include "inference/inference_engine.h"
+#include "inference/inference_params.h"
+
+namespace inference {
+
+enum class BulkOutputFormat {
+  // One JSON object per line: image path, original size and detections
+  // with float corner boxes, or the error the image failed with.
+  kJsonl,
+  // A BulkRecordHeader per image, followed by its path and its
+  // WireDetections.
+  kBinary,
+};
+
+struct BulkOptions {
+  // Threads reading and decoding images ahead of inference.
+  int io_threads = 4;
+  // Decoded images buffered ahead of inference, across all I/O threads.
+  int prefetch_depth = 32;
+  // Most images per forward pass. Batches are filled from what is already
+  // decoded, inference never waits for a batch to fill up.
+  int batch_size = 1;
+  BulkOutputFormat output_format = BulkOutputFormat::kJsonl;
+  // Output bytes buffered before a write.
+  size_t write_buffer_bytes = 1 << 20;
+  // Progress file. Run resumes from it when it exists, and rewrites it
+  // every `checkpoint_interval` images, after syncing the output up to that
+  // point. Empty disables checkpointing.
+  std::string checkpoint_path;
+  int64_t checkpoint_interval = 1000;
+  // Stop after this many images in one Run, 0 processes all of them.
+  int64_t max_images = 0;
+};
+
+// Record of one image in a kBinary output file, in native byte order.
+struct BulkRecordHeader {
+  uint32_t magic = 0;
+  // absl::StatusCode of the image, detections only follow kOk records.
+  int32_t status_code = 0;
+  // Full-resolution size of the image.
+  int32_t width = 0;
+  int32_t height = 0;
+  uint32_t path_size = 0;
+  uint32_t num_detections = 0;
+};
+
+constexpr uint32_t kBulkRecordMagic = 0x52424649; // "IFBR"
+
+static_assert(sizeof(BulkRecordHeader) == 24);
+
+struct BulkStats {
+  // Images done in this Run, and how many of those could not be read or
+  // decoded. Failures are written to the output and do not stop the run.
+  int64_t images = 0;
+  int64_t failed = 0;
+  // Images a resumed Run skipped because the checkpoint covered them.
+  int64_t resumed = 0;
+  double elapsed_seconds = 0.0;
+  double images_per_second = 0.0;
+  // Fraction of wall time spent in each stage. Reading and decoding are
+  // averaged over the I/O threads, the others run on the inference thread.
+  double read_utilization = 0.0;
+  double decode_utilization = 0.0;
+  double preprocess_utilization = 0.0;
+  double forward_utilization = 0.0;
+  double postprocess_utilization = 0.0;
+  double write_utilization = 0.0;
+  // Fraction of wall time inference waited for a decoded image. High when
+  // the job is decode-bound; near zero with busy I/O threads blocked on a
+  // full prefetch queue when it is compute-bound.
+  double inference_starved = 0.0;
+};
+
+// Runs an InferenceEngine over a list of image files for offline jobs.
+// A pool of I/O threads reads and decodes the images, JPEGs at reduced
+// resolution (see ImageDecoder), while the calling thread runs inference and
+// appends one record per image to the output in input order, so a
+// checkpoint is just the number of images done.
+class BulkImageRunner {
+public:
+  static absl::StatusOr<std::unique_ptr<BulkImageRunner>>
+  Create(const InferenceParams &params, const BulkOptions &options);
+
+  // Image files under the directory `input`, recursively, or the paths
+  // listed one per line in the file `input`. Directory listings are sorted,
+  // so a resumed run sees them in the same order.
+  static absl::StatusOr<std::vector<std::string>>
+  ListImages(const std::string &input);
+
+  ~BulkImageRunner();
+
+  // Processes `images` into `output_path`, resuming from the checkpoint if
+  // there is one. The checkpoint must come from a run over the same list.
+  absl::StatusOr<BulkStats> Run(const std::vector<std::string> &images,
+                                const std::string &output_path);
+
+private:
+  // A decoded image waiting for inference, written by the I/O thread that
+  // claimed it until `ready` is set.
+  struct Slot {
+    DecodedImage decoded;
+    absl::Status status;
+    bool ready = false;
+  };
+
+  BulkImageRunner(std::unique_ptr<InferenceEngine> engine,
+                  const InferenceParams &params, const BulkOptions &options);
+
+  void IoLoop();
+
+  // Runs inference on the `count` consecutive slots starting at `first` and
+  // appends their records.
+  absl::Status ProcessBatch(int64_t first, int count, BulkStats *stats);
+
+  // Appends the record of image `index` to write_buffer_.
+  void AppendRecord(int64_t index, const absl::Status &status,
+                    const cv::Size &size, const DetectionBatch &detections);
+
+  // Writes out write_buffer_ once it holds write_buffer_bytes, or always
+  // when `force` is set.
+  absl::Status FlushOutput(bool force);
+
+  absl::Status ReadCheckpoint(int64_t *completed, int64_t *output_bytes);
+  absl::Status WriteCheckpoint(int64_t completed);
+
+  void StopIo();
+
+  std::unique_ptr<InferenceEngine> engine_;
+  const InferenceParams params_;
+  const BulkOptions options_;
+
+  // The images of the current Run, and the end of the range it processes.
+  const std::vector<std::string> *images_ = nullptr;
+  int64_t end_ = 0;
+
+  std::mutex mutex_;
+  std::condition_variable slot_ready_;
+  std::condition_variable slot_released_;
+  std::vector<Slot> slots_;
+  // Next image an I/O thread claims, and first image whose slot inference
+  // still holds. Image i uses slots_[i % prefetch_depth].
+  int64_t next_claim_ = 0;
+  int64_t next_release_ = 0;
+  bool stopping_ = false;
+  std::vector<std::thread> io_threads_;
+
+  // Busy nanoseconds summed over the I/O threads.
+  std::atomic<int64_t> read_ns_{0};
+  std::atomic<int64_t> decode_ns_{0};
+
+  int output_fd_ = -1;
+  int64_t output_bytes_ = 0;
+  std::string write_buffer_;
+
+  // Scratch buffers of the inference thread.
+  std::vector<cv::Mat> batch_images_;
+  std::vector<int64_t> batch_indices_;
+  cv::Mat blob_;
+  std::vector<ImageInfo> image_info_;
+  std::vector<cv::Mat> network_output_;
+  DetectionBatch detections_;
+  int64_t preprocess_ns_ = 0;
+  int64_t forward_ns_ = 0;
+  int64_t postprocess_ns_ = 0;
+  int64_t write_ns_ = 0;
+};
+
+} // namespace inference
+
+#endif
@@ -0,0 +1,276 @@
+#include <algorithm>
+#include <numeric>
+
+#include "absl/strings/str_format.h"
+#include "opencv2/core.hpp"
+
+#include "inference/coco_evaluator.h"
+
+namespace inference {
+namespace {
+
+constexpr int kNumRecallThresholds = 101;
+
+// IoU of a detection with a ground truth box. For crowd regions the union is
+// the detection itself, so a detection inside a crowd fully matches it.
+float BoxIoU(float dx1, float dy1, float dx2, float dy2,
+             const GroundTruthBox &gt) {
+  const float iw = std::min(dx2, gt.x2) - std::max(dx1, gt.x1);
+  const float ih = std::min(dy2, gt.y2) - std::max(dy1, gt.y1);
+  if (iw <= 0.0f || ih <= 0.0f) {
+    return 0.0f;
+  }
+  const float intersection = iw * ih;
+  const float detection_area = (dx2 - dx1) * (dy2 - dy1);
+  const float union_area =
+      gt.crowd ? detection_area
+               : detection_area + (gt.x2 - gt.x1) * (gt.y2 - gt.y1) -
+                     intersection;
+  return union_area > 0.0f ? intersection / union_area : 0.0f;
+}
+
+} // namespace
+
+absl::StatusOr<std::unique_ptr<CocoEvaluator>>
+CocoEvaluator::Load(const std::string &annotations_path) {
+  cv::FileStorage file;
+  try {
+    file.open(annotations_path,
+              cv::FileStorage::READ | cv::FileStorage::FORMAT_JSON);
+  } catch (const cv::Exception &e) {
+    return absl::InvalidArgumentError(e.what());
+  }
+  if (!file.isOpened()) {
+    return absl::NotFoundError(
+        absl::StrFormat("Cannot open annotations %s", annotations_path));
+  }
+
+  const cv::FileNode image_nodes = file["images"];
+  const cv::FileNode annotation_nodes = file["annotations"];
+  const cv::FileNode category_nodes = file["categories"];
+  if (!image_nodes.isSeq() || !annotation_nodes.isSeq() ||
+      !category_nodes.isSeq()) {
+    return absl::InvalidArgumentError(absl::StrFormat(
+        "%s needs images, annotations and categories arrays",
+        annotations_path));
+  }
+
+  std::vector<CocoImage> images;
+  images.reserve(image_nodes.size());
+  for (const cv::FileNode &node : image_nodes) {
+    images.push_back(CocoImage{.id = static_cast<int64_t>(
+                                   static_cast<double>(node["id"])),
+                               .file_name = static_cast<std::string>(
+                                   node["file_name"])});
+  }
+
+  // Annotations refer to images by id, which need not be dense.
+  std::vector<size_t> order(images.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&images](size_t a, size_t b) {
+    return images[a].id < images[b].id;
+  });
+  for (const cv::FileNode &node : annotation_nodes) {
+    const int64_t image_id =
+        static_cast<int64_t>(static_cast<double>(node["image_id"]));
+    const auto it = std::lower_bound(
+        order.begin(), order.end(), image_id,
+        [&images](size_t index, int64_t id) { return images[index].id < id; });
+    const cv::FileNode bbox = node["bbox"];
+    if (it == order.end() || images[*it].id != image_id || !bbox.isSeq() ||
+        bbox.size() != 4) {
+      return absl::InvalidArgumentError(absl::StrFormat(
+          "annotation of image %d has no image or no [x, y, w, h] bbox",
+          image_id));
+    }
+    const float x = static_cast<float>(bbox[0]);
+    const float y = static_cast<float>(bbox[1]);
+    images[*it].boxes.push_back(GroundTruthBox{
+        .category_id = static_cast<int>(node["category_id"]),
+        .x1 = x,
+        .y1 = y,
+        .x2 = x + static_cast<float>(bbox[2]),
+        .y2 = y + static_cast<float>(bbox[3]),
+        .crowd = !node["iscrowd"].empty() &&
+                 static_cast<int>(node["iscrowd"]) != 0});
+  }
+
+  std::vector<int> category_ids;
+  for (const cv::FileNode &node : category_nodes) {
+    category_ids.push_back(static_cast<int>(node["id"]));
+  }
+  std::sort(category_ids.begin(), category_ids.end());
+
+  return Create(std::move(images), std::move(category_ids));
+}
+
+absl::StatusOr<std::unique_ptr<CocoEvaluator>>
+CocoEvaluator::Create(std::vector<CocoImage> images,
+                      std::vector<int> category_ids) {
+  if (category_ids.empty()) {
+    return absl::InvalidArgumentError("no categories");
+  }
+  return std::unique_ptr<CocoEvaluator>(
+      new CocoEvaluator(std::move(images), std::move(category_ids)));
+}
+
+CocoEvaluator::CocoEvaluator(std::vector<CocoImage> images,
+                             std::vector<int> category_ids)
+    : images_(std::move(images)), category_ids_(std::move(category_ids)),
+      detections_(images_.size()) {}
+
+void CocoEvaluator::AddDetections(size_t image_index,
+                                  const DetectionBatch &detections) {
+  std::vector<ScoredBox> &boxes = detections_[image_index];
+  boxes.clear();
+  for (size_t i = 0; i < detections.Size(); ++i) {
+    const int class_id = detections.class_ids[i];
+    if (class_id < 0 || class_id >= static_cast<int>(category_ids_.size())) {
+      continue;
+    }
+    boxes.push_back(ScoredBox{.category_id = category_ids_[class_id],
+                              .confidence = detections.confidences[i],
+                              .x1 = detections.x1[i],
+                              .y1 = detections.y1[i],
+                              .x2 = detections.x2[i],
+                              .y2 = detections.y2[i]});
+  }
+  // Highest confidence first, as every image is matched in that order.
+  std::stable_sort(boxes.begin(), boxes.end(),
+                   [](const ScoredBox &a, const ScoredBox &b) {
+                     return a.confidence > b.confidence;
+                   });
+}
+
+void CocoEvaluator::Reset() {
+  for (std::vector<ScoredBox> &boxes : detections_) {
+    boxes.clear();
+  }
+}
+
+CocoMetrics CocoEvaluator::Evaluate() const {
+  CocoMetrics metrics{.images = static_cast<int>(images_.size())};
+  for (const std::vector<ScoredBox> &boxes : detections_) {
+    metrics.detections += static_cast<int64_t>(boxes.size());
+  }
+
+  // Categories without ground truth are left out of the means.
+  double sum_50 = 0.0;
+  double sum_50_95 = 0.0;
+  int categories = 0;
+  for (int category_id : category_ids_) {
+    double category_sum = 0.0;
+    bool has_ground_truth = true;
+    for (int t = 0; t < 10 && has_ground_truth; ++t) {
+      const double ap = AveragePrecision(category_id, 0.5f + 0.05f * t);
+      has_ground_truth = ap >= 0.0;
+      if (t == 0 && has_ground_truth) {
+        sum_50 += ap;
+      }
+      category_sum += ap;
+    }
+    if (has_ground_truth) {
+      sum_50_95 += category_sum / 10.0;
+      ++categories;
+    }
+  }
+  if (categories > 0) {
+    metrics.map_50 = sum_50 / categories;
+    metrics.map_50_95 = sum_50_95 / categories;
+  }
+  return metrics;
+}
+
+double CocoEvaluator::AveragePrecision(int category_id,
+                                       float iou_threshold) const {
+  // Confidence and whether it matched, of every detection not on a crowd.
+  std::vector<std::pair<float, bool>> results;
+  int num_ground_truth = 0;
+  std::vector<const GroundTruthBox *> ground_truth;
+  std::vector<bool> matched;
+  for (size_t i = 0; i < images_.size(); ++i) {
+    // Crowd regions go last, they are only matched when nothing else is.
+    ground_truth.clear();
+    for (const GroundTruthBox &box : images_[i].boxes) {
+      if (box.category_id == category_id && !box.crowd) {
+        ground_truth.push_back(&box);
+      }
+    }
+    num_ground_truth += static_cast<int>(ground_truth.size());
+    const size_t num_regular = ground_truth.size();
+    for (const GroundTruthBox &box : images_[i].boxes) {
+      if (box.category_id == category_id && box.crowd) {
+        ground_truth.push_back(&box);
+      }
+    }
+    matched.assign(ground_truth.size(), false);
+
+    int taken = 0;
+    for (const ScoredBox &det : detections_[i]) {
+      if (det.category_id != category_id) {
+        continue;
+      }
+      if (taken++ == kMaxDetections) {
+        break;
+      }
+      float best_iou = std::min(iou_threshold, 1.0f - 1e-10f);
+      int best = -1;
+      for (size_t g = 0; g < ground_truth.size(); ++g) {
+        const bool crowd = g >= num_regular;
+        if (matched[g] && !crowd) {
+          continue;
+        }
+        // A regular match beats any crowd region.
+        if (best >= 0 && static_cast<size_t>(best) < num_regular && crowd) {
+          break;
+        }
+        const float iou = BoxIoU(det.x1, det.y1, det.x2, det.y2,
+                                 *ground_truth[g]);
+        if (iou >= best_iou) {
+          best_iou = iou;
+          best = static_cast<int>(g);
+        }
+      }
+      if (best >= 0 && static_cast<size_t>(best) >= num_regular) {
+        continue;
+      }
+      if (best >= 0) {
+        matched[best] = true;
+      }
+      results.emplace_back(det.confidence, best >= 0);
+    }
+  }
+  if (num_ground_truth == 0) {
+    return -1.0;
+  }
+
+  std::stable_sort(results.begin(), results.end(),
+                   [](const std::pair<float, bool> &a,
+                      const std::pair<float, bool> &b) {
+                     return a.first > b.first;
+                   });
+  std::vector<double> recall(results.size());
+  std::vector<double> precision(results.size());
+  int true_positives = 0;
+  for (size_t i = 0; i < results.size(); ++i) {
+    true_positives += results[i].second ? 1 : 0;
+    recall[i] = static_cast<double>(true_positives) / num_ground_truth;
+    precision[i] = static_cast<double>(true_positives) / (i + 1);
+  }
+  // Interpolated precision: the best precision at any higher recall.
+  for (size_t i = precision.size(); i-- > 1;) {
+    precision[i - 1] = std::max(precision[i - 1], precision[i]);
+  }
+
+  double sum = 0.0;
+  for (int r = 0; r < kNumRecallThresholds; ++r) {
+    const double threshold = r / 100.0;
+    const auto it = std::lower_bound(recall.begin(), recall.end(), threshold);
+    if (it != recall.end()) {
+      sum += precision[it - recall.begin()];
+    }
+  }
+  return sum / kNumRecallThresholds;
+}
+
+} // namespace inference
@@ -0,0 +1,93 @@
+#ifndef INFERENCE_COCO_EVALUATOR_H_
+#define INFERENCE_COCO_EVALUATOR_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/status/statusor.h"
+
+#include "inference/detection_batch.h"
+
+namespace inference {
+
+// Labeled object of a COCO image, with a corner box in image pixels.
+struct GroundTruthBox {
+  int category_id = 0;
+  float x1 = 0.0f;
+  float y1 = 0.0f;
+  float x2 = 0.0f;
+  float y2 = 0.0f;
+  // Crowd regions are neither missed nor matched: detections on them are
+  // ignored.
+  bool crowd = false;
+};
+
+struct CocoImage {
+  int64_t id = 0;
+  std::string file_name;
+  std::vector<GroundTruthBox> boxes;
+};
+
+struct CocoMetrics {
+  // Mean average precision over the categories with ground truth, at an IoU
+  // of 0.5 and averaged over the IoUs 0.5, 0.55, ..., 0.95.
+  double map_50 = 0.0;
+  double map_50_95 = 0.0;
+  int images = 0;
+  int64_t detections = 0;
+};
+
+// COCO bounding box evaluation: 101-point interpolated average precision
+// per category and IoU threshold, at most `max_detections` per image and
+// category, no area ranges. Matches pycocotools' "all" area, maxDets=100
+// numbers up to its handling of ties in confidence.
+class CocoEvaluator {
+public:
+  static constexpr int kMaxDetections = 100;
+
+  // Reads the images, annotations and categories of a COCO instances JSON
+  // file.
+  static absl::StatusOr<std::unique_ptr<CocoEvaluator>>
+  Load(const std::string &annotations_path);
+
+  // `category_ids` are the COCO ids of the model's classes: class i is
+  // category_ids[i]. Usually every category of the dataset, sorted, which
+  // is how the 80 COCO classes map to their ids 1 to 90.
+  static absl::StatusOr<std::unique_ptr<CocoEvaluator>>
+  Create(std::vector<CocoImage> images, std::vector<int> category_ids);
+
+  const std::vector<CocoImage> &images() const { return images_; }
+  const std::vector<int> &category_ids() const { return category_ids_; }
+
+  // Records the detections of images()[image_index], replacing any recorded
+  // before. Classes without a category are dropped.
+  void AddDetections(size_t image_index, const DetectionBatch &detections);
+
+  // Drops every recorded detection, to evaluate another set.
+  void Reset();
+
+  CocoMetrics Evaluate() const;
+
+private:
+  struct ScoredBox {
+    int category_id;
+    float confidence;
+    float x1, y1, x2, y2;
+  };
+
+  CocoEvaluator(std::vector<CocoImage> images, std::vector<int> category_ids);
+
+  // Average precision of `category_id` at `iou_threshold`, -1 when the
+  // category has no ground truth.
+  double AveragePrecision(int category_id, float iou_threshold) const;
+
+  std::vector<CocoImage> images_;
+  std::vector<int> category_ids_;
+  std::vector<std::vector<ScoredBox>> detections_;
+};
+
+} // namespace inference
+
+#endif
@@ -0,0 +1,247 @@
+#include <pthread.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <utility>
+
+#include "absl/strings/ascii.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/str_split.h"
+
+#include "inference/cpu_topology.h"
+
+namespace inference {
+namespace {
+
+// Whole contents of a sysfs attribute, false if it cannot be read.
+bool ReadAttribute(const std::filesystem::path &path, std::string *value) {
+  std::ifstream file(path);
+  if (!file) {
+    return false;
+  }
+  std::getline(file, *value);
+  return true;
+}
+
+int ReadIntAttribute(const std::filesystem::path &path, int fallback) {
+  std::string text;
+  int value = 0;
+  if (!ReadAttribute(path, &text) ||
+      !absl::SimpleAtoi(absl::StripAsciiWhitespace(text), &value)) {
+    return fallback;
+  }
+  return value;
+}
+
+} // namespace
+
+absl::StatusOr<std::vector<int>> ParseCpuList(absl::string_view list) {
+  std::vector<int> cpus;
+  for (absl::string_view part : absl::StrSplit(list, ',')) {
+    part = absl::StripAsciiWhitespace(part);
+    if (part.empty()) {
+      continue;
+    }
+    const std::pair<absl::string_view, absl::string_view> range =
+        absl::StrSplit(part, absl::MaxSplits('-', 1));
+    int first = 0;
+    int last = 0;
+    if (!absl::SimpleAtoi(range.first, &first) ||
+        !absl::SimpleAtoi(range.second.empty() ? range.first : range.second,
+                          &last) ||
+        first < 0 || last < first) {
+      return absl::InvalidArgumentError(
+          absl::StrFormat("invalid CPU list \"%s\"", list));
+    }
+    for (int cpu = first; cpu <= last; ++cpu) {
+      cpus.push_back(cpu);
+    }
+  }
+  std::sort(cpus.begin(), cpus.end());
+  cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+  return cpus;
+}
+
+absl::StatusOr<CpuTopology> CpuTopology::Detect() {
+  return FromSysfs("/sys/devices/system");
+}
+
+absl::StatusOr<CpuTopology>
+CpuTopology::FromSysfs(const std::string &root) {
+  const std::filesystem::path cpu_dir = std::filesystem::path(root) / "cpu";
+  std::string online_list;
+  if (!ReadAttribute(cpu_dir / "online", &online_list)) {
+    return absl::NotFoundError(
+        absl::StrFormat("Cannot read %s", (cpu_dir / "online").string()));
+  }
+  auto online = ParseCpuList(online_list);
+  if (!online.ok()) {
+    return online.status();
+  }
+  if (online->empty()) {
+    return absl::NotFoundError("no online CPUs");
+  }
+
+  // Node of every CPU, all on node 0 without NUMA support.
+  std::map<int, int> cpu_nodes;
+  const std::filesystem::path node_dir = std::filesystem::path(root) / "node";
+  std::error_code error;
+  for (const auto &entry :
+       std::filesystem::directory_iterator(node_dir, error)) {
+    const std::string name = entry.path().filename().string();
+    int node = 0;
+    std::string node_list;
+    if (name.rfind("node", 0) != 0 ||
+        !absl::SimpleAtoi(absl::string_view(name).substr(4), &node) ||
+        !ReadAttribute(entry.path() / "cpulist", &node_list)) {
+      continue;
+    }
+    auto node_cpus = ParseCpuList(node_list);
+    if (!node_cpus.ok()) {
+      return node_cpus.status();
+    }
+    for (int cpu : *node_cpus) {
+      cpu_nodes[cpu] = node;
+    }
+  }
+
+  CpuTopology topology;
+  std::map<std::pair<int, int>, int> core_indices;
+  std::vector<int> nodes;
+  for (int id : *online) {
+    const std::filesystem::path topology_dir =
+        cpu_dir / absl::StrFormat("cpu%d", id) / "topology";
+    const std::pair<int, int> core_key(
+        ReadIntAttribute(topology_dir / "physical_package_id", 0),
+        ReadIntAttribute(topology_dir / "core_id", id));
+    const auto core = core_indices.emplace(
+        core_key, static_cast<int>(core_indices.size()));
+    const auto node = cpu_nodes.find(id);
+    topology.cpus_.push_back(
+        Cpu{.id = id,
+            .core = core.first->second,
+            .node = node == cpu_nodes.end() ? 0 : node->second});
+    nodes.push_back(topology.cpus_.back().node);
+  }
+  std::sort(nodes.begin(), nodes.end());
+  topology.num_nodes_ = static_cast<int>(
+      std::unique(nodes.begin(), nodes.end()) - nodes.begin());
+  topology.num_cores_ = static_cast<int>(core_indices.size());
+  return topology;
+}
+
+std::vector<int> CpuTopology::NodeCpus(int node) const {
+  std::vector<int> ids;
+  for (const Cpu &cpu : cpus_) {
+    if (cpu.node == node) {
+      ids.push_back(cpu.id);
+    }
+  }
+  return ids;
+}
+
+absl::StatusOr<std::vector<std::vector<int>>>
+CpuTopology::Partition(int count, int cpus_per_set) const {
+  if (count <= 0 || cpus_per_set <= 0) {
+    return absl::InvalidArgumentError(
+        "set count and size must be positive");
+  }
+  if (static_cast<size_t>(count) * cpus_per_set > cpus_.size()) {
+    return absl::InvalidArgumentError(absl::StrFormat(
+        "%d sets of %d CPUs need more than the %d online", count,
+        cpus_per_set, cpus_.size()));
+  }
+
+  // Free CPUs of every node, first siblings of each core ahead of the rest.
+  std::map<int, std::vector<int>> free_cpus;
+  std::vector<bool> core_taken(num_cores_, false);
+  std::map<int, std::vector<int>> siblings;
+  for (const Cpu &cpu : cpus_) {
+    if (!core_taken[cpu.core]) {
+      core_taken[cpu.core] = true;
+      free_cpus[cpu.node].push_back(cpu.id);
+    } else {
+      siblings[cpu.node].push_back(cpu.id);
+    }
+  }
+  std::vector<int> nodes;
+  for (auto &[node, ids] : free_cpus) {
+    ids.insert(ids.end(), siblings[node].begin(), siblings[node].end());
+    // Taken from the back.
+    std::reverse(ids.begin(), ids.end());
+    nodes.push_back(node);
+  }
+
+  auto fullest_node = [&free_cpus]() {
+    auto fullest = free_cpus.begin();
+    for (auto it = free_cpus.begin(); it != free_cpus.end(); ++it) {
+      if (it->second.size() > fullest->second.size()) {
+        fullest = it;
+      }
+    }
+    return fullest->first;
+  };
+
+  std::vector<std::vector<int>> sets(count);
+  for (int i = 0; i < count; ++i) {
+    int node = nodes[i % nodes.size()];
+    if (free_cpus[node].size() < static_cast<size_t>(cpus_per_set)) {
+      node = fullest_node();
+    }
+    // Spills over to other nodes only when no node has enough left.
+    while (sets[i].size() < static_cast<size_t>(cpus_per_set)) {
+      if (free_cpus[node].empty()) {
+        node = fullest_node();
+      }
+      sets[i].push_back(free_cpus[node].back());
+      free_cpus[node].pop_back();
+    }
+    std::sort(sets[i].begin(), sets[i].end());
+  }
+  return sets;
+}
+
+absl::Status SetThreadAffinity(const std::vector<int> &cpus) {
+  if (cpus.empty()) {
+    return absl::InvalidArgumentError("empty CPU set");
+  }
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int cpu : cpus) {
+    if (cpu < 0 || cpu >= CPU_SETSIZE) {
+      return absl::InvalidArgumentError(
+          absl::StrFormat("CPU %d is out of range", cpu));
+    }
+    CPU_SET(cpu, &set);
+  }
+  const int error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  if (error != 0) {
+    return absl::InvalidArgumentError(absl::StrFormat(
+        "Failed to set thread affinity: %s", std::strerror(error)));
+  }
+  return absl::OkStatus();
+}
+
+absl::StatusOr<std::vector<int>> GetThreadAffinity() {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  const int error = pthread_getaffinity_np(pthread_self(), sizeof(set), &set);
+  if (error != 0) {
+    return absl::InternalError(absl::StrFormat(
+        "Failed to get thread affinity: %s", std::strerror(error)));
+  }
+  std::vector<int> cpus;
+  for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+    if (CPU_ISSET(cpu, &set)) {
+      cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+
+} // namespace inference
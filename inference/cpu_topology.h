@@ -0,0 +1,63 @@
+#ifndef INFERENCE_CPU_TOPOLOGY_H_
+#define INFERENCE_CPU_TOPOLOGY_H_
+
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+
+namespace inference {
+
+// Online logical CPUs of the machine, with the physical core and NUMA node
+// each belongs to, as Linux reports them under /sys/devices/system.
+class CpuTopology {
+public:
+  struct Cpu {
+    int id = 0;
+    // Dense index of the physical core, shared by hyperthread siblings.
+    int core = 0;
+    int node = 0;
+  };
+
+  static absl::StatusOr<CpuTopology> Detect();
+
+  // Same as above, reading the sysfs tree mounted at `root` instead of
+  // /sys/devices/system. Machines without NUMA nodes get a single node 0.
+  static absl::StatusOr<CpuTopology> FromSysfs(const std::string &root);
+
+  // Sorted by id.
+  const std::vector<Cpu> &cpus() const { return cpus_; }
+
+  int NumNodes() const { return num_nodes_; }
+  int NumCores() const { return num_cores_; }
+
+  // Ids of the CPUs on `node`, empty if there is no such node.
+  std::vector<int> NodeCpus(int node) const;
+
+  // `count` disjoint sets of `cpus_per_set` CPUs, for engines that should
+  // not share cores. Sets go round-robin over the nodes and stay on one
+  // node while it has CPUs left, and take one CPU per physical core before
+  // any hyperthread sibling.
+  absl::StatusOr<std::vector<std::vector<int>>>
+  Partition(int count, int cpus_per_set) const;
+
+private:
+  std::vector<Cpu> cpus_;
+  int num_nodes_ = 0;
+  int num_cores_ = 0;
+};
+
+// Parses a kernel CPU list such as "0-3,8,10-11".
+absl::StatusOr<std::vector<int>> ParseCpuList(absl::string_view list);
+
+// Restricts the calling thread to `cpus`.
+absl::Status SetThreadAffinity(const std::vector<int> &cpus);
+
+// CPUs the calling thread may run on.
+absl::StatusOr<std::vector<int>> GetThreadAffinity();
+
+} // namespace inference
+
+#endif
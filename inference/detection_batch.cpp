@@ -0,0 +1,69 @@
+#include "inference/detection_batch.h"
+
+namespace inference {
+
+void DetectionBatch::Reserve(size_t capacity) {
+  class_ids.reserve(capacity);
+  confidences.reserve(capacity);
+  x1.reserve(capacity);
+  y1.reserve(capacity);
+  x2.reserve(capacity);
+  y2.reserve(capacity);
+}
+
+void DetectionBatch::Clear() {
+  class_ids.clear();
+  confidences.clear();
+  x1.clear();
+  y1.clear();
+  x2.clear();
+  y2.clear();
+}
+
+void DetectionBatch::Add(int class_id, float confidence, float left,
+                         float top, float right, float bottom) {
+  class_ids.push_back(class_id);
+  confidences.push_back(confidence);
+  x1.push_back(left);
+  y1.push_back(top);
+  x2.push_back(right);
+  y2.push_back(bottom);
+}
+
+void DetectionBatch::Add(const Detection &detection) {
+  const cv::Rect &bbox = detection.bbox;
+  Add(detection.class_id, detection.confidence, static_cast<float>(bbox.x),
+      static_cast<float>(bbox.y), static_cast<float>(bbox.x + bbox.width),
+      static_cast<float>(bbox.y + bbox.height));
+}
+
+void DetectionBatch::Truncate(size_t size) {
+  if (size >= Size()) {
+    return;
+  }
+  class_ids.resize(size);
+  confidences.resize(size);
+  x1.resize(size);
+  y1.resize(size);
+  x2.resize(size);
+  y2.resize(size);
+}
+
+Detection DetectionBatch::ToDetection(size_t index) const {
+  // Rounding the corners rather than the size keeps adjacent boxes adjacent.
+  const int left = cvRound(x1[index]);
+  const int top = cvRound(y1[index]);
+  return Detection{.class_id = class_ids[index],
+                   .confidence = confidences[index],
+                   .bbox = cv::Rect(left, top, cvRound(x2[index]) - left,
+                                    cvRound(y2[index]) - top)};
+}
+
+void DetectionBatch::ToDetections(std::vector<Detection> *detections) const {
+  detections->clear();
+  for (size_t i = 0; i < Size(); ++i) {
+    detections->push_back(ToDetection(i));
+  }
+}
+
+} // namespace inference
@@ -0,0 +1,50 @@
+#ifndef INFERENCE_DETECTION_BATCH_H_
+#define INFERENCE_DETECTION_BATCH_H_
+
+#include <cstddef>
+#include <vector>
+
+#include "inference/detection.h"
+
+namespace inference {
+
+// Detections of one image in struct-of-arrays form, with float corner boxes.
+//
+// Decoding, NMS and unscaling run on these without rounding, boxes only
+// become integer pixels in ToDetection. The arrays can be handed to SIMD
+// code, or copied into a ResultRing slot, as they are.
+struct DetectionBatch {
+  // Sizes every array for up to `capacity` detections.
+  void Reserve(size_t capacity);
+
+  void Clear();
+
+  size_t Size() const { return confidences.size(); }
+  bool Empty() const { return confidences.empty(); }
+
+  void Add(int class_id, float confidence, float left, float top, float right,
+           float bottom);
+
+  // Appends `detection`, with its box as corners.
+  void Add(const Detection &detection);
+
+  // Keeps the first `size` detections.
+  void Truncate(size_t size);
+
+  // The detection at `index`, with its corners rounded to the nearest pixel.
+  Detection ToDetection(size_t index) const;
+
+  // Overwrites `detections` with every detection in order, rounded as above.
+  void ToDetections(std::vector<Detection> *detections) const;
+
+  std::vector<int> class_ids;
+  std::vector<float> confidences;
+  std::vector<float> x1;
+  std::vector<float> y1;
+  std::vector<float> x2;
+  std::vector<float> y2;
+};
+
+} // namespace inference
+
+#endif
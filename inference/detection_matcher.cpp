@@ -0,0 +1,67 @@
+#include <algorithm>
+#include <numeric>
+
+#include "inference/detection_matcher.h"
+#include "inference/non_max_suppression.h"
+
+namespace inference {
+
+void MatchStats::Add(const MatchStats &other) {
+  reference_count += other.reference_count;
+  candidate_count += other.candidate_count;
+  matched += other.matched;
+  iou_sum += other.iou_sum;
+}
+
+double MatchStats::Recall() const {
+  return reference_count == 0 ? 1.0
+                              : static_cast<double>(matched) / reference_count;
+}
+
+double MatchStats::Precision() const {
+  return candidate_count == 0 ? 1.0
+                              : static_cast<double>(matched) / candidate_count;
+}
+
+double MatchStats::MeanIoU() const {
+  return matched == 0 ? 0.0 : iou_sum / matched;
+}
+
+MatchStats DetectionMatcher::Match(const std::vector<Detection> &reference,
+                                   const std::vector<Detection> &candidates,
+                                   float iou_threshold) {
+  MatchStats stats{.reference_count = static_cast<int>(reference.size()),
+                   .candidate_count = static_cast<int>(candidates.size())};
+
+  std::vector<int> order(candidates.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&candidates](int a, int b) {
+    return candidates[a].confidence > candidates[b].confidence;
+  });
+
+  std::vector<bool> taken(reference.size(), false);
+  for (int c : order) {
+    const Detection &candidate = candidates[c];
+    int best = -1;
+    float best_iou = iou_threshold;
+    for (size_t r = 0; r < reference.size(); ++r) {
+      if (taken[r] || reference[r].class_id != candidate.class_id) {
+        continue;
+      }
+      const float iou = NonMaxSuppression::IoU(reference[r].bbox,
+                                               candidate.bbox);
+      if (iou >= best_iou) {
+        best = static_cast<int>(r);
+        best_iou = iou;
+      }
+    }
+    if (best >= 0) {
+      taken[best] = true;
+      ++stats.matched;
+      stats.iou_sum += best_iou;
+    }
+  }
+  return stats;
+}
+
+} // namespace inference
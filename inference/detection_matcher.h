@@ -0,0 +1,40 @@
+#ifndef INFERENCE_DETECTION_MATCHER_H_
+#define INFERENCE_DETECTION_MATCHER_H_
+
+#include <vector>
+
+#include "inference/detection.h"
+
+namespace inference {
+
+// Agreement between a candidate detection set and a reference one,
+// accumulated over any number of images.
+struct MatchStats {
+  int reference_count = 0;
+  int candidate_count = 0;
+  int matched = 0;
+  // Sum of the IoU of every matched pair.
+  double iou_sum = 0.0;
+
+  void Add(const MatchStats &other);
+
+  // Fraction of reference detections that were matched.
+  double Recall() const;
+  // Fraction of candidate detections that were matched.
+  double Precision() const;
+  double MeanIoU() const;
+};
+
+class DetectionMatcher {
+public:
+  // Greedily pairs every candidate, highest confidence first, with the
+  // unmatched reference detection of the same class it overlaps most, if
+  // their IoU reaches `iou_threshold`.
+  static MatchStats Match(const std::vector<Detection> &reference,
+                          const std::vector<Detection> &candidates,
+                          float iou_threshold);
+};
+
+} // namespace inference
+
+#endif
@@ -0,0 +1,145 @@
+#include <algorithm>
+
+#include "opencv2/imgcodecs.hpp"
+
+#include "inference/blob_preprocessor.h"
+#include "inference/image_decoder.h"
+
+namespace inference {
+namespace {
+
+// Whether a reduction of `original_size` by `reduction` keeps at least the
+// resolution of the letterboxed image. JPEG rounds reduced sizes up.
+bool Covers(const cv::Size &original_size, int reduction, int target_w,
+            int target_h) {
+  const ImageInfo letterbox =
+      BlobPreprocessor::Geometry(original_size, target_w, target_h);
+  const int reduced_w = (original_size.width + reduction - 1) / reduction;
+  const int reduced_h = (original_size.height + reduction - 1) / reduction;
+  return reduced_w >= static_cast<int>(original_size.width * letterbox.scale) &&
+         reduced_h >= static_cast<int>(original_size.height * letterbox.scale);
+}
+
+int ReducedReadFlag(int reduction) {
+  switch (reduction) {
+  case 2:
+    return cv::IMREAD_REDUCED_COLOR_2;
+  case 4:
+    return cv::IMREAD_REDUCED_COLOR_4;
+  case 8:
+    return cv::IMREAD_REDUCED_COLOR_8;
+  default:
+    return cv::IMREAD_COLOR;
+  }
+}
+
+} // namespace
+
+std::optional<cv::Size>
+ImageDecoder::JpegSize(absl::Span<const uint8_t> encoded) {
+  if (encoded.size() < 4 || encoded[0] != 0xFF || encoded[1] != 0xD8) {
+    return std::nullopt;
+  }
+  // Walks the marker segments up to the first start of frame. Every segment
+  // but the standalone markers is 0xFF, the marker, and a big-endian length
+  // that counts itself.
+  size_t pos = 2;
+  while (pos + 4 <= encoded.size()) {
+    if (encoded[pos] != 0xFF) {
+      return std::nullopt;
+    }
+    const uint8_t marker = encoded[pos + 1];
+    if (marker == 0xFF) {
+      // Fill byte.
+      ++pos;
+      continue;
+    }
+    if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7)) {
+      pos += 2;
+      continue;
+    }
+    const size_t length = (encoded[pos + 2] << 8) | encoded[pos + 3];
+    // SOF0 to SOF15, except DHT (C4), JPG (C8) and DAC (CC).
+    const bool start_of_frame = marker >= 0xC0 && marker <= 0xCF &&
+                                marker != 0xC4 && marker != 0xC8 &&
+                                marker != 0xCC;
+    if (start_of_frame) {
+      // Length, sample precision, height, width.
+      if (length < 7 || pos + 9 > encoded.size()) {
+        return std::nullopt;
+      }
+      const int height = (encoded[pos + 5] << 8) | encoded[pos + 6];
+      const int width = (encoded[pos + 7] << 8) | encoded[pos + 8];
+      if (width == 0 || height == 0) {
+        return std::nullopt;
+      }
+      return cv::Size(width, height);
+    }
+    if (marker == 0xDA || length < 2) {
+      // Scan data without a frame header before it.
+      return std::nullopt;
+    }
+    pos += 2 + length;
+  }
+  return std::nullopt;
+}
+
+int ImageDecoder::ChooseReduction(const cv::Size &original_size, int target_w,
+                                  int target_h) {
+  for (int reduction : {8, 4, 2}) {
+    if (Covers(original_size, reduction, target_w, target_h)) {
+      return reduction;
+    }
+  }
+  return 1;
+}
+
+absl::Status ImageDecoder::Decode(absl::Span<const uint8_t> encoded,
+                                  int target_w, int target_h,
+                                  DecodedImage *decoded) {
+  if (encoded.empty()) {
+    return absl::InvalidArgumentError("encoded image is empty");
+  }
+
+  // The header size is before EXIF orientation, which may still swap width
+  // and height, so the reduction has to cover both orientations.
+  int reduction = 1;
+  const std::optional<cv::Size> jpeg_size = JpegSize(encoded);
+  if (jpeg_size.has_value()) {
+    const cv::Size rotated(jpeg_size->height, jpeg_size->width);
+    reduction = std::min(ChooseReduction(*jpeg_size, target_w, target_h),
+                         ChooseReduction(rotated, target_w, target_h));
+  }
+
+  const cv::Mat buffer(1, static_cast<int>(encoded.size()), CV_8U,
+                       const_cast<uint8_t *>(encoded.data()));
+  cv::imdecode(buffer, ReducedReadFlag(reduction), &decoded->image);
+  if (decoded->image.empty()) {
+    return absl::InvalidArgumentError("failed to decode image");
+  }
+
+  decoded->reduction = reduction;
+  decoded->original_size = decoded->image.size();
+  if (reduction > 1) {
+    // Tells from the reduced size whether decoding rotated the image.
+    const int reduced_w = (jpeg_size->width + reduction - 1) / reduction;
+    const int reduced_h = (jpeg_size->height + reduction - 1) / reduction;
+    decoded->original_size =
+        (decoded->image.cols == reduced_w && decoded->image.rows == reduced_h)
+            ? *jpeg_size
+            : cv::Size(jpeg_size->height, jpeg_size->width);
+  }
+  return absl::OkStatus();
+}
+
+ImageInfo ImageDecoder::OriginalGeometry(const DecodedImage &decoded,
+                                         const ImageInfo &info) {
+  // Reduced JPEG pixel x covers original pixels [x * r, (x + 1) * r).
+  return ImageInfo{.width = decoded.original_size.width,
+                   .height = decoded.original_size.height,
+                   .scale = info.scale / decoded.reduction,
+                   .w_padding = info.w_padding,
+                   .h_padding = info.h_padding};
+}
+
+} // namespace inference
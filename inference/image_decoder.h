@@ -0,0 +1,55 @@
+#ifndef INFERENCE_IMAGE_DECODER_H_
+#define INFERENCE_IMAGE_DECODER_H_
+
+#include <cstdint>
+#include <optional>
+
+#include "absl/status/status.h"
+#include "absl/types/span.h"
+#include "opencv2/core.hpp"
+
+#include "inference/image_info.h"
+
+namespace inference {
+
+struct DecodedImage {
+  cv::Mat image;
+  // Size of the full-resolution image, after EXIF orientation.
+  cv::Size original_size;
+  // `image` is 1 / reduction of the original resolution: 1, 2, 4 or 8.
+  int reduction = 1;
+};
+
+// Decodes compressed images at no more resolution than the network input
+// needs. JPEG can be decoded at 1/2, 1/4 or 1/8 scale in the DCT domain,
+// which skips most of the work of a full decode; letterboxing a 12MP photo
+// to 640 pixels throws those pixels away anyway. Other formats are decoded
+// at full resolution.
+class ImageDecoder {
+public:
+  // Width and height from the frame header of the JPEG `encoded`, before
+  // EXIF orientation, without decoding it. Empty if `encoded` is not a
+  // JPEG or has no frame header.
+  static std::optional<cv::Size> JpegSize(absl::Span<const uint8_t> encoded);
+
+  // Largest reduction, 1, 2, 4 or 8, at which an image of `original_size`
+  // still has at least as many pixels as its letterboxed copy in a
+  // target_w x target_h input.
+  static int ChooseReduction(const cv::Size &original_size, int target_w,
+                             int target_h);
+
+  // Decodes `encoded` to 8-bit BGR, reduced as far as a target_w x target_h
+  // network input allows. Reuses the pixels of decoded->image when possible.
+  static absl::Status Decode(absl::Span<const uint8_t> encoded, int target_w,
+                             int target_h, DecodedImage *decoded);
+
+  // Letterbox geometry of the original image, given the geometry `info` of
+  // its reduced `decoded` copy. Boxes unscaled with it land in pixels of the
+  // original image.
+  static ImageInfo OriginalGeometry(const DecodedImage &decoded,
+                                    const ImageInfo &info);
+};
+
+} // namespace inference
+
+#endif
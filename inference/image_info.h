@@ -1,15 +1,19 @@
 #ifndef INFERENCE_IMAGE_INFO_H_
 #define INFERENCE_IMAGE_INFO_H_
 
-#include "opencv2/opencv.hpp"
-
 namespace inference {
 
+// Letterbox geometry of one preprocessed image, as produced by
+// BlobPreprocessor: a source pixel (x, y) lands at
+// (x * scale + w_padding, y * scale + h_padding) in the network input.
 struct ImageInfo {
-  float scale;
-  int h_padding;
-  int w_padding;
-  cv::Mat raw_image;
+  // Size of the source image.
+  int width = 0;
+  int height = 0;
+  float scale = 1.0f;
+  // Padding columns left of, and rows above, the resized image.
+  int w_padding = 0;
+  int h_padding = 0;
 };
 
 } // namespace inference
@@ -1,11 +1,88 @@
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <iterator>
 #include <random>
+#include <thread>
 
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
 #include "absl/log/log.h"
+#include "absl/strings/str_format.h"
 #include "opencv2/imgcodecs.hpp"
 #include "opencv2/imgproc.hpp"
+#include "opencv2/videoio.hpp"
 
+#include "inference/bulk_image_runner.h"
 #include "inference/detection.h"
 #include "inference/inference_engine.h"
+#include "inference/pinned_thread_pool.h"
+#include "inference/result_ring.h"
+#include "inference/video_stream_runner.h"
+
+ABSL_FLAG(std::string, model, "/workspace/yolo11n.onnx", "ONNX model path.");
+ABSL_FLAG(std::string, image, "/workspace/zidane.jpg",
+          "Image to run detection on when --video is not set.");
+ABSL_FLAG(std::string, output, "/workspace/detected.jpg",
+          "Where to write the annotated --image, empty to skip.");
+ABSL_FLAG(int, threads, 0,
+          "Threads of the engine's own pool. 0 runs it on OpenCV's "
+          "process-wide pool, or with --numa_node on one per CPU of the node.");
+ABSL_FLAG(int, numa_node, -1,
+          "Pin the engine to the CPUs of this NUMA node, with --threads "
+          "threads of its own. -1 leaves it unpinned.");
+ABSL_FLAG(int, letterbox_stride, 0,
+          "Letterbox into the smallest multiple of this stride, e.g. 32, "
+          "instead of the full 640x640 input. Needs a dynamic-shape model.");
+ABSL_FLAG(bool, autotune, false,
+          "Time the backend configurations at startup and keep the fastest.");
+ABSL_FLAG(std::string, video, "",
+          "Video file, stream URL or camera index. Enables streaming mode.");
+ABSL_FLAG(std::string, jsonl, "",
+          "Streaming mode: write one JSON line of detections per frame to "
+          "this file, or to stdout for \"-\".");
+ABSL_FLAG(std::string, annotated_video, "",
+          "Streaming mode: write the frames with detections drawn to this "
+          "video file.");
+ABSL_FLAG(std::string, drop_policy, "block",
+          "Streaming mode: block, drop_newest or drop_oldest when inference "
+          "falls behind decoding.");
+ABSL_FLAG(int, queue_depth, 4, "Streaming mode: decoded frames to buffer.");
+ABSL_FLAG(bool, realtime, false,
+          "Streaming mode: decode no faster than the source frame rate.");
+ABSL_FLAG(int64_t, max_frames, 0,
+          "Streaming mode: stop after this many frames, 0 for no limit. Bulk "
+          "mode: stop after this many images.");
+ABSL_FLAG(bool, motion_gate, false,
+          "Streaming mode: reuse detections on static frames and infer only "
+          "the changed regions of the others. For fixed cameras.");
+ABSL_FLAG(bool, track, false,
+          "Streaming mode: assign track ids to detections, written to the "
+          "JSON lines.");
+ABSL_FLAG(int, detection_interval, 1,
+          "Streaming mode with --track: run the detector every this many "
+          "frames, the tracker predicts the boxes in between.");
+ABSL_FLAG(std::string, result_ring, "",
+          "Streaming mode: publish the detections of every frame to this "
+          "POSIX shared memory ring, e.g. /inference_results, for other "
+          "processes to read with ResultRingReader.");
+ABSL_FLAG(int, refresh_interval, 30,
+          "Streaming mode with --motion_gate: infer the full frame at least "
+          "every this many frames.");
+ABSL_FLAG(std::string, bulk_input, "",
+          "Directory of images, searched recursively, or a file listing one "
+          "image path per line. Enables bulk mode.");
+ABSL_FLAG(std::string, bulk_output, "detections.jsonl",
+          "Bulk mode: file the per-image results are written to.");
+ABSL_FLAG(std::string, bulk_format, "jsonl",
+          "Bulk mode: jsonl, or binary for BulkRecordHeader records.");
+ABSL_FLAG(int, io_threads, 4,
+          "Bulk mode: threads reading and decoding images.");
+ABSL_FLAG(int, batch_size, 1, "Bulk mode: most images per forward pass.");
+ABSL_FLAG(std::string, checkpoint, "",
+          "Bulk mode: progress file, resumed from when it exists.");
+ABSL_FLAG(int64_t, checkpoint_interval, 1000,
+          "Bulk mode: images between checkpoints.");
 
 void SaveImage(const std::string &path, const cv::Mat &image) {
   cv::imwrite(path, image);
@@ -19,6 +96,15 @@ cv::Scalar GetColor(int class_id) {
   return cv::Scalar(b, g, r);
 }
 
+// Models trained on other datasets report ids past the COCO names.
+std::string ClassName(int class_id,
+                      const std::vector<std::string> &class_names) {
+  if (class_id < 0 || class_id >= static_cast<int>(class_names.size())) {
+    return std::to_string(class_id);
+  }
+  return class_names[class_id];
+}
+
 void DrawDetections(cv::Mat &img,
                     const std::vector<inference::Detection> &detections,
                     const std::vector<std::string> &class_names) {
@@ -31,7 +117,7 @@ void DrawDetections(cv::Mat &img,
 
     // 2. Create the Label Text
     // If class_names provided, use string, else use ID number
-    const std::string label = class_names[det.class_id];
+    const std::string label = ClassName(det.class_id, class_names);
 
     std::string score_string =
         std::to_string((int)(det.confidence * 100)) + "%";
@@ -57,60 +143,295 @@ void DrawDetections(cv::Mat &img,
   }
 }
 
+const std::vector<std::string> kCocoClassNames = {
+    "person",        "bicycle",      "car",
+    "motorcycle",    "airplane",     "bus",
+    "train",         "truck",        "boat",
+    "traffic light", "fire hydrant", "stop sign",
+    "parking meter", "bench",        "bird",
+    "cat",           "dog",          "horse",
+    "sheep",         "cow",          "elephant",
+    "bear",          "zebra",        "giraffe",
+    "backpack",      "umbrella",     "handbag",
+    "tie",           "suitcase",     "frisbee",
+    "skis",          "snowboard",    "sports ball",
+    "kite",          "baseball bat", "baseball glove",
+    "skateboard",    "surfboard",    "tennis racket",
+    "bottle",        "wine glass",   "cup",
+    "fork",          "knife",        "spoon",
+    "bowl",          "banana",       "apple",
+    "sandwich",      "orange",       "broccoli",
+    "carrot",        "hot dog",      "pizza",
+    "donut",         "cake",         "chair",
+    "couch",         "potted plant", "bed",
+    "dining table",  "toilet",       "tv",
+    "laptop",        "mouse",        "remote",
+    "keyboard",      "cell phone",   "microwave",
+    "oven",          "toaster",      "sink",
+    "refrigerator",  "book",         "clock",
+    "vase",          "scissors",     "teddy bear",
+    "hair drier",    "toothbrush"};
+
+bool ParseDropPolicy(const std::string &name,
+                     inference::FrameDropPolicy *policy) {
+  if (name == "block") {
+    *policy = inference::FrameDropPolicy::kBlock;
+  } else if (name == "drop_newest") {
+    *policy = inference::FrameDropPolicy::kDropNewest;
+  } else if (name == "drop_oldest") {
+    *policy = inference::FrameDropPolicy::kDropOldest;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+void WriteJsonLine(const inference::StreamFrame &frame,
+                   const std::vector<inference::Detection> &detections,
+                   std::ostream &out) {
+  std::string line = absl::StrFormat(
+      "{\"frame\":%d,\"timestamp_ms\":%.3f,\"latency_ms\":%.3f,"
+      "\"detections\":[",
+      frame.index, frame.timestamp_ms, frame.latency_ns * 1e-6);
+  for (size_t i = 0; i < detections.size(); ++i) {
+    const inference::Detection &det = detections[i];
+    absl::StrAppendFormat(
+        &line,
+        "%s{\"class_id\":%d,\"class\":\"%s\",\"confidence\":%.4f,"
+        "\"bbox\":[%d,%d,%d,%d]",
+        i == 0 ? "" : ",", det.class_id,
+        ClassName(det.class_id, kCocoClassNames), det.confidence,
+        det.bbox.x, det.bbox.y, det.bbox.width, det.bbox.height);
+    if (i < frame.tracks.size()) {
+      absl::StrAppendFormat(&line, ",\"track_id\":%d",
+                            frame.tracks[i].track_id);
+    }
+    line += "}";
+  }
+  line += "]}\n";
+  out << line;
+}
+
+int RunVideo(const inference::InferenceParams &params) {
+  inference::StreamOptions options{
+      .queue_depth = absl::GetFlag(FLAGS_queue_depth),
+      .pace_to_source_fps = absl::GetFlag(FLAGS_realtime),
+      .max_frames = absl::GetFlag(FLAGS_max_frames),
+      .motion_gating = absl::GetFlag(FLAGS_motion_gate),
+      .tracking = absl::GetFlag(FLAGS_track),
+      .detection_interval = absl::GetFlag(FLAGS_detection_interval)};
+  options.motion_gate.refresh_interval = absl::GetFlag(FLAGS_refresh_interval);
+  if (!ParseDropPolicy(absl::GetFlag(FLAGS_drop_policy),
+                       &options.drop_policy)) {
+    LOG(ERROR) << "Unknown --drop_policy " << absl::GetFlag(FLAGS_drop_policy);
+    return 1;
+  }
+
+  auto runner = inference::VideoStreamRunner::Open(absl::GetFlag(FLAGS_video),
+                                                   params, options);
+  if (!runner.ok()) {
+    LOG(ERROR) << runner.status();
+    return 1;
+  }
+
+  std::ofstream jsonl_file;
+  std::ostream *jsonl = nullptr;
+  const std::string jsonl_path = absl::GetFlag(FLAGS_jsonl);
+  if (jsonl_path == "-") {
+    jsonl = &std::cout;
+  } else if (!jsonl_path.empty()) {
+    jsonl_file.open(jsonl_path, std::ios::trunc);
+    if (!jsonl_file) {
+      LOG(ERROR) << "Cannot open " << jsonl_path;
+      return 1;
+    }
+    jsonl = &jsonl_file;
+  }
+
+  cv::VideoWriter writer;
+  const std::string annotated_path = absl::GetFlag(FLAGS_annotated_video);
+  if (!annotated_path.empty()) {
+    const double fps = (*runner)->source_fps() > 0.0
+                           ? (*runner)->source_fps()
+                           : 30.0;
+    writer.open(annotated_path, cv::VideoWriter::fourcc('M', 'J', 'P', 'G'),
+                fps, (*runner)->frame_size());
+    if (!writer.isOpened()) {
+      LOG(ERROR) << "Cannot open " << annotated_path;
+      return 1;
+    }
+  }
+
+  std::unique_ptr<inference::ResultRingWriter> ring;
+  const std::string ring_name = absl::GetFlag(FLAGS_result_ring);
+  if (!ring_name.empty()) {
+    auto created = inference::ResultRingWriter::Create(
+        ring_name, inference::ResultRingOptions{});
+    if (!created.ok()) {
+      LOG(ERROR) << created.status();
+      return 1;
+    }
+    ring = std::move(*created);
+  }
+
+  cv::Mat annotated;
+  auto stats = (*runner)->Run(
+      [&](const inference::StreamFrame &frame,
+          const std::vector<inference::Detection> &detections) {
+        if (jsonl != nullptr) {
+          WriteJsonLine(frame, detections, *jsonl);
+        }
+        if (ring != nullptr) {
+          ring->Publish(frame.index,
+                        static_cast<int64_t>(frame.timestamp_ms * 1e6),
+                        frame.image.cols, frame.image.rows, detections);
+        }
+        if (writer.isOpened()) {
+          frame.image.copyTo(annotated);
+          DrawDetections(annotated, detections, kCocoClassNames);
+          writer.write(annotated);
+        }
+      });
+  if (!stats.ok()) {
+    LOG(ERROR) << stats.status();
+    return 1;
+  }
+
+  const unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+  LOG(INFO) << absl::StrFormat(
+      "Processed %d of %d frames (%d dropped, %d detected) in %.2fs: "
+      "%.2f FPS, %.2f FPS per core on %d cores",
+      stats->frames_processed, stats->frames_decoded, stats->frames_dropped,
+      stats->frames_detected,
+      stats->elapsed_seconds, stats->frames_per_second,
+      stats->frames_per_second / cores, cores);
+  LOG(INFO) << absl::StrFormat(
+      "Frame latency mean %.2fms, p50 %.2fms, p90 %.2fms, p99 %.2fms",
+      stats->latency_mean_ms, stats->latency_p50_ms, stats->latency_p90_ms,
+      stats->latency_p99_ms);
+  if (options.motion_gating) {
+    LOG(INFO) << absl::StrFormat(
+        "Motion gate: %d full, %d region (%d regions), %d skipped frames",
+        stats->motion_gate.full_frames, stats->motion_gate.region_frames,
+        stats->motion_gate.regions, stats->motion_gate.skipped_frames);
+  }
+  return 0;
+}
+
+int RunBulk(const inference::InferenceParams &params) {
+  inference::BulkOptions options{
+      .io_threads = absl::GetFlag(FLAGS_io_threads),
+      .prefetch_depth = 8 * std::max(1, absl::GetFlag(FLAGS_io_threads)),
+      .batch_size = absl::GetFlag(FLAGS_batch_size),
+      .checkpoint_path = absl::GetFlag(FLAGS_checkpoint),
+      .checkpoint_interval = absl::GetFlag(FLAGS_checkpoint_interval),
+      .max_images = absl::GetFlag(FLAGS_max_frames)};
+  options.prefetch_depth = std::max(options.prefetch_depth, options.batch_size);
+  const std::string format = absl::GetFlag(FLAGS_bulk_format);
+  if (format == "binary") {
+    options.output_format = inference::BulkOutputFormat::kBinary;
+  } else if (format != "jsonl") {
+    LOG(ERROR) << "Unknown --bulk_format " << format;
+    return 1;
+  }
+
+  auto images =
+      inference::BulkImageRunner::ListImages(absl::GetFlag(FLAGS_bulk_input));
+  if (!images.ok()) {
+    LOG(ERROR) << images.status();
+    return 1;
+  }
+  auto runner = inference::BulkImageRunner::Create(params, options);
+  if (!runner.ok()) {
+    LOG(ERROR) << runner.status();
+    return 1;
+  }
+
+  auto stats = (*runner)->Run(*images, absl::GetFlag(FLAGS_bulk_output));
+  if (!stats.ok()) {
+    LOG(ERROR) << stats.status();
+    return 1;
+  }
+
+  LOG(INFO) << absl::StrFormat(
+      "Processed %d images (%d failed, %d resumed) in %.2fs: %.2f images/s",
+      stats->images, stats->failed, stats->resumed, stats->elapsed_seconds,
+      stats->images_per_second);
+  LOG(INFO) << absl::StrFormat(
+      "I/O threads: read %.0f%%, decode %.0f%%. Inference thread: "
+      "preprocess %.0f%%, forward %.0f%%, postprocess %.0f%%, write %.0f%%, "
+      "waiting for images %.0f%%",
+      100 * stats->read_utilization, 100 * stats->decode_utilization,
+      100 * stats->preprocess_utilization, 100 * stats->forward_utilization,
+      100 * stats->postprocess_utilization, 100 * stats->write_utilization,
+      100 * stats->inference_starved);
+  LOG(INFO) << (stats->inference_starved > 0.1
+                    ? "Decode-bound: inference waited for images, try more "
+                      "--io_threads."
+                    : "Compute-bound: images were ready whenever inference "
+                      "was.");
+  return 0;
+}
+
 int main(int argc, char **argv) {
-  const std::vector<std::string> kCocoClassNames = {
-      "person",        "bicycle",      "car",
-      "motorcycle",    "airplane",     "bus",
-      "train",         "truck",        "boat",
-      "traffic light", "fire hydrant", "stop sign",
-      "parking meter", "bench",        "bird",
-      "cat",           "dog",          "horse",
-      "sheep",         "cow",          "elephant",
-      "bear",          "zebra",        "giraffe",
-      "backpack",      "umbrella",     "handbag",
-      "tie",           "suitcase",     "frisbee",
-      "skis",          "snowboard",    "sports ball",
-      "kite",          "baseball bat", "baseball glove",
-      "skateboard",    "surfboard",    "tennis racket",
-      "bottle",        "wine glass",   "cup",
-      "fork",          "knife",        "spoon",
-      "bowl",          "banana",       "apple",
-      "sandwich",      "orange",       "broccoli",
-      "carrot",        "hot dog",      "pizza",
-      "donut",         "cake",         "chair",
-      "couch",         "potted plant", "bed",
-      "dining table",  "toilet",       "tv",
-      "laptop",        "mouse",        "remote",
-      "keyboard",      "cell phone",   "microwave",
-      "oven",          "toaster",      "sink",
-      "refrigerator",  "book",         "clock",
-      "vase",          "scissors",     "teddy bear",
-      "hair drier",    "toothbrush"};
-
-  inference::InferenceParams params{.model_path = "/workspace/yolo11n.onnx",
+  absl::ParseCommandLine(argc, argv);
+  // An engine with threads of its own needs parallel_for_ routed to them.
+  if (absl::GetFlag(FLAGS_threads) > 0 ||
+      absl::GetFlag(FLAGS_numa_node) >= 0) {
+    inference::PinnedThreadPool::InstallParallelBackend();
+  }
+
+  inference::InferenceParams params{.model_path = absl::GetFlag(FLAGS_model),
                                     .input_image_width = 640,
                                     .input_image_height = 640,
                                     .padding_value = cv::Scalar(114, 114, 114),
                                     .confidence_threshold = 0.5,
-                                    .iou_threshold = 0.5};
+                                    .iou_threshold = 0.5,
+                                    .letterbox_stride =
+                                        absl::GetFlag(FLAGS_letterbox_stride),
+                                    .num_threads = absl::GetFlag(FLAGS_threads),
+                                    .numa_node = absl::GetFlag(FLAGS_numa_node),
+                                    .autotune = absl::GetFlag(FLAGS_autotune)};
+
+  if (!absl::GetFlag(FLAGS_video).empty()) {
+    return RunVideo(params);
+  }
+  if (!absl::GetFlag(FLAGS_bulk_input).empty()) {
+    return RunBulk(params);
+  }
 
   auto engine = inference::InferenceEngine::Create(params);
   if (!engine.ok()) {
     LOG(ERROR) << engine.status();
+    return 1;
   }
 
-  cv::Mat source_image = cv::imread("/workspace/zidane.jpg", cv::IMREAD_COLOR);
+  // The engine decodes large JPEGs at reduced resolution, only the
+  // annotated output needs the full image.
+  const std::string image_path = absl::GetFlag(FLAGS_image);
+  std::ifstream image_file(image_path, std::ios::binary);
+  const std::vector<uint8_t> encoded(
+      (std::istreambuf_iterator<char>(image_file)),
+      std::istreambuf_iterator<char>());
+  if (encoded.empty()) {
+    LOG(ERROR) << "Cannot read " << image_path;
+    return 1;
+  }
 
-  auto detections = (*engine)->RunInference(source_image);
-  if (!detections.ok()) {
-    LOG(ERROR) << detections.status();
+  std::vector<inference::Detection> detections;
+  auto status = (*engine)->RunInferenceEncoded(encoded, &detections);
+  if (!status.ok()) {
+    LOG(ERROR) << status;
     return 1;
   }
 
-  LOG(INFO) << "Detected " << detections->size() << " objects";
+  LOG(INFO) << "Detected " << detections.size() << " objects";
 
-  DrawDetections(source_image, *detections, kCocoClassNames);
-  SaveImage("/workspace/detected.jpg", source_image);
+  if (!absl::GetFlag(FLAGS_output).empty()) {
+    cv::Mat source_image = cv::imdecode(encoded, cv::IMREAD_COLOR);
+    DrawDetections(source_image, detections, kCocoClassNames);
+    SaveImage(absl::GetFlag(FLAGS_output), source_image);
+  }
 
   return 0;
 }
@@ -0,0 +1,122 @@
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <utility>
+
+#include "absl/strings/str_format.h"
+
+#include "inference/inference_client.h"
+
+namespace inference {
+
+absl::StatusOr<std::unique_ptr<InferenceClient>>
+InferenceClient::Connect(const std::string &socket_path) {
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  if (socket_path.empty() || socket_path.size() >= sizeof(address.sun_path)) {
+    return absl::InvalidArgumentError(
+        absl::StrFormat("invalid socket path \"%s\"", socket_path));
+  }
+  std::memcpy(address.sun_path, socket_path.c_str(), socket_path.size());
+
+  const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return absl::InternalError(
+        absl::StrFormat("Failed to create socket: %s", std::strerror(errno)));
+  }
+  if (connect(fd, reinterpret_cast<const sockaddr *>(&address),
+              sizeof(address)) != 0) {
+    const int error = errno;
+    close(fd);
+    return absl::UnavailableError(absl::StrFormat(
+        "Failed to connect to %s: %s", socket_path, std::strerror(error)));
+  }
+  return std::unique_ptr<InferenceClient>(new InferenceClient(fd));
+}
+
+InferenceClient::~InferenceClient() { close(fd_); }
+
+absl::StatusOr<uint64_t> InferenceClient::Send(const cv::Mat &image) {
+  if (image.type() != CV_8UC3) {
+    return absl::InvalidArgumentError("image must be 8-bit BGR");
+  }
+  const RequestHeader header{.rows = static_cast<uint32_t>(image.rows),
+                             .cols = static_cast<uint32_t>(image.cols),
+                             .request_id = next_request_id_};
+  absl::Status status = WriteFully(fd_, &header, sizeof(header));
+  // Rows of a view are not contiguous, send them one by one.
+  const size_t row_bytes = image.cols * image.elemSize();
+  if (status.ok() && image.isContinuous()) {
+    status = WriteFully(fd_, image.data, row_bytes * image.rows);
+  }
+  for (int y = 0; status.ok() && !image.isContinuous() && y < image.rows;
+       ++y) {
+    status = WriteFully(fd_, image.ptr(y), row_bytes);
+  }
+  if (!status.ok()) {
+    return status;
+  }
+  return next_request_id_++;
+}
+
+absl::Status InferenceClient::Receive(ServerResponse *response) {
+  ResponseHeader header;
+  absl::Status status = ReadFully(fd_, &header, sizeof(header));
+  if (!status.ok()) {
+    return status;
+  }
+  if (header.magic != kResponseMagic) {
+    return absl::DataLossError("bad response header");
+  }
+
+  std::string message(header.message_size, '\0');
+  status = ReadFully(fd_, message.data(), message.size());
+  if (!status.ok()) {
+    return status;
+  }
+
+  response->request_id = header.request_id;
+  response->status = absl::Status(
+      static_cast<absl::StatusCode>(header.status_code), message);
+  response->batch_size = static_cast<int>(header.batch_size);
+  response->queue_ns = header.queue_ns;
+  response->latency_ns = header.latency_ns;
+  records_.resize(header.num_detections);
+  status = ReadFully(fd_, records_.data(),
+                     records_.size() * sizeof(WireDetection));
+  if (!status.ok()) {
+    return status;
+  }
+  response->detections.Clear();
+  for (const WireDetection &record : records_) {
+    response->detections.Add(record.class_id, record.confidence, record.x1,
+                             record.y1, record.x2, record.y2);
+  }
+  return absl::OkStatus();
+}
+
+absl::Status InferenceClient::Detect(const cv::Mat &image,
+                                     DetectionBatch *detections) {
+  auto request_id = Send(image);
+  if (!request_id.ok()) {
+    return request_id.status();
+  }
+  // Responses to earlier pipelined requests are skipped.
+  do {
+    absl::Status status = Receive(&response_);
+    if (!status.ok()) {
+      return status;
+    }
+  } while (response_.request_id != *request_id);
+  if (!response_.status.ok()) {
+    return response_.status;
+  }
+  std::swap(*detections, response_.detections);
+  return absl::OkStatus();
+}
+
+} // namespace inference
@@ -0,0 +1,66 @@
+#ifndef INFERENCE_INFERENCE_CLIENT_H_
+#define INFERENCE_INFERENCE_CLIENT_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "opencv2/core.hpp"
+
+#include "inference/detection_batch.h"
+#include "inference/server_protocol.h"
+
+namespace inference {
+
+struct ServerResponse {
+  uint64_t request_id = 0;
+  // Result of the request, `detections` is empty unless it is ok.
+  absl::Status status;
+  // Boxes in pixels of the image that was sent.
+  DetectionBatch detections;
+  // Images the server ran in the same forward pass, 0 if it never ran.
+  int batch_size = 0;
+  int64_t queue_ns = 0;
+  int64_t latency_ns = 0;
+};
+
+// Connection to an InferenceServer. Requests may be pipelined: several
+// Sends followed by as many Receives, matched up by request id.
+//
+// Not thread-safe, use one client per thread.
+class InferenceClient {
+public:
+  static absl::StatusOr<std::unique_ptr<InferenceClient>>
+  Connect(const std::string &socket_path);
+
+  ~InferenceClient();
+
+  InferenceClient(const InferenceClient &) = delete;
+  InferenceClient &operator=(const InferenceClient &) = delete;
+
+  // Sends the 8-bit BGR `image` and returns the id of the request.
+  absl::StatusOr<uint64_t> Send(const cv::Mat &image);
+
+  // Waits for the next response, overwriting `response`. Returns an error
+  // only if the connection failed; the status of the request itself is in
+  // response->status.
+  absl::Status Receive(ServerResponse *response);
+
+  // Sends `image` and waits for its detections.
+  absl::Status Detect(const cv::Mat &image, DetectionBatch *detections);
+
+private:
+  explicit InferenceClient(int fd) : fd_(fd) {}
+
+  const int fd_;
+  uint64_t next_request_id_ = 0;
+  ServerResponse response_;
+  std::vector<WireDetection> records_;
+};
+
+} // namespace inference
+
+#endif
@@ -1,14 +1,144 @@
+#include <algorithm>
 #include <cmath>
 #include <filesystem>
+#include <limits>
 
 #include "absl/log/log.h"
+#include "absl/strings/str_format.h"
 #include "opencv2/core/cuda.hpp"
+#include "opencv2/core/ocl.hpp"
 #include "opencv2/imgproc.hpp"
 
+#include "inference/cpu_topology.h"
 #include "inference/inference_engine.h"
 #include "inference/non_max_suppression.h"
+#include "inference/output_decoder.h"
 
 namespace inference {
+namespace {
+
+const char *DeviceName(ComputeDevice device) {
+  switch (device) {
+  case ComputeDevice::kAuto:
+    return "auto";
+  case ComputeDevice::kCpu:
+    return "cpu";
+  case ComputeDevice::kOpenCl:
+    return "opencl";
+  case ComputeDevice::kCuda:
+    return "cuda";
+  }
+  return "unknown";
+}
+
+// Whether the ONNX importer turned QuantizeLinear / DequantizeLinear pairs or
+// QLinear* nodes into OpenCV's INT8 layers.
+bool IsQuantizedNetwork(const cv::dnn::Net &net) {
+  std::vector<cv::String> layer_types;
+  net.getLayerTypes(layer_types);
+  for (const cv::String &type : layer_types) {
+    if (type == "Quantize" || type == "Dequantize" || type == "Requantize" ||
+        type.find("Int8") != cv::String::npos) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool SupportsFp16(ComputeDevice device) {
+  if (device != ComputeDevice::kCpu) {
+    return true;
+  }
+  // The CPU backend only has half precision kernels for ARM.
+#if defined(__aarch64__) || defined(_M_ARM64)
+  return true;
+#else
+  return false;
+#endif
+}
+
+// Applies `config` to `net`. Each setting invalidates the compiled network,
+// the next forward pass sets it up again.
+absl::Status ConfigureNetwork(const BackendConfig &config,
+                              cv::dnn::Net *net) {
+  int backend = cv::dnn::DNN_BACKEND_OPENCV;
+  int target = cv::dnn::DNN_TARGET_CPU;
+  switch (config.device) {
+  case ComputeDevice::kAuto:
+  case ComputeDevice::kCpu:
+    target = config.fp16 ? cv::dnn::DNN_TARGET_CPU_FP16
+                         : cv::dnn::DNN_TARGET_CPU;
+    break;
+  case ComputeDevice::kOpenCl:
+    target = config.fp16 ? cv::dnn::DNN_TARGET_OPENCL_FP16
+                         : cv::dnn::DNN_TARGET_OPENCL;
+    break;
+  case ComputeDevice::kCuda:
+    backend = cv::dnn::DNN_BACKEND_CUDA;
+    target = config.fp16 ? cv::dnn::DNN_TARGET_CUDA_FP16
+                         : cv::dnn::DNN_TARGET_CUDA;
+    break;
+  }
+
+  try {
+    net->setPreferableBackend(backend);
+    net->setPreferableTarget(target);
+    net->enableFusion(config.fusion);
+    net->enableWinograd(config.winograd);
+  } catch (const cv::Exception &opencv_exception) {
+    return absl::InternalError(opencv_exception.what());
+  }
+  return absl::OkStatus();
+}
+
+// Thread pool of an engine with a thread budget or placed by
+// InferenceParams::cpus or numa_node, null for an engine on OpenCV's pool.
+absl::StatusOr<std::unique_ptr<PinnedThreadPool>>
+EngineThreadPool(const InferenceParams &params) {
+  std::vector<int> cpus = params.cpus;
+  if (cpus.empty() && params.numa_node >= 0) {
+    auto topology = CpuTopology::Detect();
+    if (!topology.ok()) {
+      return topology.status();
+    }
+    cpus = topology->NodeCpus(params.numa_node);
+    if (cpus.empty()) {
+      return absl::InvalidArgumentError(absl::StrFormat(
+          "NUMA node %d has no online CPUs", params.numa_node));
+    }
+  }
+  if (cpus.empty() && params.num_threads <= 0) {
+    return nullptr;
+  }
+  if (!PinnedThreadPool::ParallelBackendInstalled()) {
+    return absl::FailedPreconditionError(
+        "num_threads, cpus and numa_node need "
+        "PinnedThreadPool::InstallParallelBackend() to be called first");
+  }
+  return PinnedThreadPool::Create(std::move(cpus), params.num_threads);
+}
+
+cv::Size SourceSize(const cv::Mat &source) { return source.size(); }
+
+cv::Size SourceSize(const YuvImage &source) {
+  return cv::Size(source.width, source.height);
+}
+
+// Maps a box in letterbox coordinates back onto the source image of
+// `image_info`, and clips it to the image.
+void UnscaleBox(const ImageInfo &image_info, float *x1, float *y1, float *x2,
+                float *y2) {
+  // x_original = (x_letterboxed - padding) / scale
+  const float inverse_scale = 1.0f / image_info.scale;
+  const float width = static_cast<float>(image_info.width);
+  const float height = static_cast<float>(image_info.height);
+  *x1 = std::clamp((*x1 - image_info.w_padding) * inverse_scale, 0.0f, width);
+  *y1 = std::clamp((*y1 - image_info.h_padding) * inverse_scale, 0.0f, height);
+  *x2 = std::clamp((*x2 - image_info.w_padding) * inverse_scale, 0.0f, width);
+  *y2 = std::clamp((*y2 - image_info.h_padding) * inverse_scale, 0.0f, height);
+}
+
+} // namespace
 
 absl::StatusOr<std::unique_ptr<InferenceEngine>>
 InferenceEngine::Create(const InferenceParams &params) {
@@ -21,41 +151,276 @@ InferenceEngine::Create(const InferenceParams &params) {
         absl::StrFormat("Cannot find model path %s", params.model_path));
   }
 
+  auto model = params.use_model_cache
+                   ? ModelCache::Global().GetModel(params.model_path)
+                   : SharedModel::Load(params.model_path);
+  if (!model.ok()) {
+    return model.status();
+  }
+
+  return Create(params, std::move(*model));
+}
+
+absl::StatusOr<std::unique_ptr<InferenceEngine>>
+InferenceEngine::Create(const InferenceParams &params,
+                        std::shared_ptr<const SharedModel> model) {
+  auto thread_pool = EngineThreadPool(params);
+  if (!thread_pool.ok()) {
+    return thread_pool.status();
+  }
+  // Everything the engine allocates from here on is first touched on its
+  // own CPUs.
+  PinnedThreadPool::Scope scope(thread_pool->get());
+
+  auto net = params.use_model_cache
+                 ? ModelCache::Global().AcquireNetwork(model)
+                 : model->NewNetwork();
+  if (!net.ok()) {
+    return net.status();
+  }
+
+  return CreateFromNetwork(params, std::move(model), std::move(*net),
+                           std::move(*thread_pool));
+}
+
+absl::StatusOr<std::unique_ptr<InferenceEngine>>
+InferenceEngine::CreateFromNetwork(
+    const InferenceParams &params, std::shared_ptr<const SharedModel> model,
+    cv::dnn::Net net, std::unique_ptr<PinnedThreadPool> thread_pool) {
+  PinnedThreadPool::Scope scope(thread_pool.get());
   std::unique_ptr<InferenceEngine> ptr(new InferenceEngine(params));
   if (ptr == nullptr) {
     return absl::InternalError("Failed to create the InferenceEngine object");
   }
 
+  ptr->thread_pool_ = std::move(thread_pool);
+
+  const int cuda_devices = cv::cuda::getCudaEnabledDeviceCount();
+  BackendConfig config{.device = params.device,
+                       .fusion = params.enable_fusion,
+                       .winograd = params.enable_winograd,
+                       .fp16 = params.use_fp16};
+  // INT8 layers only have CPU kernels in the OpenCV backend.
+  const bool quantized = IsQuantizedNetwork(net);
+  if (config.device == ComputeDevice::kAuto) {
+    config.device = (cuda_devices > 0 && !quantized) ? ComputeDevice::kCuda
+                                                     : ComputeDevice::kCpu;
+  }
+  if (quantized && config.device != ComputeDevice::kCpu) {
+    return absl::FailedPreconditionError(
+        "quantized INT8 networks only run on the CPU");
+  }
+  if (config.device == ComputeDevice::kCuda && cuda_devices <= 0) {
+    return absl::FailedPreconditionError("no CUDA device available");
+  }
+  if (config.device == ComputeDevice::kOpenCl && !cv::ocl::haveOpenCL()) {
+    return absl::FailedPreconditionError("OpenCL is not available");
+  }
+
+  ptr->model_ = std::move(model);
+  ptr->net_ = std::make_unique<cv::dnn::Net>(std::move(net));
+  ptr->quantized_ = quantized;
+  auto status = ptr->ApplyBackendConfig(config);
+  if (!status.ok()) {
+    return status;
+  }
+
   try {
-    ptr->net_ = std::make_unique<cv::dnn::Net>();
-    *(ptr->net_) = cv::dnn::readNetFromONNX(params.model_path);
+    ptr->output_names_ = ptr->net_->getUnconnectedOutLayersNames();
+  } catch (const cv::Exception &opencv_exception) {
+    return absl::InternalError(opencv_exception.what());
+  }
 
-    ptr->net_->enableFusion(false);
+  if (params.autotune) {
+    status = ptr->Autotune();
+    if (!status.ok()) {
+      return status;
+    }
+  }
 
-    auto cuda_devices = cv::cuda::getCudaEnabledDeviceCount();
+  status = ptr->Warmup();
+  if (!status.ok()) {
+    return status;
+  }
 
-    auto backend = (cuda_devices > 0) ? cv::dnn::DNN_BACKEND_CUDA
-                                      : cv::dnn::DNN_BACKEND_OPENCV;
-    auto device =
-        (cuda_devices > 0) ? cv::dnn::DNN_TARGET_CUDA : cv::dnn::DNN_TARGET_CPU;
+  status = ptr->DetectOutputLayout();
+  if (!status.ok()) {
+    return status;
+  }
 
-    ptr->net_->setPreferableBackend(backend);
-    ptr->net_->setPreferableTarget(device);
+  const BackendConfig &chosen = ptr->backend_config_;
+  LOG(INFO) << "Set device to " << DeviceName(chosen.device)
+            << (chosen.fp16 ? " (fp16)" : "") << (quantized ? " (int8)" : "")
+            << ", fusion "
+            << (chosen.fusion ? "on" : "off") << ", winograd "
+            << (chosen.winograd ? "on" : "off");
 
-    std::string device_name = (cuda_devices > 0) ? "cuda" : "cpu";
-    std::string backend_name = (cuda_devices > 0) ? "cuda" : "opencv";
-    LOG(INFO) << "Set device to " << device_name;
-    LOG(INFO) << "Set backend to " << backend_name;
+  return ptr;
+}
 
-  } catch (const cv::Exception &opencv_exception) {
-    return absl::InternalError(opencv_exception.what());
+absl::Status
+InferenceEngine::ApplyBackendConfig(const BackendConfig &config) {
+  auto status = ConfigureNetwork(config, net_.get());
+  if (!status.ok()) {
+    return status;
   }
 
-  return ptr;
+  backend_config_ = config;
+  return absl::OkStatus();
+}
+
+absl::Status InferenceEngine::Autotune() {
+  const BackendConfig base = backend_config_;
+
+  std::vector<BackendConfig> candidates;
+  for (bool fp16 : {false, true}) {
+    if (fp16 && !(params_.use_fp16 && SupportsFp16(base.device))) {
+      continue;
+    }
+    for (bool fusion : {true, false}) {
+      // Winograd kernels only exist in the CPU backend.
+      for (bool winograd : {true, false}) {
+        if (!winograd && base.device != ComputeDevice::kCpu) {
+          continue;
+        }
+        candidates.push_back(BackendConfig{.device = base.device,
+                                           .fusion = fusion,
+                                           .winograd = winograd,
+                                           .fp16 = fp16});
+      }
+    }
+  }
+
+  input_blob_.setTo(cv::Scalar::all(0));
+  const int runs = std::max(1, params_.autotune_runs);
+  std::vector<int64_t> times(runs);
+
+  BackendConfig best = base;
+  int64_t best_ns = std::numeric_limits<int64_t>::max();
+  for (const BackendConfig &candidate : candidates) {
+    auto status = ApplyBackendConfig(candidate);
+    if (!status.ok()) {
+      return status;
+    }
+
+    try {
+      // The first pass compiles the network for this configuration.
+      net_->setInput(input_blob_);
+      net_->forward(network_output_, output_names_);
+      for (int i = 0; i < runs; ++i) {
+        const int64_t start_ns = InferenceMetrics::NowNanos();
+        net_->setInput(input_blob_);
+        net_->forward(network_output_, output_names_);
+        times[i] = InferenceMetrics::NowNanos() - start_ns;
+      }
+    } catch (const cv::Exception &) {
+      // Not every target supports every layer, skip the configuration.
+      continue;
+    }
+
+    // The median is robust against one pass being preempted.
+    std::nth_element(times.begin(), times.begin() + runs / 2, times.end());
+    if (times[runs / 2] < best_ns) {
+      best_ns = times[runs / 2];
+      best = candidate;
+    }
+  }
+
+  return ApplyBackendConfig(best);
+}
+
+absl::Status InferenceEngine::Warmup() {
+  input_blob_.setTo(cv::Scalar::all(0));
+  try {
+    for (int i = 0; i < std::max(1, params_.warmup_runs); ++i) {
+      net_->setInput(input_blob_);
+      net_->forward(network_output_, output_names_);
+    }
+  } catch (const cv::Exception &e) {
+    return absl::InternalError(e.what());
+  }
+  return absl::OkStatus();
+}
+
+absl::Status InferenceEngine::DetectOutputLayout() {
+  // OpenCV does not expose the ONNX output shapes before a forward pass, so
+  // the layout is read off the output of the warmup pass.
+  if (network_output_.empty()) {
+    return absl::InvalidArgumentError("network has no outputs");
+  }
+
+  auto layout = OutputDecoder::InferLayout(
+      network_output_.front(), params_.input_image_width,
+      params_.input_image_height, params_.output_format);
+  if (!layout.ok()) {
+    return layout.status();
+  }
+
+  output_layout_ = *layout;
+  decode_ = OutputDecoder::BatchDecoderForLayout(output_layout_);
+
+  // Quantized models usually end in a DequantizeLinear and produce floats.
+  // When the head itself is quantized, its integers are mapped back with
+  // the output's scale and zero point before decoding.
+  const int depth = network_output_.front().depth();
+  if (depth == CV_8S || depth == CV_8U) {
+    std::vector<float> scales;
+    std::vector<int> zero_points;
+    try {
+      net_->getOutputDetails(scales, zero_points);
+    } catch (const cv::Exception &e) {
+      return absl::InternalError(e.what());
+    }
+    if (scales.empty() || zero_points.empty()) {
+      return absl::InvalidArgumentError(
+          "integer network output without quantization parameters");
+    }
+    output_quantization_ = {.scale = scales.front(),
+                            .zero_point = zero_points.front()};
+    dequantized_output_.create(output_layout_.rows, output_layout_.cols,
+                               CV_32F);
+  } else if (depth != CV_32F) {
+    return absl::InvalidArgumentError(
+        absl::StrFormat("unsupported network output depth %d", depth));
+  }
+  return absl::OkStatus();
+}
+
+InferenceEngine::~InferenceEngine() {
+  if (!params_.use_model_cache || model_ == nullptr) {
+    return;
+  }
+  if (net_ != nullptr) {
+    ModelCache::Global().ReleaseNetwork(model_, std::move(*net_));
+  }
+  for (ShapeNetwork &shape_network : shape_networks_) {
+    ModelCache::Global().ReleaseNetwork(model_,
+                                        std::move(shape_network.net));
+  }
 }
 
 InferenceEngine::InferenceEngine(const InferenceParams &params)
-    : params_(params) {}
+    : params_(params),
+      nms_options_{.iou_threshold = params.iou_threshold,
+                   .mode = params.nms_mode,
+                   .max_detections = params.max_detections,
+                   .spatial_bucketing = params.nms_spatial_bucketing},
+      preprocessor_(params.padding_value) {
+  const int sizes[] = {1, 3, params.input_image_height,
+                       params.input_image_width};
+  input_blob_.create(4, sizes, CV_32F);
+
+  const size_t max_candidates =
+      static_cast<size_t>(std::max(0, params.max_candidates));
+  candidates_.Reserve(max_candidates);
+  detections_.Reserve(max_candidates);
+  nms_workspace_.Reserve(max_candidates);
+
+  if (params.enable_metrics) {
+    metrics_ =
+        std::make_unique<InferenceMetrics>(params.metrics_trace_capacity);
+  }
+}
 
 absl::StatusOr<cv::Mat> InferenceEngine::LetterBox(const cv::Mat &source,
                                                    int target_w,
@@ -89,156 +454,430 @@ absl::StatusOr<cv::Mat> InferenceEngine::LetterBox(const cv::Mat &source,
 
 absl::StatusOr<std::vector<Detection>>
 InferenceEngine::RunInference(const cv::Mat &source) {
-  auto letterboxed_image =
-      LetterBox(source, params_.input_image_width, params_.input_image_height);
-  if (!letterboxed_image.ok()) {
-    return letterboxed_image.status();
+  std::vector<Detection> detections;
+  auto status = RunInference(source, &detections);
+  if (!status.ok()) {
+    return status;
   }
+  return detections;
+}
 
-  auto network_output = Forward(*letterboxed_image);
-  if (!network_output.ok()) {
-    return network_output.status();
+absl::Status InferenceEngine::RunInference(const cv::Mat &source,
+                                           std::vector<Detection> *detections) {
+  auto status = RunInference(source, &detections_);
+  if (!status.ok()) {
+    return status;
   }
+  detections_.ToDetections(detections);
+  return absl::OkStatus();
+}
 
-  auto reshaped_output = ParseNetworkOutput(*network_output);
-  if (!reshaped_output.ok()) {
-    return reshaped_output.status();
+template <typename Source>
+absl::Status InferenceEngine::RunSingle(const Source &source,
+                                        DetectionBatch *detections) {
+  PinnedThreadPool::Scope scope(thread_pool_.get());
+  auto status = Preprocess(absl::MakeConstSpan(&source, 1), &input_blob_,
+                           &image_info_);
+  if (!status.ok()) {
+    return status;
   }
 
-  auto detections = ExtractDetections(*reshaped_output);
-  if (!detections.ok()) {
-    return detections.status();
+  status = Forward(input_blob_, &network_output_);
+  if (!status.ok()) {
+    return status;
   }
 
-  auto suppressed_detections =
-      NonMaxSuppression::Apply(*detections, params_.iou_threshold);
+  return Postprocess(network_output_, 0, image_info_.front(), detections);
+}
 
-  return UnscaleDetections(suppressed_detections, source);
+absl::Status InferenceEngine::RunInference(const cv::Mat &source,
+                                           DetectionBatch *detections) {
+  return RunSingle(source, detections);
 }
 
-absl::StatusOr<std::vector<cv::Mat>>
-InferenceEngine::Forward(const cv::Mat &image) {
+absl::Status InferenceEngine::RunInference(const YuvImage &source,
+                                           DetectionBatch *detections) {
+  return RunSingle(source, detections);
+}
 
-  // Create Blob:
-  // - Resize: Already done by Letterbox, but blobFromImage ensures it.
-  // - Scale: 1/255.0 (Normalize pixel values 0-255 to 0.0-1.0)
-  // - SwapRB: true (OpenCV is BGR, YOLO needs RGB)
-  // - Crop: false
-  const double scale_factor = 1.0 / 255.0;
-  cv::Mat blob = cv::dnn::blobFromImage(
-      image, scale_factor,
-      cv::Size(params_.input_image_height, params_.input_image_width),
-      /*mean*/ cv::Scalar(), /*swapRB*/ true, /*crop*/ false);
+absl::Status InferenceEngine::RunInference(const YuvImage &source,
+                                           std::vector<Detection> *detections) {
+  auto status = RunSingle(source, &detections_);
+  if (!status.ok()) {
+    return status;
+  }
+  detections_.ToDetections(detections);
+  return absl::OkStatus();
+}
 
-  LOG(INFO) << "Blob Size: " << blob.size;
+absl::Status
+InferenceEngine::RunInferenceEncoded(absl::Span<const uint8_t> encoded,
+                                     DetectionBatch *detections) {
+  PinnedThreadPool::Scope scope(thread_pool_.get());
+  auto status =
+      ImageDecoder::Decode(encoded, params_.input_image_width,
+                           params_.input_image_height, &decoded_);
+  if (!status.ok()) {
+    return status;
+  }
 
-  std::vector<cv::Mat> outs;
-  try {
-    net_->setInput(blob);
-    net_->forward(outs, net_->getUnconnectedOutLayersNames());
-  } catch (const cv::Exception &e) {
-    return absl::InternalError(e.what());
+  status = Preprocess(absl::MakeConstSpan(&decoded_.image, 1), &input_blob_,
+                      &image_info_);
+  if (!status.ok()) {
+    return status;
   }
-  return outs;
+
+  status = Forward(input_blob_, &network_output_);
+  if (!status.ok()) {
+    return status;
+  }
+
+  return Postprocess(
+      network_output_, 0,
+      ImageDecoder::OriginalGeometry(decoded_, image_info_.front()),
+      detections);
 }
 
-absl::StatusOr<cv::Mat> InferenceEngine::ParseNetworkOutput(
-    const std::vector<cv::Mat> &network_output) {
-  if (network_output.empty()) {
-    return absl::InvalidArgumentError("network output is empty");
+absl::Status
+InferenceEngine::RunInferenceEncoded(absl::Span<const uint8_t> encoded,
+                                     std::vector<Detection> *detections) {
+  auto status = RunInferenceEncoded(encoded, &detections_);
+  if (!status.ok()) {
+    return status;
   }
+  detections_.ToDetections(detections);
+  return absl::OkStatus();
+}
 
-  // YOLOv8/v11 Output Shape: [Batch=1, Channels=84, Anchors=8400]
-  // We will reshape and return a matrix of shape [8400, 84], such that
-  // each row is a detection
-  auto output_tensor = network_output.front().reshape(0, 84);
+absl::StatusOr<std::vector<std::vector<Detection>>>
+InferenceEngine::RunInferenceBatch(absl::Span<const cv::Mat> sources) {
+  if (sources.empty()) {
+    return absl::InvalidArgumentError("batch is empty");
+  }
+
+  PinnedThreadPool::Scope scope(thread_pool_.get());
+  auto status = Preprocess(sources, &input_blob_, &image_info_);
+  if (!status.ok()) {
+    return status;
+  }
+
+  status = Forward(input_blob_, &network_output_);
+  if (!status.ok()) {
+    return status;
+  }
+
+  // Every image in the batch has its own letterbox geometry, so decoding and
+  // unscaling run per image on its slice of the output tensor.
+  std::vector<std::vector<Detection>> batch_detections(sources.size());
+  for (size_t i = 0; i < sources.size(); ++i) {
+    status = Postprocess(network_output_, static_cast<int>(i), image_info_[i],
+                         &detections_);
+    if (!status.ok()) {
+      return status;
+    }
+    detections_.ToDetections(&batch_detections[i]);
+  }
 
-  return output_tensor.t();
+  return batch_detections;
 }
 
-absl::StatusOr<std::vector<Detection>>
-InferenceEngine::ExtractDetections(const cv::Mat &output_tensor) {
+absl::Status InferenceEngine::Preprocess(absl::Span<const cv::Mat> sources,
+                                         cv::Mat *blob) {
+  return Preprocess(sources, blob, &image_info_);
+}
+
+template <typename Source>
+absl::Status
+InferenceEngine::PreprocessSources(absl::Span<const Source> sources,
+                                   cv::Mat *blob,
+                                   std::vector<ImageInfo> *image_info) {
+  PinnedThreadPool::Scope scope(thread_pool_.get());
+  StageTimer timer(metrics_.get(), Stage::kPreprocess);
+
+  // Input blob layout: [N, 3, H, W], RGB, scaled to [0, 1]. The buffer is
+  // only reallocated when the batch size or input shape changes.
+  const int batch_size = static_cast<int>(sources.size());
+  int width = params_.input_image_width;
+  int height = params_.input_image_height;
+  if (params_.letterbox_stride > 0 && batch_size > 0) {
+    // The batch shares the smallest shape that fits all of its images.
+    width = 0;
+    height = 0;
+    for (const Source &source : sources) {
+      const cv::Size input_size = BlobPreprocessor::InputSize(
+          SourceSize(source), params_.input_image_width,
+          params_.input_image_height, params_.letterbox_stride);
+      width = std::max(width, input_size.width);
+      height = std::max(height, input_size.height);
+    }
+  }
+  const int sizes[] = {batch_size, 3, height, width};
+  blob->create(4, sizes, CV_32F);
+  image_info->resize(batch_size);
+
+  for (int i = 0; i < batch_size; ++i) {
+    auto status = preprocessor_.Run(sources[i], width, height,
+                                    blob->ptr<float>(i), &(*image_info)[i]);
+    if (!status.ok()) {
+      return absl::InvalidArgumentError(absl::StrFormat(
+          "failed to preprocess image %d: %s", i, status.message()));
+    }
+  }
+
+  return absl::OkStatus();
+}
+
+absl::Status InferenceEngine::Preprocess(absl::Span<const cv::Mat> sources,
+                                         cv::Mat *blob,
+                                         std::vector<ImageInfo> *image_info) {
+  return PreprocessSources(sources, blob, image_info);
+}
+
+absl::Status InferenceEngine::Preprocess(absl::Span<const YuvImage> sources,
+                                         cv::Mat *blob,
+                                         std::vector<ImageInfo> *image_info) {
+  return PreprocessSources(sources, blob, image_info);
+}
 
+absl::StatusOr<std::vector<Detection>>
+InferenceEngine::Postprocess(const std::vector<cv::Mat> &network_output,
+                             int batch_index, const cv::Mat &source) {
   std::vector<Detection> detections;
+  auto status = Postprocess(network_output, batch_index, source, &detections);
+  if (!status.ok()) {
+    return status;
+  }
+  return detections;
+}
 
-  for (int i = 0; i < output_tensor.rows; ++i) {
-    // Get the row data in pointer, equivalent
-    // to detections.row(i) but faster
-    const float *row_ptr = output_tensor.ptr<const float>(i);
-
-    float max_confidence_score = 0;
-    int class_id = -1;
-    for (int id = 4; id < 84; ++id) {
-      if (row_ptr[id] > max_confidence_score) {
-        max_confidence_score = row_ptr[id];
-        class_id = id - 4;
-      }
+absl::Status
+InferenceEngine::Postprocess(const std::vector<cv::Mat> &network_output,
+                             int batch_index, const cv::Mat &source,
+                             std::vector<Detection> *detections) {
+  auto status = Postprocess(network_output, batch_index,
+                            SingleImageGeometry(source.size()), &detections_);
+  if (!status.ok()) {
+    return status;
+  }
+  detections_.ToDetections(detections);
+  return absl::OkStatus();
+}
+
+absl::Status
+InferenceEngine::Postprocess(const std::vector<cv::Mat> &network_output,
+                             int batch_index, const ImageInfo &image_info,
+                             DetectionBatch *detections) {
+  PinnedThreadPool::Scope scope(thread_pool_.get());
+  InferenceMetrics *metrics = metrics_.get();
+
+  // End-to-end heads are already suppressed, their decoded rows are the
+  // final detections.
+  const bool end_to_end = output_layout_.format == OutputFormat::kEndToEnd;
+  DetectionBatch *decoded = end_to_end ? detections : &candidates_;
+  {
+    StageTimer timer(metrics, Stage::kDecode);
+    auto reshaped_output = ParseNetworkOutput(network_output, batch_index);
+    if (!reshaped_output.ok()) {
+      return reshaped_output.status();
     }
 
-    if (max_confidence_score < params_.confidence_threshold) {
-      continue;
+    auto status = ExtractDetections(*reshaped_output, decoded);
+    if (!status.ok()) {
+      return status;
     }
+  }
 
-    float cx = row_ptr[0];
-    float cy = row_ptr[1];
-    float w = row_ptr[2];
-    float h = row_ptr[3];
+  if (!end_to_end) {
+    StageTimer timer(metrics, Stage::kNms);
+    NonMaxSuppression::Apply(candidates_, nms_options_, &nms_workspace_,
+                             detections);
+  } else if (params_.max_detections > 0) {
+    detections->Truncate(static_cast<size_t>(params_.max_detections));
+  }
 
-    // Convert Center-XYWH to TopLeft-XYWH for OpenCV
-    int left = int(cx - w / 2);
-    int top = int(cy - h / 2);
-    int width = int(w);
-    int height = int(h);
+  {
+    StageTimer timer(metrics, Stage::kUnscale);
+    UnscaleDetections(image_info, detections);
+  }
 
-    detections.emplace_back(
-        Detection{.class_id = class_id,
-                  .confidence = max_confidence_score,
-                  .bbox = cv::Rect(left, top, width, height)});
+  if (metrics != nullptr) {
+    metrics->RecordCandidates(decoded->Size(), detections->Size());
+    metrics->RecordFrame();
   }
+  return absl::OkStatus();
+}
 
-  return detections;
+absl::StatusOr<std::vector<cv::Mat>>
+InferenceEngine::Forward(const cv::Mat &blob) {
+  std::vector<cv::Mat> outs;
+  auto status = Forward(blob, &outs);
+  if (!status.ok()) {
+    return status;
+  }
+  return outs;
 }
 
-std::vector<Detection> InferenceEngine::UnscaleDetections(
-    const std::vector<Detection> &scaled_detections,
-    const cv::Mat &original_image) {
-  std::vector<Detection> unscaled_detections;
+absl::Status InferenceEngine::Forward(const cv::Mat &blob,
+                                      std::vector<cv::Mat> *network_output) {
+  PinnedThreadPool::Scope scope(thread_pool_.get());
+  StageTimer timer(metrics_.get(), Stage::kForward);
+
+  // Malformed blobs go to net_, which reports them.
+  auto net = NetworkFor(blob.dims == 4
+                            ? cv::Size(blob.size[3], blob.size[2])
+                            : cv::Size(params_.input_image_width,
+                                       params_.input_image_height));
+  if (!net.ok()) {
+    return net.status();
+  }
 
-  const float scale_w = static_cast<float>(params_.input_image_width) /
-                        static_cast<float>(original_image.cols);
-  const float scale_h = static_cast<float>(params_.input_image_height) /
-                        static_cast<float>(original_image.rows);
-  const float scale = std::min(scale_w, scale_h);
-  LOG(INFO) << "Scale: " << scale;
-  LOG(INFO) << "Width: " << original_image.cols;
-  LOG(INFO) << "Height: " << original_image.rows;
+  try {
+    (*net)->setInput(blob);
+    (*net)->forward(*network_output, output_names_);
+  } catch (const cv::Exception &e) {
+    return absl::InternalError(e.what());
+  }
+  return absl::OkStatus();
+}
 
+absl::StatusOr<cv::dnn::Net *>
+InferenceEngine::NetworkFor(const cv::Size &input_size) {
+  if (input_size == cv::Size(params_.input_image_width,
+                             params_.input_image_height)) {
+    return net_.get();
+  }
 
+  // OpenCV reallocates every layer buffer when the input shape of a network
+  // changes, so alternating shapes on one network would pay for that on
+  // every frame. Each shape gets a network of its own instead.
+  ++shape_network_uses_;
+  for (ShapeNetwork &shape_network : shape_networks_) {
+    if (shape_network.input_size == input_size) {
+      shape_network.last_used = shape_network_uses_;
+      return &shape_network.net;
+    }
+  }
 
-  int pad_left = (params_.input_image_width - original_image.cols * scale) / 2;
-  int pad_top = (params_.input_image_height - original_image.rows * scale) / 2;
+  auto net = params_.use_model_cache
+                 ? ModelCache::Global().AcquireNetwork(model_)
+                 : model_->NewNetwork();
+  if (!net.ok()) {
+    return net.status();
+  }
+  auto status = ConfigureNetwork(backend_config_, &*net);
+  if (!status.ok()) {
+    return status;
+  }
+
+  if (!shape_networks_.empty() &&
+      static_cast<int>(shape_networks_.size()) >= params_.max_cached_shapes) {
+    auto least_recent = std::min_element(
+        shape_networks_.begin(), shape_networks_.end(),
+        [](const ShapeNetwork &a, const ShapeNetwork &b) {
+          return a.last_used < b.last_used;
+        });
+    if (params_.use_model_cache) {
+      ModelCache::Global().ReleaseNetwork(model_,
+                                          std::move(least_recent->net));
+    }
+    shape_networks_.erase(least_recent);
+  }
+  shape_networks_.push_back(ShapeNetwork{.input_size = input_size,
+                                         .net = std::move(*net),
+                                         .last_used = shape_network_uses_});
+  return &shape_networks_.back().net;
+}
+
+absl::StatusOr<cv::Mat> InferenceEngine::ParseNetworkOutput(
+    const std::vector<cv::Mat> &network_output, int batch_index) {
+  if (network_output.empty()) {
+    return absl::InvalidArgumentError("network output is empty");
+  }
+
+  // Every image of the batch has a [rows, cols] plane, e.g. [84, 8400] for
+  // a YOLOv8/v11 COCO head. The anchor count follows the input shape, which
+  // varies with InferenceParams::letterbox_stride, the channels do not.
+  const cv::Mat &output = network_output.front();
+  const bool variable_input = params_.letterbox_stride > 0;
+  const bool rows_match =
+      output.dims == 3 && output.size[1] == output_layout_.rows;
+  const bool cols_match =
+      output.dims == 3 && output.size[2] == output_layout_.cols;
+  const bool matches =
+      output_layout_.format == OutputFormat::kChannelMajor
+          ? rows_match && (cols_match || variable_input)
+          : cols_match && (rows_match || variable_input);
+  if (!matches) {
+    return absl::InvalidArgumentError(
+        absl::StrFormat("network output does not match the [N, %d, %d] "
+                        "layout found at creation",
+                        output_layout_.rows, output_layout_.cols));
+  }
+  if (batch_index < 0 || batch_index >= output.size[0]) {
+    return absl::OutOfRangeError(
+        absl::StrFormat("batch index %d is out of range for batch size %d",
+                        batch_index, output.size[0]));
+  }
+
+  if (output.depth() != CV_32F) {
+    // x = (q - zero_point) * scale, into a buffer reused across frames.
+    const cv::Mat plane(output.size[1], output.size[2], output.type(),
+                        const_cast<uchar *>(output.ptr(batch_index)));
+    const QuantizationParams &q = output_quantization_;
+    plane.convertTo(dequantized_output_, CV_32F, q.scale,
+                    -q.zero_point * q.scale);
+    return dequantized_output_;
+  }
+
+  // Return a view of the image's plane. The decoders work on the layout the
+  // network produced directly, so no transposed copy is made.
+  return cv::Mat(output.size[1], output.size[2], CV_32F,
+                 const_cast<float *>(output.ptr<float>(batch_index)));
+}
 
-  for (const auto &det : scaled_detections) {
-    // The Math: x_original = (x_letterboxed - padding) / scale
-    float x = (det.bbox.x - pad_left) / scale;
-    float y = (det.bbox.y - pad_top) / scale;
-    float w = det.bbox.width / scale;
-    float h = det.bbox.height / scale;
+absl::Status
+InferenceEngine::ExtractDetections(const cv::Mat &output_tensor,
+                                   DetectionBatch *detections) const {
+  if (output_tensor.type() != CV_32F) {
+    return absl::InvalidArgumentError("output tensor must be a float matrix");
+  }
+
+  decode_(output_tensor, params_.confidence_threshold, detections);
+  return absl::OkStatus();
+}
 
-    // Sanity Clip (Ensure box stays inside the original image)
-    // This prevents negative coordinates or boxes spilling off the edge
-    x = std::max(0.0f, x);
-    y = std::max(0.0f, y);
-    w = std::min(w, (float)original_image.cols - x);
-    h = std::min(h, (float)original_image.rows - y);
+ImageInfo
+InferenceEngine::SingleImageGeometry(const cv::Size &source_size) const {
+  const cv::Size input_size = BlobPreprocessor::InputSize(
+      source_size, params_.input_image_width, params_.input_image_height,
+      params_.letterbox_stride);
+  return BlobPreprocessor::Geometry(source_size, input_size.width,
+                                    input_size.height);
+}
 
-    unscaled_detections.emplace_back(
-        Detection{.class_id = det.class_id,
-                  .confidence = det.confidence,
-                  .bbox = cv::Rect((int)x, (int)y, (int)w, (int)h)});
+void InferenceEngine::UnscaleDetections(
+    const cv::Mat &original_image, std::vector<Detection> *detections) const {
+  const ImageInfo image_info = SingleImageGeometry(original_image.size());
+  for (Detection &det : *detections) {
+    float x1 = static_cast<float>(det.bbox.x);
+    float y1 = static_cast<float>(det.bbox.y);
+    float x2 = static_cast<float>(det.bbox.x + det.bbox.width);
+    float y2 = static_cast<float>(det.bbox.y + det.bbox.height);
+    UnscaleBox(image_info, &x1, &y1, &x2, &y2);
+
+    const int left = cvRound(x1);
+    const int top = cvRound(y1);
+    det.bbox = cv::Rect(left, top, cvRound(x2) - left, cvRound(y2) - top);
   }
+}
 
-  return unscaled_detections;
+void InferenceEngine::UnscaleDetections(const ImageInfo &image_info,
+                                        DetectionBatch *detections) {
+  const size_t n = detections->Size();
+  for (size_t i = 0; i < n; ++i) {
+    UnscaleBox(image_info, &detections->x1[i], &detections->y1[i],
+               &detections->x2[i], &detections->y2[i]);
+  }
 }
 
 } // namespace inference
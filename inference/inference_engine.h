@@ -1,46 +1,270 @@
 #ifndef INFERENCE_INFERENCE_ENGINE_H_
 #define INFERENCE_INFERENCE_ENGINE_H_
 
+#include <cstdint>
 #include <memory>
+#include <vector>
 
 #include "absl/status/statusor.h"
+#include "absl/types/span.h"
 #include "opencv2/core.hpp"
 #include "opencv2/dnn.hpp"
 
+#include "inference/blob_preprocessor.h"
 #include "inference/detection.h"
+#include "inference/detection_batch.h"
+#include "inference/image_decoder.h"
+#include "inference/image_info.h"
+#include "inference/inference_metrics.h"
 #include "inference/inference_params.h"
+#include "inference/non_max_suppression.h"
+#include "inference/output_decoder.h"
+#include "inference/pinned_thread_pool.h"
+#include "inference/shared_model.h"
+#include "inference/yuv_image.h"
 
 namespace inference {
 
+// Backend settings a network runs with, as resolved from InferenceParams or
+// picked by autotuning.
+struct BackendConfig {
+  ComputeDevice device = ComputeDevice::kCpu;
+  bool fusion = true;
+  bool winograd = true;
+  bool fp16 = false;
+};
+
 class InferenceEngine {
 public:
   static absl::StatusOr<std::unique_ptr<InferenceEngine>>
   Create(const InferenceParams &params);
 
-  ~InferenceEngine() = default;
+  // Same as above, but the network comes from the already loaded `model`
+  // and params.model_path is ignored.
+  static absl::StatusOr<std::unique_ptr<InferenceEngine>>
+  Create(const InferenceParams &params,
+         std::shared_ptr<const SharedModel> model);
 
+  // Hands the parsed network to the ModelCache, unless disabled by
+  // InferenceParams::use_model_cache.
+  ~InferenceEngine();
+
+  // Reference letterbox implementation producing an 8-bit BGR canvas. The
+  // inference path uses the fused BlobPreprocessor instead, this is kept for
+  // tests and debugging.
   absl::StatusOr<cv::Mat> LetterBox(const cv::Mat &source, int target_w,
                                     int target_h) const;
 
   absl::StatusOr<std::vector<Detection>> RunInference(const cv::Mat &source);
 
+  // Same as above, but overwrites `detections` and runs entirely on buffers
+  // owned by the engine. Once the buffers have grown on the first frames,
+  // preprocessing and postprocessing no longer touch the heap; only the
+  // network forward pass allocates internally.
+  absl::Status RunInference(const cv::Mat &source,
+                            std::vector<Detection> *detections);
+
+  // Same as above, with boxes in source pixels kept as floats. Coordinates
+  // are never rounded on this path.
+  absl::Status RunInference(const cv::Mat &source, DetectionBatch *detections);
+
+  // Same as above, for a 4:2:0 YUV frame such as the NV12 or I420 output of
+  // a video decoder. The colour conversion happens inside the letterbox
+  // kernel, the frame is read in place and never converted as a whole.
+  absl::Status RunInference(const YuvImage &source,
+                            DetectionBatch *detections);
+
+  // Same as above, with rounded boxes.
+  absl::Status RunInference(const YuvImage &source,
+                            std::vector<Detection> *detections);
+
+  // Decodes the compressed image `encoded` (JPEG, PNG, ...) and runs
+  // inference on it. JPEGs are decoded at the smallest DCT scale that still
+  // covers the network input, see ImageDecoder. Boxes are in pixels of the
+  // full-resolution image either way.
+  absl::Status RunInferenceEncoded(absl::Span<const uint8_t> encoded,
+                                   DetectionBatch *detections);
+
+  // Same as above, with rounded boxes.
+  absl::Status RunInferenceEncoded(absl::Span<const uint8_t> encoded,
+                                   std::vector<Detection> *detections);
+
+  // Runs a single forward pass over all `sources` packed into one NCHW blob.
+  // Sources may have different resolutions, each image is letterboxed and
+  // unscaled independently. The result holds one detection vector per source,
+  // in the same order.
+  absl::StatusOr<std::vector<std::vector<Detection>>>
+  RunInferenceBatch(absl::Span<const cv::Mat> sources);
+
+  // The stages RunInference is made of, exposed so callers can pipeline
+  // them. Every stage only touches its own scratch buffers, so Preprocess,
+  // Forward and Postprocess may run concurrently on different threads, as
+  // long as no stage runs concurrently with itself or with RunInference.
+
+  // Letterboxes and normalizes `sources` into the [N, 3, H, W] `blob` with
+  // the fused preprocessing kernel. `blob` is reused when already sized. H
+  // and W are the input size, or with InferenceParams::letterbox_stride the
+  // smallest stride-aligned shape holding every source.
+  absl::Status Preprocess(absl::Span<const cv::Mat> sources, cv::Mat *blob);
+
+  // Same as above, and overwrites `image_info` with the letterbox geometry of
+  // every source, for Postprocess to unscale with.
+  absl::Status Preprocess(absl::Span<const cv::Mat> sources, cv::Mat *blob,
+                          std::vector<ImageInfo> *image_info);
+
+  // Same as above, for YUV frames.
+  absl::Status Preprocess(absl::Span<const YuvImage> sources, cv::Mat *blob,
+                          std::vector<ImageInfo> *image_info);
+
+  absl::StatusOr<std::vector<cv::Mat>> Forward(const cv::Mat &blob);
+
+  // Same as above, but copies the outputs into `network_output`, reusing
+  // the Mats already there when their shape matches. Blobs of a shape other
+  // than the full input run on a network kept for that shape, see
+  // InferenceParams::max_cached_shapes.
+  absl::Status Forward(const cv::Mat &blob,
+                       std::vector<cv::Mat> *network_output);
+
+  // Decodes, suppresses and unscales the detections of the image at
+  // `batch_index`, `source` being the image that was preprocessed. With
+  // InferenceParams::letterbox_stride, `source` must have been preprocessed
+  // on its own; batches unscale with the ImageInfo overload.
+  absl::StatusOr<std::vector<Detection>>
+  Postprocess(const std::vector<cv::Mat> &network_output, int batch_index,
+              const cv::Mat &source);
+
+  // Same as above, but overwrites `detections`.
+  absl::Status Postprocess(const std::vector<cv::Mat> &network_output,
+                           int batch_index, const cv::Mat &source,
+                           std::vector<Detection> *detections);
+
+  // Same as above, but unscales with the geometry Preprocess recorded for
+  // the image and keeps float boxes in source pixels. The other overloads
+  // round once, when converting the result.
+  absl::Status Postprocess(const std::vector<cv::Mat> &network_output,
+                           int batch_index, const ImageInfo &image_info,
+                           DetectionBatch *detections);
+
+  // Maps boxes in letterbox coordinates back onto `original_image`, in
+  // place, and clips them to it. `original_image` is assumed to have been
+  // preprocessed on its own.
+  void UnscaleDetections(const cv::Mat &original_image,
+                         std::vector<Detection> *detections) const;
+
+  // Same as above, for float boxes of an image letterboxed as `image_info`
+  // says.
+  static void UnscaleDetections(const ImageInfo &image_info,
+                                DetectionBatch *detections);
+
+  const BackendConfig &backend_config() const { return backend_config_; }
+
+  // True when the model is a statically quantized INT8 ONNX model (QDQ or
+  // QLinear ops), which runs OpenCV's INT8 CPU kernels.
+  bool quantized() const { return quantized_; }
+
+  // Output layout of the network, inferred when the engine was created.
+  const OutputLayout &output_layout() const { return output_layout_; }
+
+  // Stage latencies, candidate counts and throughput of this engine. Null
+  // unless InferenceParams::enable_metrics is set.
+  InferenceMetrics *metrics() const { return metrics_.get(); }
+
 private:
   InferenceEngine(const InferenceParams &params);
 
-  absl::StatusOr<std::vector<cv::Mat>> Forward(const cv::Mat &image);
+  // `thread_pool` is null unless the engine has a thread budget or CPUs of
+  // its own.
+  static absl::StatusOr<std::unique_ptr<InferenceEngine>>
+  CreateFromNetwork(const InferenceParams &params,
+                    std::shared_ptr<const SharedModel> model,
+                    cv::dnn::Net net,
+                    std::unique_ptr<PinnedThreadPool> thread_pool);
+
+  absl::Status ApplyBackendConfig(const BackendConfig &config);
+
+  // The network blobs of `input_size` run on: net_ for the full input size,
+  // a cached one, created with the current backend config if needed, for
+  // any other.
+  absl::StatusOr<cv::dnn::Net *> NetworkFor(const cv::Size &input_size);
 
+  // Letterbox geometry of a source_size image preprocessed alone.
+  ImageInfo SingleImageGeometry(const cv::Size &source_size) const;
+
+  // Shared by the Preprocess overloads, for cv::Mat and YuvImage sources.
+  template <typename Source>
+  absl::Status PreprocessSources(absl::Span<const Source> sources,
+                                 cv::Mat *blob,
+                                 std::vector<ImageInfo> *image_info);
+
+  // Preprocesses `source`, then runs Forward and Postprocess on it.
+  template <typename Source>
+  absl::Status RunSingle(const Source &source, DetectionBatch *detections);
+
+  // Times every candidate configuration on a blank input and applies the
+  // fastest.
+  absl::Status Autotune();
+
+  // Runs InferenceParams::warmup_runs forward passes on a blank input.
+  absl::Status Warmup();
+
+  // Picks the decoder matching the shape of the warmup output.
+  absl::Status DetectOutputLayout();
+
+  // Returns the detection matrix of the image at `batch_index` in the
+  // network output, shaped as output_layout_ says, as a view into the
+  // output blob. Quantized outputs are dequantized into dequantized_output_
+  // instead.
   absl::StatusOr<cv::Mat>
-  ParseNetworkOutput(const std::vector<cv::Mat> &network_output);
+  ParseNetworkOutput(const std::vector<cv::Mat> &network_output,
+                     int batch_index);
 
-  absl::StatusOr<std::vector<Detection>>
-  ExtractDetections(const cv::Mat &output_tensor);
+  absl::Status ExtractDetections(const cv::Mat &output_tensor,
+                                 DetectionBatch *detections) const;
 
-  std::vector<Detection>
-  UnscaleDetections(const std::vector<Detection> &scaled_detections,
-                    const cv::Mat &original_image);
+  // A network set up for one input shape other than the full one.
+  struct ShapeNetwork {
+    cv::Size input_size;
+    cv::dnn::Net net;
+    // Value of shape_network_uses_ when it last ran, for LRU eviction.
+    int64_t last_used = 0;
+  };
+
+  // Affine mapping of an integer network output back to real values.
+  struct QuantizationParams {
+    float scale = 1.0f;
+    int zero_point = 0;
+  };
 
   InferenceParams params_;
+  // Runs the engine's parallel work when it has a thread budget or CPUs of
+  // its own, null otherwise.
+  // Every entry point that computes holds a Scope of it.
+  std::unique_ptr<PinnedThreadPool> thread_pool_;
+  NmsOptions nms_options_;
+  std::shared_ptr<const SharedModel> model_;
   std::unique_ptr<cv::dnn::Net> net_;
+  BackendConfig backend_config_;
+  bool quantized_ = false;
+  QuantizationParams output_quantization_;
+  std::vector<cv::String> output_names_;
+  std::unique_ptr<InferenceMetrics> metrics_;
+  OutputLayout output_layout_;
+  OutputDecoder::BatchDecodeFunction decode_ = nullptr;
+  std::vector<ShapeNetwork> shape_networks_;
+  int64_t shape_network_uses_ = 0;
+
+  // Scratch buffers, reserved from InferenceParams at construction and
+  // reused by every frame.
+  BlobPreprocessor preprocessor_;
+  DecodedImage decoded_;
+  cv::Mat input_blob_;
+  std::vector<cv::Mat> network_output_;
+  std::vector<ImageInfo> image_info_;
+  cv::Mat dequantized_output_;
+  DetectionBatch candidates_;
+  // Result of the Detection vector overloads, before rounding.
+  DetectionBatch detections_;
+  NmsWorkspace nms_workspace_;
 };
 
 } // namespace inference
@@ -0,0 +1,174 @@
+#include <unistd.h>
+
+#include <fstream>
+
+#include "absl/log/log.h"
+#include "absl/strings/str_format.h"
+
+#include "inference/cpu_topology.h"
+#include "inference/inference_engine_pool.h"
+#include "inference/pinned_thread_pool.h"
+
+namespace inference {
+namespace {
+
+// Resident set size of the process, 0 if /proc is not available.
+size_t ResidentBytes() {
+  std::ifstream statm("/proc/self/statm");
+  size_t total_pages = 0;
+  size_t resident_pages = 0;
+  if (!(statm >> total_pages >> resident_pages)) {
+    return 0;
+  }
+  return resident_pages * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+} // namespace
+
+int InferenceEnginePool::DefaultNumWorkers() {
+  auto topology = CpuTopology::Detect();
+  return topology.ok() ? topology->NumNodes() : 1;
+}
+
+absl::StatusOr<std::unique_ptr<InferenceEnginePool>>
+InferenceEnginePool::Create(const InferenceParams &params) {
+  const int num_workers = DefaultNumWorkers();
+  if (num_workers == 1 || !params.cpus.empty() || params.numa_node >= 0 ||
+      !PinnedThreadPool::ParallelBackendInstalled()) {
+    return Create(params, num_workers);
+  }
+  // Spread over the nodes, so each worker gets a node's worth of threads
+  // next to its own memory.
+  std::vector<InferenceParams> worker_params(num_workers, params);
+  for (int i = 0; i < num_workers; ++i) {
+    worker_params[i].numa_node = i;
+  }
+  return CreateWorkers(worker_params);
+}
+
+absl::StatusOr<std::unique_ptr<InferenceEnginePool>>
+InferenceEnginePool::Create(const InferenceParams &params, int num_workers) {
+  if (num_workers <= 0) {
+    return absl::InvalidArgumentError("num_workers must be positive");
+  }
+  return CreateWorkers(std::vector<InferenceParams>(num_workers, params));
+}
+
+absl::StatusOr<std::unique_ptr<InferenceEnginePool>>
+InferenceEnginePool::CreateWorkers(
+    const std::vector<InferenceParams> &worker_params) {
+  const InferenceParams &params = worker_params.front();
+  const int num_workers = static_cast<int>(worker_params.size());
+  std::unique_ptr<InferenceEnginePool> pool(new InferenceEnginePool());
+
+  // The first worker is charged for the model copy read here.
+  size_t before = ResidentBytes();
+  auto model = params.use_model_cache
+                   ? ModelCache::Global().GetModel(params.model_path)
+                   : SharedModel::Load(params.model_path);
+  if (!model.ok()) {
+    return model.status();
+  }
+  pool->model_ = std::move(*model);
+  pool->memory_report_.model_bytes = pool->model_->ModelBytes();
+
+  const cv::Mat warmup_frame(params.input_image_height,
+                             params.input_image_width, CV_8UC3,
+                             params.padding_value);
+
+  size_t extra_bytes = 0;
+  for (int i = 0; i < num_workers; ++i) {
+    if (i > 0) {
+      before = ResidentBytes();
+    }
+
+    auto engine = InferenceEngine::Create(worker_params[i], pool->model_);
+    if (!engine.ok()) {
+      return engine.status();
+    }
+
+    auto warmup = (*engine)->RunInference(warmup_frame);
+    if (!warmup.ok()) {
+      return warmup.status();
+    }
+
+    const size_t after = ResidentBytes();
+    const size_t added = (after > before) ? after - before : 0;
+    if (i == 0) {
+      pool->memory_report_.first_worker_bytes = added;
+    } else {
+      extra_bytes += added;
+    }
+
+    pool->engines_.emplace_back(std::move(*engine));
+  }
+
+  if (num_workers > 1) {
+    pool->memory_report_.extra_worker_bytes = extra_bytes / (num_workers - 1);
+  }
+
+  LOG(INFO) << absl::StrFormat(
+      "Created %d workers, model %d bytes read once, first worker %d "
+      "bytes, %d bytes per extra worker",
+      num_workers, pool->memory_report_.model_bytes,
+      pool->memory_report_.first_worker_bytes,
+      pool->memory_report_.extra_worker_bytes);
+
+  for (auto &engine : pool->engines_) {
+    pool->workers_.emplace_back(&InferenceEnginePool::WorkerLoop, pool.get(),
+                                engine.get());
+  }
+
+  return pool;
+}
+
+InferenceEnginePool::~InferenceEnginePool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  request_available_.notify_all();
+
+  for (auto &worker : workers_) {
+    worker.join();
+  }
+}
+
+std::future<InferenceEnginePool::Result>
+InferenceEnginePool::Submit(const cv::Mat &source) {
+  Request request{.source = source};
+  auto future = request.promise.get_future();
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    requests_.push_back(std::move(request));
+  }
+  request_available_.notify_one();
+
+  return future;
+}
+
+InferenceEnginePool::Result
+InferenceEnginePool::RunInference(const cv::Mat &source) {
+  return Submit(source).get();
+}
+
+void InferenceEnginePool::WorkerLoop(InferenceEngine *engine) {
+  while (true) {
+    Request request;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      request_available_.wait(
+          lock, [this] { return stopping_ || !requests_.empty(); });
+      if (requests_.empty()) {
+        return;
+      }
+      request = std::move(requests_.front());
+      requests_.pop_front();
+    }
+
+    request.promise.set_value(engine->RunInference(request.source));
+  }
+}
+
+} // namespace inference
@@ -0,0 +1,103 @@
+#ifndef INFERENCE_INFERENCE_ENGINE_POOL_H_
+#define INFERENCE_INFERENCE_ENGINE_POOL_H_
+
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "opencv2/core.hpp"
+
+#include "inference/detection.h"
+#include "inference/inference_engine.h"
+#include "inference/inference_params.h"
+#include "inference/shared_model.h"
+
+namespace inference {
+
+// A fixed set of InferenceEngine workers that can be called concurrently.
+//
+// The model file is read once, and that copy and OpenCV's process-wide
+// state are all the workers share. Every worker parses its own network from
+// that copy, and OpenCV DNN gives each network a private copy of the
+// weights, their repacked convolution kernels and the activations, so each
+// worker costs about as much memory as a single engine. A few workers with
+// large thread budgets use far less memory than one per core.
+//
+// Requests go to a single queue that idle workers pull from, so a request
+// never waits behind a busy worker while another one is free.
+class InferenceEnginePool {
+public:
+  using Result = absl::StatusOr<std::vector<Detection>>;
+
+  // Resident memory measured while the pool was created, every worker having
+  // run one warmup frame so lazily allocated buffers are included.
+  struct MemoryReport {
+    // Serialized model, read once for the whole pool.
+    size_t model_bytes = 0;
+    // Added by the first worker, including the copy of the model read for
+    // the pool and OpenCV's one-time setup.
+    size_t first_worker_bytes = 0;
+    // Added by each further worker, on average: its own network.
+    size_t extra_worker_bytes = 0;
+  };
+
+  // Workers of a pool created without an explicit count: one per NUMA node.
+  static int DefaultNumWorkers();
+
+  // DefaultNumWorkers() workers. Unless `params` places the engines, each
+  // worker runs on the CPUs of its own NUMA node with their thread budget,
+  // if PinnedThreadPool::InstallParallelBackend() was called. Otherwise the
+  // workers share OpenCV's pool.
+  static absl::StatusOr<std::unique_ptr<InferenceEnginePool>>
+  Create(const InferenceParams &params);
+
+  static absl::StatusOr<std::unique_ptr<InferenceEnginePool>>
+  Create(const InferenceParams &params, int num_workers);
+
+  // Finishes the queued requests, then stops the workers.
+  ~InferenceEnginePool();
+
+  // Queues `source` for the next free worker. Thread-safe.
+  std::future<Result> Submit(const cv::Mat &source);
+
+  // Blocking convenience wrapper around Submit. Thread-safe.
+  Result RunInference(const cv::Mat &source);
+
+  int NumWorkers() const { return static_cast<int>(engines_.size()); }
+
+  const MemoryReport &memory_report() const { return memory_report_; }
+
+private:
+  struct Request {
+    cv::Mat source;
+    std::promise<Result> promise;
+  };
+
+  InferenceEnginePool() = default;
+
+  // One worker per element, all of the same model.
+  static absl::StatusOr<std::unique_ptr<InferenceEnginePool>>
+  CreateWorkers(const std::vector<InferenceParams> &worker_params);
+
+  void WorkerLoop(InferenceEngine *engine);
+
+  std::shared_ptr<const SharedModel> model_;
+  std::vector<std::unique_ptr<InferenceEngine>> engines_;
+  MemoryReport memory_report_;
+
+  std::mutex mutex_;
+  std::condition_variable request_available_;
+  std::deque<Request> requests_;
+  bool stopping_ = false;
+
+  std::vector<std::thread> workers_;
+};
+
+} // namespace inference
+
+#endif
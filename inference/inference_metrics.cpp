@@ -0,0 +1,283 @@
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+
+#include "absl/strings/str_format.h"
+
+#include "inference/inference_metrics.h"
+
+namespace inference {
+namespace {
+
+// Small sequential ids read better in trace viewers than hashed thread ids.
+int CurrentThreadId() {
+  static std::atomic<int> next_id{1};
+  thread_local const int id = next_id.fetch_add(1, std::memory_order_relaxed);
+  return id;
+}
+
+absl::Status WriteFile(const std::string &path, const std::string &contents) {
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  file << contents;
+  file.close();
+  if (!file) {
+    return absl::InternalError(absl::StrFormat("Failed to write %s", path));
+  }
+  return absl::OkStatus();
+}
+
+void AppendSummary(const std::string &name, const std::string &help,
+                   const Histogram &histogram, std::string *out) {
+  absl::StrAppendFormat(out, "# HELP %s %s\n# TYPE %s summary\n", name, help,
+                        name);
+  for (double quantile : {0.5, 0.9, 0.99}) {
+    absl::StrAppendFormat(out, "%s{quantile=\"%g\"} %d\n", name, quantile,
+                          histogram.Quantile(quantile));
+  }
+  absl::StrAppendFormat(out, "%s_sum %d\n%s_count %d\n", name,
+                        histogram.Sum(), name, histogram.Count());
+}
+
+} // namespace
+
+const char *StageName(Stage stage) {
+  switch (stage) {
+  case Stage::kPreprocess:
+    return "preprocess";
+  case Stage::kForward:
+    return "forward";
+  case Stage::kDecode:
+    return "decode";
+  case Stage::kNms:
+    return "nms";
+  case Stage::kUnscale:
+    return "unscale";
+  }
+  return "unknown";
+}
+
+int Histogram::BucketIndex(uint64_t value) {
+  if (value < 4) {
+    return static_cast<int>(value);
+  }
+  // The two bits below the leading one pick the linear sub-bucket.
+  const int octave = std::bit_width(value) - 1;
+  const int sub_bucket = static_cast<int>((value >> (octave - 2)) & 3);
+  return 4 + (octave - 2) * 4 + sub_bucket;
+}
+
+uint64_t Histogram::BucketUpperBound(int index) {
+  if (index < 4) {
+    return static_cast<uint64_t>(index);
+  }
+  const int octave = (index - 4) / 4 + 2;
+  const uint64_t sub_bucket = (index - 4) % 4;
+  const uint64_t width = uint64_t{1} << (octave - 2);
+  return ((4 + sub_bucket) << (octave - 2)) + (width - 1);
+}
+
+void Histogram::Record(uint64_t value) {
+  buckets_[BucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+  count_.fetch_add(1, std::memory_order_relaxed);
+  sum_.fetch_add(value, std::memory_order_relaxed);
+}
+
+void Histogram::Reset() {
+  for (auto &bucket : buckets_) {
+    bucket.store(0, std::memory_order_relaxed);
+  }
+  count_.store(0, std::memory_order_relaxed);
+  sum_.store(0, std::memory_order_relaxed);
+}
+
+uint64_t Histogram::Count() const {
+  return count_.load(std::memory_order_relaxed);
+}
+
+uint64_t Histogram::Sum() const { return sum_.load(std::memory_order_relaxed); }
+
+double Histogram::Mean() const {
+  const uint64_t count = Count();
+  return count == 0 ? 0.0 : static_cast<double>(Sum()) / count;
+}
+
+uint64_t Histogram::Quantile(double quantile) const {
+  // Buckets are read one by one while others may still record, so rank
+  // against their own total rather than count_.
+  uint64_t total = 0;
+  std::array<uint64_t, kNumBuckets> counts;
+  for (int i = 0; i < kNumBuckets; ++i) {
+    counts[i] = buckets_[i].load(std::memory_order_relaxed);
+    total += counts[i];
+  }
+  if (total == 0) {
+    return 0;
+  }
+
+  const uint64_t rank = std::max<uint64_t>(
+      1, static_cast<uint64_t>(std::ceil(std::clamp(quantile, 0.0, 1.0) *
+                                         static_cast<double>(total))));
+  uint64_t seen = 0;
+  for (int i = 0; i < kNumBuckets; ++i) {
+    seen += counts[i];
+    if (seen >= rank) {
+      return BucketUpperBound(i);
+    }
+  }
+  return BucketUpperBound(kNumBuckets - 1);
+}
+
+uint64_t Histogram::CountAtMost(uint64_t bound) const {
+  uint64_t count = 0;
+  for (int i = 0; i < kNumBuckets && BucketUpperBound(i) <= bound; ++i) {
+    count += buckets_[i].load(std::memory_order_relaxed);
+  }
+  return count;
+}
+
+InferenceMetrics::InferenceMetrics(int trace_capacity)
+    : epoch_ns_(NowNanos()),
+      trace_(static_cast<size_t>(std::max(0, trace_capacity))) {}
+
+int64_t InferenceMetrics::NowNanos() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void InferenceMetrics::RecordStage(Stage stage, int64_t start_ns,
+                                   int64_t end_ns) {
+  const int64_t duration_ns = std::max<int64_t>(0, end_ns - start_ns);
+  stage_latency_[static_cast<int>(stage)].Record(
+      static_cast<uint64_t>(duration_ns));
+
+  if (trace_.empty()) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(trace_mutex_);
+  trace_[trace_next_] = TraceEvent{.stage = stage,
+                                   .thread_id = CurrentThreadId(),
+                                   .start_ns = start_ns,
+                                   .duration_ns = duration_ns};
+  if (++trace_next_ == trace_.size()) {
+    trace_next_ = 0;
+    trace_wrapped_ = true;
+  }
+}
+
+void InferenceMetrics::RecordCandidates(size_t before_nms, size_t after_nms) {
+  candidates_before_nms_.Record(before_nms);
+  detections_after_nms_.Record(after_nms);
+}
+
+void InferenceMetrics::RecordFrame() {
+  const int64_t now = NowNanos();
+  int64_t unset = 0;
+  first_frame_ns_.compare_exchange_strong(unset, now,
+                                          std::memory_order_relaxed);
+  last_frame_ns_.store(now, std::memory_order_relaxed);
+  frames_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void InferenceMetrics::Reset() {
+  for (auto &histogram : stage_latency_) {
+    histogram.Reset();
+  }
+  candidates_before_nms_.Reset();
+  detections_after_nms_.Reset();
+  frames_.store(0, std::memory_order_relaxed);
+  first_frame_ns_.store(0, std::memory_order_relaxed);
+  last_frame_ns_.store(0, std::memory_order_relaxed);
+  epoch_ns_.store(NowNanos(), std::memory_order_relaxed);
+
+  std::lock_guard<std::mutex> lock(trace_mutex_);
+  trace_next_ = 0;
+  trace_wrapped_ = false;
+}
+
+double InferenceMetrics::FramesPerSecond() const {
+  const uint64_t frames = this->frames();
+  const int64_t span_ns = last_frame_ns_.load(std::memory_order_relaxed) -
+                          first_frame_ns_.load(std::memory_order_relaxed);
+  if (frames < 2 || span_ns <= 0) {
+    return 0.0;
+  }
+  return static_cast<double>(frames - 1) * 1e9 / static_cast<double>(span_ns);
+}
+
+std::string InferenceMetrics::PrometheusText() const {
+  std::string out;
+
+  const char *latency = "inference_stage_latency_seconds";
+  absl::StrAppendFormat(&out,
+                        "# HELP %s Latency of each inference pipeline stage.\n"
+                        "# TYPE %s histogram\n",
+                        latency, latency);
+  for (int s = 0; s < kNumStages; ++s) {
+    const Histogram &histogram = stage_latency_[s];
+    const char *stage = StageName(static_cast<Stage>(s));
+    // Powers of two from about 1us to 34s line up with bucket boundaries,
+    // so the cumulative counts are exact.
+    for (int bit = 10; bit <= 35; ++bit) {
+      const uint64_t bound_ns = uint64_t{1} << bit;
+      absl::StrAppendFormat(&out, "%s_bucket{stage=\"%s\",le=\"%g\"} %d\n",
+                            latency, stage, bound_ns * 1e-9,
+                            histogram.CountAtMost(bound_ns - 1));
+    }
+    absl::StrAppendFormat(&out, "%s_bucket{stage=\"%s\",le=\"+Inf\"} %d\n",
+                          latency, stage, histogram.Count());
+    absl::StrAppendFormat(&out, "%s_sum{stage=\"%s\"} %g\n", latency, stage,
+                          histogram.Sum() * 1e-9);
+    absl::StrAppendFormat(&out, "%s_count{stage=\"%s\"} %d\n", latency, stage,
+                          histogram.Count());
+  }
+
+  AppendSummary("inference_candidates_before_nms",
+                "Decoded candidates per image entering NMS.",
+                candidates_before_nms_, &out);
+  AppendSummary("inference_detections_after_nms",
+                "Detections per image surviving NMS.", detections_after_nms_,
+                &out);
+
+  absl::StrAppendFormat(&out,
+                        "# HELP inference_frames_total Images postprocessed.\n"
+                        "# TYPE inference_frames_total counter\n"
+                        "inference_frames_total %d\n",
+                        frames());
+  absl::StrAppendFormat(&out,
+                        "# HELP inference_frames_per_second Throughput "
+                        "between the first and the last frame.\n"
+                        "# TYPE inference_frames_per_second gauge\n"
+                        "inference_frames_per_second %g\n",
+                        FramesPerSecond());
+  return out;
+}
+
+absl::Status InferenceMetrics::WritePrometheus(const std::string &path) const {
+  return WriteFile(path, PrometheusText());
+}
+
+absl::Status InferenceMetrics::WriteChromeTrace(const std::string &path) const {
+  std::string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  {
+    std::lock_guard<std::mutex> lock(trace_mutex_);
+    const int64_t epoch_ns = epoch_ns_.load(std::memory_order_relaxed);
+    const size_t size = trace_wrapped_ ? trace_.size() : trace_next_;
+    const size_t first = trace_wrapped_ ? trace_next_ : 0;
+    for (size_t i = 0; i < size; ++i) {
+      const TraceEvent &event = trace_[(first + i) % trace_.size()];
+      absl::StrAppendFormat(
+          &out,
+          "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+          "\"ts\":%.3f,\"dur\":%.3f}",
+          i == 0 ? "" : ",", StageName(event.stage), event.thread_id,
+          (event.start_ns - epoch_ns) * 1e-3, event.duration_ns * 1e-3);
+    }
+  }
+  out += "]}\n";
+  return WriteFile(path, out);
+}
+
+} // namespace inference
@@ -0,0 +1,151 @@
+#ifndef INFERENCE_INFERENCE_METRICS_H_
+#define INFERENCE_INFERENCE_METRICS_H_
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+
+namespace inference {
+
+enum class Stage {
+  kPreprocess,
+  kForward,
+  kDecode,
+  kNms,
+  kUnscale,
+};
+
+constexpr int kNumStages = 5;
+
+// Lower case name used in metric labels and trace events.
+const char *StageName(Stage stage);
+
+// Lock-free histogram of non-negative integers. Values below 4 are counted
+// exactly, above that every power of two is split into four linear buckets,
+// so quantiles are reported within 25% of the true value.
+class Histogram {
+public:
+  static constexpr int kNumBuckets = 4 + 62 * 4;
+
+  void Record(uint64_t value);
+  void Reset();
+
+  uint64_t Count() const;
+  uint64_t Sum() const;
+  double Mean() const;
+
+  // Upper bound of the bucket holding the `quantile` (0..1) value, 0 when
+  // nothing was recorded.
+  uint64_t Quantile(double quantile) const;
+
+  // Number of recorded values that are at most `bound`. Exact when `bound`
+  // is one less than a power of two.
+  uint64_t CountAtMost(uint64_t bound) const;
+
+  static int BucketIndex(uint64_t value);
+  static uint64_t BucketUpperBound(int index);
+
+private:
+  std::array<std::atomic<uint64_t>, kNumBuckets> buckets_{};
+  std::atomic<uint64_t> count_{0};
+  std::atomic<uint64_t> sum_{0};
+};
+
+// Per-stage latency, candidate counts around NMS and frame throughput of one
+// InferenceEngine. Recording is lock-free except for the optional trace
+// ring, so stages running on different threads can record concurrently.
+class InferenceMetrics {
+public:
+  // Keeps the last `trace_capacity` stage spans for WriteChromeTrace, 0
+  // disables tracing.
+  explicit InferenceMetrics(int trace_capacity);
+
+  static int64_t NowNanos();
+
+  void RecordStage(Stage stage, int64_t start_ns, int64_t end_ns);
+  void RecordCandidates(size_t before_nms, size_t after_nms);
+  void RecordFrame();
+
+  void Reset();
+
+  // Latency in nanoseconds.
+  const Histogram &stage_latency(Stage stage) const {
+    return stage_latency_[static_cast<int>(stage)];
+  }
+  const Histogram &candidates_before_nms() const {
+    return candidates_before_nms_;
+  }
+  const Histogram &detections_after_nms() const {
+    return detections_after_nms_;
+  }
+
+  uint64_t frames() const { return frames_.load(std::memory_order_relaxed); }
+
+  // Frames per second between the first and the last recorded frame.
+  double FramesPerSecond() const;
+
+  // Prometheus text exposition format. Latencies are histograms in seconds,
+  // candidate counts are summaries.
+  std::string PrometheusText() const;
+  absl::Status WritePrometheus(const std::string &path) const;
+
+  // Chrome trace event JSON of the retained stage spans, loadable in
+  // chrome://tracing or Perfetto.
+  absl::Status WriteChromeTrace(const std::string &path) const;
+
+private:
+  struct TraceEvent {
+    Stage stage;
+    int thread_id;
+    int64_t start_ns;
+    int64_t duration_ns;
+  };
+
+  std::array<Histogram, kNumStages> stage_latency_;
+  Histogram candidates_before_nms_;
+  Histogram detections_after_nms_;
+
+  std::atomic<uint64_t> frames_{0};
+  std::atomic<int64_t> first_frame_ns_{0};
+  std::atomic<int64_t> last_frame_ns_{0};
+
+  // Trace timestamps are relative to this.
+  std::atomic<int64_t> epoch_ns_;
+
+  mutable std::mutex trace_mutex_;
+  std::vector<TraceEvent> trace_;
+  size_t trace_next_ = 0;
+  bool trace_wrapped_ = false;
+};
+
+// Records the time between construction and destruction as one span of
+// `stage`. Reads no clock when `metrics` is null.
+class StageTimer {
+public:
+  StageTimer(InferenceMetrics *metrics, Stage stage)
+      : metrics_(metrics), stage_(stage),
+        start_ns_(metrics != nullptr ? InferenceMetrics::NowNanos() : 0) {}
+
+  ~StageTimer() {
+    if (metrics_ != nullptr) {
+      metrics_->RecordStage(stage_, start_ns_, InferenceMetrics::NowNanos());
+    }
+  }
+
+  StageTimer(const StageTimer &) = delete;
+  StageTimer &operator=(const StageTimer &) = delete;
+
+private:
+  InferenceMetrics *const metrics_;
+  const Stage stage_;
+  const int64_t start_ns_;
+};
+
+} // namespace inference
+
+#endif
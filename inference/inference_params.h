@@ -1,10 +1,33 @@
 #ifndef INFERENCE_INFERENCE_PARAMS_H_
 #define INFERENCE_INFERENCE_PARAMS_H_
 
+#include <string>
+#include <vector>
+
 #include "opencv2/core.hpp"
 
+#include "inference/nms_options.h"
+#include "inference/output_decoder.h"
+
 namespace inference {
 
+// Device the network runs on.
+enum class ComputeDevice {
+  // CUDA when a device is present, the CPU otherwise.
+  kAuto,
+  kCpu,
+  kOpenCl,
+  kCuda,
+};
+
+// What AsyncInferenceEngine::Submit does when the pipeline is full.
+enum class BackpressurePolicy {
+  // Block the caller until the first stage has room.
+  kBlock,
+  // Fail the submission right away with ResourceExhausted.
+  kReject,
+};
+
 struct InferenceParams {
   std::string model_path;
   int input_image_width;
@@ -12,6 +35,84 @@ struct InferenceParams {
   cv::Scalar padding_value;
   float confidence_threshold;
   float iou_threshold;
+
+  // Letterboxes every image into the smallest rectangle with sides a
+  // multiple of `letterbox_stride` that holds it at the input_image_width x
+  // input_image_height scale, e.g. 640x384 for a 16:9 frame at 640x640,
+  // instead of padding to the full input. A batch takes the largest shape
+  // of its images. Needs a model with dynamic input sizes whose strides
+  // divide `letterbox_stride`, 32 for YOLO. 0 keeps the full input.
+  int letterbox_stride = 0;
+  // Networks prepared for input shapes other than the full one, each keeps
+  // its own layer buffers. The least recently used is dropped beyond this.
+  int max_cached_shapes = 4;
+
+  // Layout of the network output. kAuto infers it from the output shape
+  // when the engine is created; kEndToEnd heads skip NMS.
+  OutputFormat output_format = OutputFormat::kAuto;
+
+  // Network execution. Fusion folds batch norms and activations into the
+  // preceding convolutions, Winograd kernels speed up 3x3 convolutions on
+  // the CPU. FP16 selects the half precision target of the device: CUDA,
+  // OpenCL, or ARM CPUs.
+  ComputeDevice device = ComputeDevice::kAuto;
+  bool enable_fusion = true;
+  bool enable_winograd = true;
+  bool use_fp16 = false;
+  // Thread budget of this engine alone. Its parallel_for_ work runs on a
+  // PinnedThreadPool of its own during its own calls, so other engines and
+  // OpenCV users in the process keep their threads. 0 leaves the engine on
+  // OpenCV's process-wide pool, which only the application sizes, with
+  // cv::setNumThreads. With `cpus` or `numa_node` set, 0 is one per CPU.
+  // Setting it, `cpus` or `numa_node` requires the application to call
+  // PinnedThreadPool::InstallParallelBackend() first, Create fails
+  // otherwise.
+  int num_threads = 0;
+  // CPUs the engine runs on. Its parallel_for_ work goes to a
+  // PinnedThreadPool of `num_threads` on these CPUs, and the threads
+  // calling into the engine are pinned to them for the duration of each
+  // call. Engine buffers are first touched there, so with CPUs of a single
+  // node they are allocated on that NUMA node. Empty leaves the engine
+  // unpinned.
+  std::vector<int> cpus;
+  // Every CPU of this NUMA node, when `cpus` is empty. -1 for none.
+  int numa_node = -1;
+
+  // Share loaded model files and recycle the parsed networks of destroyed
+  // engines through the process-wide ModelCache.
+  bool use_model_cache = true;
+
+  // Forward passes on a blank image run by InferenceEngine::Create, so the
+  // first real frame doesn't pay for layer setup and buffer allocation.
+  // At least one always runs, it also reveals the output layout.
+  int warmup_runs = 1;
+  // Times every fusion / Winograd combination, and FP16 if use_fp16 allows
+  // it, over `autotune_runs` forwards at creation and keeps the fastest.
+  // Overrides enable_fusion and enable_winograd.
+  bool autotune = false;
+  int autotune_runs = 3;
+
+  // Non maximum suppression, see NmsOptions.
+  NmsMode nms_mode = NmsMode::kClassAware;
+  // Detections kept per image, highest confidence first. 0 keeps them all.
+  int max_detections = 0;
+  bool nms_spatial_bucketing = false;
+
+  // Candidate detections per image the postprocessing buffers are reserved
+  // for up front, one per anchor of a 640x640 YOLOv8/v11 head. Frames with
+  // more candidates still work, the buffers grow once.
+  int max_candidates = 8400;
+
+  // Per-stage latency, NMS candidate counts and throughput, exposed through
+  // InferenceEngine::metrics(). When off, the pipeline reads no clock.
+  bool enable_metrics = false;
+  // Most recent stage spans kept for InferenceMetrics::WriteChromeTrace, 0
+  // keeps none.
+  int metrics_trace_capacity = 0;
+
+  // AsyncInferenceEngine: capacity of each queue between pipeline stages.
+  int async_queue_depth = 4;
+  BackpressurePolicy async_backpressure = BackpressurePolicy::kBlock;
 };
 
 } // namespace inference
@@ -0,0 +1,426 @@
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <utility>
+
+#include "absl/strings/str_format.h"
+
+#include "inference/inference_server.h"
+#include "inference/server_protocol.h"
+
+namespace inference {
+
+struct InferenceServer::Connection {
+  explicit Connection(int fd) : fd(fd) {}
+  // Requests hold the connection until answered, so the socket outlives a
+  // client that hangs up with requests in flight.
+  ~Connection() { close(fd); }
+
+  const int fd;
+  std::mutex mutex;
+  std::condition_variable changed;
+  // Encoded responses waiting for the writer, oldest first.
+  std::deque<std::string> responses;
+  size_t queued_bytes = 0;
+  // Requests read and not yet answered. The writer exits once the reader is
+  // done and all of them went out.
+  int unanswered = 0;
+  bool reader_done = false;
+  // The client was disconnected, later responses are dropped.
+  bool broken = false;
+  std::thread reader;
+  std::thread writer;
+  // Reader and writer threads still running.
+  std::atomic<int> running{2};
+};
+
+struct InferenceServer::Request {
+  explicit Request(std::shared_ptr<Connection> connection)
+      : connection(std::move(connection)) {
+    std::lock_guard<std::mutex> lock(this->connection->mutex);
+    ++this->connection->unanswered;
+  }
+  ~Request() {
+    {
+      std::lock_guard<std::mutex> lock(connection->mutex);
+      --connection->unanswered;
+    }
+    connection->changed.notify_all();
+  }
+
+  const std::shared_ptr<Connection> connection;
+  uint64_t request_id = 0;
+  cv::Mat image;
+  // When the pixels were fully received, and when the batcher took it.
+  int64_t received_ns = 0;
+  int64_t dequeued_ns = 0;
+};
+
+absl::StatusOr<std::unique_ptr<InferenceServer>>
+InferenceServer::Create(const InferenceParams &params,
+                        const ServerOptions &options) {
+  if (options.max_batch_size <= 0 || options.queue_capacity <= 0 ||
+      options.max_batch_delay_us < 0 || options.max_image_pixels <= 0 ||
+      options.max_queued_response_bytes == 0 ||
+      options.write_timeout_ms <= 0) {
+    return absl::InvalidArgumentError(
+        "max_batch_size, queue_capacity, max_image_pixels, "
+        "max_queued_response_bytes and write_timeout_ms must be positive, "
+        "max_batch_delay_us must not be negative");
+  }
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  if (options.socket_path.empty() ||
+      options.socket_path.size() >= sizeof(address.sun_path)) {
+    return absl::InvalidArgumentError(absl::StrFormat(
+        "socket path must be 1 to %d characters, got \"%s\"",
+        sizeof(address.sun_path) - 1, options.socket_path));
+  }
+  std::memcpy(address.sun_path, options.socket_path.c_str(),
+              options.socket_path.size());
+
+  auto engine = InferenceEngine::Create(params);
+  if (!engine.ok()) {
+    return engine.status();
+  }
+
+  // A socket left behind by a crashed server would make bind fail.
+  unlink(options.socket_path.c_str());
+  const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return absl::InternalError(
+        absl::StrFormat("Failed to create socket: %s", std::strerror(errno)));
+  }
+  if (bind(fd, reinterpret_cast<const sockaddr *>(&address),
+           sizeof(address)) != 0 ||
+      listen(fd, SOMAXCONN) != 0) {
+    const int error = errno;
+    close(fd);
+    return absl::InternalError(absl::StrFormat("Failed to listen on %s: %s",
+                                               options.socket_path,
+                                               std::strerror(error)));
+  }
+
+  return std::unique_ptr<InferenceServer>(
+      new InferenceServer(std::move(*engine), options, fd));
+}
+
+InferenceServer::InferenceServer(std::unique_ptr<InferenceEngine> engine,
+                                 const ServerOptions &options, int listen_fd)
+    : engine_(std::move(engine)), options_(options), listen_fd_(listen_fd),
+      latency_by_batch_size_(options.max_batch_size),
+      batches_by_size_(options.max_batch_size) {
+  batch_.reserve(options.max_batch_size);
+  sources_.reserve(options.max_batch_size);
+  image_info_.reserve(options.max_batch_size);
+  batch_thread_ = std::thread(&InferenceServer::BatchLoop, this);
+  accept_thread_ = std::thread(&InferenceServer::AcceptLoop, this);
+}
+
+InferenceServer::~InferenceServer() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  queue_changed_.notify_all();
+
+  // Wakes accept() up with an error.
+  shutdown(listen_fd_, SHUT_RDWR);
+  accept_thread_.join();
+  close(listen_fd_);
+  unlink(options_.socket_path.c_str());
+
+  // The batcher drains the queue before exiting, so every admitted request
+  // is answered while its connection is still open.
+  batch_thread_.join();
+
+  // Only read side: the writers still send the queued responses, bounded by
+  // write_timeout_ms for clients that stopped reading.
+  std::lock_guard<std::mutex> lock(connections_mutex_);
+  for (const auto &connection : connections_) {
+    shutdown(connection->fd, SHUT_RD);
+  }
+  for (const auto &connection : connections_) {
+    connection->reader.join();
+    connection->writer.join();
+  }
+  connections_.clear();
+}
+
+ServerStats InferenceServer::stats() const {
+  ServerStats stats{.requests = requests_.load(std::memory_order_relaxed),
+                    .rejected = rejected_.load(std::memory_order_relaxed),
+                    .disconnected =
+                        disconnected_.load(std::memory_order_relaxed)};
+  for (int i = 0; i < options_.max_batch_size; ++i) {
+    const uint64_t batches =
+        batches_by_size_[i].load(std::memory_order_relaxed);
+    if (batches == 0) {
+      continue;
+    }
+    const Histogram &latency = latency_by_batch_size_[i];
+    stats.batches += batches;
+    stats.by_batch_size.push_back(
+        BatchLatency{.batch_size = i + 1,
+                     .batches = batches,
+                     .requests = latency.Count(),
+                     .p50_ms = latency.Quantile(0.5) * 1e-6,
+                     .p99_ms = latency.Quantile(0.99) * 1e-6});
+  }
+  return stats;
+}
+
+void InferenceServer::AcceptLoop() {
+  while (true) {
+    const int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      // Shut down by the destructor.
+      return;
+    }
+
+    // A blocked write fails with EAGAIN after the timeout, which
+    // disconnects the client.
+    const timeval timeout{.tv_sec = options_.write_timeout_ms / 1000,
+                          .tv_usec = options_.write_timeout_ms % 1000 * 1000};
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    auto connection = std::make_shared<Connection>(fd);
+    std::lock_guard<std::mutex> lock(connections_mutex_);
+    // Reap connections whose client went away, their sockets close once
+    // their last request is answered.
+    std::erase_if(connections_, [](const std::shared_ptr<Connection> &c) {
+      if (c->running.load(std::memory_order_acquire) > 0) {
+        return false;
+      }
+      c->reader.join();
+      c->writer.join();
+      return true;
+    });
+    connection->reader =
+        std::thread(&InferenceServer::ConnectionLoop, this, connection);
+    connection->writer =
+        std::thread(&InferenceServer::WriteLoop, this, connection);
+    connections_.push_back(std::move(connection));
+  }
+}
+
+void InferenceServer::ConnectionLoop(std::shared_ptr<Connection> connection) {
+  RequestHeader header;
+  while (ReadFully(connection->fd, &header, sizeof(header)).ok()) {
+    auto request = std::make_unique<Request>(connection);
+    request->request_id = header.request_id;
+
+    // Without a valid header the stream cannot be resynchronized.
+    const int64_t pixels = static_cast<int64_t>(header.rows) * header.cols;
+    if (header.magic != kRequestMagic || pixels > options_.max_image_pixels ||
+        std::max(header.rows, header.cols) > options_.max_image_pixels) {
+      request->received_ns = InferenceMetrics::NowNanos();
+      Respond(*request,
+              absl::InvalidArgumentError(absl::StrFormat(
+                  "bad request header or image larger than %d pixels",
+                  options_.max_image_pixels)),
+              0, 0, no_detections_);
+      break;
+    }
+
+    request->image.create(static_cast<int>(header.rows),
+                          static_cast<int>(header.cols), CV_8UC3);
+    if (!ReadFully(connection->fd, request->image.data,
+                   request->image.total() * request->image.elemSize())
+             .ok()) {
+      break;
+    }
+    request->received_ns = InferenceMetrics::NowNanos();
+    requests_.fetch_add(1, std::memory_order_relaxed);
+    if (request->image.empty()) {
+      Respond(*request, absl::InvalidArgumentError("empty image"), 0, 0,
+              no_detections_);
+      continue;
+    }
+    Admit(std::move(request));
+  }
+  {
+    std::lock_guard<std::mutex> lock(connection->mutex);
+    connection->reader_done = true;
+  }
+  connection->changed.notify_all();
+  connection->running.fetch_sub(1, std::memory_order_release);
+}
+
+void InferenceServer::WriteLoop(std::shared_ptr<Connection> connection) {
+  std::unique_lock<std::mutex> lock(connection->mutex);
+  while (true) {
+    connection->changed.wait(lock, [&] {
+      return connection->broken || !connection->responses.empty() ||
+             (connection->reader_done && connection->unanswered == 0);
+    });
+    if (connection->broken || connection->responses.empty()) {
+      break;
+    }
+    const std::string response = std::move(connection->responses.front());
+    connection->responses.pop_front();
+    lock.unlock();
+    const absl::Status status =
+        WriteFully(connection->fd, response.data(), response.size());
+    lock.lock();
+    connection->queued_bytes -= response.size();
+    // The client hung up or stopped reading for write_timeout_ms.
+    if (!status.ok()) {
+      Disconnect(*connection);
+      break;
+    }
+  }
+  lock.unlock();
+  connection->running.fetch_sub(1, std::memory_order_release);
+}
+
+void InferenceServer::Admit(std::unique_ptr<Request> request) {
+  absl::Status refused;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stopping_) {
+      refused = absl::UnavailableError("server is shutting down");
+    } else if (queue_.size() >=
+               static_cast<size_t>(options_.queue_capacity)) {
+      refused = absl::ResourceExhaustedError("server queue is full");
+    } else {
+      queue_.push_back(std::move(request));
+    }
+  }
+  if (refused.ok()) {
+    queue_changed_.notify_all();
+    return;
+  }
+  if (refused.code() == absl::StatusCode::kResourceExhausted) {
+    rejected_.fetch_add(1, std::memory_order_relaxed);
+  }
+  Respond(*request, refused, 0, 0, no_detections_);
+}
+
+void InferenceServer::BatchLoop() {
+  const size_t max_batch_size = static_cast<size_t>(options_.max_batch_size);
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      queue_changed_.wait(lock, [&] { return stopping_ || !queue_.empty(); });
+      if (queue_.empty()) {
+        return;
+      }
+      // The batch closes when full or when its oldest request has waited
+      // long enough, whichever comes first. Stopping flushes right away.
+      const auto deadline =
+          std::chrono::steady_clock::time_point(
+              std::chrono::nanoseconds(queue_.front()->received_ns)) +
+          std::chrono::microseconds(options_.max_batch_delay_us);
+      queue_changed_.wait_until(lock, deadline, [&] {
+        return stopping_ || queue_.size() >= max_batch_size;
+      });
+      const size_t count = std::min(queue_.size(), max_batch_size);
+      for (size_t i = 0; i < count; ++i) {
+        batch_.push_back(std::move(queue_.front()));
+        queue_.pop_front();
+      }
+    }
+
+    const int64_t now_ns = InferenceMetrics::NowNanos();
+    for (const auto &request : batch_) {
+      request->dequeued_ns = now_ns;
+    }
+    RunBatch(batch_);
+    batch_.clear();
+  }
+}
+
+void InferenceServer::RunBatch(
+    absl::Span<const std::unique_ptr<Request>> requests) {
+  const int batch_size = static_cast<int>(requests.size());
+  sources_.clear();
+  for (const auto &request : requests) {
+    sources_.push_back(request->image);
+  }
+
+  absl::Status status = engine_->Preprocess(sources_, &blob_, &image_info_);
+  if (!status.ok() && batch_size > 1) {
+    for (size_t i = 0; i < requests.size(); ++i) {
+      RunBatch(requests.subspan(i, 1));
+    }
+    return;
+  }
+  if (status.ok()) {
+    status = engine_->Forward(blob_, &network_output_);
+  }
+
+  // Stats are updated before responding, so a client that got its response
+  // finds its request counted.
+  batches_by_size_[batch_size - 1].fetch_add(1, std::memory_order_relaxed);
+  for (int i = 0; i < batch_size; ++i) {
+    const Request &request = *requests[i];
+    absl::Status result = status;
+    if (result.ok()) {
+      result = engine_->Postprocess(network_output_, i, image_info_[i],
+                                    &detections_);
+    }
+    latency_by_batch_size_[batch_size - 1].Record(
+        InferenceMetrics::NowNanos() - request.received_ns);
+    Respond(request, result, batch_size,
+            request.dequeued_ns - request.received_ns,
+            result.ok() ? detections_ : no_detections_);
+  }
+}
+
+void InferenceServer::Respond(const Request &request,
+                              const absl::Status &status, int batch_size,
+                              int64_t queue_ns,
+                              const DetectionBatch &detections) {
+  std::string response;
+  EncodeResponse(
+      ResponseHeader{
+          .status_code = static_cast<int32_t>(status.code()),
+          .request_id = request.request_id,
+          .batch_size = static_cast<uint32_t>(batch_size),
+          .queue_ns = queue_ns,
+          .latency_ns = InferenceMetrics::NowNanos() - request.received_ns},
+      status.message(), detections, &response);
+
+  Connection &connection = *request.connection;
+  {
+    std::lock_guard<std::mutex> lock(connection.mutex);
+    // A client that hung up simply misses its response.
+    if (connection.broken) {
+      return;
+    }
+    if (connection.queued_bytes + response.size() >
+        options_.max_queued_response_bytes) {
+      Disconnect(connection);
+      return;
+    }
+    connection.queued_bytes += response.size();
+    connection.responses.push_back(std::move(response));
+  }
+  connection.changed.notify_all();
+}
+
+void InferenceServer::Disconnect(Connection &connection) {
+  if (connection.broken) {
+    return;
+  }
+  connection.broken = true;
+  connection.responses.clear();
+  disconnected_.fetch_add(1, std::memory_order_relaxed);
+  // Wakes a blocked writer and the reader up, the socket itself closes with
+  // the last request holding the connection.
+  shutdown(connection.fd, SHUT_RDWR);
+  connection.changed.notify_all();
+}
+
+} // namespace inference
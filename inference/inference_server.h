@@ -0,0 +1,163 @@
+#ifndef INFERENCE_INFERENCE_SERVER_H_
+#define INFERENCE_INFERENCE_SERVER_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+#include "opencv2/core.hpp"
+
+#include "inference/detection_batch.h"
+#include "inference/image_info.h"
+#include "inference/inference_engine.h"
+#include "inference/inference_metrics.h"
+#include "inference/inference_params.h"
+
+namespace inference {
+
+struct ServerOptions {
+  // Path of the Unix domain socket to listen on.
+  std::string socket_path;
+  // Most requests coalesced into one forward pass.
+  int max_batch_size = 8;
+  // Longest the oldest queued request waits for others to fill its batch.
+  int64_t max_batch_delay_us = 2000;
+  // Requests admitted but not yet running. Requests beyond it are answered
+  // right away with ResourceExhaustedError.
+  int queue_capacity = 64;
+  // Largest image accepted, in pixels.
+  int64_t max_image_pixels = 3840 * 2160;
+  // Responses waiting to be written to one connection, in bytes. A client
+  // that falls this far behind is disconnected.
+  size_t max_queued_response_bytes = 1 << 20;
+  // Longest a write to a client may block before it is disconnected.
+  int write_timeout_ms = 10000;
+};
+
+// Request latency of the batches of one size.
+struct BatchLatency {
+  int batch_size = 0;
+  uint64_t batches = 0;
+  uint64_t requests = 0;
+  // From the request being received to its response being ready.
+  double p50_ms = 0.0;
+  double p99_ms = 0.0;
+};
+
+struct ServerStats {
+  uint64_t requests = 0;
+  // Refused because the admission queue was full.
+  uint64_t rejected = 0;
+  // Connections dropped because their client stopped reading responses or
+  // hung up before getting them.
+  uint64_t disconnected = 0;
+  uint64_t batches = 0;
+  // One entry per batch size that ran, smallest first.
+  std::vector<BatchLatency> by_batch_size;
+};
+
+// Serves an InferenceEngine to local processes over a Unix domain socket,
+// speaking the protocol in server_protocol.h (InferenceClient is the client
+// side).
+//
+// Every connection has a reader thread that admits its requests into a
+// bounded queue. A single batcher thread takes the oldest request, waits up
+// to max_batch_delay_us for more to arrive, and runs up to max_batch_size
+// of them, from any mix of connections and resolutions, through one forward
+// pass. Each image is letterboxed and unscaled with its own geometry.
+//
+// Responses never block the batcher: they are queued on the connection the
+// request came in on and sent by that connection's writer thread. A client
+// that stops reading is disconnected once its queue fills up or a write
+// times out, without holding up anyone else's responses.
+class InferenceServer {
+public:
+  static absl::StatusOr<std::unique_ptr<InferenceServer>>
+  Create(const InferenceParams &params, const ServerOptions &options);
+
+  // Stops accepting, answers every admitted request, then closes the
+  // connections and removes the socket.
+  ~InferenceServer();
+
+  InferenceServer(const InferenceServer &) = delete;
+  InferenceServer &operator=(const InferenceServer &) = delete;
+
+  // Thread-safe.
+  ServerStats stats() const;
+
+  const std::string &socket_path() const { return options_.socket_path; }
+
+private:
+  struct Connection;
+  struct Request;
+
+  InferenceServer(std::unique_ptr<InferenceEngine> engine,
+                  const ServerOptions &options, int listen_fd);
+
+  void AcceptLoop();
+  void ConnectionLoop(std::shared_ptr<Connection> connection);
+  void WriteLoop(std::shared_ptr<Connection> connection);
+  void BatchLoop();
+
+  // Queues `request`, or answers it right away if the queue is full or the
+  // server is stopping.
+  void Admit(std::unique_ptr<Request> request);
+
+  // Runs `requests` through one forward pass and answers them. If the batch
+  // fails to preprocess, its requests are retried one by one so a single
+  // bad image only fails its own request.
+  void RunBatch(absl::Span<const std::unique_ptr<Request>> requests);
+
+  // Queues the response to `request` on its connection.
+  void Respond(const Request &request, const absl::Status &status,
+               int batch_size, int64_t queue_ns,
+               const DetectionBatch &detections);
+
+  // Drops the queued responses of `connection` and shuts its socket down.
+  // Called with the connection's mutex held.
+  void Disconnect(Connection &connection);
+
+  std::unique_ptr<InferenceEngine> engine_;
+  const ServerOptions options_;
+  const int listen_fd_;
+
+  std::mutex mutex_;
+  std::condition_variable queue_changed_;
+  std::deque<std::unique_ptr<Request>> queue_;
+  bool stopping_ = false;
+
+  std::mutex connections_mutex_;
+  std::vector<std::shared_ptr<Connection>> connections_;
+
+  std::atomic<uint64_t> requests_{0};
+  std::atomic<uint64_t> rejected_{0};
+  std::atomic<uint64_t> disconnected_{0};
+  // Indexed by batch size - 1.
+  std::vector<Histogram> latency_by_batch_size_;
+  std::vector<std::atomic<uint64_t>> batches_by_size_;
+
+  // Scratch buffers of the batcher thread.
+  std::vector<std::unique_ptr<Request>> batch_;
+  std::vector<cv::Mat> sources_;
+  cv::Mat blob_;
+  std::vector<cv::Mat> network_output_;
+  std::vector<ImageInfo> image_info_;
+  DetectionBatch detections_;
+  DetectionBatch no_detections_;
+
+  std::thread batch_thread_;
+  std::thread accept_thread_;
+};
+
+} // namespace inference
+
+#endif
@@ -0,0 +1,289 @@
+#include <algorithm>
+#include <cmath>
+
+#include "absl/strings/str_format.h"
+#include "opencv2/imgproc.hpp"
+
+#include "inference/motion_gated_inference_engine.h"
+
+namespace inference {
+namespace {
+
+// Grows `rect` to at least `min_size`, around its center, and keeps it
+// inside `bounds`.
+cv::Rect GrowTo(const cv::Rect &rect, const cv::Size &min_size,
+                const cv::Rect &bounds) {
+  const int width =
+      std::min(std::max(rect.width, min_size.width), bounds.width);
+  const int height =
+      std::min(std::max(rect.height, min_size.height), bounds.height);
+  const int x = std::clamp(rect.x + (rect.width - width) / 2, bounds.x,
+                           bounds.x + bounds.width - width);
+  const int y = std::clamp(rect.y + (rect.height - height) / 2, bounds.y,
+                           bounds.y + bounds.height - height);
+  return cv::Rect(x, y, width, height);
+}
+
+// Replaces overlapping rects by their union until none overlap.
+void MergeOverlapping(std::vector<cv::Rect> *rects) {
+  bool merged = true;
+  while (merged) {
+    merged = false;
+    for (size_t i = 0; i < rects->size() && !merged; ++i) {
+      for (size_t j = i + 1; j < rects->size(); ++j) {
+        if (((*rects)[i] & (*rects)[j]).area() > 0) {
+          (*rects)[i] |= (*rects)[j];
+          rects->erase(rects->begin() + j);
+          merged = true;
+          break;
+        }
+      }
+    }
+  }
+}
+
+bool Intersects(const cv::Rect &box, const std::vector<cv::Rect> &rects) {
+  for (const cv::Rect &rect : rects) {
+    if ((box & rect).area() > 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+} // namespace
+
+absl::StatusOr<std::unique_ptr<MotionGatedInferenceEngine>>
+MotionGatedInferenceEngine::Create(const InferenceParams &params,
+                                   const MotionGateOptions &options) {
+  if (options.thumbnail_width <= 0 || options.refresh_interval <= 0 ||
+      options.max_regions <= 0 || options.region_margin < 0) {
+    return absl::InvalidArgumentError(
+        "thumbnail_width, refresh_interval and max_regions must be positive, "
+        "region_margin non-negative");
+  }
+  if (options.static_fraction < 0.0 ||
+      options.max_region_fraction < options.static_fraction) {
+    return absl::InvalidArgumentError(absl::StrFormat(
+        "need 0 <= static_fraction (%g) <= max_region_fraction (%g)",
+        options.static_fraction, options.max_region_fraction));
+  }
+
+  auto engine = InferenceEngine::Create(params);
+  if (!engine.ok()) {
+    return engine.status();
+  }
+
+  return std::unique_ptr<MotionGatedInferenceEngine>(
+      new MotionGatedInferenceEngine(std::move(*engine), params, options));
+}
+
+MotionGatedInferenceEngine::MotionGatedInferenceEngine(
+    std::unique_ptr<InferenceEngine> engine, const InferenceParams &params,
+    const MotionGateOptions &options)
+    : engine_(std::move(engine)), options_(options),
+      input_size_(params.input_image_width, params.input_image_height),
+      nms_options_{.iou_threshold = params.iou_threshold,
+                   .mode = params.nms_mode,
+                   .max_detections = params.max_detections,
+                   .spatial_bucketing = params.nms_spatial_bucketing} {}
+
+absl::StatusOr<std::vector<Detection>>
+MotionGatedInferenceEngine::RunInference(const cv::Mat &source) {
+  std::vector<Detection> detections;
+  auto status = RunInference(source, &detections);
+  if (!status.ok()) {
+    return status;
+  }
+  return detections;
+}
+
+absl::Status
+MotionGatedInferenceEngine::RunInference(const cv::Mat &source,
+                                         std::vector<Detection> *detections) {
+  if (source.empty() || source.type() != CV_8UC3) {
+    return absl::InvalidArgumentError("source must be a non-empty CV_8UC3");
+  }
+
+  MakeThumbnail(source);
+  const GateDecision decision = Classify(source.size());
+
+  absl::Status status;
+  switch (decision) {
+  case GateDecision::kFull:
+    status = RunFull(source);
+    ++stats_.full_frames;
+    break;
+  case GateDecision::kRegions:
+    status = RunRegions(source);
+    ++stats_.region_frames;
+    stats_.regions += static_cast<int64_t>(regions_.size());
+    break;
+  case GateDecision::kSkipped:
+    ++frames_since_full_;
+    ++stats_.skipped_frames;
+    break;
+  }
+  if (!status.ok()) {
+    // The reference may be half updated, start over on the next frame.
+    Reset();
+    return status;
+  }
+
+  last_decision_ = decision;
+  *detections = previous_;
+  return absl::OkStatus();
+}
+
+void MotionGatedInferenceEngine::Reset() {
+  reference_.release();
+  reference_source_size_ = cv::Size();
+  frames_since_full_ = 0;
+  previous_.clear();
+}
+
+void MotionGatedInferenceEngine::MakeThumbnail(const cv::Mat &source) {
+  const int width = std::min(options_.thumbnail_width, source.cols);
+  const int height = std::max(
+      1, static_cast<int>(std::lround(static_cast<double>(source.rows) *
+                                      width / source.cols)));
+  // Area averaging is what makes the thumbnail insensitive to pixel noise.
+  cv::resize(source, small_, cv::Size(width, height), 0, 0, cv::INTER_AREA);
+  cv::cvtColor(small_, thumbnail_, cv::COLOR_BGR2GRAY);
+}
+
+GateDecision MotionGatedInferenceEngine::Classify(const cv::Size &source_size) {
+  motion_.clear();
+  regions_.clear();
+  if (reference_.empty() || reference_source_size_ != source_size ||
+      frames_since_full_ + 1 >= options_.refresh_interval) {
+    return GateDecision::kFull;
+  }
+
+  cv::absdiff(thumbnail_, reference_, changed_);
+  cv::threshold(changed_, changed_, options_.pixel_threshold, 255,
+                cv::THRESH_BINARY);
+  const double fraction =
+      static_cast<double>(cv::countNonZero(changed_)) / changed_.total();
+  if (fraction < options_.static_fraction) {
+    return GateDecision::kSkipped;
+  }
+  if (fraction > options_.max_region_fraction) {
+    return GateDecision::kFull;
+  }
+
+  // Joins the fragments a moving object leaves in the difference.
+  cv::dilate(changed_, changed_, cv::Mat());
+  const int num_labels = cv::connectedComponentsWithStats(
+      changed_, labels_, component_stats_, centroids_, 8, CV_32S);
+
+  const double scale_x =
+      static_cast<double>(source_size.width) / thumbnail_.cols;
+  const double scale_y =
+      static_cast<double>(source_size.height) / thumbnail_.rows;
+  const cv::Rect bounds(cv::Point(0, 0), source_size);
+  for (int label = 1; label < num_labels; ++label) {
+    const int *stat = component_stats_.ptr<int>(label);
+    const int x0 = static_cast<int>(stat[cv::CC_STAT_LEFT] * scale_x);
+    const int y0 = static_cast<int>(stat[cv::CC_STAT_TOP] * scale_y);
+    const int x1 = static_cast<int>(std::ceil(
+        (stat[cv::CC_STAT_LEFT] + stat[cv::CC_STAT_WIDTH]) * scale_x));
+    const int y1 = static_cast<int>(std::ceil(
+        (stat[cv::CC_STAT_TOP] + stat[cv::CC_STAT_HEIGHT]) * scale_y));
+    const cv::Rect motion = cv::Rect(x0, y0, x1 - x0, y1 - y0) & bounds;
+    motion_.push_back(motion);
+
+    // Crops are at least the network input, so objects in them are
+    // inferred at native resolution rather than blown up.
+    const int margin = options_.region_margin;
+    const cv::Rect padded(motion.x - margin, motion.y - margin,
+                          motion.width + 2 * margin,
+                          motion.height + 2 * margin);
+    regions_.push_back(GrowTo(padded & bounds, input_size_, bounds));
+  }
+  MergeOverlapping(&regions_);
+
+  if (regions_.empty() ||
+      regions_.size() > static_cast<size_t>(options_.max_regions)) {
+    return GateDecision::kFull;
+  }
+  // Crops covering the frame anyway are cheaper as one letterbox.
+  int64_t region_area = 0;
+  for (const cv::Rect &region : regions_) {
+    region_area += region.area();
+  }
+  if (region_area >= bounds.area()) {
+    return GateDecision::kFull;
+  }
+  return GateDecision::kRegions;
+}
+
+absl::Status MotionGatedInferenceEngine::RunFull(const cv::Mat &source) {
+  auto status = engine_->RunInference(source, &previous_);
+  if (!status.ok()) {
+    return status;
+  }
+  thumbnail_.copyTo(reference_);
+  reference_source_size_ = source.size();
+  frames_since_full_ = 0;
+  return absl::OkStatus();
+}
+
+absl::Status MotionGatedInferenceEngine::RunRegions(const cv::Mat &source) {
+  crops_.clear();
+  for (const cv::Rect &region : regions_) {
+    crops_.push_back(source(region));
+  }
+
+  auto status = engine_->Preprocess(crops_, &blob_, &crop_info_);
+  if (!status.ok()) {
+    return status;
+  }
+  status = engine_->Forward(blob_, &network_output_);
+  if (!status.ok()) {
+    return status;
+  }
+
+  // Detections away from the motion still hold. Those it touches are
+  // replaced by the crops' detections, and NMS settles objects seen both
+  // by a crop and, cut at the crop border, in the previous frame.
+  candidates_.clear();
+  for (const Detection &det : previous_) {
+    if (!Intersects(det.bbox, motion_)) {
+      candidates_.push_back(det);
+    }
+  }
+  for (size_t i = 0; i < crops_.size(); ++i) {
+    status = engine_->Postprocess(network_output_, static_cast<int>(i),
+                                  crop_info_[i], &region_batch_);
+    if (!status.ok()) {
+      return status;
+    }
+    region_batch_.ToDetections(&region_detections_);
+    for (Detection &det : region_detections_) {
+      det.bbox += regions_[i].tl();
+      candidates_.push_back(det);
+    }
+  }
+  NonMaxSuppression::Apply(candidates_, nms_options_, &nms_workspace_,
+                           &previous_);
+
+  // The inferred areas become the new reference, shrunk to whole thumbnail
+  // pixels inside them.
+  const double scale_x = static_cast<double>(source.cols) / thumbnail_.cols;
+  const double scale_y = static_cast<double>(source.rows) / thumbnail_.rows;
+  for (const cv::Rect &region : regions_) {
+    const int x0 = static_cast<int>(std::ceil(region.x / scale_x));
+    const int y0 = static_cast<int>(std::ceil(region.y / scale_y));
+    const int x1 = static_cast<int>(region.br().x / scale_x);
+    const int y1 = static_cast<int>(region.br().y / scale_y);
+    if (x1 > x0 && y1 > y0) {
+      const cv::Rect area(x0, y0, x1 - x0, y1 - y0);
+      thumbnail_(area).copyTo(reference_(area));
+    }
+  }
+  ++frames_since_full_;
+  return absl::OkStatus();
+}
+
+} // namespace inference
@@ -0,0 +1,145 @@
+#ifndef INFERENCE_MOTION_GATED_INFERENCE_ENGINE_H_
+#define INFERENCE_MOTION_GATED_INFERENCE_ENGINE_H_
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "opencv2/core.hpp"
+
+#include "inference/detection.h"
+#include "inference/detection_batch.h"
+#include "inference/image_info.h"
+#include "inference/inference_engine.h"
+#include "inference/inference_params.h"
+#include "inference/non_max_suppression.h"
+
+namespace inference {
+
+struct MotionGateOptions {
+  // Width of the grayscale thumbnail frames are compared on. The height
+  // follows the source aspect ratio.
+  int thumbnail_width = 160;
+  // Absolute thumbnail difference, in 8-bit gray levels, above which a
+  // pixel counts as changed. Keeps sensor noise and compression artifacts
+  // out of the score.
+  int pixel_threshold = 24;
+  // Fraction of changed thumbnail pixels below which the frame is static
+  // and the previous detections are returned.
+  double static_fraction = 0.002;
+  // Fraction above which the change is not local anymore and the whole
+  // frame is inferred.
+  double max_region_fraction = 0.25;
+  // Changed regions beyond this many run as a full frame instead.
+  int max_regions = 4;
+  // Source pixels added around each changed region, so objects partially
+  // inside it are seen whole.
+  int region_margin = 32;
+  // Run the full frame at least every this many frames, whatever the
+  // motion, so slow drift and missed objects are corrected. 1 disables
+  // gating.
+  int refresh_interval = 30;
+};
+
+// How a frame was handled.
+enum class GateDecision {
+  // The full frame went through the network.
+  kFull,
+  // Only the changed regions did, merged with the previous detections.
+  kRegions,
+  // Nothing changed, the previous detections were returned.
+  kSkipped,
+};
+
+struct MotionGateStats {
+  int64_t full_frames = 0;
+  int64_t region_frames = 0;
+  int64_t skipped_frames = 0;
+  // Regions inferred across all region frames.
+  int64_t regions = 0;
+};
+
+// Stateful detector for fixed cameras, where consecutive frames mostly
+// don't change. Before inference, every frame is compared to the last
+// inferred one on a small grayscale thumbnail. A static frame reuses the
+// previous detections, a frame with localized change runs the network only
+// on crops around the changed regions, batched in one forward pass, and
+// anything else runs the full frame. A full refresh is forced every
+// refresh_interval frames.
+//
+// Frames must come from a single stream, in order. Not thread-safe.
+class MotionGatedInferenceEngine {
+public:
+  static absl::StatusOr<std::unique_ptr<MotionGatedInferenceEngine>>
+  Create(const InferenceParams &params, const MotionGateOptions &options);
+
+  absl::StatusOr<std::vector<Detection>> RunInference(const cv::Mat &source);
+
+  // Same as above, but overwrites `detections`. Buffers are reused across
+  // frames of the same size.
+  absl::Status RunInference(const cv::Mat &source,
+                            std::vector<Detection> *detections);
+
+  // Forgets the previous frame, the next one runs in full. For a new scene
+  // or after a seek.
+  void Reset();
+
+  GateDecision last_decision() const { return last_decision_; }
+  const MotionGateStats &stats() const { return stats_; }
+
+  InferenceEngine &engine() const { return *engine_; }
+
+private:
+  MotionGatedInferenceEngine(std::unique_ptr<InferenceEngine> engine,
+                             const InferenceParams &params,
+                             const MotionGateOptions &options);
+
+  // Shrinks `source` to the gray thumbnail_.
+  void MakeThumbnail(const cv::Mat &source);
+
+  // Compares thumbnail_ with reference_ and fills regions_ with the changed
+  // areas in source coordinates, margin included. Returns the decision.
+  GateDecision Classify(const cv::Size &source_size);
+
+  absl::Status RunFull(const cv::Mat &source);
+  absl::Status RunRegions(const cv::Mat &source);
+
+  std::unique_ptr<InferenceEngine> engine_;
+  const MotionGateOptions options_;
+  const cv::Size input_size_;
+  NmsOptions nms_options_;
+
+  // Thumbnail of the last inferred frame, regions refreshed as they are
+  // inferred, so slow change accumulates until it is noticed.
+  cv::Mat reference_;
+  cv::Size reference_source_size_;
+  int frames_since_full_ = 0;
+  std::vector<Detection> previous_;
+
+  cv::Mat thumbnail_;
+  cv::Mat small_;
+  cv::Mat changed_;
+  cv::Mat labels_;
+  cv::Mat component_stats_;
+  cv::Mat centroids_;
+  // Changed areas before and after adding the margin, source coordinates.
+  std::vector<cv::Rect> motion_;
+  std::vector<cv::Rect> regions_;
+  std::vector<cv::Mat> crops_;
+  cv::Mat blob_;
+  std::vector<ImageInfo> crop_info_;
+  std::vector<cv::Mat> network_output_;
+  DetectionBatch region_batch_;
+  std::vector<Detection> region_detections_;
+  std::vector<Detection> candidates_;
+  NmsWorkspace nms_workspace_;
+
+  GateDecision last_decision_ = GateDecision::kFull;
+  MotionGateStats stats_;
+};
+
+} // namespace inference
+
+#endif
@@ -0,0 +1,522 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "absl/strings/str_format.h"
+
+#include "inference/multi_object_tracker.h"
+#include "inference/non_max_suppression.h"
+
+namespace inference {
+namespace {
+
+enum AxisIndex { kCenterX = 0, kCenterY = 1, kWidth = 2, kHeight = 3 };
+
+// Cost of pairs below the IoU threshold. Larger than any real cost, 1 - IoU,
+// so the solver only picks them when a row has nothing else, and those
+// assignments are discarded.
+constexpr double kNoMatchCost = 1e6;
+
+int Find(std::vector<int> &parent, int node) {
+  while (parent[node] != node) {
+    parent[node] = parent[parent[node]];
+    node = parent[node];
+  }
+  return node;
+}
+
+} // namespace
+
+absl::StatusOr<std::unique_ptr<MultiObjectTracker>>
+MultiObjectTracker::Create(const TrackerOptions &options) {
+  if (options.max_tracks <= 0 || options.min_hits <= 0 ||
+      options.max_misses < 0) {
+    return absl::InvalidArgumentError(
+        "max_tracks and min_hits must be positive, max_misses non-negative");
+  }
+  if (options.low_confidence > options.high_confidence) {
+    return absl::InvalidArgumentError(absl::StrFormat(
+        "low_confidence %g is above high_confidence %g",
+        options.low_confidence, options.high_confidence));
+  }
+  if (options.match_iou <= 0.0f || options.match_iou > 1.0f) {
+    return absl::InvalidArgumentError(
+        absl::StrFormat("match_iou %g must be in (0, 1]", options.match_iou));
+  }
+  return std::unique_ptr<MultiObjectTracker>(new MultiObjectTracker(options));
+}
+
+MultiObjectTracker::MultiObjectTracker(const TrackerOptions &options)
+    : options_(options) {
+  const size_t capacity = static_cast<size_t>(options.max_tracks);
+  for (Axis &axis : axes_) {
+    axis.value.resize(capacity);
+    axis.velocity.resize(capacity);
+    axis.p00.resize(capacity);
+    axis.p01.resize(capacity);
+    axis.p11.resize(capacity);
+  }
+  ids_.resize(capacity);
+  class_ids_.resize(capacity);
+  confidences_.resize(capacity);
+  hits_.resize(capacity);
+  misses_.resize(capacity);
+  frames_since_update_.resize(capacity);
+  predicted_.resize(capacity);
+  track_matched_.resize(capacity);
+  unmatched_tracks_.reserve(capacity);
+  recent_tracks_.reserve(capacity);
+}
+
+void MultiObjectTracker::Update(const std::vector<Detection> &detections,
+                                std::vector<TrackedObject> *tracks) {
+  PredictAll();
+  for (int t = 0; t < num_tracks_; ++t) {
+    predicted_[t] = TrackBox(t);
+    track_matched_[t] = 0;
+  }
+  detection_matched_.assign(detections.size(), 0);
+
+  high_.clear();
+  low_.clear();
+  for (size_t i = 0; i < detections.size(); ++i) {
+    const float confidence = detections[i].confidence;
+    if (confidence >= options_.high_confidence) {
+      high_.push_back(static_cast<int>(i));
+    } else if (confidence >= options_.low_confidence) {
+      low_.push_back(static_cast<int>(i));
+    }
+  }
+
+  // Confident detections go first, against every track, lost ones
+  // included so objects reappearing after an occlusion keep their id.
+  unmatched_tracks_.clear();
+  for (int t = 0; t < num_tracks_; ++t) {
+    unmatched_tracks_.push_back(t);
+  }
+  Associate(detections, &high_, &unmatched_tracks_);
+
+  // Weak detections only extend tracks that were matched on the previous
+  // detector frame. They are mostly partially occluded objects.
+  recent_tracks_.clear();
+  for (int t : unmatched_tracks_) {
+    if (misses_[t] == 0) {
+      recent_tracks_.push_back(t);
+    }
+  }
+  Associate(detections, &low_, &recent_tracks_);
+
+  // Back to front, removal moves the last track into the freed slot.
+  for (int t = num_tracks_ - 1; t >= 0; --t) {
+    if (track_matched_[t]) {
+      continue;
+    }
+    ++misses_[t];
+    const bool tentative = hits_[t] < options_.min_hits;
+    if (tentative || misses_[t] > options_.max_misses) {
+      RemoveTrack(t);
+    }
+  }
+
+  for (int d : high_) {
+    StartTrack(detections[d]);
+  }
+  first_update_ = false;
+
+  Report(tracks);
+}
+
+void MultiObjectTracker::Predict(std::vector<TrackedObject> *tracks) {
+  PredictAll();
+  Report(tracks);
+}
+
+void MultiObjectTracker::Reset() {
+  num_tracks_ = 0;
+  first_update_ = true;
+}
+
+void MultiObjectTracker::PredictAll() {
+  const float q_position = options_.position_noise * options_.position_noise;
+  const float q_velocity = options_.velocity_noise * options_.velocity_noise;
+  const float *height = axes_[kHeight].value.data();
+
+  // Height last, the noise of every axis scales with its value before the
+  // prediction.
+  for (Axis &axis : axes_) {
+    float *value = axis.value.data();
+    const float *velocity = axis.velocity.data();
+    float *p00 = axis.p00.data();
+    float *p01 = axis.p01.data();
+    float *p11 = axis.p11.data();
+    for (int t = 0; t < num_tracks_; ++t) {
+      const float h2 = height[t] * height[t];
+      value[t] += velocity[t];
+      p00[t] += 2.0f * p01[t] + p11[t] + q_position * h2;
+      p01[t] += p11[t];
+      p11[t] += q_velocity * h2;
+    }
+  }
+  for (int t = 0; t < num_tracks_; ++t) {
+    ++frames_since_update_[t];
+  }
+}
+
+void MultiObjectTracker::Correct(int track, const Detection &detection) {
+  const float measurement[4] = {
+      detection.bbox.x + 0.5f * detection.bbox.width,
+      detection.bbox.y + 0.5f * detection.bbox.height,
+      static_cast<float>(detection.bbox.width),
+      static_cast<float>(detection.bbox.height)};
+  const float height = axes_[kHeight].value[track];
+  const float r = options_.measurement_noise * options_.measurement_noise *
+                  height * height;
+
+  for (int a = 0; a < 4; ++a) {
+    Axis &axis = axes_[a];
+    const float p00 = axis.p00[track];
+    const float p01 = axis.p01[track];
+    const float s = p00 + r;
+    const float k0 = p00 / s;
+    const float k1 = p01 / s;
+    const float innovation = measurement[a] - axis.value[track];
+    axis.value[track] += k0 * innovation;
+    axis.velocity[track] += k1 * innovation;
+    axis.p00[track] = (1.0f - k0) * p00;
+    axis.p01[track] = (1.0f - k0) * p01;
+    axis.p11[track] -= k1 * p01;
+  }
+
+  class_ids_[track] = detection.class_id;
+  confidences_[track] = detection.confidence;
+  ++hits_[track];
+  misses_[track] = 0;
+  frames_since_update_[track] = 0;
+}
+
+int MultiObjectTracker::StartTrack(const Detection &detection) {
+  if (num_tracks_ >= options_.max_tracks) {
+    return -1;
+  }
+
+  const int t = num_tracks_++;
+  const float measurement[4] = {
+      detection.bbox.x + 0.5f * detection.bbox.width,
+      detection.bbox.y + 0.5f * detection.bbox.height,
+      static_cast<float>(detection.bbox.width),
+      static_cast<float>(detection.bbox.height)};
+  const float height = std::max(1.0f, measurement[kHeight]);
+  const float position_std = 2.0f * options_.position_noise * height;
+  const float velocity_std = 10.0f * options_.velocity_noise * height;
+  for (int a = 0; a < 4; ++a) {
+    axes_[a].value[t] = measurement[a];
+    axes_[a].velocity[t] = 0.0f;
+    axes_[a].p00[t] = position_std * position_std;
+    axes_[a].p01[t] = 0.0f;
+    axes_[a].p11[t] = velocity_std * velocity_std;
+  }
+
+  ids_[t] = next_id_++;
+  class_ids_[t] = detection.class_id;
+  confidences_[t] = detection.confidence;
+  hits_[t] = first_update_ ? options_.min_hits : 1;
+  misses_[t] = 0;
+  frames_since_update_[t] = 0;
+  return t;
+}
+
+void MultiObjectTracker::RemoveTrack(int track) {
+  const int last = --num_tracks_;
+  if (track == last) {
+    return;
+  }
+  for (Axis &axis : axes_) {
+    axis.value[track] = axis.value[last];
+    axis.velocity[track] = axis.velocity[last];
+    axis.p00[track] = axis.p00[last];
+    axis.p01[track] = axis.p01[last];
+    axis.p11[track] = axis.p11[last];
+  }
+  ids_[track] = ids_[last];
+  class_ids_[track] = class_ids_[last];
+  confidences_[track] = confidences_[last];
+  hits_[track] = hits_[last];
+  misses_[track] = misses_[last];
+  frames_since_update_[track] = frames_since_update_[last];
+  predicted_[track] = predicted_[last];
+  track_matched_[track] = track_matched_[last];
+}
+
+cv::Rect MultiObjectTracker::TrackBox(int track) const {
+  const float width = std::max(1.0f, axes_[kWidth].value[track]);
+  const float height = std::max(1.0f, axes_[kHeight].value[track]);
+  return cv::Rect(
+      static_cast<int>(std::lround(axes_[kCenterX].value[track] - width / 2)),
+      static_cast<int>(std::lround(axes_[kCenterY].value[track] - height / 2)),
+      static_cast<int>(std::lround(width)),
+      static_cast<int>(std::lround(height)));
+}
+
+void MultiObjectTracker::Report(std::vector<TrackedObject> *tracks) const {
+  tracks->clear();
+  for (int t = 0; t < num_tracks_; ++t) {
+    if (hits_[t] < options_.min_hits || misses_[t] > 0) {
+      continue;
+    }
+    tracks->push_back(
+        TrackedObject{.track_id = ids_[t],
+                      .detection = Detection{.class_id = class_ids_[t],
+                                             .confidence = confidences_[t],
+                                             .bbox = TrackBox(t)},
+                      .frames_since_update = frames_since_update_[t]});
+  }
+}
+
+void MultiObjectTracker::Associate(const std::vector<Detection> &detections,
+                                   std::vector<int> *detection_indices,
+                                   std::vector<int> *track_indices) {
+  const int num_rows = static_cast<int>(track_indices->size());
+  const int num_cols = static_cast<int>(detection_indices->size());
+  if (num_rows == 0 || num_cols == 0) {
+    return;
+  }
+
+  // Gated pairs. Rows are positions in track_indices, columns positions in
+  // detection_indices. Columns are sorted by x with their boxes copied into
+  // struct-of-arrays form, so each track only sweeps the contiguous run of
+  // detections whose x range can overlap its own.
+  columns_by_x_.resize(num_cols);
+  for (int col = 0; col < num_cols; ++col) {
+    columns_by_x_[col] = col;
+  }
+  auto column_box = [&](int col) -> const cv::Rect & {
+    return detections[(*detection_indices)[col]].bbox;
+  };
+  std::sort(columns_by_x_.begin(), columns_by_x_.end(),
+            [&](int a, int b) { return column_box(a).x < column_box(b).x; });
+  sorted_x1_.resize(num_cols);
+  sorted_y1_.resize(num_cols);
+  sorted_x2_.resize(num_cols);
+  sorted_y2_.resize(num_cols);
+  sorted_class_.resize(num_cols);
+  int max_width = 0;
+  for (int k = 0; k < num_cols; ++k) {
+    const Detection &det = detections[(*detection_indices)[columns_by_x_[k]]];
+    sorted_x1_[k] = det.bbox.x;
+    sorted_y1_[k] = det.bbox.y;
+    sorted_x2_[k] = det.bbox.x + det.bbox.width;
+    sorted_y2_[k] = det.bbox.y + det.bbox.height;
+    sorted_class_[k] = det.class_id;
+    max_width = std::max(max_width, det.bbox.width);
+  }
+
+  const int *x1s = sorted_x1_.data();
+  const int *y1s = sorted_y1_.data();
+  const int *x2s = sorted_x2_.data();
+  const int *y2s = sorted_y2_.data();
+  const int *classes = sorted_class_.data();
+  pairs_.clear();
+  for (int row = 0; row < num_rows; ++row) {
+    const int t = (*track_indices)[row];
+    const cv::Rect &predicted = predicted_[t];
+    const int x1 = predicted.x;
+    const int y1 = predicted.y;
+    const int x2 = predicted.x + predicted.width;
+    const int y2 = predicted.y + predicted.height;
+    const int first = static_cast<int>(
+        std::upper_bound(x1s, x1s + num_cols, x1 - max_width) - x1s);
+    const int class_id = class_ids_[t];
+    const bool class_aware = options_.class_aware;
+    for (int k = first; k < num_cols && x1s[k] < x2; ++k) {
+      // Most candidates fail one of these at random, evaluated without
+      // branches the loop doesn't stall on mispredictions.
+      const bool overlaps = (x2s[k] > x1) & (y1s[k] < y2) & (y2s[k] > y1) &
+                            (!class_aware | (classes[k] == class_id));
+      if (!overlaps) {
+        continue;
+      }
+      const int col = columns_by_x_[k];
+      const Detection &det = detections[(*detection_indices)[col]];
+      const float iou = NonMaxSuppression::IoU(predicted, det.bbox);
+      if (iou >= options_.match_iou) {
+        pairs_.push_back(Pair{.track = row, .detection = col, .iou = iou});
+      }
+    }
+  }
+  if (pairs_.empty()) {
+    return;
+  }
+
+  // Connected components of the bipartite graph of gated pairs, rows are
+  // nodes [0, num_rows), columns follow.
+  const int num_nodes = num_rows + num_cols;
+  parent_.resize(num_nodes);
+  for (int i = 0; i < num_nodes; ++i) {
+    parent_[i] = i;
+  }
+  for (const Pair &pair : pairs_) {
+    const int a = Find(parent_, pair.track);
+    const int b = Find(parent_, num_rows + pair.detection);
+    if (a != b) {
+      parent_[std::max(a, b)] = std::min(a, b);
+    }
+  }
+  for (int i = 0; i < num_nodes; ++i) {
+    parent_[i] = Find(parent_, i);
+  }
+
+  // Counting sort of the nodes and of the pairs by component root, so each
+  // component is a contiguous range of both.
+  component_offsets_.assign(num_nodes + 1, 0);
+  pair_offsets_.assign(num_nodes + 1, 0);
+  for (int i = 0; i < num_nodes; ++i) {
+    ++component_offsets_[parent_[i] + 1];
+  }
+  for (const Pair &pair : pairs_) {
+    ++pair_offsets_[parent_[pair.track] + 1];
+  }
+  for (int i = 0; i < num_nodes; ++i) {
+    component_offsets_[i + 1] += component_offsets_[i];
+    pair_offsets_[i + 1] += pair_offsets_[i];
+  }
+  // local_index_ and fill_ are the fill cursors for now.
+  nodes_by_component_.resize(num_nodes);
+  local_index_.assign(component_offsets_.begin(), component_offsets_.end() - 1);
+  for (int i = 0; i < num_nodes; ++i) {
+    nodes_by_component_[local_index_[parent_[i]]++] = i;
+  }
+  sorted_pairs_.resize(pairs_.size());
+  fill_.assign(pair_offsets_.begin(), pair_offsets_.end() - 1);
+  for (const Pair &pair : pairs_) {
+    sorted_pairs_[fill_[parent_[pair.track]]++] = pair;
+  }
+
+  for (int root = 0; root < num_nodes; ++root) {
+    const int pair_begin = pair_offsets_[root];
+    const int pair_end = pair_offsets_[root + 1];
+    if (pair_begin == pair_end) {
+      continue;
+    }
+    if (pair_end - pair_begin == 1) {
+      // A lone pair, by far the common case for well separated objects.
+      const Pair &pair = sorted_pairs_[pair_begin];
+      const int t = (*track_indices)[pair.track];
+      const int d = (*detection_indices)[pair.detection];
+      Correct(t, detections[d]);
+      track_matched_[t] = 1;
+      detection_matched_[d] = 1;
+      continue;
+    }
+
+    component_rows_.clear();
+    component_cols_.clear();
+    for (int k = component_offsets_[root]; k < component_offsets_[root + 1];
+         ++k) {
+      const int node = nodes_by_component_[k];
+      if (node < num_rows) {
+        local_index_[node] = static_cast<int>(component_rows_.size());
+        component_rows_.push_back(node);
+      } else {
+        local_index_[node] = static_cast<int>(component_cols_.size());
+        component_cols_.push_back(node - num_rows);
+      }
+    }
+
+    // The solver wants no more rows than columns.
+    const int rows = static_cast<int>(component_rows_.size());
+    const int cols = static_cast<int>(component_cols_.size());
+    const bool transposed = rows > cols;
+    const int n = transposed ? cols : rows;
+    const int m = transposed ? rows : cols;
+    cost_.assign(static_cast<size_t>(n) * m, kNoMatchCost);
+    for (int p = pair_begin; p < pair_end; ++p) {
+      const Pair &pair = sorted_pairs_[p];
+      const int r = local_index_[pair.track];
+      const int c = local_index_[num_rows + pair.detection];
+      const size_t index = transposed ? static_cast<size_t>(c) * m + r
+                                      : static_cast<size_t>(r) * m + c;
+      cost_[index] = 1.0 - pair.iou;
+    }
+    SolveAssignment(n, m);
+
+    for (int i = 0; i < n; ++i) {
+      const int j = row_match_[i];
+      if (j < 0 || cost_[static_cast<size_t>(i) * m + j] >= kNoMatchCost) {
+        continue;
+      }
+      const int r = transposed ? j : i;
+      const int c = transposed ? i : j;
+      const int t = (*track_indices)[component_rows_[r]];
+      const int d = (*detection_indices)[component_cols_[c]];
+      Correct(t, detections[d]);
+      track_matched_[t] = 1;
+      detection_matched_[d] = 1;
+    }
+  }
+
+  std::erase_if(*track_indices, [this](int t) { return track_matched_[t]; });
+  std::erase_if(*detection_indices,
+                [this](int d) { return detection_matched_[d]; });
+}
+
+void MultiObjectTracker::SolveAssignment(int rows, int cols) {
+  // Hungarian algorithm with potentials, O(rows^2 * cols), on cost_ with
+  // rows <= cols. Indices are 1-based, column 0 is a sentinel.
+  constexpr double kInfinity = std::numeric_limits<double>::infinity();
+  potential_u_.assign(rows + 1, 0.0);
+  potential_v_.assign(cols + 1, 0.0);
+  column_owner_.assign(cols + 1, 0);
+  way_.assign(cols + 1, 0);
+
+  for (int i = 1; i <= rows; ++i) {
+    column_owner_[0] = i;
+    int j0 = 0;
+    min_slack_.assign(cols + 1, kInfinity);
+    used_.assign(cols + 1, 0);
+    do {
+      used_[j0] = 1;
+      const int i0 = column_owner_[j0];
+      const double *cost_row = &cost_[static_cast<size_t>(i0 - 1) * cols];
+      double delta = kInfinity;
+      int j1 = 0;
+      for (int j = 1; j <= cols; ++j) {
+        if (used_[j]) {
+          continue;
+        }
+        const double slack =
+            cost_row[j - 1] - potential_u_[i0] - potential_v_[j];
+        if (slack < min_slack_[j]) {
+          min_slack_[j] = slack;
+          way_[j] = j0;
+        }
+        if (min_slack_[j] < delta) {
+          delta = min_slack_[j];
+          j1 = j;
+        }
+      }
+      for (int j = 0; j <= cols; ++j) {
+        if (used_[j]) {
+          potential_u_[column_owner_[j]] += delta;
+          potential_v_[j] -= delta;
+        } else {
+          min_slack_[j] -= delta;
+        }
+      }
+      j0 = j1;
+    } while (column_owner_[j0] != 0);
+    do {
+      const int j1 = way_[j0];
+      column_owner_[j0] = column_owner_[j1];
+      j0 = j1;
+    } while (j0 != 0);
+  }
+
+  row_match_.assign(rows, -1);
+  for (int j = 1; j <= cols; ++j) {
+    if (column_owner_[j] != 0) {
+      row_match_[column_owner_[j] - 1] = j - 1;
+    }
+  }
+}
+
+} // namespace inference
@@ -0,0 +1,180 @@
+#ifndef INFERENCE_MULTI_OBJECT_TRACKER_H_
+#define INFERENCE_MULTI_OBJECT_TRACKER_H_
+
+#include <memory>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "opencv2/core.hpp"
+
+#include "inference/detection.h"
+
+namespace inference {
+
+struct TrackerOptions {
+  // Detections at or above this confidence are associated first and may
+  // start new tracks. Those between low_confidence and this only extend
+  // existing tracks, which keeps occluded objects tracked (ByteTrack).
+  float high_confidence = 0.5f;
+  float low_confidence = 0.1f;
+  // Minimum IoU between a predicted track box and a detection to match.
+  float match_iou = 0.3f;
+  // Tracks only match detections of their own class.
+  bool class_aware = true;
+  // Matches needed before a new track is reported.
+  int min_hits = 3;
+  // Detector frames a track survives without a match.
+  int max_misses = 30;
+  // Capacity of the preallocated track state. New tracks beyond it are not
+  // started.
+  int max_tracks = 1024;
+  // Kalman filter noise, as standard deviations relative to the box height
+  // per frame, with the ByteTrack defaults.
+  float position_noise = 1.0f / 20.0f;
+  float velocity_noise = 1.0f / 160.0f;
+  float measurement_noise = 1.0f / 20.0f;
+};
+
+// A track reported by MultiObjectTracker.
+struct TrackedObject {
+  // Unique per tracker, never reused.
+  int track_id;
+  // Filtered box, class, and confidence of the last matched detection.
+  Detection detection;
+  // Frames since the track last matched a detection, counting frames the
+  // tracker only predicted.
+  int frames_since_update;
+};
+
+// SORT/ByteTrack style multi-object tracker on top of Detection.
+//
+// Every track runs a constant velocity Kalman filter over its box center,
+// width and height. With the noise scaled per axis, the 8-dimensional
+// filter separates into four independent position/velocity filters, so the
+// state of all tracks is kept in struct-of-arrays form, preallocated for
+// max_tracks, and predicted in one vectorizable pass.
+//
+// Detections are associated to predicted boxes by IoU with the Hungarian
+// algorithm. Only pairs above match_iou can match, so the cost matrix is
+// split into connected components first and each is solved on its own,
+// which keeps the update in the microseconds for hundreds of sparse tracks.
+//
+// Not thread-safe.
+class MultiObjectTracker {
+public:
+  static absl::StatusOr<std::unique_ptr<MultiObjectTracker>>
+  Create(const TrackerOptions &options);
+
+  // Advances every track one frame and associates `detections` of that
+  // frame with them. Overwrites `tracks` with the confirmed tracks matched
+  // in this frame. Allocates nothing once buffers have grown to the
+  // detection count.
+  void Update(const std::vector<Detection> &detections,
+              std::vector<TrackedObject> *tracks);
+
+  // Advances every track one frame without detections, for frames the
+  // detector skipped. Overwrites `tracks` with the predicted boxes of the
+  // confirmed tracks that matched in the last detector frame.
+  void Predict(std::vector<TrackedObject> *tracks);
+
+  // Drops every track. Ids keep counting.
+  void Reset();
+
+  // Live tracks, tentative and lost ones included.
+  int NumTracks() const { return num_tracks_; }
+
+private:
+  explicit MultiObjectTracker(const TrackerOptions &options);
+
+  // Moves every track one frame forward.
+  void PredictAll();
+
+  // Matches the detections at `detection_indices` with the tracks at
+  // `track_indices`, both compacted to the unmatched ones on return, and
+  // corrects matched tracks.
+  void Associate(const std::vector<Detection> &detections,
+                 std::vector<int> *detection_indices,
+                 std::vector<int> *track_indices);
+
+  // Solves the assignment of the dense component in cost_, rows x cols,
+  // into row_match_.
+  void SolveAssignment(int rows, int cols);
+
+  void Correct(int track, const Detection &detection);
+  int StartTrack(const Detection &detection);
+  void RemoveTrack(int track);
+  cv::Rect TrackBox(int track) const;
+  void Report(std::vector<TrackedObject> *tracks) const;
+
+  const TrackerOptions options_;
+  int next_id_ = 1;
+  int num_tracks_ = 0;
+  // Tracks started on the first frame are confirmed right away, there is
+  // nothing they could be confused with yet.
+  bool first_update_ = true;
+
+  // Track state, struct-of-arrays, max_tracks long, live tracks first.
+  // Filter axes are center x, center y, width and height; `p00`, `p01` and
+  // `p11` are the position/velocity covariance of each axis.
+  struct Axis {
+    std::vector<float> value;
+    std::vector<float> velocity;
+    std::vector<float> p00;
+    std::vector<float> p01;
+    std::vector<float> p11;
+  };
+  Axis axes_[4];
+  std::vector<int> ids_;
+  std::vector<int> class_ids_;
+  std::vector<float> confidences_;
+  std::vector<int> hits_;
+  std::vector<int> misses_;
+  std::vector<int> frames_since_update_;
+
+  // Association scratch.
+  std::vector<int> high_;
+  std::vector<int> low_;
+  std::vector<int> unmatched_tracks_;
+  std::vector<int> recent_tracks_;
+  std::vector<cv::Rect> predicted_;
+  // Detection columns sorted by left edge, and their boxes and classes in
+  // that order.
+  std::vector<int> columns_by_x_;
+  std::vector<int> sorted_x1_;
+  std::vector<int> sorted_y1_;
+  std::vector<int> sorted_x2_;
+  std::vector<int> sorted_y2_;
+  std::vector<int> sorted_class_;
+  // Candidate pairs above match_iou, as track, detection and IoU.
+  struct Pair {
+    int track;
+    int detection;
+    float iou;
+  };
+  std::vector<Pair> pairs_;
+  // Union-find over tracks and detections, then the nodes and pairs grouped
+  // by component, and each node's row or column in its component.
+  std::vector<int> parent_;
+  std::vector<int> component_offsets_;
+  std::vector<int> nodes_by_component_;
+  std::vector<int> pair_offsets_;
+  std::vector<Pair> sorted_pairs_;
+  std::vector<int> fill_;
+  std::vector<int> component_rows_;
+  std::vector<int> component_cols_;
+  std::vector<int> local_index_;
+  std::vector<double> cost_;
+  std::vector<int> row_match_;
+  std::vector<double> potential_u_;
+  std::vector<double> potential_v_;
+  std::vector<int> column_owner_;
+  std::vector<int> way_;
+  std::vector<double> min_slack_;
+  std::vector<char> used_;
+  std::vector<char> track_matched_;
+  std::vector<char> detection_matched_;
+};
+
+} // namespace inference
+
+#endif
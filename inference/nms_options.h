@@ -0,0 +1,26 @@
+#ifndef INFERENCE_NMS_OPTIONS_H_
+#define INFERENCE_NMS_OPTIONS_H_
+
+namespace inference {
+
+enum class NmsMode {
+  // Original class-agnostic greedy scan, kept for comparison.
+  kLegacy,
+  // Boxes only suppress boxes of the same class.
+  kClassAware,
+};
+
+struct NmsOptions {
+  float iou_threshold = 0.5f;
+  NmsMode mode = NmsMode::kClassAware;
+  // Maximum number of detections returned, highest confidence first. 0 keeps
+  // every surviving detection.
+  int max_detections = 0;
+  // Bins the candidates of each class into a uniform grid so only boxes that
+  // share a cell are compared. Pays off for large, spread out candidate sets.
+  bool spatial_bucketing = false;
+};
+
+} // namespace inference
+
+#endif
@@ -1,6 +1,367 @@
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+#include "opencv2/core/hal/intrin.hpp"
+
 #include "inference/non_max_suppression.h"
 
 namespace inference {
+namespace {
+
+// Segments smaller than this are scanned densely even when bucketing is on,
+// building the grid costs more than it saves.
+constexpr int kMinBucketedCandidates = 128;
+
+// Upper bound on grid cells per axis.
+constexpr int kMaxGridCells = 64;
+
+// Accessors the suppression code reads candidates through, for Detection
+// vectors and float DetectionBatches.
+int CandidateCount(const std::vector<Detection> &detections) {
+  return static_cast<int>(detections.size());
+}
+
+int CandidateCount(const DetectionBatch &detections) {
+  return static_cast<int>(detections.Size());
+}
+
+int ClassAt(const std::vector<Detection> &detections, int i) {
+  return detections[i].class_id;
+}
+
+int ClassAt(const DetectionBatch &detections, int i) {
+  return detections.class_ids[i];
+}
+
+float ConfidenceAt(const std::vector<Detection> &detections, int i) {
+  return detections[i].confidence;
+}
+
+float ConfidenceAt(const DetectionBatch &detections, int i) {
+  return detections.confidences[i];
+}
+
+// Copies candidate `i` into position `position` of the workspace arrays.
+void LoadBox(const std::vector<Detection> &detections, int i, int position,
+             NmsWorkspace &ws) {
+  const cv::Rect &bbox = detections[i].bbox;
+  ws.x1[position] = static_cast<float>(bbox.x);
+  ws.y1[position] = static_cast<float>(bbox.y);
+  ws.x2[position] = static_cast<float>(bbox.x + bbox.width);
+  ws.y2[position] = static_cast<float>(bbox.y + bbox.height);
+  ws.area[position] =
+      static_cast<float>(bbox.width) * static_cast<float>(bbox.height);
+}
+
+void LoadBox(const DetectionBatch &detections, int i, int position,
+             NmsWorkspace &ws) {
+  ws.x1[position] = detections.x1[i];
+  ws.y1[position] = detections.y1[i];
+  ws.x2[position] = detections.x2[i];
+  ws.y2[position] = detections.y2[i];
+  ws.area[position] = (detections.x2[i] - detections.x1[i]) *
+                      (detections.y2[i] - detections.y1[i]);
+}
+
+// Fills the struct-of-arrays candidate buffers of `ws`. Positions are sorted
+// by descending confidence and, when `group_by_class` is set, by class first
+// so every class is one contiguous run.
+template <typename Candidates>
+void LoadCandidates(const Candidates &detections, bool group_by_class,
+                    NmsWorkspace &ws) {
+  const int n = CandidateCount(detections);
+  ws.order.resize(n);
+  std::iota(ws.order.begin(), ws.order.end(), 0);
+  std::sort(ws.order.begin(), ws.order.end(),
+            [&detections, group_by_class](int a, int b) {
+              if (group_by_class &&
+                  ClassAt(detections, a) != ClassAt(detections, b)) {
+                return ClassAt(detections, a) < ClassAt(detections, b);
+              }
+              const float lhs = ConfidenceAt(detections, a);
+              const float rhs = ConfidenceAt(detections, b);
+              if (lhs != rhs) {
+                return lhs > rhs;
+              }
+              return a < b;
+            });
+
+  ws.x1.resize(n);
+  ws.y1.resize(n);
+  ws.x2.resize(n);
+  ws.y2.resize(n);
+  ws.area.resize(n);
+  ws.suppressed.assign(n, 0);
+  ws.kept.clear();
+  for (int i = 0; i < n; ++i) {
+    LoadBox(detections, ws.order[i], i, ws);
+  }
+}
+
+// IoU(i, j) > iou_threshold, without the division.
+bool Overlaps(const NmsWorkspace &ws, int i, int j, float iou_threshold) {
+  const float inter_w = std::max(
+      0.0f, std::min(ws.x2[i], ws.x2[j]) - std::max(ws.x1[i], ws.x1[j]));
+  const float inter_h = std::max(
+      0.0f, std::min(ws.y2[i], ws.y2[j]) - std::max(ws.y1[i], ws.y1[j]));
+  const float inter = inter_w * inter_h;
+  return inter > iou_threshold * (ws.area[i] + ws.area[j] - inter);
+}
+
+// Marks every candidate in (i, end) that overlaps the kept box i.
+void SuppressDense(NmsWorkspace &boxes, int i, int end,
+                   float iou_threshold) {
+  int j = i + 1;
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+  const int lanes = cv::VTraits<cv::v_float32>::vlanes();
+  const cv::v_float32 box_x1 = cv::vx_setall_f32(boxes.x1[i]);
+  const cv::v_float32 box_y1 = cv::vx_setall_f32(boxes.y1[i]);
+  const cv::v_float32 box_x2 = cv::vx_setall_f32(boxes.x2[i]);
+  const cv::v_float32 box_y2 = cv::vx_setall_f32(boxes.y2[i]);
+  const cv::v_float32 box_area = cv::vx_setall_f32(boxes.area[i]);
+  const cv::v_float32 threshold = cv::vx_setall_f32(iou_threshold);
+  const cv::v_float32 zero = cv::vx_setzero_f32();
+
+  for (; j <= end - lanes; j += lanes) {
+    const cv::v_float32 inter_w = cv::v_max(
+        cv::v_sub(cv::v_min(box_x2, cv::vx_load(&boxes.x2[j])),
+                  cv::v_max(box_x1, cv::vx_load(&boxes.x1[j]))),
+        zero);
+    const cv::v_float32 inter_h = cv::v_max(
+        cv::v_sub(cv::v_min(box_y2, cv::vx_load(&boxes.y2[j])),
+                  cv::v_max(box_y1, cv::vx_load(&boxes.y1[j]))),
+        zero);
+    const cv::v_float32 inter = cv::v_mul(inter_w, inter_h);
+    const cv::v_float32 union_area =
+        cv::v_sub(cv::v_add(box_area, cv::vx_load(&boxes.area[j])), inter);
+    const cv::v_float32 overlaps =
+        cv::v_gt(inter, cv::v_mul(threshold, union_area));
+
+    cv::v_store(&boxes.suppressed[j],
+                cv::v_or(cv::vx_load(&boxes.suppressed[j]),
+                         cv::v_reinterpret_as_s32(overlaps)));
+  }
+#endif
+  for (; j < end; ++j) {
+    if (Overlaps(boxes, i, j, iou_threshold)) {
+      boxes.suppressed[j] = 1;
+    }
+  }
+}
+
+// Greedy suppression over the single-class run [begin, end). Appends the
+// positions of kept boxes to `boxes.kept`, stopping after `max_keep` of them.
+void SuppressSegment(NmsWorkspace &boxes, int begin, int end,
+                     float iou_threshold, size_t max_keep) {
+  size_t num_kept = 0;
+  for (int i = begin; i < end && num_kept < max_keep; ++i) {
+    if (boxes.suppressed[i]) {
+      continue;
+    }
+    boxes.kept.push_back(i);
+    ++num_kept;
+    SuppressDense(boxes, i, end, iou_threshold);
+  }
+}
+
+// Same as SuppressSegment, but candidates are registered in every cell of a
+// uniform grid they touch, so a kept box is only compared against boxes that
+// share one of its cells. Overlapping boxes always share a cell.
+void SuppressSegmentBucketed(NmsWorkspace &boxes, int begin, int end,
+                             float iou_threshold, size_t max_keep) {
+  float min_x = boxes.x1[begin], min_y = boxes.y1[begin];
+  float max_x = boxes.x2[begin], max_y = boxes.y2[begin];
+  double sum_w = 0.0, sum_h = 0.0;
+  for (int i = begin; i < end; ++i) {
+    min_x = std::min(min_x, boxes.x1[i]);
+    min_y = std::min(min_y, boxes.y1[i]);
+    max_x = std::max(max_x, boxes.x2[i]);
+    max_y = std::max(max_y, boxes.y2[i]);
+    sum_w += boxes.x2[i] - boxes.x1[i];
+    sum_h += boxes.y2[i] - boxes.y1[i];
+  }
+
+  // Cells about twice the mean box size keep most boxes within 2x2 cells.
+  const int n = end - begin;
+  const float cell_w = std::max(1.0f, static_cast<float>(2.0 * sum_w / n));
+  const float cell_h = std::max(1.0f, static_cast<float>(2.0 * sum_h / n));
+  const int grid_w = std::clamp(
+      static_cast<int>(std::ceil((max_x - min_x) / cell_w)), 1, kMaxGridCells);
+  const int grid_h = std::clamp(
+      static_cast<int>(std::ceil((max_y - min_y) / cell_h)), 1, kMaxGridCells);
+  const float inv_cell_w = grid_w / std::max(1.0f, max_x - min_x);
+  const float inv_cell_h = grid_h / std::max(1.0f, max_y - min_y);
+
+  auto cell_range = [&](int i, int *cx0, int *cy0, int *cx1, int *cy1) {
+    *cx0 = std::clamp(static_cast<int>((boxes.x1[i] - min_x) * inv_cell_w), 0,
+                      grid_w - 1);
+    *cy0 = std::clamp(static_cast<int>((boxes.y1[i] - min_y) * inv_cell_h), 0,
+                      grid_h - 1);
+    *cx1 = std::clamp(static_cast<int>((boxes.x2[i] - min_x) * inv_cell_w), 0,
+                      grid_w - 1);
+    *cy1 = std::clamp(static_cast<int>((boxes.y2[i] - min_y) * inv_cell_h), 0,
+                      grid_h - 1);
+  };
+
+  // Compressed cell lists: cell c holds entries[starts[c], starts[c + 1]).
+  // Candidates are inserted in position order, so every list is sorted by
+  // descending confidence.
+  std::vector<int> &starts = boxes.cell_starts;
+  starts.assign(grid_w * grid_h + 1, 0);
+  for (int i = begin; i < end; ++i) {
+    int cx0, cy0, cx1, cy1;
+    cell_range(i, &cx0, &cy0, &cx1, &cy1);
+    for (int cy = cy0; cy <= cy1; ++cy) {
+      for (int cx = cx0; cx <= cx1; ++cx) {
+        ++starts[cy * grid_w + cx + 1];
+      }
+    }
+  }
+  std::partial_sum(starts.begin(), starts.end(), starts.begin());
+
+  std::vector<int> &entries = boxes.cell_entries;
+  std::vector<int> &fill = boxes.cell_fill;
+  entries.resize(starts.back());
+  fill.assign(starts.begin(), starts.end() - 1);
+  for (int i = begin; i < end; ++i) {
+    int cx0, cy0, cx1, cy1;
+    cell_range(i, &cx0, &cy0, &cx1, &cy1);
+    for (int cy = cy0; cy <= cy1; ++cy) {
+      for (int cx = cx0; cx <= cx1; ++cx) {
+        entries[fill[cy * grid_w + cx]++] = i;
+      }
+    }
+  }
+
+  size_t num_kept = 0;
+  for (int i = begin; i < end && num_kept < max_keep; ++i) {
+    if (boxes.suppressed[i]) {
+      continue;
+    }
+    boxes.kept.push_back(i);
+    ++num_kept;
+
+    int cx0, cy0, cx1, cy1;
+    cell_range(i, &cx0, &cy0, &cx1, &cy1);
+    for (int cy = cy0; cy <= cy1; ++cy) {
+      for (int cx = cx0; cx <= cx1; ++cx) {
+        const int cell = cy * grid_w + cx;
+        for (int e = starts[cell]; e < starts[cell + 1]; ++e) {
+          const int j = entries[e];
+          if (j > i && !boxes.suppressed[j] &&
+              Overlaps(boxes, i, j, iou_threshold)) {
+            boxes.suppressed[j] = 1;
+          }
+        }
+      }
+    }
+  }
+}
+
+// Whether the positions i and j overlap in the class-agnostic scan. Detection
+// vectors use the integer IoU of the reference Apply.
+bool LegacyOverlaps(const std::vector<Detection> &detections,
+                    const NmsWorkspace &ws, int i, int j,
+                    float iou_threshold) {
+  return NonMaxSuppression::IoU(detections[ws.order[i]].bbox,
+                                detections[ws.order[j]].bbox) > iou_threshold;
+}
+
+bool LegacyOverlaps(const DetectionBatch &, const NmsWorkspace &ws, int i,
+                    int j, float iou_threshold) {
+  return Overlaps(ws, i, j, iou_threshold);
+}
+
+// The class-agnostic scan of the reference Apply, on candidates loaded
+// without class grouping. Kept positions come out in confidence order.
+template <typename Candidates>
+void SuppressLegacy(const Candidates &detections, NmsWorkspace &ws,
+                    float iou_threshold, size_t max_keep) {
+  const int n = CandidateCount(detections);
+  for (int i = 0; i < n && ws.kept.size() < max_keep; ++i) {
+    if (ws.suppressed[i]) {
+      continue;
+    }
+    ws.kept.push_back(i);
+    for (int j = i + 1; j < n; ++j) {
+      if (LegacyOverlaps(detections, ws, i, j, iou_threshold)) {
+        ws.suppressed[j] = 1;
+      }
+    }
+  }
+}
+
+// Runs the suppression `options` asks for over `detections` and leaves the
+// positions of the survivors in `ws.kept`, by descending confidence.
+template <typename Candidates>
+void SelectSurvivors(const Candidates &detections, const NmsOptions &options,
+                     NmsWorkspace &boxes) {
+  const int n = CandidateCount(detections);
+  const size_t max_keep = (options.max_detections > 0)
+                              ? static_cast<size_t>(options.max_detections)
+                              : static_cast<size_t>(n);
+
+  if (options.mode == NmsMode::kLegacy) {
+    LoadCandidates(detections, /*group_by_class=*/false, boxes);
+    SuppressLegacy(detections, boxes, options.iou_threshold, max_keep);
+    return;
+  }
+
+  LoadCandidates(detections, /*group_by_class=*/true, boxes);
+
+  // Classes never suppress each other, so each class run is reduced on its
+  // own. No class can contribute more than max_keep boxes to the result.
+  for (int begin = 0; begin < n;) {
+    const int class_id = ClassAt(detections, boxes.order[begin]);
+    int end = begin + 1;
+    while (end < n && ClassAt(detections, boxes.order[end]) == class_id) {
+      ++end;
+    }
+
+    if (options.spatial_bucketing && end - begin >= kMinBucketedCandidates) {
+      SuppressSegmentBucketed(boxes, begin, end, options.iou_threshold,
+                              max_keep);
+    } else {
+      SuppressSegment(boxes, begin, end, options.iou_threshold, max_keep);
+    }
+    begin = end;
+  }
+
+  // Merge the per-class survivors by confidence and apply the top-K cap.
+  std::vector<int> &kept = boxes.kept;
+  auto by_confidence = [&](int a, int b) {
+    const float lhs = ConfidenceAt(detections, boxes.order[a]);
+    const float rhs = ConfidenceAt(detections, boxes.order[b]);
+    return (lhs != rhs) ? lhs > rhs : boxes.order[a] < boxes.order[b];
+  };
+  if (kept.size() > max_keep) {
+    std::partial_sort(kept.begin(), kept.begin() + max_keep, kept.end(),
+                      by_confidence);
+    kept.resize(max_keep);
+  } else {
+    std::sort(kept.begin(), kept.end(), by_confidence);
+  }
+}
+
+} // namespace
+
+void NmsWorkspace::Reserve(size_t max_candidates) {
+  order.reserve(max_candidates);
+  x1.reserve(max_candidates);
+  y1.reserve(max_candidates);
+  x2.reserve(max_candidates);
+  y2.reserve(max_candidates);
+  area.reserve(max_candidates);
+  suppressed.reserve(max_candidates);
+  kept.reserve(max_candidates);
+
+  const size_t max_cells = kMaxGridCells * kMaxGridCells;
+  cell_starts.reserve(max_cells + 1);
+  cell_fill.reserve(max_cells);
+  // Most boxes touch at most 2x2 cells.
+  cell_entries.reserve(4 * max_candidates);
+}
 
 float NonMaxSuppression::IoU(const cv::Rect &bbox1, const cv::Rect &bbox2) {
   const auto box1_x1 = bbox1.x;
@@ -67,4 +428,43 @@ NonMaxSuppression::Apply(const std::vector<Detection> &raw_detections,
   return result;
 }
 
+std::vector<Detection>
+NonMaxSuppression::Apply(const std::vector<Detection> &raw_detections,
+                         const NmsOptions &options) {
+  NmsWorkspace workspace;
+  std::vector<Detection> result;
+  Apply(raw_detections, options, &workspace, &result);
+  return result;
+}
+
+void NonMaxSuppression::Apply(const std::vector<Detection> &raw_detections,
+                              const NmsOptions &options,
+                              NmsWorkspace *workspace,
+                              std::vector<Detection> *result) {
+  NmsWorkspace &boxes = *workspace;
+  SelectSurvivors(raw_detections, options, boxes);
+
+  result->clear();
+  for (int position : boxes.kept) {
+    result->push_back(raw_detections[boxes.order[position]]);
+  }
+}
+
+void NonMaxSuppression::Apply(const DetectionBatch &candidates,
+                              const NmsOptions &options,
+                              NmsWorkspace *workspace,
+                              DetectionBatch *result) {
+  NmsWorkspace &boxes = *workspace;
+  SelectSurvivors(candidates, options, boxes);
+
+  // The workspace already holds the boxes in position order.
+  result->Clear();
+  for (int position : boxes.kept) {
+    result->Add(candidates.class_ids[boxes.order[position]],
+                candidates.confidences[boxes.order[position]],
+                boxes.x1[position], boxes.y1[position], boxes.x2[position],
+                boxes.y2[position]);
+  }
+}
+
 } // namespace inference
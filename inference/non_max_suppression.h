@@ -1,18 +1,69 @@
 #ifndef INFERENCE_NON_MAX_SUPPRESSION_H_
 #define INFERENCE_NON_MAX_SUPPRESSION_H_
 
+#include <cstddef>
+#include <vector>
+
 #include "opencv2/core/types.hpp"
 
 #include "inference/detection.h"
+#include "inference/detection_batch.h"
+#include "inference/nms_options.h"
 
 namespace inference {
 
+// Scratch buffers of the options based Apply. Candidates are kept in
+// struct-of-arrays float form, `order` maps a position to the index of the
+// raw detection. Reusing one workspace across calls keeps steady-state
+// suppression free of heap allocations.
+struct NmsWorkspace {
+  // Sizes every buffer for up to `max_candidates` raw detections.
+  void Reserve(size_t max_candidates);
+
+  std::vector<int> order;
+  std::vector<float> x1;
+  std::vector<float> y1;
+  std::vector<float> x2;
+  std::vector<float> y2;
+  std::vector<float> area;
+  // Non-zero once suppressed. int32 so SIMD masks can be OR-ed in directly.
+  std::vector<int> suppressed;
+  // Positions of the boxes that survived.
+  std::vector<int> kept;
+
+  // Compressed cell lists of the spatial bucketing grid.
+  std::vector<int> cell_starts;
+  std::vector<int> cell_fill;
+  std::vector<int> cell_entries;
+};
+
 class NonMaxSuppression {
 public:
   static float IoU(const cv::Rect &bbox1, const cv::Rect &bbox2);
 
   static std::vector<Detection>
   Apply(const std::vector<Detection> &raw_detections, float iou_threshold);
+
+  // Suppression according to `options`. Results are sorted by descending
+  // confidence. In kClassAware mode candidates are grouped per class and kept
+  // in struct-of-arrays float form with precomputed areas, so each kept box
+  // is tested against a whole vector of candidates at once.
+  static std::vector<Detection>
+  Apply(const std::vector<Detection> &raw_detections,
+        const NmsOptions &options);
+
+  // Same as above, but uses the buffers of `workspace` and overwrites
+  // `result`, which must not alias `raw_detections`. Allocates nothing once
+  // the workspace and `result` have grown to the candidate count.
+  static void Apply(const std::vector<Detection> &raw_detections,
+                    const NmsOptions &options, NmsWorkspace *workspace,
+                    std::vector<Detection> *result);
+
+  // Same as above, on float boxes. kLegacy mode compares the float boxes
+  // too, instead of the integer IoU.
+  static void Apply(const DetectionBatch &candidates,
+                    const NmsOptions &options, NmsWorkspace *workspace,
+                    DetectionBatch *result);
 };
 
 } // namespace inference
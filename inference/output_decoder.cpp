@@ -0,0 +1,368 @@
+#include <algorithm>
+
+#include "absl/strings/str_format.h"
+#include "opencv2/core/hal/intrin.hpp"
+
+#include "inference/output_decoder.h"
+
+namespace inference {
+namespace {
+
+// Anchors processed together while sweeping the class planes. Each class row
+// is then read as one contiguous 256 byte run and the running maxima stay in
+// L1.
+constexpr int kAnchorBlock = 64;
+
+Detection MakeDetection(int class_id, float confidence, float cx, float cy,
+                        float w, float h) {
+  // Convert Center-XYWH to TopLeft-XYWH for OpenCV
+  int left = int(cx - w / 2);
+  int top = int(cy - h / 2);
+  int width = int(w);
+  int height = int(h);
+
+  return Detection{.class_id = class_id,
+                   .confidence = confidence,
+                   .bbox = cv::Rect(left, top, width, height)};
+}
+
+// Output sinks of the decoders. Detection vectors keep the original integer
+// boxes, batches keep the network's float coordinates.
+void Append(std::vector<Detection> *detections, int class_id,
+            float confidence, float cx, float cy, float w, float h) {
+  detections->emplace_back(MakeDetection(class_id, confidence, cx, cy, w, h));
+}
+
+void Append(DetectionBatch *detections, int class_id, float confidence,
+            float cx, float cy, float w, float h) {
+  detections->Add(class_id, confidence, cx - w / 2, cy - h / 2, cx + w / 2,
+                  cy + h / 2);
+}
+
+void AppendCorners(std::vector<Detection> *detections, int class_id,
+                   float confidence, float x1, float y1, float x2, float y2) {
+  detections->emplace_back(Detection{
+      .class_id = class_id,
+      .confidence = confidence,
+      .bbox = cv::Rect(int(x1), int(y1), int(x2 - x1), int(y2 - y1))});
+}
+
+void AppendCorners(DetectionBatch *detections, int class_id, float confidence,
+                   float x1, float y1, float x2, float y2) {
+  detections->Add(class_id, confidence, x1, y1, x2, y2);
+}
+
+void Clear(std::vector<Detection> *detections) { detections->clear(); }
+
+void Clear(DetectionBatch *detections) { detections->Clear(); }
+
+// Decoders for one class count, kNumClasses == 0 reads it from the matrix.
+template <int kNumClasses, typename Output>
+void DecodeChannelMajorImpl(const cv::Mat &planes, float confidence_threshold,
+                            Output *detections) {
+  Clear(detections);
+
+  // A fixed class count lets the compiler unroll the class sweep.
+  const int num_classes = kNumClasses > 0 ? kNumClasses : planes.rows - 4;
+  const int num_anchors = planes.cols;
+  const size_t stride = planes.step1();
+
+  const float *cx = planes.ptr<const float>(0);
+  const float *cy = planes.ptr<const float>(1);
+  const float *w = planes.ptr<const float>(2);
+  const float *h = planes.ptr<const float>(3);
+  const float *class_planes = planes.ptr<const float>(4);
+
+  alignas(64) float best_scores[kAnchorBlock];
+  alignas(64) int best_classes[kAnchorBlock];
+
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+  const int lanes = cv::VTraits<cv::v_float32>::vlanes();
+  const cv::v_float32 threshold = cv::vx_setall_f32(confidence_threshold);
+#endif
+
+  for (int block = 0; block < num_anchors; block += kAnchorBlock) {
+    const int block_size = std::min(kAnchorBlock, num_anchors - block);
+
+    // Same starting point as the scalar path: a class only wins with a
+    // strictly positive score, so ties keep the lowest class id.
+    std::fill_n(best_scores, block_size, 0.0f);
+    std::fill_n(best_classes, block_size, -1);
+
+    for (int c = 0; c < num_classes; ++c) {
+      const float *scores = class_planes + c * stride + block;
+
+      int i = 0;
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+      const cv::v_int32 class_id = cv::vx_setall_s32(c);
+      for (; i <= block_size - lanes; i += lanes) {
+        const cv::v_float32 score = cv::vx_load(scores + i);
+        const cv::v_float32 best = cv::vx_load(best_scores + i);
+        const cv::v_float32 greater = cv::v_gt(score, best);
+
+        cv::v_store(best_scores + i, cv::v_select(greater, score, best));
+        cv::v_store(best_classes + i,
+                    cv::v_select(cv::v_reinterpret_as_s32(greater), class_id,
+                                 cv::vx_load(best_classes + i)));
+      }
+#endif
+      for (; i < block_size; ++i) {
+        if (scores[i] > best_scores[i]) {
+          best_scores[i] = scores[i];
+          best_classes[i] = c;
+        }
+      }
+    }
+
+    int i = 0;
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+    // Most anchors are background, so whole vectors are usually rejected
+    // with a single comparison.
+    for (; i <= block_size - lanes; i += lanes) {
+      if (!cv::v_check_any(
+              cv::v_ge(cv::vx_load(best_scores + i), threshold))) {
+        continue;
+      }
+      for (int lane = i; lane < i + lanes; ++lane) {
+        if (best_scores[lane] < confidence_threshold) {
+          continue;
+        }
+        const int anchor = block + lane;
+        Append(detections, best_classes[lane], best_scores[lane], cx[anchor],
+               cy[anchor], w[anchor], h[anchor]);
+      }
+    }
+#endif
+    for (; i < block_size; ++i) {
+      if (best_scores[i] < confidence_threshold) {
+        continue;
+      }
+      const int anchor = block + i;
+      Append(detections, best_classes[i], best_scores[i], cx[anchor],
+             cy[anchor], w[anchor], h[anchor]);
+    }
+  }
+}
+
+template <int kNumClasses, typename Output>
+void DecodeRowMajorImpl(const cv::Mat &rows, float confidence_threshold,
+                        Output *detections) {
+  Clear(detections);
+
+  const int num_classes = kNumClasses > 0 ? kNumClasses : rows.cols - 4;
+  for (int i = 0; i < rows.rows; ++i) {
+    const float *row_ptr = rows.ptr<const float>(i);
+    const float *scores = row_ptr + 4;
+
+    float max_confidence_score = 0;
+    int class_id = -1;
+    for (int id = 0; id < num_classes; ++id) {
+      if (scores[id] > max_confidence_score) {
+        max_confidence_score = scores[id];
+        class_id = id;
+      }
+    }
+
+    if (max_confidence_score < confidence_threshold) {
+      continue;
+    }
+
+    Append(detections, class_id, max_confidence_score, row_ptr[0],
+           row_ptr[1], row_ptr[2], row_ptr[3]);
+  }
+}
+
+template <typename Output>
+void DecodeEndToEndImpl(const cv::Mat &rows, float confidence_threshold,
+                        Output *detections) {
+  Clear(detections);
+
+  for (int i = 0; i < rows.rows; ++i) {
+    const float *row = rows.ptr<const float>(i);
+    if (row[4] < confidence_threshold) {
+      continue;
+    }
+    AppendCorners(detections, static_cast<int>(row[5]), row[4], row[0],
+                  row[1], row[2], row[3]);
+  }
+}
+
+template <typename Output>
+using Decoder = void (*)(const cv::Mat &, float, Output *);
+
+// Picks the decoder instantiation for `layout` and Output.
+template <typename Output>
+Decoder<Output> DecoderFor(const OutputLayout &layout) {
+  switch (layout.format) {
+  case OutputFormat::kChannelMajor:
+    switch (layout.num_classes) {
+    case 1:
+      return &DecodeChannelMajorImpl<1, Output>;
+    case 80:
+      return &DecodeChannelMajorImpl<80, Output>;
+    default:
+      return &DecodeChannelMajorImpl<0, Output>;
+    }
+  case OutputFormat::kRowMajor:
+    switch (layout.num_classes) {
+    case 1:
+      return &DecodeRowMajorImpl<1, Output>;
+    case 80:
+      return &DecodeRowMajorImpl<80, Output>;
+    default:
+      return &DecodeRowMajorImpl<0, Output>;
+    }
+  case OutputFormat::kEndToEnd:
+    return &DecodeEndToEndImpl<Output>;
+  case OutputFormat::kAuto:
+    break;
+  }
+  return nullptr;
+}
+
+// Total anchors of the stride 8, 16 and 32 grids of a YOLO head.
+int AnchorCount(int input_width, int input_height) {
+  int anchors = 0;
+  for (int stride : {8, 16, 32}) {
+    anchors += (input_width / stride) * (input_height / stride);
+  }
+  return anchors;
+}
+
+} // namespace
+
+std::vector<Detection>
+OutputDecoder::DecodeRowMajor(const cv::Mat &rows,
+                              float confidence_threshold) {
+  std::vector<Detection> detections;
+
+  for (int i = 0; i < rows.rows; ++i) {
+    // Get the row data in pointer, equivalent
+    // to detections.row(i) but faster
+    const float *row_ptr = rows.ptr<const float>(i);
+
+    float max_confidence_score = 0;
+    int class_id = -1;
+    for (int id = 4; id < rows.cols; ++id) {
+      if (row_ptr[id] > max_confidence_score) {
+        max_confidence_score = row_ptr[id];
+        class_id = id - 4;
+      }
+    }
+
+    if (max_confidence_score < confidence_threshold) {
+      continue;
+    }
+
+    detections.emplace_back(MakeDetection(class_id, max_confidence_score,
+                                          row_ptr[0], row_ptr[1], row_ptr[2],
+                                          row_ptr[3]));
+  }
+
+  return detections;
+}
+
+std::vector<Detection>
+OutputDecoder::DecodeChannelMajor(const cv::Mat &planes,
+                                  float confidence_threshold) {
+  std::vector<Detection> detections;
+  DecodeChannelMajor(planes, confidence_threshold, &detections);
+  return detections;
+}
+
+void OutputDecoder::DecodeChannelMajor(const cv::Mat &planes,
+                                       float confidence_threshold,
+                                       std::vector<Detection> *detections) {
+  DecodeChannelMajorImpl<0>(planes, confidence_threshold, detections);
+}
+
+void OutputDecoder::DecodeRowMajor(const cv::Mat &rows,
+                                   float confidence_threshold,
+                                   std::vector<Detection> *detections) {
+  DecodeRowMajorImpl<0>(rows, confidence_threshold, detections);
+}
+
+void OutputDecoder::DecodeEndToEnd(const cv::Mat &rows,
+                                   float confidence_threshold,
+                                   std::vector<Detection> *detections) {
+  DecodeEndToEndImpl(rows, confidence_threshold, detections);
+}
+
+void OutputDecoder::DecodeChannelMajor(const cv::Mat &planes,
+                                       float confidence_threshold,
+                                       DetectionBatch *detections) {
+  DecodeChannelMajorImpl<0>(planes, confidence_threshold, detections);
+}
+
+void OutputDecoder::DecodeRowMajor(const cv::Mat &rows,
+                                   float confidence_threshold,
+                                   DetectionBatch *detections) {
+  DecodeRowMajorImpl<0>(rows, confidence_threshold, detections);
+}
+
+void OutputDecoder::DecodeEndToEnd(const cv::Mat &rows,
+                                   float confidence_threshold,
+                                   DetectionBatch *detections) {
+  DecodeEndToEndImpl(rows, confidence_threshold, detections);
+}
+
+absl::StatusOr<OutputLayout>
+OutputDecoder::InferLayout(const cv::Mat &output, int input_width,
+                           int input_height, OutputFormat format) {
+  if (output.dims != 3) {
+    return absl::InvalidArgumentError(absl::StrFormat(
+        "expected a [N, D1, D2] network output, got %d dims", output.dims));
+  }
+
+  const int d1 = output.size[1];
+  const int d2 = output.size[2];
+  if (format == OutputFormat::kAuto) {
+    const int anchors = AnchorCount(input_width, input_height);
+    if (d2 == anchors) {
+      format = OutputFormat::kChannelMajor;
+    } else if (d1 == anchors) {
+      format = OutputFormat::kRowMajor;
+    } else if (d2 == 6) {
+      format = OutputFormat::kEndToEnd;
+    } else {
+      // Unusual strides. Heads have far more anchors than channels.
+      format = d1 < d2 ? OutputFormat::kChannelMajor : OutputFormat::kRowMajor;
+    }
+  }
+
+  OutputLayout layout{.format = format, .rows = d1, .cols = d2};
+  switch (format) {
+  case OutputFormat::kChannelMajor:
+    layout.num_classes = d1 - 4;
+    break;
+  case OutputFormat::kRowMajor:
+    layout.num_classes = d2 - 4;
+    break;
+  case OutputFormat::kEndToEnd:
+    if (d2 != 6) {
+      return absl::InvalidArgumentError(absl::StrFormat(
+          "end-to-end output rows must have 6 values, got %d", d2));
+    }
+    return layout;
+  case OutputFormat::kAuto:
+    break;
+  }
+
+  if (layout.num_classes <= 0) {
+    return absl::InvalidArgumentError(absl::StrFormat(
+        "network output [%d, %d] has no class scores", d1, d2));
+  }
+  return layout;
+}
+
+OutputDecoder::DecodeFunction
+OutputDecoder::ForLayout(const OutputLayout &layout) {
+  return DecoderFor<std::vector<Detection>>(layout);
+}
+
+OutputDecoder::BatchDecodeFunction
+OutputDecoder::BatchDecoderForLayout(const OutputLayout &layout) {
+  return DecoderFor<DetectionBatch>(layout);
+}
+
+} // namespace inference
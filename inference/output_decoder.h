@@ -0,0 +1,107 @@
+#ifndef INFERENCE_OUTPUT_DECODER_H_
+#define INFERENCE_OUTPUT_DECODER_H_
+
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "opencv2/core.hpp"
+
+#include "inference/detection.h"
+#include "inference/detection_batch.h"
+
+namespace inference {
+
+// How a detection head lays out its output, per image.
+enum class OutputFormat {
+  // Work it out from the output shape, see OutputDecoder::InferLayout.
+  kAuto,
+  // [4 + K, Anchors], one channel per row. YOLOv8/v11 ONNX exports.
+  kChannelMajor,
+  // [Anchors, 4 + K], one anchor per row. Transposed exports.
+  kRowMajor,
+  // [Detections, 6] rows of [x1, y1, x2, y2, score, class_id], already
+  // suppressed by the network. YOLOv10 and other NMS-free exports.
+  kEndToEnd,
+};
+
+struct OutputLayout {
+  OutputFormat format = OutputFormat::kAuto;
+  // Classes scored per anchor, 0 for kEndToEnd heads which emit class ids.
+  int num_classes = 0;
+  // Shape of the per-image output matrix.
+  int rows = 0;
+  int cols = 0;
+};
+
+// Turns raw YOLO head output into detections. A row of the head is
+// [cx, cy, w, h, class_0, ..., class_{K-1}] for one anchor.
+class OutputDecoder {
+public:
+  using DecodeFunction = void (*)(const cv::Mat &output,
+                                  float confidence_threshold,
+                                  std::vector<Detection> *detections);
+  using BatchDecodeFunction = void (*)(const cv::Mat &output,
+                                       float confidence_threshold,
+                                       DetectionBatch *detections);
+
+  // Works out the layout of a [N, D1, D2] head `output` produced for an
+  // input_width x input_height image. Anchor heads are told apart by which
+  // dimension holds the anchor count of the stride 8/16/32 grids; a trailing
+  // dimension of 6 without that anchor count is an end-to-end head. `format`
+  // forces a layout when the shape is ambiguous.
+  static absl::StatusOr<OutputLayout> InferLayout(const cv::Mat &output,
+                                                  int input_width,
+                                                  int input_height,
+                                                  OutputFormat format);
+
+  // Returns the decoder for `layout`. Common class counts get decoders
+  // compiled for that count.
+  static DecodeFunction ForLayout(const OutputLayout &layout);
+
+  // Same as above, for decoders keeping float boxes in a DetectionBatch.
+  static BatchDecodeFunction BatchDecoderForLayout(const OutputLayout &layout);
+
+  // Decodes a [Anchors, 4 + K] matrix, one anchor per row. This is the
+  // original scalar path and needs the network output transposed first; it is
+  // kept as the reference implementation.
+  static std::vector<Detection> DecodeRowMajor(const cv::Mat &rows,
+                                               float confidence_threshold);
+
+  // Same as above, but overwrites `detections`.
+  static void DecodeRowMajor(const cv::Mat &rows, float confidence_threshold,
+                             std::vector<Detection> *detections);
+
+  // Decodes the native [4 + K, Anchors] layout the network produces, one
+  // channel per row. Runs a SIMD max/argmax across the class planes for
+  // blocks of anchors and only reads box coordinates for anchors whose best
+  // score passes the threshold. Produces the same detections, in the same
+  // order, as DecodeRowMajor on the transposed matrix.
+  static std::vector<Detection> DecodeChannelMajor(const cv::Mat &planes,
+                                                   float confidence_threshold);
+
+  // Same as above, but overwrites `detections` so its capacity is reused
+  // from frame to frame.
+  static void DecodeChannelMajor(const cv::Mat &planes,
+                                 float confidence_threshold,
+                                 std::vector<Detection> *detections);
+
+  // Decodes a [Detections, 6] end-to-end head. Rows keep their order, which
+  // is by descending score for the usual top-k exports.
+  static void DecodeEndToEnd(const cv::Mat &rows, float confidence_threshold,
+                             std::vector<Detection> *detections);
+
+  // The decoders above, writing corner boxes at the network's float
+  // precision into `detections`, which is overwritten. Same detections in
+  // the same order.
+  static void DecodeChannelMajor(const cv::Mat &planes,
+                                 float confidence_threshold,
+                                 DetectionBatch *detections);
+  static void DecodeRowMajor(const cv::Mat &rows, float confidence_threshold,
+                             DetectionBatch *detections);
+  static void DecodeEndToEnd(const cv::Mat &rows, float confidence_threshold,
+                             DetectionBatch *detections);
+};
+
+} // namespace inference
+
+#endif
@@ -0,0 +1,246 @@
+#include <pthread.h>
+#include <sched.h>
+
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <utility>
+
+#include "absl/strings/str_format.h"
+#include "opencv2/core.hpp"
+#include "opencv2/core/parallel/parallel_backend.hpp"
+
+#include "inference/cpu_topology.h"
+#include "inference/pinned_thread_pool.h"
+
+namespace inference {
+namespace {
+
+// Pool the current thread's parallel_for_ work goes to, and the index of
+// the thread within it, 0 for the thread that called Run.
+thread_local PinnedThreadPool *current_pool = nullptr;
+thread_local int current_thread_index = 0;
+
+// Routes parallel_for_ to the pool of the calling thread, and to an
+// unpinned pool standing in for OpenCV's own outside of any Scope.
+class PinnedParallelBackend : public cv::parallel::ParallelForAPI {
+public:
+  void parallel_for(int tasks, FN_parallel_for_body_cb_t body_callback,
+                    void *callback_data) override {
+    if (current_pool != nullptr) {
+      current_pool->Run(tasks, body_callback, callback_data);
+      return;
+    }
+    std::shared_ptr<PinnedThreadPool> fallback;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (fallback_ == nullptr) {
+        auto pool = PinnedThreadPool::Create({}, num_threads_);
+        if (pool.ok()) {
+          fallback_ = std::move(*pool);
+        }
+      }
+      fallback = fallback_;
+    }
+    if (fallback == nullptr) {
+      body_callback(0, tasks, callback_data);
+      return;
+    }
+    fallback->Run(tasks, body_callback, callback_data);
+  }
+
+  int getThreadNum() const override { return current_thread_index; }
+
+  int getNumThreads() const override {
+    if (current_pool != nullptr) {
+      return current_pool->num_threads();
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    return num_threads_;
+  }
+
+  int setNumThreads(int num_threads) override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const int previous = num_threads_;
+    num_threads_ = num_threads > 0 ? num_threads : cv::getNumberOfCPUs();
+    if (num_threads_ != previous) {
+      // Runs in progress keep the old pool alive until they finish.
+      fallback_ = nullptr;
+    }
+    return previous;
+  }
+
+  const char *getName() const override { return "inference_pinned"; }
+
+private:
+  mutable std::mutex mutex_;
+  int num_threads_ = cv::getNumberOfCPUs();
+  std::shared_ptr<PinnedThreadPool> fallback_;
+};
+
+std::atomic<bool> backend_installed{false};
+
+} // namespace
+
+void PinnedThreadPool::InstallParallelBackend() {
+  static std::once_flag installed;
+  std::call_once(installed, [] {
+    // Carries over the current cv::setNumThreads value to the fallback.
+    cv::parallel::setParallelForBackend(
+        std::make_shared<PinnedParallelBackend>(), true);
+    backend_installed.store(true, std::memory_order_release);
+  });
+}
+
+bool PinnedThreadPool::ParallelBackendInstalled() {
+  return backend_installed.load(std::memory_order_acquire);
+}
+
+absl::StatusOr<std::unique_ptr<PinnedThreadPool>>
+PinnedThreadPool::Create(std::vector<int> cpus, int num_threads) {
+  if (num_threads < 0) {
+    return absl::InvalidArgumentError("num_threads must not be negative");
+  }
+  if (num_threads == 0) {
+    num_threads = cpus.empty() ? cv::getNumberOfCPUs()
+                               : static_cast<int>(cpus.size());
+  }
+
+  std::unique_ptr<PinnedThreadPool> pool(
+      new PinnedThreadPool(std::move(cpus)));
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int cpu : pool->cpus_) {
+    if (cpu < 0 || cpu >= CPU_SETSIZE) {
+      return absl::InvalidArgumentError(
+          absl::StrFormat("CPU %d is out of range", cpu));
+    }
+    CPU_SET(cpu, &set);
+  }
+
+  for (int i = 1; i < num_threads; ++i) {
+    pool->workers_.emplace_back(&PinnedThreadPool::WorkerLoop, pool.get(), i);
+    if (pool->cpus_.empty()) {
+      continue;
+    }
+    const int error = pthread_setaffinity_np(
+        pool->workers_.back().native_handle(), sizeof(set), &set);
+    if (error != 0) {
+      // The destructor stops the workers started so far.
+      return absl::InvalidArgumentError(absl::StrFormat(
+          "Failed to pin thread pool to CPUs: %s", std::strerror(error)));
+    }
+  }
+  return pool;
+}
+
+PinnedThreadPool::PinnedThreadPool(std::vector<int> cpus)
+    : cpus_(std::move(cpus)) {}
+
+PinnedThreadPool::~PinnedThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  job_posted_.notify_all();
+  for (std::thread &worker : workers_) {
+    worker.join();
+  }
+}
+
+void PinnedThreadPool::Run(int num_tasks, TaskFunction body, void *data) {
+  if (num_tasks <= 0) {
+    return;
+  }
+  std::unique_lock<std::mutex> run_lock(run_mutex_, std::try_to_lock);
+  if (!run_lock.owns_lock() || workers_.empty() || num_tasks == 1) {
+    body(0, num_tasks, data);
+    return;
+  }
+
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    // A worker that joined the previous job late may still be claiming
+    // from next_task_.
+    workers_idle_.wait(lock, [this] { return busy_workers_ == 0; });
+    body_ = body;
+    data_ = data;
+    num_tasks_ = num_tasks;
+    next_task_.store(0, std::memory_order_relaxed);
+    remaining_tasks_.store(num_tasks, std::memory_order_relaxed);
+    ++generation_;
+  }
+  job_posted_.notify_all();
+
+  RunTasks();
+  std::unique_lock<std::mutex> lock(mutex_);
+  job_done_.wait(lock, [this] {
+    return remaining_tasks_.load(std::memory_order_acquire) == 0;
+  });
+}
+
+void PinnedThreadPool::RunTasks() {
+  for (int task = next_task_.fetch_add(1, std::memory_order_relaxed);
+       task < num_tasks_;
+       task = next_task_.fetch_add(1, std::memory_order_relaxed)) {
+    body_(task, task + 1, data_);
+    if (remaining_tasks_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      // Under the mutex, so Run cannot miss it between its check and wait.
+      std::lock_guard<std::mutex> lock(mutex_);
+      job_done_.notify_one();
+    }
+  }
+}
+
+void PinnedThreadPool::WorkerLoop(int index) {
+  current_pool = this;
+  current_thread_index = index;
+
+  uint64_t seen = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      job_posted_.wait(
+          lock, [this, seen] { return stopping_ || generation_ != seen; });
+      if (stopping_) {
+        return;
+      }
+      seen = generation_;
+      ++busy_workers_;
+    }
+
+    RunTasks();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (--busy_workers_ == 0) {
+      workers_idle_.notify_all();
+    }
+  }
+}
+
+PinnedThreadPool::Scope::Scope(PinnedThreadPool *pool) {
+  if (pool == nullptr || pool == current_pool) {
+    return;
+  }
+  if (!pool->cpus().empty()) {
+    auto cpus = GetThreadAffinity();
+    if (cpus.ok() && SetThreadAffinity(pool->cpus()).ok()) {
+      previous_cpus_ = std::move(*cpus);
+    }
+  }
+  entered_ = true;
+  previous_pool_ = current_pool;
+  current_pool = pool;
+}
+
+PinnedThreadPool::Scope::~Scope() {
+  if (!entered_) {
+    return;
+  }
+  current_pool = previous_pool_;
+  if (!previous_cpus_.empty()) {
+    SetThreadAffinity(previous_cpus_).IgnoreError();
+  }
+}
+
+} // namespace inference
@@ -0,0 +1,111 @@
+#ifndef INFERENCE_PINNED_THREAD_POOL_H_
+#define INFERENCE_PINNED_THREAD_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "absl/status/statusor.h"
+
+namespace inference {
+
+// Worker threads pinned to a set of CPUs, which OpenCV's parallel_for_ runs
+// on instead of its process-wide pool while the calling thread is inside a
+// Scope of the pool. Gives each engine its own thread budget on its own
+// cores, so engines in one process don't spread their work over each
+// other's cores or across NUMA nodes.
+//
+// Routing parallel_for_ takes a backend that replaces OpenCV's own for the
+// whole process, so it is opt-in: the application calls
+// InstallParallelBackend() once at startup. Until then a Scope only pins
+// the calling thread and parallel_for_ keeps running on OpenCV's pool.
+//
+// OpenCV runs one parallel_for_ region at a time in the whole process, a
+// region started while another one is running runs serially on its caller.
+// Engines with budgets above one thread that run at the same time mostly
+// take turns on their pools instead of running side by side.
+class PinnedThreadPool {
+public:
+  // Body of parallel work, called with a range of task indices.
+  using TaskFunction = void (*)(int start, int end, void *data);
+
+  // `num_threads` counts the thread calling Run, which takes its share of
+  // the tasks, so num_threads - 1 workers are started. 0 means one thread
+  // per CPU, 1 runs everything on the caller. Empty `cpus` leaves the
+  // threads unpinned.
+  static absl::StatusOr<std::unique_ptr<PinnedThreadPool>>
+  Create(std::vector<int> cpus, int num_threads);
+
+  // Replaces OpenCV's parallel_for_ backend, for the rest of the process,
+  // with one that runs the work of a thread inside a Scope on its pool.
+  // Work outside any Scope runs on an unpinned pool sized like OpenCV's
+  // own, following cv::setNumThreads. Idempotent and thread-safe, but
+  // best called before any other thread uses OpenCV.
+  static void InstallParallelBackend();
+  static bool ParallelBackendInstalled();
+
+  ~PinnedThreadPool();
+
+  const std::vector<int> &cpus() const { return cpus_; }
+  int num_threads() const { return static_cast<int>(workers_.size()) + 1; }
+
+  // Runs `body` over the tasks [0, num_tasks) on the workers and the
+  // calling thread, and returns once all of them are done. A Run issued
+  // while another one is in progress runs on its caller alone.
+  void Run(int num_tasks, TaskFunction body, void *data);
+
+  // Pins the calling thread to the CPUs of `pool` and routes its
+  // parallel_for_ work to the pool until destroyed, then restores both.
+  // Does nothing for a null pool or one the thread is already in.
+  class Scope {
+  public:
+    explicit Scope(PinnedThreadPool *pool);
+    ~Scope();
+
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+  private:
+    bool entered_ = false;
+    PinnedThreadPool *previous_pool_ = nullptr;
+    std::vector<int> previous_cpus_;
+  };
+
+private:
+  explicit PinnedThreadPool(std::vector<int> cpus);
+
+  void WorkerLoop(int index);
+
+  // Claims and runs tasks of the current job until none are left.
+  void RunTasks();
+
+  const std::vector<int> cpus_;
+  std::vector<std::thread> workers_;
+
+  // Held by the Run in progress.
+  std::mutex run_mutex_;
+
+  std::mutex mutex_;
+  std::condition_variable job_posted_;
+  std::condition_variable job_done_;
+  std::condition_variable workers_idle_;
+  // Bumped for every job, workers sleep on job_posted_ until it changes.
+  uint64_t generation_ = 0;
+  int busy_workers_ = 0;
+  bool stopping_ = false;
+
+  // The current job. Written under mutex_ while no worker is busy.
+  TaskFunction body_ = nullptr;
+  void *data_ = nullptr;
+  int num_tasks_ = 0;
+  std::atomic<int> next_task_{0};
+  std::atomic<int> remaining_tasks_{0};
+};
+
+} // namespace inference
+
+#endif
@@ -0,0 +1,356 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <new>
+
+#include "absl/strings/str_format.h"
+
+#include "inference/result_ring.h"
+
+namespace inference {
+namespace {
+
+// "DETRING" and a layout version, checked by readers.
+constexpr uint64_t kMagic = 0x474e4952544544;
+constexpr uint32_t kVersion = 1;
+
+// Slots and arrays start on their own cache lines, so a reader polling one
+// slot does not share lines with the slot being written.
+constexpr size_t kCacheLine = 64;
+
+// Arrays of a slot, in order: class ids, confidences, x1, y1, x2, y2.
+constexpr int kNumArrays = 6;
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "the ring needs address-free 64-bit atomics");
+
+constexpr size_t RoundUp(size_t size) {
+  return (size + kCacheLine - 1) / kCacheLine * kCacheLine;
+}
+
+struct RingHeader {
+  // Written last by the writer, so readers never see a half initialized
+  // ring.
+  std::atomic<uint64_t> magic;
+  uint32_t version;
+  int32_t num_slots;
+  int32_t max_detections;
+  uint64_t slot_size;
+  // Sequence of the next frame, on its own line as the only field written
+  // per frame.
+  alignas(kCacheLine) std::atomic<uint64_t> next_sequence;
+};
+
+struct SlotHeader {
+  // 2 * sequence + 1 while the frame is written, 2 * sequence + 2 once it
+  // is published, 0 before the first write.
+  std::atomic<uint64_t> stamp;
+  ResultFrameInfo info;
+};
+
+constexpr size_t kHeaderSize = RoundUp(sizeof(RingHeader));
+constexpr size_t kSlotHeaderSize = RoundUp(sizeof(SlotHeader));
+
+size_t ArraySize(int max_detections) {
+  return RoundUp(static_cast<size_t>(max_detections) * sizeof(float));
+}
+
+size_t SlotSize(int max_detections) {
+  return kSlotHeaderSize + kNumArrays * ArraySize(max_detections);
+}
+
+size_t RingSize(int num_slots, int max_detections) {
+  return kHeaderSize +
+         static_cast<size_t>(num_slots) * SlotSize(max_detections);
+}
+
+uint64_t WritingStamp(uint64_t sequence) { return 2 * sequence + 1; }
+
+uint64_t PublishedStamp(uint64_t sequence) { return 2 * sequence + 2; }
+
+// Start of array `index` of the slot at `slot`.
+template <typename T>
+T *SlotArray(T *slot, int index, int max_detections) {
+  return slot + kSlotHeaderSize + index * ArraySize(max_detections);
+}
+
+} // namespace
+
+absl::StatusOr<std::unique_ptr<ResultRingWriter>>
+ResultRingWriter::Create(const std::string &name,
+                         const ResultRingOptions &options) {
+  if (name.size() < 2 || name.front() != '/' ||
+      name.find('/', 1) != std::string::npos) {
+    return absl::InvalidArgumentError(absl::StrFormat(
+        "shared memory name must look like /name, got \"%s\"", name));
+  }
+  if (options.num_slots <= 0 || options.max_detections <= 0) {
+    return absl::InvalidArgumentError(
+        "num_slots and max_detections must be positive");
+  }
+
+  // A ring left behind by a crashed writer is replaced, its readers keep
+  // the old mapping and see no new frames.
+  shm_unlink(name.c_str());
+  const int fd =
+      shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    return absl::InternalError(absl::StrFormat(
+        "Failed to create shared memory %s: %s", name, std::strerror(errno)));
+  }
+
+  const size_t size = RingSize(options.num_slots, options.max_detections);
+  if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+    close(fd);
+    shm_unlink(name.c_str());
+    return absl::InternalError(absl::StrFormat(
+        "Failed to size shared memory %s: %s", name, std::strerror(errno)));
+  }
+  void *memory =
+      mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (memory == MAP_FAILED) {
+    shm_unlink(name.c_str());
+    return absl::InternalError(
+        absl::StrFormat("Failed to map shared memory %s", name));
+  }
+
+  // ftruncate zero-fills, every slot starts unpublished.
+  char *bytes = static_cast<char *>(memory);
+  for (int i = 0; i < options.num_slots; ++i) {
+    new (bytes + kHeaderSize + i * SlotSize(options.max_detections))
+        SlotHeader{};
+  }
+  RingHeader *header = new (memory) RingHeader{};
+  header->version = kVersion;
+  header->num_slots = options.num_slots;
+  header->max_detections = options.max_detections;
+  header->slot_size = SlotSize(options.max_detections);
+  header->magic.store(kMagic, std::memory_order_release);
+
+  return std::unique_ptr<ResultRingWriter>(new ResultRingWriter(
+      name, memory, size, options.num_slots, options.max_detections));
+}
+
+ResultRingWriter::ResultRingWriter(std::string name, void *memory,
+                                   size_t size, int num_slots,
+                                   int max_detections)
+    : name_(std::move(name)), memory_(memory), size_(size),
+      num_slots_(num_slots), max_detections_(max_detections) {}
+
+ResultRingWriter::~ResultRingWriter() {
+  munmap(memory_, size_);
+  shm_unlink(name_.c_str());
+}
+
+char *ResultRingWriter::BeginFrame(int64_t frame_index, int64_t timestamp_ns,
+                                   int image_width, int image_height,
+                                   size_t count) {
+  char *slot = static_cast<char *>(memory_) + kHeaderSize +
+               (next_sequence_ % num_slots_) * SlotSize(max_detections_);
+  SlotHeader *header = reinterpret_cast<SlotHeader *>(slot);
+
+  // Readers that see the odd stamp, or see it change while they read, drop
+  // the frame. The fence keeps the writes below from moving above the
+  // stamp.
+  header->stamp.store(WritingStamp(next_sequence_), std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  const size_t stored = std::min(count, static_cast<size_t>(max_detections_));
+  header->info = ResultFrameInfo{
+      .sequence = next_sequence_,
+      .frame_index = frame_index,
+      .timestamp_ns = timestamp_ns,
+      .image_width = image_width,
+      .image_height = image_height,
+      .num_detections = static_cast<int32_t>(stored),
+      .dropped_detections = static_cast<int32_t>(count - stored)};
+  return slot;
+}
+
+uint64_t ResultRingWriter::EndFrame(char *slot) {
+  const uint64_t sequence = next_sequence_++;
+  reinterpret_cast<SlotHeader *>(slot)->stamp.store(
+      PublishedStamp(sequence), std::memory_order_release);
+  static_cast<RingHeader *>(memory_)->next_sequence.store(
+      next_sequence_, std::memory_order_release);
+  return sequence;
+}
+
+uint64_t ResultRingWriter::Publish(int64_t frame_index, int64_t timestamp_ns,
+                                   int image_width, int image_height,
+                                   const DetectionBatch &detections) {
+  char *slot = BeginFrame(frame_index, timestamp_ns, image_width,
+                          image_height, detections.Size());
+  const size_t count =
+      reinterpret_cast<SlotHeader *>(slot)->info.num_detections;
+  const void *arrays[kNumArrays] = {
+      detections.class_ids.data(), detections.confidences.data(),
+      detections.x1.data(),        detections.y1.data(),
+      detections.x2.data(),        detections.y2.data()};
+  static_assert(sizeof(int) == sizeof(int32_t) &&
+                sizeof(float) == sizeof(int32_t));
+  for (int i = 0; i < kNumArrays && count > 0; ++i) {
+    std::memcpy(SlotArray(slot, i, max_detections_), arrays[i],
+                count * sizeof(float));
+  }
+  return EndFrame(slot);
+}
+
+uint64_t ResultRingWriter::Publish(int64_t frame_index, int64_t timestamp_ns,
+                                   int image_width, int image_height,
+                                   absl::Span<const Detection> detections) {
+  char *slot = BeginFrame(frame_index, timestamp_ns, image_width,
+                          image_height, detections.size());
+  const size_t count =
+      reinterpret_cast<SlotHeader *>(slot)->info.num_detections;
+  int32_t *class_ids =
+      reinterpret_cast<int32_t *>(SlotArray(slot, 0, max_detections_));
+  float *confidences =
+      reinterpret_cast<float *>(SlotArray(slot, 1, max_detections_));
+  float *x1 = reinterpret_cast<float *>(SlotArray(slot, 2, max_detections_));
+  float *y1 = reinterpret_cast<float *>(SlotArray(slot, 3, max_detections_));
+  float *x2 = reinterpret_cast<float *>(SlotArray(slot, 4, max_detections_));
+  float *y2 = reinterpret_cast<float *>(SlotArray(slot, 5, max_detections_));
+  for (size_t i = 0; i < count; ++i) {
+    const Detection &det = detections[i];
+    class_ids[i] = det.class_id;
+    confidences[i] = det.confidence;
+    x1[i] = static_cast<float>(det.bbox.x);
+    y1[i] = static_cast<float>(det.bbox.y);
+    x2[i] = static_cast<float>(det.bbox.x + det.bbox.width);
+    y2[i] = static_cast<float>(det.bbox.y + det.bbox.height);
+  }
+  return EndFrame(slot);
+}
+
+absl::StatusOr<std::unique_ptr<ResultRingReader>>
+ResultRingReader::Open(const std::string &name) {
+  const int fd = shm_open(name.c_str(), O_RDONLY | O_CLOEXEC, 0);
+  if (fd < 0) {
+    if (errno == ENOENT) {
+      return absl::NotFoundError(
+          absl::StrFormat("No result ring %s", name));
+    }
+    return absl::InternalError(absl::StrFormat(
+        "Failed to open shared memory %s: %s", name, std::strerror(errno)));
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) != 0 ||
+      static_cast<size_t>(info.st_size) < kHeaderSize) {
+    close(fd);
+    return absl::FailedPreconditionError(
+        absl::StrFormat("Shared memory %s is not a result ring", name));
+  }
+  const size_t size = static_cast<size_t>(info.st_size);
+  void *memory = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (memory == MAP_FAILED) {
+    return absl::InternalError(
+        absl::StrFormat("Failed to map shared memory %s", name));
+  }
+
+  const RingHeader *header = static_cast<const RingHeader *>(memory);
+  if (header->magic.load(std::memory_order_acquire) != kMagic ||
+      header->version != kVersion || header->num_slots <= 0 ||
+      header->max_detections <= 0 ||
+      header->slot_size != SlotSize(header->max_detections) ||
+      RingSize(header->num_slots, header->max_detections) != size) {
+    munmap(memory, size);
+    return absl::FailedPreconditionError(absl::StrFormat(
+        "Shared memory %s is not an initialized version %d result ring",
+        name, kVersion));
+  }
+
+  return std::unique_ptr<ResultRingReader>(new ResultRingReader(
+      memory, size, header->num_slots, header->max_detections));
+}
+
+ResultRingReader::ResultRingReader(const void *memory, size_t size,
+                                   int num_slots, int max_detections)
+    : memory_(memory), size_(size), num_slots_(num_slots),
+      max_detections_(max_detections) {}
+
+ResultRingReader::~ResultRingReader() {
+  munmap(const_cast<void *>(memory_), size_);
+}
+
+uint64_t ResultRingReader::NextSequence() const {
+  return static_cast<const RingHeader *>(memory_)->next_sequence.load(
+      std::memory_order_acquire);
+}
+
+const char *ResultRingReader::SlotAt(uint64_t sequence) const {
+  return static_cast<const char *>(memory_) + kHeaderSize +
+         (sequence % num_slots_) * SlotSize(max_detections_);
+}
+
+bool ResultRingReader::Read(uint64_t sequence, ResultView *view) const {
+  if (sequence >= NextSequence()) {
+    return false;
+  }
+  const char *slot = SlotAt(sequence);
+  const SlotHeader *header = reinterpret_cast<const SlotHeader *>(slot);
+  if (header->stamp.load(std::memory_order_acquire) !=
+      PublishedStamp(sequence)) {
+    return false;
+  }
+
+  view->info = header->info;
+  view->info.sequence = sequence;
+  view->class_ids = reinterpret_cast<const int32_t *>(
+      SlotArray(slot, 0, max_detections_));
+  const float *arrays[kNumArrays - 1];
+  for (int i = 1; i < kNumArrays; ++i) {
+    arrays[i - 1] = reinterpret_cast<const float *>(
+        SlotArray(slot, i, max_detections_));
+  }
+  view->confidences = arrays[0];
+  view->x1 = arrays[1];
+  view->y1 = arrays[2];
+  view->x2 = arrays[3];
+  view->y2 = arrays[4];
+  // The metadata was copied out of the slot, it may be torn too.
+  return Validate(*view) && view->info.num_detections >= 0 &&
+         view->info.num_detections <= max_detections_;
+}
+
+bool ResultRingReader::Validate(const ResultView &view) const {
+  // Orders the reads made through the view before the stamp check.
+  std::atomic_thread_fence(std::memory_order_acquire);
+  const SlotHeader *header =
+      reinterpret_cast<const SlotHeader *>(SlotAt(view.info.sequence));
+  return header->stamp.load(std::memory_order_relaxed) ==
+         PublishedStamp(view.info.sequence);
+}
+
+bool ResultRingReader::Copy(uint64_t sequence, ResultFrameInfo *info,
+                            DetectionBatch *detections) const {
+  ResultView view;
+  if (!Read(sequence, &view)) {
+    return false;
+  }
+
+  const size_t count = static_cast<size_t>(view.info.num_detections);
+  detections->class_ids.assign(view.class_ids, view.class_ids + count);
+  detections->confidences.assign(view.confidences, view.confidences + count);
+  detections->x1.assign(view.x1, view.x1 + count);
+  detections->y1.assign(view.y1, view.y1 + count);
+  detections->x2.assign(view.x2, view.x2 + count);
+  detections->y2.assign(view.y2, view.y2 + count);
+  if (!Validate(view)) {
+    detections->Clear();
+    return false;
+  }
+  *info = view.info;
+  return true;
+}
+
+} // namespace inference
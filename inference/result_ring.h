@@ -0,0 +1,161 @@
+#ifndef INFERENCE_RESULT_RING_H_
+#define INFERENCE_RESULT_RING_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+
+#include "inference/detection.h"
+#include "inference/detection_batch.h"
+
+namespace inference {
+
+struct ResultRingOptions {
+  // Frames kept in the ring. Readers falling further behind than this lose
+  // frames.
+  int num_slots = 64;
+  // Detections stored per frame, the lowest confidence ones of a larger
+  // frame are dropped.
+  int max_detections = 300;
+};
+
+// Metadata of a published frame.
+struct ResultFrameInfo {
+  // Publish order in the ring, from 0.
+  uint64_t sequence = 0;
+  // Caller supplied frame index and timestamp.
+  int64_t frame_index = 0;
+  int64_t timestamp_ns = 0;
+  int32_t image_width = 0;
+  int32_t image_height = 0;
+  int32_t num_detections = 0;
+  // Detections beyond max_detections that were not stored.
+  int32_t dropped_detections = 0;
+};
+
+// A published frame, read in place in the shared memory. The arrays are
+// num_detections long, boxes are float corners in source pixels.
+//
+// The writer may start overwriting the slot at any time, so values read
+// through the pointers only count once ResultRingReader::Validate confirms
+// the view was intact while they were read.
+struct ResultView {
+  ResultFrameInfo info;
+  const int32_t *class_ids = nullptr;
+  const float *confidences = nullptr;
+  const float *x1 = nullptr;
+  const float *y1 = nullptr;
+  const float *x2 = nullptr;
+  const float *y2 = nullptr;
+};
+
+// Publishing side of a POSIX shared memory ring of detection results, for
+// sidecar processes (trackers, loggers, UIs) to consume the detections of an
+// inference process without serialization.
+//
+// The ring is single producer, multiple consumer and lock-free on both
+// sides. Each slot is a seqlock: the writer marks it odd while writing and
+// stamps it with the frame's sequence when done, readers check the stamp
+// before and after reading. Readers only map the memory read-only and keep
+// their own position, so any number of them can attach, fall behind or go
+// away without the writer noticing.
+//
+// Not thread-safe, there must be one writer per ring.
+class ResultRingWriter {
+public:
+  // Creates the shared memory object `name`, e.g. "/inference_results",
+  // replacing a stale one left by a crashed writer.
+  static absl::StatusOr<std::unique_ptr<ResultRingWriter>>
+  Create(const std::string &name, const ResultRingOptions &options);
+
+  // Unmaps and unlinks the ring. Attached readers keep their mapping.
+  ~ResultRingWriter();
+
+  ResultRingWriter(const ResultRingWriter &) = delete;
+  ResultRingWriter &operator=(const ResultRingWriter &) = delete;
+
+  // Publishes the detections of one frame, which must be sorted by
+  // descending confidence for truncation to drop the right ones. Never
+  // blocks and never allocates. Returns the sequence of the frame.
+  uint64_t Publish(int64_t frame_index, int64_t timestamp_ns, int image_width,
+                   int image_height, const DetectionBatch &detections);
+
+  // Same as above, for integer boxes.
+  uint64_t Publish(int64_t frame_index, int64_t timestamp_ns, int image_width,
+                   int image_height, absl::Span<const Detection> detections);
+
+  // Frames published so far.
+  uint64_t published() const { return next_sequence_; }
+
+private:
+  ResultRingWriter(std::string name, void *memory, size_t size,
+                   int num_slots, int max_detections);
+
+  // Marks the slot of the next sequence as being written, fills in its
+  // metadata for `count` detections, and returns it.
+  char *BeginFrame(int64_t frame_index, int64_t timestamp_ns,
+                   int image_width, int image_height, size_t count);
+  // Publishes the slot and returns its sequence.
+  uint64_t EndFrame(char *slot);
+
+  const std::string name_;
+  void *const memory_;
+  const size_t size_;
+  const int num_slots_;
+  const int max_detections_;
+  uint64_t next_sequence_ = 0;
+};
+
+// Consuming side of a ring created by ResultRingWriter, in any process.
+//
+// Thread-safe, all methods are const and only read the mapping.
+class ResultRingReader {
+public:
+  static absl::StatusOr<std::unique_ptr<ResultRingReader>>
+  Open(const std::string &name);
+
+  ~ResultRingReader();
+
+  ResultRingReader(const ResultRingReader &) = delete;
+  ResultRingReader &operator=(const ResultRingReader &) = delete;
+
+  // Sequence the writer publishes next. Frames from
+  // max(0, NextSequence() - num_slots()) on are readable, the rest were
+  // overwritten.
+  uint64_t NextSequence() const;
+
+  int num_slots() const { return num_slots_; }
+  int max_detections() const { return max_detections_; }
+
+  // Points `view` at frame `sequence` in the shared memory. Returns false if
+  // the frame is not published yet or was overwritten.
+  bool Read(uint64_t sequence, ResultView *view) const;
+
+  // Whether the slot of `view` still holds its frame. Call after reading
+  // through the view, values read before a failed validation may be torn.
+  bool Validate(const ResultView &view) const;
+
+  // Reads frame `sequence` into `info` and `detections`, validated. Returns
+  // false if the frame is not published yet or was overwritten.
+  bool Copy(uint64_t sequence, ResultFrameInfo *info,
+            DetectionBatch *detections) const;
+
+private:
+  ResultRingReader(const void *memory, size_t size, int num_slots,
+                   int max_detections);
+
+  const char *SlotAt(uint64_t sequence) const;
+
+  const void *const memory_;
+  const size_t size_;
+  const int num_slots_;
+  const int max_detections_;
+};
+
+} // namespace inference
+
+#endif
@@ -0,0 +1,75 @@
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+#include "absl/strings/str_format.h"
+
+#include "inference/server_protocol.h"
+
+namespace inference {
+
+absl::Status ReadFully(int fd, void *data, size_t size) {
+  char *bytes = static_cast<char *>(data);
+  while (size > 0) {
+    const ssize_t received = read(fd, bytes, size);
+    if (received < 0 && errno == EINTR) {
+      continue;
+    }
+    if (received == 0) {
+      return absl::UnavailableError("connection closed");
+    }
+    if (received < 0) {
+      return absl::UnavailableError(
+          absl::StrFormat("read failed: %s", std::strerror(errno)));
+    }
+    bytes += received;
+    size -= static_cast<size_t>(received);
+  }
+  return absl::OkStatus();
+}
+
+absl::Status WriteFully(int fd, const void *data, size_t size) {
+  const char *bytes = static_cast<const char *>(data);
+  while (size > 0) {
+    const ssize_t sent = send(fd, bytes, size, MSG_NOSIGNAL);
+    if (sent < 0 && errno == EINTR) {
+      continue;
+    }
+    if (sent < 0) {
+      return absl::UnavailableError(
+          absl::StrFormat("write failed: %s", std::strerror(errno)));
+    }
+    bytes += sent;
+    size -= static_cast<size_t>(sent);
+  }
+  return absl::OkStatus();
+}
+
+void EncodeResponse(const ResponseHeader &header, std::string_view message,
+                    const DetectionBatch &detections, std::string *buffer) {
+  ResponseHeader wire_header = header;
+  wire_header.message_size = static_cast<uint32_t>(message.size());
+  wire_header.num_detections = static_cast<uint32_t>(detections.Size());
+
+  buffer->resize(sizeof(wire_header) + message.size() +
+                 detections.Size() * sizeof(WireDetection));
+  char *out = buffer->data();
+  std::memcpy(out, &wire_header, sizeof(wire_header));
+  out += sizeof(wire_header);
+  std::memcpy(out, message.data(), message.size());
+  out += message.size();
+  for (size_t i = 0; i < detections.Size(); ++i) {
+    const WireDetection record{.class_id = detections.class_ids[i],
+                               .confidence = detections.confidences[i],
+                               .x1 = detections.x1[i],
+                               .y1 = detections.y1[i],
+                               .x2 = detections.x2[i],
+                               .y2 = detections.y2[i]};
+    std::memcpy(out, &record, sizeof(record));
+    out += sizeof(record);
+  }
+}
+
+} // namespace inference
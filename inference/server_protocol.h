@@ -0,0 +1,81 @@
+#ifndef INFERENCE_SERVER_PROTOCOL_H_
+#define INFERENCE_SERVER_PROTOCOL_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "absl/status/status.h"
+
+#include "inference/detection_batch.h"
+
+namespace inference {
+
+// Wire format of InferenceServer. Server and clients share a host, so every
+// field is in native byte order and structs are sent as they are laid out.
+//
+// A request is a RequestHeader followed by rows * cols * 3 bytes of 8-bit
+// BGR pixels, row by row without padding. A response is a ResponseHeader
+// followed by message_size bytes of error message and num_detections
+// WireDetection records. Responses of a connection may arrive in any order,
+// request_id tells them apart.
+
+constexpr uint32_t kRequestMagic = 0x51524649;  // "IFRQ"
+constexpr uint32_t kResponseMagic = 0x53524649; // "IFRS"
+
+struct RequestHeader {
+  uint32_t magic = kRequestMagic;
+  uint32_t rows = 0;
+  uint32_t cols = 0;
+  uint32_t reserved = 0;
+  // Chosen by the client, echoed in the response.
+  uint64_t request_id = 0;
+};
+
+struct ResponseHeader {
+  uint32_t magic = kResponseMagic;
+  // An absl::StatusCode, detections are only sent for kOk.
+  int32_t status_code = 0;
+  uint64_t request_id = 0;
+  uint32_t message_size = 0;
+  uint32_t num_detections = 0;
+  // Images in the forward pass that served the request, 0 if it never ran.
+  uint32_t batch_size = 0;
+  uint32_t reserved = 0;
+  // Time spent in the admission queue, and from the request being received
+  // to the response being sent.
+  int64_t queue_ns = 0;
+  int64_t latency_ns = 0;
+};
+
+// Box in source pixels, as float corners.
+struct WireDetection {
+  int32_t class_id = 0;
+  float confidence = 0.0f;
+  float x1 = 0.0f;
+  float y1 = 0.0f;
+  float x2 = 0.0f;
+  float y2 = 0.0f;
+};
+
+static_assert(sizeof(RequestHeader) == 24);
+static_assert(sizeof(ResponseHeader) == 48);
+static_assert(sizeof(WireDetection) == 24);
+
+// Reads exactly `size` bytes from the socket `fd`, retrying short reads and
+// interrupts. Returns UnavailableError once the peer closed the connection.
+absl::Status ReadFully(int fd, void *data, size_t size);
+
+// Writes exactly `size` bytes to the socket `fd`. Never raises SIGPIPE, a
+// closed peer is reported as UnavailableError.
+absl::Status WriteFully(int fd, const void *data, size_t size);
+
+// Serializes a response into `buffer`, overwriting it, so the caller can
+// send it with a single write.
+void EncodeResponse(const ResponseHeader &header, std::string_view message,
+                    const DetectionBatch &detections, std::string *buffer);
+
+} // namespace inference
+
+#endif
@@ -0,0 +1,199 @@
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <filesystem>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/str_format.h"
+
+#include "inference/shared_model.h"
+
+namespace inference {
+namespace {
+
+absl::StatusOr<int64_t> ModificationTimeNs(const std::string &path) {
+  struct stat info;
+  if (stat(path.c_str(), &info) != 0) {
+    return absl::NotFoundError(
+        absl::StrFormat("Cannot find model path %s", path));
+  }
+  return static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 +
+         info.st_mtim.tv_nsec;
+}
+
+} // namespace
+
+absl::StatusOr<std::shared_ptr<const SharedModel>>
+SharedModel::Load(const std::string &model_path) {
+  if (model_path.empty()) {
+    return absl::InvalidArgumentError("Model path is empty");
+  }
+
+  if (!std::filesystem::exists(model_path)) {
+    return absl::NotFoundError(
+        absl::StrFormat("Cannot find model path %s", model_path));
+  }
+
+  const int fd = open(model_path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return absl::InternalError(
+        absl::StrFormat("Failed to open model %s", model_path));
+  }
+
+  // Read into memory of our own rather than mapped: networks are parsed
+  // from it long after Load, and a mapping would see the file being
+  // rewritten in place, or fault if it shrank.
+  struct stat info;
+  std::string data;
+  bool read_ok = fstat(fd, &info) == 0 && info.st_size > 0;
+  if (read_ok) {
+    data.resize(static_cast<size_t>(info.st_size));
+    size_t offset = 0;
+    while (offset < data.size()) {
+      const ssize_t n =
+          pread(fd, data.data() + offset, data.size() - offset, offset);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        break;
+      }
+      offset += static_cast<size_t>(n);
+    }
+    read_ok = offset == data.size();
+  }
+  // A file rewritten while it was read gives a mix of both versions.
+  struct stat after;
+  read_ok = read_ok && fstat(fd, &after) == 0 &&
+            after.st_size == info.st_size &&
+            after.st_mtim.tv_sec == info.st_mtim.tv_sec &&
+            after.st_mtim.tv_nsec == info.st_mtim.tv_nsec;
+  close(fd);
+  if (!read_ok) {
+    return absl::InternalError(
+        absl::StrFormat("Failed to read model %s", model_path));
+  }
+
+  std::shared_ptr<SharedModel> model(new SharedModel());
+  model->path_ = model_path;
+  model->modification_time_ns_ =
+      static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 +
+      info.st_mtim.tv_nsec;
+  model->data_ = std::move(data);
+
+  return model;
+}
+
+absl::StatusOr<cv::dnn::Net> SharedModel::NewNetwork() const {
+  try {
+    return cv::dnn::readNetFromONNX(data_.data(), data_.size());
+  } catch (const cv::Exception &e) {
+    return absl::InternalError(e.what());
+  }
+}
+
+ModelCache &ModelCache::Global() {
+  // Leaked so engines destroyed during static destruction can still
+  // release their networks.
+  static ModelCache *cache = new ModelCache();
+  return *cache;
+}
+
+absl::StatusOr<std::shared_ptr<const SharedModel>>
+ModelCache::GetModel(const std::string &model_path) {
+  if (model_path.empty()) {
+    return absl::InvalidArgumentError("Model path is empty");
+  }
+  auto modification_time_ns = ModificationTimeNs(model_path);
+  if (!modification_time_ns.ok()) {
+    return modification_time_ns.status();
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(model_path);
+    if (it != entries_.end() &&
+        it->second.model->modification_time_ns() == *modification_time_ns) {
+      return it->second.model;
+    }
+  }
+
+  // Read without the lock held. If two threads race on the same file, the
+  // later one replaces the entry and both copies stay valid for whoever
+  // holds them.
+  auto model = SharedModel::Load(model_path);
+  if (!model.ok()) {
+    return model.status();
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  entries_[model_path] = Entry{.model = *model};
+  return *model;
+}
+
+absl::StatusOr<cv::dnn::Net>
+ModelCache::AcquireNetwork(const std::shared_ptr<const SharedModel> &model) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(model->path());
+    if (it != entries_.end() && it->second.model == model &&
+        !it->second.idle_networks.empty()) {
+      cv::dnn::Net net = std::move(it->second.idle_networks.back());
+      it->second.idle_networks.pop_back();
+      return net;
+    }
+  }
+
+  return model->NewNetwork();
+}
+
+void ModelCache::ReleaseNetwork(const std::shared_ptr<const SharedModel> &model,
+                                cv::dnn::Net net) {
+  // Networks dropped here are destroyed after the lock is released.
+  std::vector<cv::dnn::Net> dropped;
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = entries_.find(model->path());
+  if (it == entries_.end() || it->second.model != model) {
+    dropped.push_back(std::move(net));
+    return;
+  }
+  std::deque<cv::dnn::Net> &idle_networks = it->second.idle_networks;
+  idle_networks.push_back(std::move(net));
+  while (idle_networks.size() > max_idle_networks_) {
+    dropped.push_back(std::move(idle_networks.front()));
+    idle_networks.pop_front();
+  }
+}
+
+void ModelCache::SetMaxIdleNetworks(size_t max_idle_networks) {
+  std::vector<cv::dnn::Net> dropped;
+  std::lock_guard<std::mutex> lock(mutex_);
+  max_idle_networks_ = max_idle_networks;
+  for (auto &[path, entry] : entries_) {
+    while (entry.idle_networks.size() > max_idle_networks_) {
+      dropped.push_back(std::move(entry.idle_networks.front()));
+      entry.idle_networks.pop_front();
+    }
+  }
+}
+
+void ModelCache::Clear() {
+  std::map<std::string, Entry> entries;
+  std::lock_guard<std::mutex> lock(mutex_);
+  entries.swap(entries_);
+}
+
+size_t ModelCache::NumIdleNetworks() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  size_t count = 0;
+  for (const auto &[path, entry] : entries_) {
+    count += entry.idle_networks.size();
+  }
+  return count;
+}
+
+} // namespace inference
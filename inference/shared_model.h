@@ -0,0 +1,110 @@
+#ifndef INFERENCE_SHARED_MODEL_H_
+#define INFERENCE_SHARED_MODEL_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "absl/status/statusor.h"
+#include "opencv2/dnn.hpp"
+
+namespace inference {
+
+// An ONNX model read from disk once and shared by several engines.
+//
+// cv::dnn::Net runs are not thread-safe, so every engine needs its own
+// network, and OpenCV DNN keeps a private copy of the layer parameters (plus
+// backend specific repacked kernels) in every network it parses. What can be
+// shared is the serialized model, held in memory so NewNetwork parses
+// without file I/O. It is a copy rather than a mapping of the file, so
+// rewriting the file in place cannot corrupt networks parsed later.
+class SharedModel {
+public:
+  static absl::StatusOr<std::shared_ptr<const SharedModel>>
+  Load(const std::string &model_path);
+
+  SharedModel(const SharedModel &) = delete;
+  SharedModel &operator=(const SharedModel &) = delete;
+
+  // Returns a new network that can run independently of every other network
+  // created from this model. Thread-safe.
+  absl::StatusOr<cv::dnn::Net> NewNetwork() const;
+
+  const std::string &path() const { return path_; }
+
+  // Modification time of the file when it was read.
+  int64_t modification_time_ns() const { return modification_time_ns_; }
+
+  // Size of the serialized model.
+  size_t ModelBytes() const { return data_.size(); }
+
+private:
+  SharedModel() = default;
+
+  std::string path_;
+  int64_t modification_time_ns_ = 0;
+  std::string data_;
+};
+
+// Process-wide cache of loaded models and of the parsed networks engines are
+// done with, keyed by model path and modification time. Repeated
+// InferenceEngine::Create calls for the same file read it once, and an
+// engine created after another one was destroyed takes over its parsed network
+// instead of parsing the protobuf again. Rewriting the model file changes
+// its modification time, so stale entries are never handed out.
+//
+// An idle network keeps its activation buffers, as large as a running
+// engine's, so only a few per model are kept. A process whose concurrency
+// drops after a peak gives that memory back as its engines are destroyed.
+class ModelCache {
+public:
+  static constexpr size_t kDefaultMaxIdleNetworks = 2;
+
+  static ModelCache &Global();
+
+  // Returns the model for `model_path`, reading it if the file is new or
+  // changed since it was last read. Thread-safe.
+  absl::StatusOr<std::shared_ptr<const SharedModel>>
+  GetModel(const std::string &model_path);
+
+  // Returns a network of `model`, an idle one released earlier if there is
+  // one, a newly parsed one otherwise. Thread-safe.
+  absl::StatusOr<cv::dnn::Net>
+  AcquireNetwork(const std::shared_ptr<const SharedModel> &model);
+
+  // Keeps `net`, parsed from `model`, for a later AcquireNetwork. Dropped if
+  // the model has been replaced in the meantime. Beyond the idle network
+  // limit, the least recently released network of the model is dropped.
+  // Thread-safe.
+  void ReleaseNetwork(const std::shared_ptr<const SharedModel> &model,
+                      cv::dnn::Net net);
+
+  // Idle networks kept per model, 0 to keep none. Lowering it drops the
+  // least recently released networks right away. Thread-safe.
+  void SetMaxIdleNetworks(size_t max_idle_networks);
+
+  // Frees every model no engine uses anymore and drops all idle networks.
+  void Clear();
+
+  size_t NumIdleNetworks() const;
+
+private:
+  struct Entry {
+    std::shared_ptr<const SharedModel> model;
+    // Least recently released first.
+    std::deque<cv::dnn::Net> idle_networks;
+  };
+
+  mutable std::mutex mutex_;
+  size_t max_idle_networks_ = kDefaultMaxIdleNetworks;
+  // By model path.
+  std::map<std::string, Entry> entries_;
+};
+
+} // namespace inference
+
+#endif
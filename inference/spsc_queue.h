@@ -0,0 +1,132 @@
+#ifndef INFERENCE_SPSC_QUEUE_H_
+#define INFERENCE_SPSC_QUEUE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace inference {
+
+// Bounded lock-free single-producer / single-consumer ring buffer.
+//
+// TryPush and TryPop never block. Push and Pop block on the opposite side's
+// progress with std::atomic wait/notify, so an idle pipeline stage sleeps
+// instead of spinning. After Close, Push fails and Pop drains what is left.
+template <typename T> class SpscQueue {
+public:
+  // The capacity is rounded up to the next power of two.
+  explicit SpscQueue(size_t capacity)
+      : slots_(RoundUpToPowerOfTwo(capacity)), mask_(slots_.size() - 1) {}
+
+  SpscQueue(const SpscQueue &) = delete;
+  SpscQueue &operator=(const SpscQueue &) = delete;
+
+  size_t Capacity() const { return slots_.size(); }
+
+  size_t Size() const {
+    return static_cast<size_t>(tail_.load(std::memory_order_acquire) -
+                               head_.load(std::memory_order_acquire));
+  }
+
+  bool Closed() const { return closed_.load(std::memory_order_acquire); }
+
+  // Producer side. Returns false if the queue is full or closed, `value` is
+  // left untouched in that case.
+  bool TryPush(T &value) {
+    if (Closed()) {
+      return false;
+    }
+
+    const uint64_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_.load(std::memory_order_acquire) == slots_.size()) {
+      return false;
+    }
+
+    slots_[tail & mask_] = std::move(value);
+    tail_.store(tail + 1, std::memory_order_release);
+    Signal(pushes_);
+    return true;
+  }
+
+  // Producer side. Blocks while the queue is full, returns false if the
+  // queue is closed.
+  bool Push(T &value) {
+    while (true) {
+      const uint32_t pops = pops_.load(std::memory_order_acquire);
+      if (TryPush(value)) {
+        return true;
+      }
+      if (Closed()) {
+        return false;
+      }
+      pops_.wait(pops, std::memory_order_acquire);
+    }
+  }
+
+  // Consumer side. Returns false if the queue is empty.
+  bool TryPop(T &value) {
+    const uint64_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_.load(std::memory_order_acquire)) {
+      return false;
+    }
+
+    value = std::move(slots_[head & mask_]);
+    head_.store(head + 1, std::memory_order_release);
+    Signal(pops_);
+    return true;
+  }
+
+  // Consumer side. Blocks while the queue is empty, returns false once the
+  // queue is closed and drained.
+  bool Pop(T &value) {
+    while (true) {
+      const uint32_t pushes = pushes_.load(std::memory_order_acquire);
+      if (TryPop(value)) {
+        return true;
+      }
+      if (Closed()) {
+        // A push may have landed between the failed TryPop and Close.
+        return TryPop(value);
+      }
+      pushes_.wait(pushes, std::memory_order_acquire);
+    }
+  }
+
+  // Wakes both sides. Either side may call it.
+  void Close() {
+    closed_.store(true, std::memory_order_release);
+    Signal(pushes_);
+    Signal(pops_);
+  }
+
+private:
+  static size_t RoundUpToPowerOfTwo(size_t value) {
+    size_t result = 1;
+    while (result < value) {
+      result <<= 1;
+    }
+    return result;
+  }
+
+  // Event counters the blocking calls wait on. They are sampled before the
+  // non-blocking attempt, so a wakeup between the two is never lost.
+  static void Signal(std::atomic<uint32_t> &events) {
+    events.fetch_add(1, std::memory_order_release);
+    events.notify_all();
+  }
+
+  std::vector<T> slots_;
+  const size_t mask_;
+
+  alignas(64) std::atomic<uint64_t> head_{0};
+  alignas(64) std::atomic<uint64_t> tail_{0};
+  alignas(64) std::atomic<uint32_t> pushes_{0};
+  alignas(64) std::atomic<uint32_t> pops_{0};
+  std::atomic<bool> closed_{false};
+};
+
+} // namespace inference
+
+#endif
@@ -0,0 +1,107 @@
+#include <atomic>
+
+#include "opencv2/core.hpp"
+#include "gtest/gtest.h"
+
+#include "inference/async_inference_engine.h"
+#include "inference/inference_engine.h"
+
+namespace inference {
+namespace {
+class AsyncInferenceEngineTest : public ::testing::Test {
+protected:
+  static InferenceParams MakeParams() {
+    return InferenceParams{.model_path = "/workspace/yolo11n.onnx",
+                           .input_image_width = 640,
+                           .input_image_height = 640,
+                           .padding_value = cv::Scalar(114, 114, 114),
+                           .confidence_threshold = 0.25,
+                           .iou_threshold = 0.5};
+  }
+
+  static std::vector<cv::Mat> MakeFrames(int count) {
+    std::vector<cv::Mat> frames;
+    for (int i = 0; i < count; ++i) {
+      cv::Mat frame(480 + 40 * i, 640 + 80 * i, CV_8UC3);
+      cv::randu(frame, cv::Scalar::all(0), cv::Scalar::all(255));
+      frames.push_back(frame);
+    }
+    return frames;
+  }
+};
+
+TEST_F(AsyncInferenceEngineTest, ResultsMatchSynchronousEngineInOrderTest) {
+  auto async_engine = AsyncInferenceEngine::Create(MakeParams());
+  ASSERT_TRUE(async_engine.ok()) << async_engine.status();
+  auto engine = InferenceEngine::Create(MakeParams());
+  ASSERT_TRUE(engine.ok()) << engine.status();
+
+  const auto frames = MakeFrames(8);
+  std::vector<std::future<AsyncInferenceEngine::Result>> futures;
+  for (const auto &frame : frames) {
+    futures.push_back((*async_engine)->Submit(frame));
+  }
+
+  for (size_t i = 0; i < frames.size(); ++i) {
+    auto async_result = futures[i].get();
+    ASSERT_TRUE(async_result.ok()) << async_result.status();
+
+    auto expected = (*engine)->RunInference(frames[i]);
+    ASSERT_TRUE(expected.ok()) << expected.status();
+    ASSERT_EQ(async_result->size(), expected->size()) << "frame " << i;
+    for (size_t j = 0; j < expected->size(); ++j) {
+      EXPECT_EQ((*async_result)[j].class_id, (*expected)[j].class_id);
+      EXPECT_EQ((*async_result)[j].bbox, (*expected)[j].bbox);
+    }
+  }
+}
+
+TEST_F(AsyncInferenceEngineTest, CallbacksRunInSubmissionOrderTest) {
+  auto async_engine = AsyncInferenceEngine::Create(MakeParams());
+  ASSERT_TRUE(async_engine.ok()) << async_engine.status();
+
+  const auto frames = MakeFrames(6);
+  std::vector<int> delivered;
+  std::atomic<int> pending(static_cast<int>(frames.size()));
+  for (size_t i = 0; i < frames.size(); ++i) {
+    auto status = (*async_engine)->Submit(
+        frames[i], [&delivered, &pending, i](AsyncInferenceEngine::Result r) {
+          EXPECT_TRUE(r.ok()) << r.status();
+          delivered.push_back(static_cast<int>(i));
+          --pending;
+        });
+    ASSERT_TRUE(status.ok()) << status;
+  }
+
+  // Destroying the engine drains the pipeline.
+  async_engine->reset();
+  EXPECT_EQ(pending.load(), 0);
+  EXPECT_EQ(delivered, std::vector<int>({0, 1, 2, 3, 4, 5}));
+}
+
+TEST_F(AsyncInferenceEngineTest, RejectPolicyFailsFastWhenFullTest) {
+  auto params = MakeParams();
+  params.async_queue_depth = 1;
+  params.async_backpressure = BackpressurePolicy::kReject;
+  auto async_engine = AsyncInferenceEngine::Create(params);
+  ASSERT_TRUE(async_engine.ok()) << async_engine.status();
+
+  const auto frames = MakeFrames(1);
+  std::vector<std::future<AsyncInferenceEngine::Result>> futures;
+  for (int i = 0; i < 64; ++i) {
+    futures.push_back((*async_engine)->Submit(frames[0]));
+  }
+
+  int rejected = 0;
+  for (auto &future : futures) {
+    auto result = future.get();
+    if (!result.ok()) {
+      EXPECT_EQ(result.status().code(), absl::StatusCode::kResourceExhausted);
+      ++rejected;
+    }
+  }
+  EXPECT_GT(rejected, 0);
+}
+
+} // namespace
+} // namespace inference
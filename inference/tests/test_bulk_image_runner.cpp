@@ -0,0 +1,192 @@
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_format.h"
+#include "opencv2/core.hpp"
+#include "opencv2/imgcodecs.hpp"
+#include "gtest/gtest.h"
+
+#include "inference/bulk_image_runner.h"
+#include "inference/server_protocol.h"
+
+namespace inference {
+namespace {
+class BulkImageRunnerTest : public ::testing::Test {
+protected:
+  static constexpr int kNumImages = 12;
+
+  void SetUp() override {
+    directory_ = std::filesystem::temp_directory_path() / "bulk_runner_test";
+    std::filesystem::remove_all(directory_);
+    std::filesystem::create_directories(directory_ / "nested");
+
+    cv::Mat image(360, 480, CV_8UC3);
+    for (int i = 0; i < kNumImages; ++i) {
+      cv::randu(image, cv::Scalar::all(0), cv::Scalar::all(255));
+      const std::string name = absl::StrFormat(
+          "%simage_%02d.%s", i % 3 == 0 ? "nested/" : "", i,
+          i % 2 == 0 ? "jpg" : "png");
+      ASSERT_TRUE(cv::imwrite((directory_ / name).string(), image));
+    }
+    std::ofstream(directory_ / "notes.txt") << "not an image";
+  }
+
+  void TearDown() override { std::filesystem::remove_all(directory_); }
+
+  static InferenceParams Params() {
+    return InferenceParams{.model_path = "/workspace/yolo11n.onnx",
+                           .input_image_width = 640,
+                           .input_image_height = 640,
+                           .padding_value = cv::Scalar(114, 114, 114),
+                           .confidence_threshold = 0.25,
+                           .iou_threshold = 0.5};
+  }
+
+  static std::string ReadAll(const std::filesystem::path &path) {
+    std::ifstream file(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(file),
+                       std::istreambuf_iterator<char>());
+  }
+
+  static std::vector<std::string> Lines(const std::string &text) {
+    std::vector<std::string> lines;
+    std::istringstream stream(text);
+    std::string line;
+    while (std::getline(stream, line)) {
+      lines.push_back(line);
+    }
+    return lines;
+  }
+
+  std::vector<std::string> Images() const {
+    auto images = BulkImageRunner::ListImages(directory_.string());
+    EXPECT_TRUE(images.ok()) << images.status();
+    return images.ok() ? *images : std::vector<std::string>();
+  }
+
+  std::filesystem::path directory_;
+};
+
+TEST_F(BulkImageRunnerTest, ListsImagesRecursivelyOrFromAFileTest) {
+  const std::vector<std::string> images = Images();
+  ASSERT_EQ(images.size(), static_cast<size_t>(kNumImages));
+  EXPECT_TRUE(std::is_sorted(images.begin(), images.end()));
+
+  const std::filesystem::path list = directory_ / "list.txt";
+  std::ofstream(list) << images[3] << "\n\n  " << images[1] << "  \n";
+  auto listed = BulkImageRunner::ListImages(list.string());
+  ASSERT_TRUE(listed.ok()) << listed.status();
+  EXPECT_EQ(*listed, (std::vector<std::string>{images[3], images[1]}));
+
+  EXPECT_EQ(BulkImageRunner::ListImages((directory_ / "missing").string())
+                .status()
+                .code(),
+            absl::StatusCode::kNotFound);
+}
+
+TEST_F(BulkImageRunnerTest, WritesOneLinePerImageInOrderTest) {
+  std::vector<std::string> images = Images();
+  // A corrupt file is reported in place and does not stop the run.
+  const std::filesystem::path corrupt = directory_ / "corrupt.jpg";
+  std::ofstream(corrupt) << "garbage";
+  images.insert(images.begin() + 5, corrupt.string());
+
+  auto runner = BulkImageRunner::Create(
+      Params(), BulkOptions{.io_threads = 3, .batch_size = 4});
+  ASSERT_TRUE(runner.ok()) << runner.status();
+  const std::filesystem::path output = directory_ / "out.jsonl";
+  auto stats = (*runner)->Run(images, output.string());
+  ASSERT_TRUE(stats.ok()) << stats.status();
+
+  EXPECT_EQ(stats->images, kNumImages + 1);
+  EXPECT_EQ(stats->failed, 1);
+  EXPECT_GT(stats->images_per_second, 0.0);
+  EXPECT_GT(stats->forward_utilization, 0.0);
+  EXPECT_GT(stats->decode_utilization, 0.0);
+
+  const std::vector<std::string> lines = Lines(ReadAll(output));
+  ASSERT_EQ(lines.size(), images.size());
+  for (size_t i = 0; i < images.size(); ++i) {
+    EXPECT_EQ(lines[i].find("{\"image\":\"" + images[i] + "\""), 0u) << i;
+  }
+  EXPECT_NE(lines[5].find("\"error\":"), std::string::npos);
+  EXPECT_NE(lines[0].find("\"width\":480,\"height\":360"), std::string::npos);
+
+  // A runner processes one list.
+  EXPECT_EQ((*runner)->Run(images, output.string()).status().code(),
+            absl::StatusCode::kFailedPrecondition);
+}
+
+TEST_F(BulkImageRunnerTest, ResumesFromCheckpointTest) {
+  const std::vector<std::string> images = Images();
+  const std::filesystem::path expected_output = directory_ / "expected.jsonl";
+  {
+    auto runner = BulkImageRunner::Create(Params(), BulkOptions{});
+    ASSERT_TRUE(runner.ok()) << runner.status();
+    ASSERT_TRUE((*runner)->Run(images, expected_output.string()).ok());
+  }
+
+  // Three runs cut short by max_images pick up where the previous one left.
+  const std::filesystem::path output = directory_ / "resumed.jsonl";
+  const BulkOptions options{
+      .io_threads = 2,
+      .checkpoint_path = (directory_ / "checkpoint").string(),
+      .checkpoint_interval = 2,
+      .max_images = 5};
+  int64_t done = 0;
+  for (int run = 0; run < 3; ++run) {
+    auto runner = BulkImageRunner::Create(Params(), options);
+    ASSERT_TRUE(runner.ok()) << runner.status();
+    auto stats = (*runner)->Run(images, output.string());
+    ASSERT_TRUE(stats.ok()) << stats.status();
+    EXPECT_EQ(stats->resumed, done);
+    done += stats->images;
+  }
+  EXPECT_EQ(done, kNumImages);
+  EXPECT_EQ(ReadAll(output), ReadAll(expected_output));
+
+  // A checkpoint past the end of the list belongs to another list.
+  auto runner = BulkImageRunner::Create(Params(), options);
+  ASSERT_TRUE(runner.ok()) << runner.status();
+  EXPECT_EQ((*runner)
+                ->Run(std::vector<std::string>(images.begin(),
+                                               images.begin() + 3),
+                      output.string())
+                .status()
+                .code(),
+            absl::StatusCode::kFailedPrecondition);
+}
+
+TEST_F(BulkImageRunnerTest, BinaryRecordsHoldEveryImageTest) {
+  const std::vector<std::string> images = Images();
+  auto runner = BulkImageRunner::Create(
+      Params(), BulkOptions{.output_format = BulkOutputFormat::kBinary});
+  ASSERT_TRUE(runner.ok()) << runner.status();
+  const std::filesystem::path output = directory_ / "out.bin";
+  ASSERT_TRUE((*runner)->Run(images, output.string()).ok());
+
+  const std::string data = ReadAll(output);
+  size_t offset = 0;
+  for (const std::string &image : images) {
+    BulkRecordHeader header;
+    ASSERT_LE(offset + sizeof(header), data.size());
+    std::memcpy(&header, data.data() + offset, sizeof(header));
+    offset += sizeof(header);
+    EXPECT_EQ(header.magic, kBulkRecordMagic);
+    EXPECT_EQ(header.status_code, 0);
+    EXPECT_EQ(header.width, 480);
+    EXPECT_EQ(header.height, 360);
+    ASSERT_EQ(data.compare(offset, header.path_size, image), 0);
+    offset += header.path_size + header.num_detections * sizeof(WireDetection);
+  }
+  EXPECT_EQ(offset, data.size());
+}
+
+} // namespace
+} // namespace inference
@@ -0,0 +1,156 @@
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "inference/coco_evaluator.h"
+#include "inference/detection_batch.h"
+
+namespace inference {
+namespace {
+class CocoEvaluatorTest : public ::testing::Test {
+protected:
+  // Two images with two people (category 1) and a car (category 3) between
+  // them; class 0 of the model is category 1 and class 1 is category 3.
+  static std::unique_ptr<CocoEvaluator> TwoImages() {
+    std::vector<CocoImage> images = {
+        {.id = 7,
+         .file_name = "a.jpg",
+         .boxes = {{.category_id = 1, .x1 = 10, .y1 = 10, .x2 = 60, .y2 = 110},
+                   {.category_id = 3, .x1 = 100, .y1 = 50, .x2 = 300,
+                    .y2 = 150}}},
+        {.id = 9,
+         .file_name = "b.jpg",
+         .boxes = {{.category_id = 1, .x1 = 200, .y1 = 20, .x2 = 240,
+                    .y2 = 120}}}};
+    auto evaluator = CocoEvaluator::Create(std::move(images), {1, 3});
+    EXPECT_TRUE(evaluator.ok()) << evaluator.status();
+    return evaluator.ok() ? std::move(*evaluator) : nullptr;
+  }
+
+  // Detections equal to the ground truth of every image.
+  static void AddPerfectDetections(CocoEvaluator *evaluator) {
+    for (size_t i = 0; i < evaluator->images().size(); ++i) {
+      DetectionBatch detections;
+      for (const GroundTruthBox &box : evaluator->images()[i].boxes) {
+        detections.Add(box.category_id == 1 ? 0 : 1, 0.9f, box.x1, box.y1,
+                       box.x2, box.y2);
+      }
+      evaluator->AddDetections(i, detections);
+    }
+  }
+};
+
+TEST_F(CocoEvaluatorTest, PerfectDetectionsScoreOneTest) {
+  auto evaluator = TwoImages();
+  ASSERT_NE(evaluator, nullptr);
+  AddPerfectDetections(evaluator.get());
+
+  const CocoMetrics metrics = evaluator->Evaluate();
+  EXPECT_DOUBLE_EQ(metrics.map_50, 1.0);
+  EXPECT_DOUBLE_EQ(metrics.map_50_95, 1.0);
+  EXPECT_EQ(metrics.images, 2);
+  EXPECT_EQ(metrics.detections, 3);
+
+  evaluator->Reset();
+  const CocoMetrics empty = evaluator->Evaluate();
+  EXPECT_EQ(empty.map_50, 0.0);
+  EXPECT_EQ(empty.detections, 0);
+}
+
+TEST_F(CocoEvaluatorTest, LooseBoxesOnlyCountAtLowIouTest) {
+  auto evaluator = TwoImages();
+  ASSERT_NE(evaluator, nullptr);
+  // Every box shifted by a fifth of its width: IoU 2/3.
+  for (size_t i = 0; i < evaluator->images().size(); ++i) {
+    DetectionBatch detections;
+    for (const GroundTruthBox &box : evaluator->images()[i].boxes) {
+      const float shift = (box.x2 - box.x1) / 5.0f;
+      detections.Add(box.category_id == 1 ? 0 : 1, 0.9f, box.x1 + shift,
+                     box.y1, box.x2 + shift, box.y2);
+    }
+    evaluator->AddDetections(i, detections);
+  }
+
+  const CocoMetrics metrics = evaluator->Evaluate();
+  EXPECT_DOUBLE_EQ(metrics.map_50, 1.0);
+  // Matched at 0.5, 0.55, 0.6 and 0.65 out of ten thresholds.
+  EXPECT_NEAR(metrics.map_50_95, 0.4, 1e-9);
+}
+
+TEST_F(CocoEvaluatorTest, ConfidentFalsePositiveLowersPrecisionTest) {
+  auto evaluator = TwoImages();
+  ASSERT_NE(evaluator, nullptr);
+  AddPerfectDetections(evaluator.get());
+  // A person on the car, ranked above both real people.
+  DetectionBatch detections;
+  detections.Add(0, 0.95f, 100, 50, 300, 150);
+  detections.Add(0, 0.9f, 10, 10, 60, 110);
+  detections.Add(1, 0.9f, 100, 50, 300, 150);
+  evaluator->AddDetections(0, detections);
+
+  const CocoMetrics metrics = evaluator->Evaluate();
+  // Person precision is 2/3 at every recall level, the car is still 1.
+  EXPECT_NEAR(metrics.map_50, (2.0 / 3.0 + 1.0) / 2.0, 1e-9);
+
+  // Classes the evaluator has no category for are dropped.
+  detections.Add(5, 0.99f, 0, 0, 10, 10);
+  evaluator->AddDetections(0, detections);
+  EXPECT_NEAR(evaluator->Evaluate().map_50, (2.0 / 3.0 + 1.0) / 2.0, 1e-9);
+}
+
+TEST_F(CocoEvaluatorTest, DetectionsOnCrowdRegionsAreIgnoredTest) {
+  std::vector<CocoImage> images = {
+      {.id = 1,
+       .boxes = {{.category_id = 1, .x1 = 0, .y1 = 0, .x2 = 50, .y2 = 100},
+                 {.category_id = 1, .x1 = 100, .y1 = 0, .x2 = 400, .y2 = 300,
+                  .crowd = true}}}};
+  auto evaluator = CocoEvaluator::Create(std::move(images), {1});
+  ASSERT_TRUE(evaluator.ok()) << evaluator.status();
+
+  DetectionBatch detections;
+  detections.Add(0, 0.99f, 150, 50, 200, 150);
+  detections.Add(0, 0.98f, 250, 100, 300, 200);
+  detections.Add(0, 0.5f, 0, 0, 50, 100);
+  (*evaluator)->AddDetections(0, detections);
+  EXPECT_DOUBLE_EQ((*evaluator)->Evaluate().map_50_95, 1.0);
+}
+
+TEST_F(CocoEvaluatorTest, LoadsInstancesJsonTest) {
+  const std::filesystem::path path =
+      std::filesystem::temp_directory_path() / "coco_evaluator_test.json";
+  std::ofstream(path) << R"({
+    "images": [{"id": 42, "file_name": "x.jpg", "width": 640, "height": 480},
+               {"id": 5, "file_name": "y.jpg", "width": 640, "height": 480}],
+    "annotations": [
+      {"id": 1, "image_id": 5, "category_id": 3, "iscrowd": 0,
+       "bbox": [10.5, 20, 30, 40]},
+      {"id": 2, "image_id": 42, "category_id": 1, "iscrowd": 1,
+       "bbox": [0, 0, 100, 100]}],
+    "categories": [{"id": 3, "name": "car"}, {"id": 1, "name": "person"}]
+  })";
+  auto evaluator = CocoEvaluator::Load(path.string());
+  std::filesystem::remove(path);
+  ASSERT_TRUE(evaluator.ok()) << evaluator.status();
+
+  EXPECT_EQ((*evaluator)->category_ids(), (std::vector<int>{1, 3}));
+  const std::vector<CocoImage> &images = (*evaluator)->images();
+  ASSERT_EQ(images.size(), 2u);
+  EXPECT_EQ(images[0].id, 42);
+  EXPECT_EQ(images[1].file_name, "y.jpg");
+  ASSERT_EQ(images[0].boxes.size(), 1u);
+  EXPECT_TRUE(images[0].boxes[0].crowd);
+  ASSERT_EQ(images[1].boxes.size(), 1u);
+  const GroundTruthBox &box = images[1].boxes[0];
+  EXPECT_EQ(box.category_id, 3);
+  EXPECT_FALSE(box.crowd);
+  EXPECT_FLOAT_EQ(box.x1, 10.5f);
+  EXPECT_FLOAT_EQ(box.y2, 60.0f);
+
+  EXPECT_EQ(CocoEvaluator::Load("/nonexistent/instances.json").status().code(),
+            absl::StatusCode::kNotFound);
+}
+
+} // namespace
+} // namespace inference
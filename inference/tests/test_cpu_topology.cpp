@@ -0,0 +1,110 @@
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "inference/cpu_topology.h"
+
+namespace inference {
+namespace {
+class CpuTopologyTest : public ::testing::Test {
+protected:
+  // A dual-socket machine as sysfs shows it: one NUMA node per socket, two
+  // cores per socket, two hyperthreads per core. CPUs i and i + 4 are
+  // siblings, node 0 holds CPUs 0, 1, 4 and 5.
+  void SetUp() override {
+    root_ = std::filesystem::temp_directory_path() / "cpu_topology_test";
+    std::filesystem::remove_all(root_);
+    std::filesystem::create_directories(root_ / "cpu");
+    std::ofstream(root_ / "cpu" / "online") << "0-7\n";
+    for (int cpu = 0; cpu < 8; ++cpu) {
+      const std::filesystem::path topology =
+          root_ / "cpu" / ("cpu" + std::to_string(cpu)) / "topology";
+      std::filesystem::create_directories(topology);
+      std::ofstream(topology / "physical_package_id") << (cpu % 4) / 2;
+      std::ofstream(topology / "core_id") << cpu % 2;
+    }
+    for (const char *node : {"node0", "node1"}) {
+      std::filesystem::create_directories(root_ / "node" / node);
+    }
+    std::ofstream(root_ / "node" / "node0" / "cpulist") << "0-1,4-5\n";
+    std::ofstream(root_ / "node" / "node1" / "cpulist") << "2-3,6-7\n";
+  }
+
+  void TearDown() override { std::filesystem::remove_all(root_); }
+
+  std::filesystem::path root_;
+};
+
+TEST_F(CpuTopologyTest, ParsesCpuListsTest) {
+  auto cpus = ParseCpuList("0-2, 8,5\n");
+  ASSERT_TRUE(cpus.ok()) << cpus.status();
+  EXPECT_EQ(*cpus, (std::vector<int>{0, 1, 2, 5, 8}));
+  EXPECT_TRUE(ParseCpuList("")->empty());
+  EXPECT_FALSE(ParseCpuList("3-1").ok());
+  EXPECT_FALSE(ParseCpuList("cpu0").ok());
+}
+
+TEST_F(CpuTopologyTest, ReadsNodesAndCoresTest) {
+  auto topology = CpuTopology::FromSysfs(root_.string());
+  ASSERT_TRUE(topology.ok()) << topology.status();
+  EXPECT_EQ(topology->cpus().size(), 8u);
+  EXPECT_EQ(topology->NumNodes(), 2);
+  EXPECT_EQ(topology->NumCores(), 4);
+  EXPECT_EQ(topology->NodeCpus(1), (std::vector<int>{2, 3, 6, 7}));
+  EXPECT_TRUE(topology->NodeCpus(2).empty());
+  EXPECT_EQ(topology->cpus()[4].core, topology->cpus()[0].core);
+
+  // Without NUMA information everything is on node 0.
+  std::filesystem::remove_all(root_ / "node");
+  topology = CpuTopology::FromSysfs(root_.string());
+  ASSERT_TRUE(topology.ok()) << topology.status();
+  EXPECT_EQ(topology->NumNodes(), 1);
+  EXPECT_EQ(topology->NodeCpus(0).size(), 8u);
+
+  EXPECT_EQ(CpuTopology::FromSysfs((root_ / "missing").string())
+                .status()
+                .code(),
+            absl::StatusCode::kNotFound);
+}
+
+TEST_F(CpuTopologyTest, PartitionSpreadsSetsOverNodesAndCoresTest) {
+  auto topology = CpuTopology::FromSysfs(root_.string());
+  ASSERT_TRUE(topology.ok()) << topology.status();
+
+  // Alternating nodes, one hyperthread per core until the cores run out.
+  auto sets = topology->Partition(4, 1);
+  ASSERT_TRUE(sets.ok()) << sets.status();
+  EXPECT_EQ(*sets, (std::vector<std::vector<int>>{{0}, {2}, {1}, {3}}));
+
+  sets = topology->Partition(3, 2);
+  ASSERT_TRUE(sets.ok()) << sets.status();
+  EXPECT_EQ(*sets, (std::vector<std::vector<int>>{{0, 1}, {2, 3}, {4, 5}}));
+
+  // A set larger than a node spills over to the other one.
+  sets = topology->Partition(1, 6);
+  ASSERT_TRUE(sets.ok()) << sets.status();
+  EXPECT_EQ(*sets, (std::vector<std::vector<int>>{{0, 1, 2, 3, 4, 5}}));
+
+  EXPECT_FALSE(topology->Partition(3, 3).ok());
+  EXPECT_FALSE(topology->Partition(0, 1).ok());
+}
+
+TEST_F(CpuTopologyTest, ThreadAffinityRoundTripsTest) {
+  auto cpus = GetThreadAffinity();
+  ASSERT_TRUE(cpus.ok()) << cpus.status();
+  ASSERT_FALSE(cpus->empty());
+
+  ASSERT_TRUE(SetThreadAffinity({cpus->front()}).ok());
+  EXPECT_EQ(*GetThreadAffinity(), std::vector<int>{cpus->front()});
+  ASSERT_TRUE(SetThreadAffinity(*cpus).ok());
+  EXPECT_EQ(*GetThreadAffinity(), *cpus);
+
+  EXPECT_FALSE(SetThreadAffinity({}).ok());
+  EXPECT_FALSE(SetThreadAffinity({-1}).ok());
+}
+
+} // namespace
+} // namespace inference
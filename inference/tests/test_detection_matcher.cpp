@@ -0,0 +1,60 @@
+#include "gtest/gtest.h"
+
+#include "inference/detection_matcher.h"
+
+namespace inference {
+namespace {
+class DetectionMatcherTest : public ::testing::Test {
+protected:
+  static Detection Make(int class_id, float confidence, int x, int y) {
+    return Detection{.class_id = class_id,
+                     .confidence = confidence,
+                     .bbox = cv::Rect(x, y, 100, 100)};
+  }
+};
+
+TEST_F(DetectionMatcherTest, IdenticalSetsMatchFullyTest) {
+  const std::vector<Detection> detections = {Make(0, 0.9f, 0, 0),
+                                             Make(1, 0.8f, 200, 200)};
+  const MatchStats stats =
+      DetectionMatcher::Match(detections, detections, 0.5f);
+  EXPECT_EQ(stats.matched, 2);
+  EXPECT_DOUBLE_EQ(stats.Recall(), 1.0);
+  EXPECT_DOUBLE_EQ(stats.Precision(), 1.0);
+  EXPECT_DOUBLE_EQ(stats.MeanIoU(), 1.0);
+}
+
+TEST_F(DetectionMatcherTest, ClassAndOverlapMustAgreeTest) {
+  const std::vector<Detection> reference = {Make(0, 0.9f, 0, 0),
+                                            Make(1, 0.8f, 200, 200)};
+  // Right place but wrong class, shifted too far, and one extra box.
+  const std::vector<Detection> candidates = {
+      Make(2, 0.9f, 0, 0), Make(1, 0.8f, 260, 200), Make(1, 0.7f, 205, 200),
+      Make(3, 0.6f, 500, 500)};
+
+  const MatchStats stats =
+      DetectionMatcher::Match(reference, candidates, 0.5f);
+  EXPECT_EQ(stats.matched, 1);
+  EXPECT_DOUBLE_EQ(stats.Recall(), 0.5);
+  EXPECT_DOUBLE_EQ(stats.Precision(), 0.25);
+  EXPECT_NEAR(stats.MeanIoU(), 9500.0 / 10500.0, 1e-6);
+}
+
+TEST_F(DetectionMatcherTest, EachReferenceMatchesOnceTest) {
+  const std::vector<Detection> reference = {Make(0, 0.9f, 0, 0)};
+  const std::vector<Detection> candidates = {Make(0, 0.5f, 0, 0),
+                                             Make(0, 0.9f, 2, 0)};
+
+  MatchStats total = DetectionMatcher::Match(reference, candidates, 0.5f);
+  EXPECT_EQ(total.matched, 1);
+  // The more confident candidate claims the reference.
+  EXPECT_LT(total.MeanIoU(), 1.0);
+
+  total.Add(DetectionMatcher::Match(reference, reference, 0.5f));
+  EXPECT_EQ(total.reference_count, 2);
+  EXPECT_EQ(total.candidate_count, 3);
+  EXPECT_EQ(total.matched, 2);
+}
+
+} // namespace
+} // namespace inference
@@ -0,0 +1,98 @@
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "opencv2/core.hpp"
+#include "opencv2/imgcodecs.hpp"
+#include "gtest/gtest.h"
+
+#include "inference/blob_preprocessor.h"
+#include "inference/image_decoder.h"
+
+namespace inference {
+namespace {
+class ImageDecoderTest : public ::testing::Test {
+protected:
+  static std::vector<uint8_t> Encode(const std::string &extension, int width,
+                                     int height) {
+    cv::Mat image(height, width, CV_8UC3);
+    cv::randu(image, cv::Scalar::all(0), cv::Scalar::all(255));
+    std::vector<uint8_t> encoded;
+    EXPECT_TRUE(cv::imencode(extension, image, encoded));
+    return encoded;
+  }
+};
+
+TEST_F(ImageDecoderTest, ReadsJpegSizeFromHeaderTest) {
+  const std::vector<uint8_t> jpeg = Encode(".jpg", 1234, 567);
+  const auto size = ImageDecoder::JpegSize(jpeg);
+  ASSERT_TRUE(size.has_value());
+  EXPECT_EQ(*size, cv::Size(1234, 567));
+
+  EXPECT_FALSE(ImageDecoder::JpegSize(Encode(".png", 64, 64)).has_value());
+  // Truncated before the frame header.
+  EXPECT_FALSE(ImageDecoder::JpegSize(absl::MakeConstSpan(jpeg.data(), 4))
+                   .has_value());
+}
+
+TEST_F(ImageDecoderTest, ChoosesLargestCoveringReductionTest) {
+  EXPECT_EQ(ImageDecoder::ChooseReduction(cv::Size(320, 240), 640, 640), 1);
+  EXPECT_EQ(ImageDecoder::ChooseReduction(cv::Size(640, 480), 640, 640), 1);
+  EXPECT_EQ(ImageDecoder::ChooseReduction(cv::Size(1280, 720), 640, 640), 2);
+  EXPECT_EQ(ImageDecoder::ChooseReduction(cv::Size(1920, 1080), 640, 640), 2);
+  EXPECT_EQ(ImageDecoder::ChooseReduction(cv::Size(4000, 3000), 640, 640), 4);
+  EXPECT_EQ(ImageDecoder::ChooseReduction(cv::Size(5120, 5120), 640, 640), 8);
+  // A portrait image is limited by its height.
+  EXPECT_EQ(ImageDecoder::ChooseReduction(cv::Size(3000, 4000), 640, 640), 4);
+}
+
+TEST_F(ImageDecoderTest, DecodesLargeJpegsReducedTest) {
+  DecodedImage decoded;
+  ASSERT_TRUE(
+      ImageDecoder::Decode(Encode(".jpg", 4000, 3000), 640, 640, &decoded)
+          .ok());
+  EXPECT_EQ(decoded.reduction, 4);
+  EXPECT_EQ(decoded.image.size(), cv::Size(1000, 750));
+  EXPECT_EQ(decoded.original_size, cv::Size(4000, 3000));
+  EXPECT_EQ(decoded.image.type(), CV_8UC3);
+
+  // Sizes that do not divide evenly round up.
+  ASSERT_TRUE(
+      ImageDecoder::Decode(Encode(".jpg", 1283, 721), 640, 640, &decoded)
+          .ok());
+  EXPECT_EQ(decoded.reduction, 2);
+  EXPECT_EQ(decoded.image.size(), cv::Size(642, 361));
+  EXPECT_EQ(decoded.original_size, cv::Size(1283, 721));
+}
+
+TEST_F(ImageDecoderTest, DecodesOtherFormatsAtFullResolutionTest) {
+  DecodedImage decoded;
+  ASSERT_TRUE(
+      ImageDecoder::Decode(Encode(".png", 1920, 1080), 640, 640, &decoded)
+          .ok());
+  EXPECT_EQ(decoded.reduction, 1);
+  EXPECT_EQ(decoded.image.size(), cv::Size(1920, 1080));
+  EXPECT_EQ(decoded.original_size, cv::Size(1920, 1080));
+
+  const std::vector<uint8_t> garbage(100, 7);
+  EXPECT_EQ(ImageDecoder::Decode(garbage, 640, 640, &decoded).code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+TEST_F(ImageDecoderTest, OriginalGeometryMapsToFullResolutionTest) {
+  DecodedImage decoded;
+  ASSERT_TRUE(
+      ImageDecoder::Decode(Encode(".jpg", 4000, 3000), 640, 640, &decoded)
+          .ok());
+  const ImageInfo reduced =
+      BlobPreprocessor::Geometry(decoded.image.size(), 640, 640);
+  const ImageInfo original = ImageDecoder::OriginalGeometry(decoded, reduced);
+  EXPECT_EQ(original.width, 4000);
+  EXPECT_EQ(original.height, 3000);
+  EXPECT_FLOAT_EQ(original.scale, 640.0f / 4000.0f);
+  EXPECT_EQ(original.w_padding, reduced.w_padding);
+  EXPECT_EQ(original.h_padding, reduced.h_padding);
+}
+
+} // namespace
+} // namespace inference
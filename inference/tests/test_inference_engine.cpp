@@ -1,29 +1,47 @@
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
 #include "opencv2/core.hpp"
+#include "opencv2/imgcodecs.hpp"
+#include "opencv2/imgproc.hpp"
 #include "gtest/gtest.h"
 
+#include "inference/blob_preprocessor.h"
+#include "inference/cpu_topology.h"
+#include "inference/detection_matcher.h"
 #include "inference/inference_engine.h"
+#include "inference/pinned_thread_pool.h"
+#include "inference/yuv_image.h"
 
 namespace inference {
 namespace {
 class InferenceEngineTest : public ::testing::Test {
 protected:
   void SetUp() override {
-    auto inference_engine = InferenceEngine::Create(
-
-        InferenceParams{.model_path = "/workspace/yolo11n.onnx",
-                        .input_image_width = 640,
-                        .input_image_height = 640,
-                        .padding_value = cv::Scalar(114, 114, 114),
-                        .confidence_threshold = 0.5,
-                        .iou_threshold = 0.5});
-
+    auto inference_engine = InferenceEngine::Create(MakeParams());
     ASSERT_TRUE(inference_engine.ok());
     engine_ = std::move(*inference_engine);
   }
 
+  // Parameters of the fixture's engine, tests override single fields.
+  static InferenceParams MakeParams() {
+    return InferenceParams{.model_path = "/workspace/yolo11n.onnx",
+                           .input_image_width = 640,
+                           .input_image_height = 640,
+                           .padding_value = cv::Scalar(114, 114, 114),
+                           .confidence_threshold = 0.5,
+                           .iou_threshold = 0.5};
+  }
+
   static bool IsRegionSolidColor(const cv::Mat &full_image, cv::Rect region,
                                  cv::Scalar expected_color);
 
+  // Same classes in the same order, boxes within `tolerance` pixels.
+  static void ExpectDetectionsNear(const std::vector<Detection> &actual,
+                                   const std::vector<Detection> &expected,
+                                   int tolerance);
+
   std::unique_ptr<InferenceEngine> engine_;
 };
 
@@ -45,6 +63,19 @@ bool InferenceEngineTest::IsRegionSolidColor(const cv::Mat &full_image,
   return (total_diff[0] == 0.0 && total_diff[1] == 0.0 && total_diff[2] == 0.0);
 }
 
+void InferenceEngineTest::ExpectDetectionsNear(
+    const std::vector<Detection> &actual,
+    const std::vector<Detection> &expected, int tolerance) {
+  ASSERT_EQ(actual.size(), expected.size());
+  for (size_t i = 0; i < expected.size(); ++i) {
+    EXPECT_EQ(actual[i].class_id, expected[i].class_id) << "detection " << i;
+    EXPECT_NEAR(actual[i].bbox.x, expected[i].bbox.x, tolerance);
+    EXPECT_NEAR(actual[i].bbox.y, expected[i].bbox.y, tolerance);
+    EXPECT_NEAR(actual[i].bbox.width, expected[i].bbox.width, tolerance);
+    EXPECT_NEAR(actual[i].bbox.height, expected[i].bbox.height, tolerance);
+  }
+}
+
 TEST_F(InferenceEngineTest, LetterBoxTest) {
   cv::Mat source_image(1080, 1920, CV_8UC3, cv::Scalar(0, 0, 255));
   auto letterboxed_result = engine_->LetterBox(source_image, 640, 640);
@@ -69,5 +100,509 @@ TEST_F(InferenceEngineTest, LetterBoxTest) {
       << "Scaled image contained non-red pixels!";
 }
 
+TEST_F(InferenceEngineTest, FusedPreprocessingMatchesLetterBoxTest) {
+  BlobPreprocessor preprocessor(cv::Scalar(114, 114, 114));
+
+  const std::vector<cv::Size> source_sizes = {
+      {1920, 1080}, {3840, 2160}, {480, 720}, {640, 640}, {320, 200}};
+  for (const auto &size : source_sizes) {
+    cv::Mat source(size, CV_8UC3);
+    cv::randu(source, cv::Scalar::all(0), cv::Scalar::all(255));
+
+    auto letterboxed = engine_->LetterBox(source, 640, 640);
+    ASSERT_TRUE(letterboxed.ok());
+    cv::Mat expected = cv::dnn::blobFromImage(
+        *letterboxed, 1.0 / 255.0, cv::Size(640, 640), cv::Scalar(),
+        /*swapRB*/ true, /*crop*/ false);
+
+    cv::Mat actual(std::vector<int>{1, 3, 640, 640}, CV_32F);
+    ASSERT_TRUE(preprocessor.Run(source, 640, 640, actual.ptr<float>()).ok());
+
+    // cv::resize interpolates in fixed point and rounds to 8 bits, the fused
+    // kernel interpolates in float, so allow about one intensity level.
+    EXPECT_LE(cv::norm(expected, actual, cv::NORM_INF), 1.5 / 255.0)
+        << "Mismatch for source size " << size;
+  }
+}
+
+TEST_F(InferenceEngineTest, YuvPreprocessingMatchesConvertedBgrTest) {
+  BlobPreprocessor preprocessor(cv::Scalar(114, 114, 114));
+  cv::Mat expected(std::vector<int>{1, 3, 640, 640}, CV_32F);
+  cv::Mat actual(std::vector<int>{1, 3, 640, 640}, CV_32F);
+  ImageInfo expected_info;
+  ImageInfo actual_info;
+
+  for (const cv::Size size : {cv::Size(1920, 1080), cv::Size(480, 720),
+                              cv::Size(640, 640), cv::Size(320, 200)}) {
+    // Planes inside a wider buffer, so rows are strided.
+    cv::Mat buffer(size.height * 3 / 2, size.width + 64, CV_8UC1);
+    cv::randu(buffer, cv::Scalar::all(0), cv::Scalar::all(255));
+    const cv::Mat yuv = buffer(cv::Rect(0, 0, size.width, buffer.rows));
+    const uint8_t *y_plane = yuv.ptr<uint8_t>(0);
+    const uint8_t *chroma = yuv.ptr<uint8_t>(size.height);
+
+    cv::Mat bgr;
+    cv::cvtColor(yuv, bgr, cv::COLOR_YUV2BGR_NV12);
+    ASSERT_TRUE(preprocessor
+                    .Run(bgr, 640, 640, expected.ptr<float>(), &expected_info)
+                    .ok());
+    const YuvImage nv12 = YuvImage::Nv12(size.width, size.height, y_plane,
+                                         yuv.step, chroma, yuv.step);
+    ASSERT_TRUE(
+        preprocessor.Run(nv12, 640, 640, actual.ptr<float>(), &actual_info)
+            .ok());
+    EXPECT_LE(cv::norm(expected, actual, cv::NORM_INF), 1e-6)
+        << "NV12 mismatch for source size " << size;
+    EXPECT_EQ(actual_info.scale, expected_info.scale);
+    EXPECT_EQ(actual_info.w_padding, expected_info.w_padding);
+    EXPECT_EQ(actual_info.h_padding, expected_info.h_padding);
+
+    // I420 from a packed copy: Y, then the quarter size U and V planes.
+    const cv::Mat packed = yuv.clone();
+    cv::cvtColor(packed, bgr, cv::COLOR_YUV2BGR_I420);
+    ASSERT_TRUE(preprocessor
+                    .Run(bgr, 640, 640, expected.ptr<float>(), &expected_info)
+                    .ok());
+    const uint8_t *u_plane = packed.ptr<uint8_t>(size.height);
+    const uint8_t *v_plane = u_plane + size.area() / 4;
+    const YuvImage i420 =
+        YuvImage::I420(size.width, size.height, packed.ptr<uint8_t>(0),
+                       size.width, u_plane, size.width / 2, v_plane,
+                       size.width / 2);
+    ASSERT_TRUE(
+        preprocessor.Run(i420, 640, 640, actual.ptr<float>(), &actual_info)
+            .ok());
+    EXPECT_LE(cv::norm(expected, actual, cv::NORM_INF), 1e-6)
+        << "I420 mismatch for source size " << size;
+  }
+}
+
+TEST_F(InferenceEngineTest, RunInferenceOnNv12MatchesBgrTest) {
+  for (const char *path : {"/workspace/zidane.jpg", "/workspace/bus.jpg"}) {
+    const cv::Mat scene = cv::imread(path);
+    ASSERT_FALSE(scene.empty()) << path;
+    const int width = scene.cols;
+    const int height = scene.rows;
+
+    // OpenCV only encodes I420, interleave its U and V planes into NV12.
+    cv::Mat i420;
+    cv::cvtColor(scene, i420, cv::COLOR_BGR2YUV_I420);
+    cv::Mat nv12 = i420.clone();
+    const cv::Mat u(height / 2, width / 2, CV_8UC1, i420.ptr(height));
+    const cv::Mat v(height / 2, width / 2, CV_8UC1,
+                    i420.ptr(height) + u.total());
+    cv::Mat uv(height / 2, width / 2, CV_8UC2, nv12.ptr(height));
+    cv::merge(std::vector<cv::Mat>{u, v}, uv);
+
+    // Both paths see the same pixels, only the colour conversion differs.
+    cv::Mat bgr;
+    cv::cvtColor(nv12, bgr, cv::COLOR_YUV2BGR_NV12);
+    DetectionBatch expected;
+    ASSERT_TRUE(engine_->RunInference(bgr, &expected).ok());
+    DetectionBatch actual;
+    ASSERT_TRUE(engine_
+                    ->RunInference(YuvImage::Nv12(width, height, nv12.ptr(0),
+                                                  nv12.step, nv12.ptr(height),
+                                                  nv12.step),
+                                   &actual)
+                    .ok());
+    ASSERT_GT(expected.Size(), 0u) << path;
+    ASSERT_EQ(actual.Size(), expected.Size()) << path;
+    for (size_t i = 0; i < expected.Size(); ++i) {
+      EXPECT_EQ(actual.class_ids[i], expected.class_ids[i]) << path;
+      EXPECT_NEAR(actual.x1[i], expected.x1[i], 2.0f) << path;
+      EXPECT_NEAR(actual.y1[i], expected.y1[i], 2.0f) << path;
+      EXPECT_NEAR(actual.x2[i], expected.x2[i], 2.0f) << path;
+      EXPECT_NEAR(actual.y2[i], expected.y2[i], 2.0f) << path;
+    }
+
+    DetectionBatch odd;
+    EXPECT_EQ(engine_
+                  ->RunInference(YuvImage::Nv12(width - 1, height,
+                                                nv12.ptr(0), nv12.step,
+                                                nv12.ptr(height), nv12.step),
+                                 &odd)
+                  .code(),
+              absl::StatusCode::kInvalidArgument);
+  }
+}
+
+TEST_F(InferenceEngineTest, RunInferenceBatchMatchesSingleImageTest) {
+  // Real scenes, so there are detections to compare: a landscape and a
+  // portrait image, and a half size copy of the landscape one letterboxed
+  // at a different scale.
+  const cv::Mat landscape = cv::imread("/workspace/zidane.jpg");
+  const cv::Mat portrait = cv::imread("/workspace/bus.jpg");
+  ASSERT_FALSE(landscape.empty());
+  ASSERT_FALSE(portrait.empty());
+  cv::Mat small;
+  cv::resize(landscape, small, cv::Size(), 0.5, 0.5, cv::INTER_AREA);
+
+  std::vector<cv::Mat> sources = {landscape, portrait, small};
+  auto batch_result = engine_->RunInferenceBatch(sources);
+  ASSERT_TRUE(batch_result.ok()) << batch_result.status();
+  ASSERT_EQ(batch_result->size(), sources.size());
+
+  for (size_t i = 0; i < sources.size(); ++i) {
+    auto single_result = engine_->RunInference(sources[i]);
+    ASSERT_TRUE(single_result.ok()) << single_result.status();
+    ASSERT_FALSE(single_result->empty()) << "No detections in image " << i;
+    ASSERT_EQ((*batch_result)[i].size(), single_result->size())
+        << "Detection count mismatch for image " << i;
+
+    for (size_t j = 0; j < single_result->size(); ++j) {
+      const auto &batched = (*batch_result)[i][j];
+      const auto &single = (*single_result)[j];
+      EXPECT_EQ(batched.class_id, single.class_id);
+      EXPECT_NEAR(batched.confidence, single.confidence, 1e-4);
+      EXPECT_NEAR(batched.bbox.x, single.bbox.x, 1);
+      EXPECT_NEAR(batched.bbox.y, single.bbox.y, 1);
+      EXPECT_NEAR(batched.bbox.width, single.bbox.width, 1);
+      EXPECT_NEAR(batched.bbox.height, single.bbox.height, 1);
+    }
+  }
+}
+
+TEST_F(InferenceEngineTest, PreprocessRecordsLetterboxGeometryTest) {
+  cv::Mat landscape(1080, 1920, CV_8UC3, cv::Scalar::all(0));
+  cv::Mat portrait(720, 480, CV_8UC3, cv::Scalar::all(0));
+  std::vector<cv::Mat> sources = {landscape, portrait};
+
+  cv::Mat blob;
+  std::vector<ImageInfo> image_info;
+  ASSERT_TRUE(engine_->Preprocess(sources, &blob, &image_info).ok());
+  ASSERT_EQ(image_info.size(), 2u);
+
+  EXPECT_EQ(image_info[0].width, 1920);
+  EXPECT_EQ(image_info[0].height, 1080);
+  EXPECT_FLOAT_EQ(image_info[0].scale, 1.0f / 3.0f);
+  EXPECT_EQ(image_info[0].w_padding, 0);
+  EXPECT_EQ(image_info[0].h_padding, 140);
+
+  EXPECT_EQ(image_info[1].width, 480);
+  EXPECT_FLOAT_EQ(image_info[1].scale, 640.0f / 720.0f);
+  EXPECT_EQ(image_info[1].w_padding, 107);
+  EXPECT_EQ(image_info[1].h_padding, 0);
+}
+
+TEST_F(InferenceEngineTest, RectangularInputSizeIsStrideAlignedTest) {
+  EXPECT_EQ(BlobPreprocessor::InputSize(cv::Size(1920, 1080), 640, 640, 32),
+            cv::Size(640, 384));
+  EXPECT_EQ(BlobPreprocessor::InputSize(cv::Size(1080, 1920), 640, 640, 32),
+            cv::Size(384, 640));
+  EXPECT_EQ(BlobPreprocessor::InputSize(cv::Size(640, 480), 640, 640, 32),
+            cv::Size(640, 480));
+  EXPECT_EQ(BlobPreprocessor::InputSize(cv::Size(1000, 1000), 640, 640, 32),
+            cv::Size(640, 640));
+  // A 1:10 strip still gets one stride of height.
+  EXPECT_EQ(BlobPreprocessor::InputSize(cv::Size(1000, 100), 640, 640, 32),
+            cv::Size(640, 64));
+  EXPECT_EQ(BlobPreprocessor::InputSize(cv::Size(1920, 1080), 640, 640, 0),
+            cv::Size(640, 640));
+}
+
+TEST_F(InferenceEngineTest, RectangularLetterboxRecordsActualPaddingTest) {
+  InferenceParams params = MakeParams();
+  params.letterbox_stride = 32;
+  auto inference_engine = InferenceEngine::Create(params);
+  ASSERT_TRUE(inference_engine.ok());
+  InferenceEngine &rectangular = **inference_engine;
+
+  cv::Mat landscape(1080, 1920, CV_8UC3);
+  cv::randu(landscape, cv::Scalar::all(0), cv::Scalar::all(255));
+  cv::Mat blob;
+  std::vector<ImageInfo> image_info;
+  ASSERT_TRUE(rectangular
+                  .Preprocess(absl::MakeConstSpan(&landscape, 1), &blob,
+                              &image_info)
+                  .ok());
+  ASSERT_EQ(blob.size[2], 384);
+  ASSERT_EQ(blob.size[3], 640);
+  EXPECT_FLOAT_EQ(image_info[0].scale, 1.0f / 3.0f);
+  EXPECT_EQ(image_info[0].w_padding, 0);
+  EXPECT_EQ(image_info[0].h_padding, 12);
+
+  // The image rows are the same as in the full square, only the padding
+  // around them shrinks.
+  cv::Mat square_blob;
+  ASSERT_TRUE(
+      engine_->Preprocess(absl::MakeConstSpan(&landscape, 1), &square_blob)
+          .ok());
+  for (int c = 0; c < 3; ++c) {
+    const cv::Mat plane(384, 640, CV_32F, blob.ptr<float>(0, c));
+    const cv::Mat square_plane(640, 640, CV_32F, square_blob.ptr<float>(0, c));
+    EXPECT_EQ(cv::norm(plane.rowRange(12, 372),
+                       square_plane.rowRange(140, 500), cv::NORM_INF),
+              0.0);
+  }
+
+  // A batch shares the smallest shape holding all of its images.
+  cv::Mat four_by_three(480, 640, CV_8UC3, cv::Scalar::all(0));
+  std::vector<cv::Mat> sources = {landscape, four_by_three};
+  ASSERT_TRUE(rectangular.Preprocess(sources, &blob, &image_info).ok());
+  ASSERT_EQ(blob.size[2], 480);
+  ASSERT_EQ(blob.size[3], 640);
+  EXPECT_FLOAT_EQ(image_info[0].scale, 1.0f / 3.0f);
+  EXPECT_EQ(image_info[0].h_padding, 60);
+  EXPECT_EQ(image_info[1].h_padding, 0);
+
+  // Unscaling a single image assumes the shape it was preprocessed into.
+  std::vector<Detection> detections = {
+      Detection{.class_id = 0, .confidence = 0.9f,
+                .bbox = cv::Rect(30, 42, 300, 150)}};
+  rectangular.UnscaleDetections(landscape, &detections);
+  EXPECT_EQ(detections[0].bbox, cv::Rect(90, 90, 900, 450));
+}
+
+TEST_F(InferenceEngineTest, RectangularRunInferenceMatchesSquareTest) {
+  InferenceParams params = MakeParams();
+  params.letterbox_stride = 32;
+  auto inference_engine = InferenceEngine::Create(params);
+  ASSERT_TRUE(inference_engine.ok()) << inference_engine.status();
+
+  // 1280x720 runs at 640x384 and 810x1080 at 480x640, both with fewer
+  // anchors than the square the engine was created with.
+  for (const char *path : {"/workspace/zidane.jpg", "/workspace/bus.jpg"}) {
+    const cv::Mat source = cv::imread(path);
+    ASSERT_FALSE(source.empty()) << path;
+    auto rectangular = (*inference_engine)->RunInference(source);
+    ASSERT_TRUE(rectangular.ok()) << rectangular.status();
+    ASSERT_FALSE(rectangular->empty()) << path;
+    auto square = engine_->RunInference(source);
+    ASSERT_TRUE(square.ok()) << square.status();
+
+    // Less padding moves a few borderline detections, the rest must agree.
+    const MatchStats stats =
+        DetectionMatcher::Match(*square, *rectangular, /*iou_threshold=*/0.7f);
+    EXPECT_GE(stats.Recall(), 0.9) << path;
+    EXPECT_GE(stats.Precision(), 0.9) << path;
+  }
+}
+
+TEST_F(InferenceEngineTest, UnscaleUsesRecordedGeometryTest) {
+  const ImageInfo image_info{.width = 1920,
+                             .height = 1080,
+                             .scale = 1.0f / 3.0f,
+                             .w_padding = 0,
+                             .h_padding = 140};
+  DetectionBatch detections;
+  detections.Add(0, 0.9f, 10.5f, 150.25f, 100.0f, 200.0f);
+  // Spills over the padding, clipped to the image.
+  detections.Add(1, 0.8f, -5.0f, 100.0f, 700.0f, 520.0f);
+
+  InferenceEngine::UnscaleDetections(image_info, &detections);
+  EXPECT_FLOAT_EQ(detections.x1[0], 31.5f);
+  EXPECT_FLOAT_EQ(detections.y1[0], 30.75f);
+  EXPECT_FLOAT_EQ(detections.x2[0], 300.0f);
+  EXPECT_FLOAT_EQ(detections.y2[0], 180.0f);
+  EXPECT_EQ(detections.x1[1], 0.0f);
+  EXPECT_EQ(detections.y1[1], 0.0f);
+  EXPECT_EQ(detections.x2[1], 1920.0f);
+  EXPECT_EQ(detections.y2[1], 1080.0f);
+}
+
+TEST_F(InferenceEngineTest, DetectionBatchMatchesRoundedDetectionsTest) {
+  const cv::Mat source = cv::imread("/workspace/zidane.jpg");
+  ASSERT_FALSE(source.empty());
+
+  DetectionBatch batch;
+  ASSERT_TRUE(engine_->RunInference(source, &batch).ok());
+  auto detections = engine_->RunInference(source);
+  ASSERT_TRUE(detections.ok());
+
+  // Boxes are rounded once, from the float result.
+  ASSERT_GT(batch.Size(), 0u);
+  ASSERT_EQ(batch.Size(), detections->size());
+  for (size_t i = 0; i < batch.Size(); ++i) {
+    EXPECT_EQ(batch.ToDetection(i).bbox, (*detections)[i].bbox);
+    EXPECT_EQ(batch.class_ids[i], (*detections)[i].class_id);
+  }
+}
+
+TEST_F(InferenceEngineTest, EncodedImagesUnscaleToFullResolutionTest) {
+  // A real scene blown up to a 12 megapixel photo, so there are boxes to
+  // scale back.
+  const cv::Mat scene = cv::imread("/workspace/zidane.jpg");
+  ASSERT_FALSE(scene.empty());
+  cv::Mat source;
+  cv::resize(scene, source, cv::Size(4000, 3000), 0, 0, cv::INTER_LINEAR);
+
+  // Lossless formats decode at full resolution, same as RunInference.
+  std::vector<uint8_t> png;
+  ASSERT_TRUE(cv::imencode(".png", source, png));
+  DetectionBatch expected;
+  ASSERT_TRUE(engine_->RunInference(source, &expected).ok());
+  DetectionBatch actual;
+  ASSERT_TRUE(engine_->RunInferenceEncoded(png, &actual).ok());
+  ASSERT_GT(actual.Size(), 0u);
+  EXPECT_EQ(actual.x1, expected.x1);
+  EXPECT_EQ(actual.y2, expected.y2);
+
+  // The JPEG is decoded at 1/4 scale, boxes are scaled back up by 4.
+  std::vector<uint8_t> jpeg;
+  ASSERT_TRUE(cv::imencode(".jpg", source, jpeg));
+  const cv::Mat reduced = cv::imdecode(jpeg, cv::IMREAD_REDUCED_COLOR_4);
+  ASSERT_EQ(reduced.size(), cv::Size(1000, 750));
+  ASSERT_TRUE(engine_->RunInference(reduced, &expected).ok());
+  ASSERT_TRUE(engine_->RunInferenceEncoded(jpeg, &actual).ok());
+  ASSERT_GT(actual.Size(), 0u);
+  ASSERT_EQ(actual.Size(), expected.Size());
+  for (size_t i = 0; i < actual.Size(); ++i) {
+    EXPECT_NEAR(actual.x1[i], 4.0f * expected.x1[i], 1e-2f);
+    EXPECT_NEAR(actual.y1[i], 4.0f * expected.y1[i], 1e-2f);
+    EXPECT_NEAR(actual.x2[i], 4.0f * expected.x2[i], 1e-2f);
+    EXPECT_NEAR(actual.y2[i], 4.0f * expected.y2[i], 1e-2f);
+  }
+
+  const std::vector<uint8_t> garbage(64, 0);
+  EXPECT_EQ(engine_->RunInferenceEncoded(garbage, &actual).code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+TEST_F(InferenceEngineTest, MetricsRecordEveryStageTest) {
+  EXPECT_EQ(engine_->metrics(), nullptr);
+
+  InferenceParams params = MakeParams();
+  params.enable_metrics = true;
+  params.metrics_trace_capacity = 16;
+  auto inference_engine = InferenceEngine::Create(params);
+  ASSERT_TRUE(inference_engine.ok());
+  const InferenceMetrics *metrics = (*inference_engine)->metrics();
+  ASSERT_NE(metrics, nullptr);
+
+  cv::Mat source(720, 1280, CV_8UC3);
+  cv::randu(source, cv::Scalar::all(0), cv::Scalar::all(255));
+  for (int i = 0; i < 3; ++i) {
+    ASSERT_TRUE((*inference_engine)->RunInference(source).ok());
+  }
+
+  for (Stage stage : {Stage::kPreprocess, Stage::kForward, Stage::kDecode,
+                      Stage::kNms, Stage::kUnscale}) {
+    EXPECT_EQ(metrics->stage_latency(stage).Count(), 3u) << StageName(stage);
+  }
+  EXPECT_GT(metrics->stage_latency(Stage::kForward).Sum(), 0u);
+  EXPECT_EQ(metrics->candidates_before_nms().Count(), 3u);
+  EXPECT_EQ(metrics->frames(), 3u);
+  EXPECT_GT(metrics->FramesPerSecond(), 0.0);
+}
+
+TEST_F(InferenceEngineTest, OutputLayoutInferredAtCreateTest) {
+  const OutputLayout &layout = engine_->output_layout();
+  EXPECT_EQ(layout.format, OutputFormat::kChannelMajor);
+  EXPECT_EQ(layout.num_classes, 80);
+  EXPECT_EQ(layout.rows, 84);
+  EXPECT_EQ(layout.cols, 8400);
+
+  // A forced layout that does not fit the output is rejected up front.
+  InferenceParams params = MakeParams();
+  params.output_format = OutputFormat::kEndToEnd;
+  auto inference_engine = InferenceEngine::Create(params);
+  EXPECT_EQ(inference_engine.status().code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+TEST_F(InferenceEngineTest, BackendParamsAreAppliedTest) {
+  InferenceParams params = MakeParams();
+  params.device = ComputeDevice::kCpu;
+  params.enable_fusion = false;
+  params.enable_winograd = false;
+  params.warmup_runs = 2;
+  auto inference_engine = InferenceEngine::Create(params);
+  ASSERT_TRUE(inference_engine.ok()) << inference_engine.status();
+  const BackendConfig &config = (*inference_engine)->backend_config();
+  EXPECT_EQ(config.device, ComputeDevice::kCpu);
+  EXPECT_FALSE(config.fusion);
+  EXPECT_FALSE(config.winograd);
+  EXPECT_FALSE(config.fp16);
+  EXPECT_FALSE((*inference_engine)->quantized());
+
+  // Fusion and Winograd only reorder floating point math.
+  for (const char *path : {"/workspace/zidane.jpg", "/workspace/bus.jpg"}) {
+    const cv::Mat source = cv::imread(path);
+    ASSERT_FALSE(source.empty()) << path;
+    auto unfused = (*inference_engine)->RunInference(source);
+    auto fused = engine_->RunInference(source);
+    ASSERT_TRUE(unfused.ok());
+    ASSERT_TRUE(fused.ok());
+    ASSERT_FALSE(fused->empty()) << path;
+    ExpectDetectionsNear(*unfused, *fused, 2);
+  }
+}
+
+TEST_F(InferenceEngineTest, AutotunePicksAConfigurationTest) {
+  InferenceParams params = MakeParams();
+  params.device = ComputeDevice::kCpu;
+  params.autotune = true;
+  params.autotune_runs = 1;
+  auto inference_engine = InferenceEngine::Create(params);
+  ASSERT_TRUE(inference_engine.ok()) << inference_engine.status();
+  // FP16 was not allowed.
+  EXPECT_FALSE((*inference_engine)->backend_config().fp16);
+
+  cv::Mat source(480, 640, CV_8UC3);
+  cv::randu(source, cv::Scalar::all(0), cv::Scalar::all(255));
+  EXPECT_TRUE((*inference_engine)->RunInference(source).ok());
+}
+
+TEST_F(InferenceEngineTest, PinnedEngineMatchesUnpinnedTest) {
+  PinnedThreadPool::InstallParallelBackend();
+  auto caller_cpus = GetThreadAffinity();
+  ASSERT_TRUE(caller_cpus.ok()) << caller_cpus.status();
+  const std::vector<int> cpus(
+      caller_cpus->begin(),
+      caller_cpus->begin() + std::min<size_t>(2, caller_cpus->size()));
+
+  InferenceParams params = MakeParams();
+  params.num_threads = 2;
+  params.cpus = cpus;
+  auto inference_engine = InferenceEngine::Create(params);
+  ASSERT_TRUE(inference_engine.ok()) << inference_engine.status();
+
+  for (const char *path : {"/workspace/zidane.jpg", "/workspace/bus.jpg"}) {
+    const cv::Mat source = cv::imread(path);
+    ASSERT_FALSE(source.empty()) << path;
+    auto pinned = (*inference_engine)->RunInference(source);
+    auto unpinned = engine_->RunInference(source);
+    ASSERT_TRUE(pinned.ok());
+    ASSERT_TRUE(unpinned.ok());
+    ASSERT_FALSE(unpinned->empty()) << path;
+    ExpectDetectionsNear(*pinned, *unpinned, 1);
+  }
+  // The calling thread is only pinned for the duration of the call.
+  EXPECT_EQ(*GetThreadAffinity(), *caller_cpus);
+
+  InferenceParams unknown_node = MakeParams();
+  unknown_node.numa_node = 4096;
+  EXPECT_EQ(InferenceEngine::Create(unknown_node).status().code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+TEST_F(InferenceEngineTest, ThreadBudgetStaysInsideTheEngineTest) {
+  PinnedThreadPool::InstallParallelBackend();
+  const int process_threads = cv::getNumThreads();
+  InferenceParams params = MakeParams();
+  params.num_threads = 1;
+  auto inference_engine = InferenceEngine::Create(params);
+  ASSERT_TRUE(inference_engine.ok()) << inference_engine.status();
+  EXPECT_EQ(cv::getNumThreads(), process_threads);
+
+  for (const char *path : {"/workspace/zidane.jpg", "/workspace/bus.jpg"}) {
+    const cv::Mat source = cv::imread(path);
+    ASSERT_FALSE(source.empty()) << path;
+    auto budgeted = (*inference_engine)->RunInference(source);
+    auto shared = engine_->RunInference(source);
+    ASSERT_TRUE(budgeted.ok());
+    ASSERT_TRUE(shared.ok());
+    ASSERT_FALSE(shared->empty()) << path;
+    ExpectDetectionsNear(*budgeted, *shared, 1);
+  }
+  EXPECT_EQ(cv::getNumThreads(), process_threads);
+}
+
+TEST_F(InferenceEngineTest, RunInferenceBatchRejectsEmptyBatchTest) {
+  auto result = engine_->RunInferenceBatch({});
+  EXPECT_EQ(result.status().code(), absl::StatusCode::kInvalidArgument);
+}
+
 } // namespace
 } // namespace inference
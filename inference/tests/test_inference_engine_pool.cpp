@@ -0,0 +1,91 @@
+#include <future>
+#include <vector>
+
+#include "opencv2/core.hpp"
+#include "opencv2/imgcodecs.hpp"
+#include "opencv2/imgproc.hpp"
+#include "gtest/gtest.h"
+
+#include "inference/inference_engine.h"
+#include "inference/inference_engine_pool.h"
+
+namespace inference {
+namespace {
+class InferenceEnginePoolTest : public ::testing::Test {
+protected:
+  static InferenceParams MakeParams() {
+    return InferenceParams{.model_path = "/workspace/yolo11n.onnx",
+                           .input_image_width = 640,
+                           .input_image_height = 640,
+                           .padding_value = cv::Scalar(114, 114, 114),
+                           .confidence_threshold = 0.25,
+                           .iou_threshold = 0.5};
+  }
+};
+
+TEST_F(InferenceEnginePoolTest, ConcurrentRequestsMatchSingleEngineTest) {
+  auto pool = InferenceEnginePool::Create(MakeParams(), 3);
+  ASSERT_TRUE(pool.ok()) << pool.status();
+  EXPECT_EQ((*pool)->NumWorkers(), 3);
+
+  auto engine = InferenceEngine::Create(MakeParams());
+  ASSERT_TRUE(engine.ok()) << engine.status();
+
+  // Real scenes at a few scales, each with its own detections, so a worker
+  // answering with another request's result shows up.
+  std::vector<cv::Mat> scenes;
+  for (const char *path : {"/workspace/zidane.jpg", "/workspace/bus.jpg"}) {
+    const cv::Mat image = cv::imread(path);
+    ASSERT_FALSE(image.empty()) << path;
+    for (double scale : {1.0, 0.75, 0.5}) {
+      cv::Mat resized;
+      cv::resize(image, resized, cv::Size(), scale, scale, cv::INTER_AREA);
+      scenes.push_back(resized);
+    }
+  }
+
+  std::vector<cv::Mat> frames;
+  std::vector<std::future<InferenceEnginePool::Result>> futures;
+  for (int i = 0; i < 12; ++i) {
+    frames.push_back(scenes[i % scenes.size()]);
+    futures.push_back((*pool)->Submit(frames.back()));
+  }
+
+  for (size_t i = 0; i < frames.size(); ++i) {
+    auto pooled = futures[i].get();
+    ASSERT_TRUE(pooled.ok()) << pooled.status();
+
+    auto expected = (*engine)->RunInference(frames[i]);
+    ASSERT_TRUE(expected.ok()) << expected.status();
+    ASSERT_FALSE(expected->empty()) << "frame " << i;
+    ASSERT_EQ(pooled->size(), expected->size()) << "frame " << i;
+    for (size_t j = 0; j < expected->size(); ++j) {
+      const Detection &actual = (*pooled)[j];
+      EXPECT_EQ(actual.class_id, (*expected)[j].class_id) << "frame " << i;
+      EXPECT_NEAR(actual.bbox.x, (*expected)[j].bbox.x, 1) << "frame " << i;
+      EXPECT_NEAR(actual.bbox.y, (*expected)[j].bbox.y, 1) << "frame " << i;
+      EXPECT_NEAR(actual.bbox.width, (*expected)[j].bbox.width, 1)
+          << "frame " << i;
+      EXPECT_NEAR(actual.bbox.height, (*expected)[j].bbox.height, 1)
+          << "frame " << i;
+    }
+  }
+}
+
+TEST_F(InferenceEnginePoolTest, DefaultsToOneWorkerPerNodeTest) {
+  auto pool = InferenceEnginePool::Create(MakeParams());
+  ASSERT_TRUE(pool.ok()) << pool.status();
+  EXPECT_EQ((*pool)->NumWorkers(), InferenceEnginePool::DefaultNumWorkers());
+  EXPECT_GE((*pool)->NumWorkers(), 1);
+
+  cv::Mat frame(480, 640, CV_8UC3, cv::Scalar::all(128));
+  EXPECT_TRUE((*pool)->RunInference(frame).ok());
+}
+
+TEST_F(InferenceEnginePoolTest, RejectsEmptyPoolTest) {
+  auto pool = InferenceEnginePool::Create(MakeParams(), 0);
+  EXPECT_EQ(pool.status().code(), absl::StatusCode::kInvalidArgument);
+}
+
+} // namespace
+} // namespace inference
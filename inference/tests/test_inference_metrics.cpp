@@ -0,0 +1,114 @@
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "inference/inference_metrics.h"
+
+namespace inference {
+namespace {
+class InferenceMetricsTest : public ::testing::Test {
+protected:
+  static std::string ReadFile(const std::string &path) {
+    std::ifstream file(path);
+    return std::string(std::istreambuf_iterator<char>(file),
+                       std::istreambuf_iterator<char>());
+  }
+
+  static int CountOccurrences(const std::string &text,
+                              const std::string &pattern) {
+    int count = 0;
+    for (size_t pos = text.find(pattern); pos != std::string::npos;
+         pos = text.find(pattern, pos + 1)) {
+      ++count;
+    }
+    return count;
+  }
+};
+
+TEST_F(InferenceMetricsTest, HistogramBucketsBoundValuesTest) {
+  int previous_index = -1;
+  for (uint64_t value = 0; value < 100000; value += 1 + value / 7) {
+    const int index = Histogram::BucketIndex(value);
+    const uint64_t upper = Histogram::BucketUpperBound(index);
+    EXPECT_GE(upper, value);
+    EXPECT_LE(upper, value + value / 4) << "value " << value;
+    EXPECT_GE(index, previous_index);
+    previous_index = index;
+  }
+  EXPECT_LT(Histogram::BucketIndex(~uint64_t{0}), Histogram::kNumBuckets);
+}
+
+TEST_F(InferenceMetricsTest, HistogramQuantilesTest) {
+  Histogram histogram;
+  EXPECT_EQ(histogram.Quantile(0.5), 0u);
+
+  for (uint64_t value = 1; value <= 1000; ++value) {
+    histogram.Record(value);
+  }
+  EXPECT_EQ(histogram.Count(), 1000u);
+  EXPECT_EQ(histogram.Sum(), 500500u);
+  EXPECT_NEAR(histogram.Quantile(0.5), 500.0, 125.0);
+  EXPECT_NEAR(histogram.Quantile(0.99), 990.0, 250.0);
+  EXPECT_EQ(histogram.CountAtMost(1023), 1000u);
+  EXPECT_EQ(histogram.CountAtMost(255), 255u);
+}
+
+TEST_F(InferenceMetricsTest, PrometheusTextTest) {
+  InferenceMetrics metrics(/*trace_capacity=*/0);
+  metrics.RecordStage(Stage::kForward, 0, 3000000);
+  metrics.RecordCandidates(120, 7);
+  metrics.RecordFrame();
+
+  const std::string text = metrics.PrometheusText();
+  auto contains = [&text](const std::string &line) {
+    return text.find(line) != std::string::npos;
+  };
+  EXPECT_TRUE(
+      contains("inference_stage_latency_seconds_count{stage=\"forward\"} 1"));
+  EXPECT_TRUE(
+      contains("inference_stage_latency_seconds_count{stage=\"nms\"} 0"));
+  EXPECT_TRUE(contains("inference_stage_latency_seconds_bucket{stage="
+                       "\"forward\",le=\"+Inf\"} 1"));
+  EXPECT_TRUE(contains("inference_candidates_before_nms_sum 120"));
+  EXPECT_TRUE(contains("inference_frames_total 1"));
+}
+
+TEST_F(InferenceMetricsTest, ChromeTraceKeepsMostRecentSpansTest) {
+  InferenceMetrics metrics(/*trace_capacity=*/2);
+  metrics.RecordStage(Stage::kPreprocess, 0, 10);
+  metrics.RecordStage(Stage::kForward, 10, 20);
+  metrics.RecordStage(Stage::kNms, 20, 30);
+
+  const auto path = std::filesystem::temp_directory_path() /
+                    "inference_metrics_test_trace.json";
+  ASSERT_TRUE(metrics.WriteChromeTrace(path.string()).ok());
+  const std::string trace = ReadFile(path.string());
+  std::filesystem::remove(path);
+
+  EXPECT_EQ(CountOccurrences(trace, "\"ph\":\"X\""), 2);
+  EXPECT_EQ(trace.find("preprocess"), std::string::npos);
+  EXPECT_LT(trace.find("forward"), trace.find("nms"));
+
+  // Stage histograms keep every span, the ring only bounds the trace.
+  EXPECT_EQ(metrics.stage_latency(Stage::kPreprocess).Count(), 1u);
+}
+
+TEST_F(InferenceMetricsTest, ResetClearsEverythingTest) {
+  InferenceMetrics metrics(/*trace_capacity=*/4);
+  metrics.RecordStage(Stage::kDecode, 0, 100);
+  metrics.RecordCandidates(10, 2);
+  metrics.RecordFrame();
+  metrics.RecordFrame();
+
+  metrics.Reset();
+  EXPECT_EQ(metrics.stage_latency(Stage::kDecode).Count(), 0u);
+  EXPECT_EQ(metrics.candidates_before_nms().Count(), 0u);
+  EXPECT_EQ(metrics.frames(), 0u);
+  EXPECT_EQ(metrics.FramesPerSecond(), 0.0);
+}
+
+} // namespace
+} // namespace inference
@@ -0,0 +1,247 @@
+#include <unistd.h>
+
+#include <chrono>
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "opencv2/core.hpp"
+#include "opencv2/imgcodecs.hpp"
+#include "opencv2/imgproc.hpp"
+#include "gtest/gtest.h"
+
+#include "inference/detection_batch.h"
+#include "inference/inference_client.h"
+#include "inference/inference_engine.h"
+#include "inference/inference_server.h"
+
+namespace inference {
+namespace {
+class InferenceServerTest : public ::testing::Test {
+protected:
+  static InferenceParams MakeParams() {
+    return InferenceParams{.model_path = "/workspace/yolo11n.onnx",
+                           .input_image_width = 640,
+                           .input_image_height = 640,
+                           .padding_value = cv::Scalar(114, 114, 114),
+                           .confidence_threshold = 0.25,
+                           .iou_threshold = 0.5};
+  }
+
+  // Socket paths are global, keep concurrent test runs apart.
+  static std::string SocketPath() {
+    return "/tmp/inference_server_test_" + std::to_string(getpid()) +
+           ".sock";
+  }
+
+  static std::unique_ptr<InferenceServer>
+  StartServer(ServerOptions options,
+              const InferenceParams &params = MakeParams()) {
+    options.socket_path = SocketPath();
+    auto server = InferenceServer::Create(params, options);
+    EXPECT_TRUE(server.ok()) << server.status();
+    return server.ok() ? std::move(*server) : nullptr;
+  }
+
+  static std::unique_ptr<InferenceClient> Connect() {
+    auto client = InferenceClient::Connect(SocketPath());
+    EXPECT_TRUE(client.ok()) << client.status();
+    return client.ok() ? std::move(*client) : nullptr;
+  }
+
+  static cv::Mat RandomImage(int rows, int cols) {
+    cv::Mat image(rows, cols, CV_8UC3);
+    cv::randu(image, cv::Scalar::all(0), cv::Scalar::all(255));
+    return image;
+  }
+};
+
+TEST_F(InferenceServerTest, MatchesLocalEngineTest) {
+  auto server = StartServer(ServerOptions{.max_batch_delay_us = 0});
+  ASSERT_NE(server, nullptr);
+  auto client = Connect();
+  ASSERT_NE(client, nullptr);
+  auto engine = InferenceEngine::Create(MakeParams());
+  ASSERT_TRUE(engine.ok()) << engine.status();
+
+  for (const cv::Size size : {cv::Size(640, 480), cv::Size(300, 900)}) {
+    const cv::Mat image = RandomImage(size.height, size.width);
+    DetectionBatch remote;
+    ASSERT_TRUE(client->Detect(image, &remote).ok());
+    DetectionBatch local;
+    ASSERT_TRUE((*engine)->RunInference(image, &local).ok());
+
+    ASSERT_EQ(remote.Size(), local.Size());
+    for (size_t i = 0; i < local.Size(); ++i) {
+      EXPECT_EQ(remote.class_ids[i], local.class_ids[i]);
+      EXPECT_NEAR(remote.x1[i], local.x1[i], 1e-3);
+      EXPECT_NEAR(remote.y2[i], local.y2[i], 1e-3);
+    }
+  }
+}
+
+TEST_F(InferenceServerTest, CoalescesConcurrentClientsTest) {
+  // A long delay makes the batch close because it is full.
+  auto server = StartServer(
+      ServerOptions{.max_batch_size = 4, .max_batch_delay_us = 2000000});
+  ASSERT_NE(server, nullptr);
+
+  // Different resolutions, each unscaled onto its own image.
+  const std::vector<cv::Size> sizes = {cv::Size(640, 480), cv::Size(320, 240),
+                                       cv::Size(480, 800), cv::Size(64, 64)};
+  std::vector<ServerResponse> responses(sizes.size());
+  std::vector<std::thread> clients;
+  for (size_t i = 0; i < sizes.size(); ++i) {
+    clients.emplace_back([&, i]() {
+      auto client = Connect();
+      ASSERT_NE(client, nullptr);
+      ASSERT_TRUE(
+          client->Send(RandomImage(sizes[i].height, sizes[i].width)).ok());
+      ASSERT_TRUE(client->Receive(&responses[i]).ok());
+    });
+  }
+  for (std::thread &client : clients) {
+    client.join();
+  }
+
+  for (size_t i = 0; i < sizes.size(); ++i) {
+    const ServerResponse &response = responses[i];
+    ASSERT_TRUE(response.status.ok()) << response.status;
+    EXPECT_EQ(response.batch_size, 4);
+    EXPECT_GE(response.latency_ns, response.queue_ns);
+    for (size_t j = 0; j < response.detections.Size(); ++j) {
+      EXPECT_GE(response.detections.x1[j], 0.0f);
+      EXPECT_LE(response.detections.x2[j], sizes[i].width);
+      EXPECT_LE(response.detections.y2[j], sizes[i].height);
+    }
+  }
+
+  const ServerStats stats = server->stats();
+  EXPECT_EQ(stats.requests, 4u);
+  EXPECT_EQ(stats.batches, 1u);
+  ASSERT_EQ(stats.by_batch_size.size(), 1u);
+  EXPECT_EQ(stats.by_batch_size[0].batch_size, 4);
+  EXPECT_EQ(stats.by_batch_size[0].requests, 4u);
+  EXPECT_GT(stats.by_batch_size[0].p99_ms, 0.0);
+}
+
+TEST_F(InferenceServerTest, PipelinedRequestsAreAnsweredTest) {
+  auto server = StartServer(
+      ServerOptions{.max_batch_size = 3, .max_batch_delay_us = 100000});
+  ASSERT_NE(server, nullptr);
+  auto client = Connect();
+  ASSERT_NE(client, nullptr);
+
+  std::vector<uint64_t> ids;
+  for (int i = 0; i < 3; ++i) {
+    auto id = client->Send(RandomImage(360, 640));
+    ASSERT_TRUE(id.ok()) << id.status();
+    ids.push_back(*id);
+  }
+  for (int i = 0; i < 3; ++i) {
+    ServerResponse response;
+    ASSERT_TRUE(client->Receive(&response).ok());
+    EXPECT_TRUE(response.status.ok()) << response.status;
+    EXPECT_EQ(response.request_id, ids[i]);
+    EXPECT_EQ(response.batch_size, 3);
+  }
+}
+
+TEST_F(InferenceServerTest, RejectsWhenQueueIsFullTest) {
+  auto server = StartServer(ServerOptions{
+      .max_batch_size = 1, .max_batch_delay_us = 0, .queue_capacity = 1});
+  ASSERT_NE(server, nullptr);
+  auto client = Connect();
+  ASSERT_NE(client, nullptr);
+
+  // Sent faster than a forward pass runs, most find the queue taken.
+  constexpr int kRequests = 16;
+  const cv::Mat image = RandomImage(480, 640);
+  for (int i = 0; i < kRequests; ++i) {
+    ASSERT_TRUE(client->Send(image).ok());
+  }
+  int rejected = 0;
+  for (int i = 0; i < kRequests; ++i) {
+    ServerResponse response;
+    ASSERT_TRUE(client->Receive(&response).ok());
+    if (!response.status.ok()) {
+      EXPECT_EQ(response.status.code(), absl::StatusCode::kResourceExhausted);
+      EXPECT_EQ(response.batch_size, 0);
+      ++rejected;
+    }
+  }
+  EXPECT_GT(rejected, 0);
+  EXPECT_LT(rejected, kRequests);
+  EXPECT_EQ(server->stats().rejected, static_cast<uint64_t>(rejected));
+}
+
+TEST_F(InferenceServerTest, BadImagesOnlyFailTheirOwnRequestTest) {
+  auto server = StartServer(ServerOptions{.max_batch_delay_us = 0});
+  ASSERT_NE(server, nullptr);
+  auto client = Connect();
+  ASSERT_NE(client, nullptr);
+
+  DetectionBatch detections;
+  EXPECT_EQ(client->Detect(cv::Mat(0, 0, CV_8UC3), &detections).code(),
+            absl::StatusCode::kInvalidArgument);
+  EXPECT_EQ(client->Detect(cv::Mat(4, 4, CV_8UC1), &detections).code(),
+            absl::StatusCode::kInvalidArgument);
+  // The connection is still usable.
+  EXPECT_TRUE(client->Detect(RandomImage(480, 640), &detections).ok());
+}
+
+TEST_F(InferenceServerTest, ClientThatNeverReadsDoesNotBlockOthersTest) {
+  // A threshold this low fills every response up to max_detections, so the
+  // responses of a few batches overflow the socket buffer.
+  InferenceParams params = MakeParams();
+  params.confidence_threshold = 0.001;
+  params.max_detections = 300;
+  auto server = StartServer(ServerOptions{.max_batch_delay_us = 0,
+                                          .queue_capacity = 128,
+                                          .max_queued_response_bytes = 64 << 10,
+                                          .write_timeout_ms = 200},
+                            params);
+  ASSERT_NE(server, nullptr);
+  cv::Mat image = cv::imread("/workspace/bus.jpg");
+  ASSERT_FALSE(image.empty());
+  cv::resize(image, image, cv::Size(), 0.5, 0.5, cv::INTER_AREA);
+
+  auto stalled = Connect();
+  ASSERT_NE(stalled, nullptr);
+  // Sends fail once the server gave up on the client.
+  int sent = 0;
+  while (sent < 64 && stalled->Send(image).ok()) {
+    ++sent;
+  }
+
+  auto reader = Connect();
+  ASSERT_NE(reader, nullptr);
+  auto detected = std::async(std::launch::async, [&] {
+    DetectionBatch detections;
+    return reader->Detect(image, &detections);
+  });
+  ASSERT_EQ(detected.wait_for(std::chrono::seconds(60)),
+            std::future_status::ready)
+      << "Response held up behind a client that never reads";
+  EXPECT_TRUE(detected.get().ok());
+  EXPECT_EQ(server->stats().disconnected, 1u);
+}
+
+TEST_F(InferenceServerTest, RejectsInvalidOptionsTest) {
+  EXPECT_EQ(InferenceServer::Create(MakeParams(),
+                                    ServerOptions{.socket_path = ""})
+                .status()
+                .code(),
+            absl::StatusCode::kInvalidArgument);
+  EXPECT_EQ(InferenceServer::Create(MakeParams(),
+                                    ServerOptions{.socket_path = SocketPath(),
+                                                  .max_batch_size = 0})
+                .status()
+                .code(),
+            absl::StatusCode::kInvalidArgument);
+  EXPECT_FALSE(InferenceClient::Connect(SocketPath()).ok());
+}
+
+} // namespace
+} // namespace inference
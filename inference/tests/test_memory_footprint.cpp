@@ -0,0 +1,37 @@
+#include "opencv2/core.hpp"
+#include "gtest/gtest.h"
+
+#include "inference/inference_engine_pool.h"
+
+namespace inference {
+namespace {
+
+// A binary of its own: memory other tests freed would be reused by the
+// workers and hide what they cost.
+TEST(MemoryFootprintTest, PoolMemoryGrowsSublinearlyWithWorkersTest) {
+  // Reads the model afresh instead of taking networks recycled by the cache.
+  const InferenceParams params{.model_path = "/workspace/yolo11n.onnx",
+                               .input_image_width = 640,
+                               .input_image_height = 640,
+                               .padding_value = cv::Scalar(114, 114, 114),
+                               .confidence_threshold = 0.25,
+                               .iou_threshold = 0.5,
+                               .use_model_cache = false};
+  constexpr int kWorkers = 4;
+  auto pool = InferenceEnginePool::Create(params, kWorkers);
+  ASSERT_TRUE(pool.ok()) << pool.status();
+
+  const auto &report = (*pool)->memory_report();
+  ASSERT_GT(report.model_bytes, 0u);
+  ASSERT_GT(report.first_worker_bytes, report.model_bytes);
+  // The model copy and OpenCV's one-time setup are paid once, every
+  // further worker only adds its own network.
+  const size_t total_bytes = report.first_worker_bytes +
+                             (kWorkers - 1) * report.extra_worker_bytes;
+  EXPECT_LT(total_bytes, kWorkers * report.first_worker_bytes)
+      << "first worker " << report.first_worker_bytes << " bytes, extra "
+      << report.extra_worker_bytes << " bytes";
+}
+
+} // namespace
+} // namespace inference
@@ -0,0 +1,141 @@
+#include "opencv2/core.hpp"
+#include "gtest/gtest.h"
+
+#include "inference/motion_gated_inference_engine.h"
+
+namespace inference {
+namespace {
+class MotionGatedInferenceEngineTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    background_.create(1080, 1920, CV_8UC3);
+    cv::randu(background_, cv::Scalar::all(0), cv::Scalar::all(255));
+  }
+
+  static InferenceParams Params() {
+    return InferenceParams{.model_path = "/workspace/yolo11n.onnx",
+                           .input_image_width = 640,
+                           .input_image_height = 640,
+                           .padding_value = cv::Scalar(114, 114, 114),
+                           .confidence_threshold = 0.25,
+                           .iou_threshold = 0.5};
+  }
+
+  std::unique_ptr<MotionGatedInferenceEngine>
+  Create(const MotionGateOptions &options = MotionGateOptions{}) {
+    auto engine = MotionGatedInferenceEngine::Create(Params(), options);
+    EXPECT_TRUE(engine.ok()) << engine.status();
+    return engine.ok() ? std::move(*engine) : nullptr;
+  }
+
+  GateDecision Run(MotionGatedInferenceEngine &engine, const cv::Mat &frame) {
+    std::vector<Detection> detections;
+    EXPECT_TRUE(engine.RunInference(frame, &detections).ok());
+    return engine.last_decision();
+  }
+
+  cv::Mat background_;
+};
+
+TEST_F(MotionGatedInferenceEngineTest, StaticFramesReuseDetectionsTest) {
+  auto engine = Create();
+  ASSERT_NE(engine, nullptr);
+
+  auto first = engine->RunInference(background_);
+  ASSERT_TRUE(first.ok());
+  EXPECT_EQ(engine->last_decision(), GateDecision::kFull);
+
+  // Sensor noise stays below the pixel threshold.
+  cv::Mat noisy = background_.clone();
+  cv::Mat noise(noisy.size(), CV_8UC3);
+  cv::randu(noise, cv::Scalar::all(0), cv::Scalar::all(3));
+  noisy += noise;
+
+  auto second = engine->RunInference(noisy);
+  ASSERT_TRUE(second.ok());
+  EXPECT_EQ(engine->last_decision(), GateDecision::kSkipped);
+  ASSERT_EQ(second->size(), first->size());
+  for (size_t i = 0; i < first->size(); ++i) {
+    EXPECT_EQ((*second)[i].bbox, (*first)[i].bbox);
+  }
+  EXPECT_EQ(engine->stats().full_frames, 1);
+  EXPECT_EQ(engine->stats().skipped_frames, 1);
+}
+
+TEST_F(MotionGatedInferenceEngineTest, LocalChangeInfersRegionsTest) {
+  auto engine = Create();
+  ASSERT_NE(engine, nullptr);
+  EXPECT_EQ(Run(*engine, background_), GateDecision::kFull);
+
+  cv::Mat moved = background_.clone();
+  moved(cv::Rect(100, 100, 120, 120)).setTo(cv::Scalar(255, 255, 255));
+  moved(cv::Rect(1600, 800, 80, 160)).setTo(cv::Scalar(0, 0, 0));
+  EXPECT_EQ(Run(*engine, moved), GateDecision::kRegions);
+  EXPECT_EQ(engine->stats().regions, 2);
+
+  // The inferred regions are the new reference.
+  EXPECT_EQ(Run(*engine, moved), GateDecision::kSkipped);
+
+  // A different scene is no local change.
+  const cv::Mat other(background_.size(), CV_8UC3, cv::Scalar(20, 20, 20));
+  EXPECT_EQ(Run(*engine, other), GateDecision::kFull);
+}
+
+TEST_F(MotionGatedInferenceEngineTest, RegionDetectionsInSourceFrameTest) {
+  auto engine = Create();
+  ASSERT_NE(engine, nullptr);
+  EXPECT_EQ(Run(*engine, background_), GateDecision::kFull);
+
+  cv::Mat moved = background_.clone();
+  moved(cv::Rect(900, 500, 200, 200)).setTo(cv::Scalar(255, 255, 255));
+  std::vector<Detection> detections;
+  ASSERT_TRUE(engine->RunInference(moved, &detections).ok());
+  EXPECT_EQ(engine->last_decision(), GateDecision::kRegions);
+  const cv::Rect bounds(0, 0, moved.cols, moved.rows);
+  for (const Detection &det : detections) {
+    EXPECT_EQ(det.bbox & bounds, det.bbox);
+  }
+}
+
+TEST_F(MotionGatedInferenceEngineTest, FullRefreshEveryIntervalTest) {
+  auto engine = Create(MotionGateOptions{.refresh_interval = 4});
+  ASSERT_NE(engine, nullptr);
+
+  std::vector<GateDecision> decisions;
+  for (int i = 0; i < 9; ++i) {
+    decisions.push_back(Run(*engine, background_));
+  }
+  const std::vector<GateDecision> expected = {
+      GateDecision::kFull,    GateDecision::kSkipped, GateDecision::kSkipped,
+      GateDecision::kSkipped, GateDecision::kFull,    GateDecision::kSkipped,
+      GateDecision::kSkipped, GateDecision::kSkipped, GateDecision::kFull};
+  EXPECT_EQ(decisions, expected);
+}
+
+TEST_F(MotionGatedInferenceEngineTest, ResetAndResizeForceFullFrameTest) {
+  auto engine = Create();
+  ASSERT_NE(engine, nullptr);
+  EXPECT_EQ(Run(*engine, background_), GateDecision::kFull);
+  EXPECT_EQ(Run(*engine, background_), GateDecision::kSkipped);
+
+  engine->Reset();
+  EXPECT_EQ(Run(*engine, background_), GateDecision::kFull);
+
+  cv::Mat smaller;
+  background_(cv::Rect(0, 0, 1280, 720)).copyTo(smaller);
+  EXPECT_EQ(Run(*engine, smaller), GateDecision::kFull);
+}
+
+TEST_F(MotionGatedInferenceEngineTest, RejectsInvalidOptionsTest) {
+  auto engine = MotionGatedInferenceEngine::Create(
+      Params(), MotionGateOptions{.refresh_interval = 0});
+  EXPECT_EQ(engine.status().code(), absl::StatusCode::kInvalidArgument);
+
+  engine = MotionGatedInferenceEngine::Create(
+      Params(),
+      MotionGateOptions{.static_fraction = 0.5, .max_region_fraction = 0.1});
+  EXPECT_EQ(engine.status().code(), absl::StatusCode::kInvalidArgument);
+}
+
+} // namespace
+} // namespace inference
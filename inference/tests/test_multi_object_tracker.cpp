@@ -0,0 +1,227 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "inference/multi_object_tracker.h"
+
+namespace inference {
+namespace {
+class MultiObjectTrackerTest : public ::testing::Test {
+protected:
+  static std::unique_ptr<MultiObjectTracker>
+  Create(const TrackerOptions &options = TrackerOptions{}) {
+    auto tracker = MultiObjectTracker::Create(options);
+    EXPECT_TRUE(tracker.ok()) << tracker.status();
+    return tracker.ok() ? std::move(*tracker) : nullptr;
+  }
+
+  static Detection Box(int class_id, float confidence, int x, int y,
+                       int width = 50, int height = 100) {
+    return Detection{.class_id = class_id,
+                     .confidence = confidence,
+                     .bbox = cv::Rect(x, y, width, height)};
+  }
+
+  static const TrackedObject *FindTrack(
+      const std::vector<TrackedObject> &tracks, int track_id) {
+    for (const TrackedObject &track : tracks) {
+      if (track.track_id == track_id) {
+        return &track;
+      }
+    }
+    return nullptr;
+  }
+};
+
+TEST_F(MultiObjectTrackerTest, KeepsIdsOfMovingObjectsTest) {
+  auto tracker = Create();
+  ASSERT_NE(tracker, nullptr);
+
+  // Two objects moving towards each other horizontally, 4 px per frame.
+  std::vector<TrackedObject> tracks;
+  tracker->Update({Box(0, 0.9f, 100, 100), Box(0, 0.9f, 400, 100)}, &tracks);
+  ASSERT_EQ(tracks.size(), 2u);
+  const int left_id = tracks[0].detection.bbox.x < 200 ? tracks[0].track_id
+                                                       : tracks[1].track_id;
+  const int right_id = tracks[0].track_id ^ tracks[1].track_id ^ left_id;
+
+  for (int frame = 1; frame < 20; ++frame) {
+    tracker->Update({Box(0, 0.9f, 400 - 4 * frame, 100),
+                     Box(0, 0.9f, 100 + 4 * frame, 100)},
+                    &tracks);
+    ASSERT_EQ(tracks.size(), 2u) << "frame " << frame;
+    const TrackedObject *left = FindTrack(tracks, left_id);
+    const TrackedObject *right = FindTrack(tracks, right_id);
+    ASSERT_NE(left, nullptr);
+    ASSERT_NE(right, nullptr);
+    EXPECT_NEAR(left->detection.bbox.x, 100 + 4 * frame, 3);
+    EXPECT_NEAR(right->detection.bbox.x, 400 - 4 * frame, 3);
+    EXPECT_EQ(left->frames_since_update, 0);
+  }
+}
+
+TEST_F(MultiObjectTrackerTest, PredictsBetweenDetectorFramesTest) {
+  auto tracker = Create();
+  ASSERT_NE(tracker, nullptr);
+
+  // Detector every third frame, object moving 6 px per frame.
+  std::vector<TrackedObject> tracks;
+  int id = -1;
+  for (int frame = 0; frame < 30; ++frame) {
+    if (frame % 3 == 0) {
+      tracker->Update({Box(2, 0.8f, 6 * frame, 50)}, &tracks);
+    } else {
+      tracker->Predict(&tracks);
+    }
+    ASSERT_EQ(tracks.size(), 1u) << "frame " << frame;
+    if (id < 0) {
+      id = tracks[0].track_id;
+    }
+    EXPECT_EQ(tracks[0].track_id, id);
+    EXPECT_EQ(tracks[0].detection.class_id, 2);
+    EXPECT_EQ(tracks[0].frames_since_update, frame % 3);
+    if (frame >= 15) {
+      // The velocity has converged, predictions follow the object.
+      EXPECT_NEAR(tracks[0].detection.bbox.x, 6 * frame, 4) << frame;
+    }
+  }
+}
+
+TEST_F(MultiObjectTrackerTest, NewTracksNeedMinHitsTest) {
+  auto tracker = Create(TrackerOptions{.min_hits = 3});
+  ASSERT_NE(tracker, nullptr);
+
+  std::vector<TrackedObject> tracks;
+  tracker->Update({}, &tracks);
+  EXPECT_TRUE(tracks.empty());
+
+  tracker->Update({Box(0, 0.9f, 10, 10)}, &tracks);
+  EXPECT_TRUE(tracks.empty());
+  tracker->Update({Box(0, 0.9f, 12, 10)}, &tracks);
+  EXPECT_TRUE(tracks.empty());
+  tracker->Update({Box(0, 0.9f, 14, 10)}, &tracks);
+  EXPECT_EQ(tracks.size(), 1u);
+
+  // A tentative track missing once is dropped.
+  tracker->Update({Box(0, 0.9f, 16, 10), Box(1, 0.9f, 300, 300)}, &tracks);
+  EXPECT_EQ(tracker->NumTracks(), 2);
+  tracker->Update({Box(0, 0.9f, 18, 10)}, &tracks);
+  EXPECT_EQ(tracker->NumTracks(), 1);
+}
+
+TEST_F(MultiObjectTrackerTest, LowConfidenceDetectionsOnlyExtendTracksTest) {
+  auto tracker = Create();
+  ASSERT_NE(tracker, nullptr);
+
+  std::vector<TrackedObject> tracks;
+  tracker->Update({Box(0, 0.9f, 100, 100)}, &tracks);
+  ASSERT_EQ(tracks.size(), 1u);
+  const int id = tracks[0].track_id;
+
+  // Partially occluded: the score drops, the track continues.
+  tracker->Update({Box(0, 0.2f, 102, 100), Box(0, 0.2f, 500, 500)}, &tracks);
+  ASSERT_EQ(tracks.size(), 1u);
+  EXPECT_EQ(tracks[0].track_id, id);
+  EXPECT_EQ(tracker->NumTracks(), 1);
+}
+
+TEST_F(MultiObjectTrackerTest, LostTracksRecoverTheirIdTest) {
+  auto tracker = Create(TrackerOptions{.max_misses = 5});
+  ASSERT_NE(tracker, nullptr);
+
+  std::vector<TrackedObject> tracks;
+  tracker->Update({Box(0, 0.9f, 100, 100)}, &tracks);
+  const int id = tracks[0].track_id;
+
+  for (int i = 0; i < 3; ++i) {
+    tracker->Update({}, &tracks);
+    EXPECT_TRUE(tracks.empty());
+  }
+  tracker->Update({Box(0, 0.9f, 100, 100)}, &tracks);
+  ASSERT_EQ(tracks.size(), 1u);
+  EXPECT_EQ(tracks[0].track_id, id);
+
+  for (int i = 0; i < 6; ++i) {
+    tracker->Update({}, &tracks);
+  }
+  EXPECT_EQ(tracker->NumTracks(), 0);
+}
+
+TEST_F(MultiObjectTrackerTest, ClassAwareAssociationTest) {
+  auto tracker = Create();
+  ASSERT_NE(tracker, nullptr);
+
+  std::vector<TrackedObject> tracks;
+  tracker->Update({Box(0, 0.9f, 100, 100)}, &tracks);
+  const int id = tracks[0].track_id;
+
+  tracker->Update({Box(1, 0.9f, 100, 100)}, &tracks);
+  EXPECT_TRUE(FindTrack(tracks, id) == nullptr);
+}
+
+TEST_F(MultiObjectTrackerTest, CrowdedSceneMatchesOneToOneTest) {
+  auto tracker = Create();
+  ASSERT_NE(tracker, nullptr);
+
+  // A grid of overlapping boxes where greedy matching would be ambiguous,
+  // and a hundred well separated ones.
+  std::vector<Detection> detections;
+  for (int i = 0; i < 5; ++i) {
+    for (int j = 0; j < 5; ++j) {
+      detections.push_back(Box(0, 0.9f, 20 * i, 20 * j, 40, 40));
+    }
+  }
+  for (int i = 0; i < 100; ++i) {
+    detections.push_back(Box(0, 0.9f, 1000 + 100 * (i % 10),
+                             1000 + 100 * (i / 10), 40, 40));
+  }
+
+  std::vector<TrackedObject> tracks;
+  tracker->Update(detections, &tracks);
+  ASSERT_EQ(tracks.size(), detections.size());
+  std::vector<int> ids;
+  for (const TrackedObject &track : tracks) {
+    ids.push_back(track.track_id);
+  }
+
+  for (int frame = 0; frame < 5; ++frame) {
+    tracker->Update(detections, &tracks);
+    ASSERT_EQ(tracks.size(), detections.size());
+    EXPECT_EQ(tracker->NumTracks(), static_cast<int>(detections.size()));
+  }
+  for (int id : ids) {
+    EXPECT_NE(FindTrack(tracks, id), nullptr) << id;
+  }
+}
+
+TEST_F(MultiObjectTrackerTest, RespectsCapacityTest) {
+  auto tracker = Create(TrackerOptions{.max_tracks = 4});
+  ASSERT_NE(tracker, nullptr);
+
+  std::vector<Detection> detections;
+  for (int i = 0; i < 10; ++i) {
+    detections.push_back(Box(0, 0.9f, 100 * i, 0));
+  }
+  std::vector<TrackedObject> tracks;
+  tracker->Update(detections, &tracks);
+  EXPECT_EQ(tracker->NumTracks(), 4);
+  EXPECT_EQ(tracks.size(), 4u);
+
+  tracker->Reset();
+  EXPECT_EQ(tracker->NumTracks(), 0);
+}
+
+TEST_F(MultiObjectTrackerTest, RejectsInvalidOptionsTest) {
+  EXPECT_EQ(MultiObjectTracker::Create(TrackerOptions{.max_tracks = 0})
+                .status()
+                .code(),
+            absl::StatusCode::kInvalidArgument);
+  EXPECT_EQ(MultiObjectTracker::Create(
+                TrackerOptions{.high_confidence = 0.2f, .low_confidence = 0.5f})
+                .status()
+                .code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+} // namespace
+} // namespace inference
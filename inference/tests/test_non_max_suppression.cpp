@@ -1,10 +1,46 @@
+#include <random>
+
 #include "inference/non_max_suppression.h"
 #include "opencv2/core/types.hpp"
 #include "gtest/gtest.h"
 
 namespace inference {
 namespace {
-class NonMaxSuppressionTest : public ::testing::Test {};
+class NonMaxSuppressionTest : public ::testing::Test {
+protected:
+  // Random boxes clustered around a few centers so many of them overlap.
+  static std::vector<Detection> MakeCrowdedScene(int count, int num_classes,
+                                                 unsigned seed);
+};
+
+std::vector<Detection>
+NonMaxSuppressionTest::MakeCrowdedScene(int count, int num_classes,
+                                        unsigned seed) {
+  std::mt19937 rng(seed);
+  std::uniform_int_distribution<int> center(0, 1900);
+  std::normal_distribution<float> jitter(0.0f, 12.0f);
+  std::uniform_int_distribution<int> size(20, 120);
+  std::uniform_real_distribution<float> confidence(0.25f, 1.0f);
+  std::uniform_int_distribution<int> class_id(0, num_classes - 1);
+
+  std::vector<cv::Point> centers(count / 8 + 1);
+  for (auto &c : centers) {
+    c = cv::Point(center(rng), center(rng) / 2);
+  }
+
+  std::vector<Detection> detections;
+  for (int i = 0; i < count; ++i) {
+    const cv::Point &c = centers[i % centers.size()];
+    const int w = size(rng);
+    const int h = size(rng);
+    detections.push_back(Detection{
+        .class_id = class_id(rng),
+        .confidence = confidence(rng),
+        .bbox = cv::Rect(c.x + static_cast<int>(jitter(rng)) - w / 2,
+                         c.y + static_cast<int>(jitter(rng)) - h / 2, w, h)});
+  }
+  return detections;
+}
 
 TEST_F(NonMaxSuppressionTest, IoUTest) {
   cv::Rect bbox1(0, 0, 10, 10);
@@ -38,5 +74,140 @@ TEST_F(NonMaxSuppressionTest, ApplyTest) {
   EXPECT_EQ(result.size(), 2);
 };
 
+TEST_F(NonMaxSuppressionTest, ClassAwareKeepsOverlappingClassesTest) {
+  Detection person{
+      .class_id = 0, .confidence = 0.90f, .bbox = cv::Rect(0, 0, 100, 200)};
+  Detection handbag{
+      .class_id = 26, .confidence = 0.60f, .bbox = cv::Rect(5, 5, 95, 190)};
+  Detection duplicate{
+      .class_id = 0, .confidence = 0.70f, .bbox = cv::Rect(2, 2, 100, 200)};
+
+  std::vector<Detection> inputs = {handbag, person, duplicate};
+
+  auto legacy = NonMaxSuppression::Apply(
+      inputs, NmsOptions{.iou_threshold = 0.5f, .mode = NmsMode::kLegacy});
+  ASSERT_EQ(legacy.size(), 1);
+  EXPECT_EQ(legacy[0].class_id, 0);
+
+  auto class_aware = NonMaxSuppression::Apply(
+      inputs, NmsOptions{.iou_threshold = 0.5f, .mode = NmsMode::kClassAware});
+  ASSERT_EQ(class_aware.size(), 2);
+  EXPECT_EQ(class_aware[0].class_id, 0);
+  EXPECT_EQ(class_aware[0].confidence, 0.90f);
+  EXPECT_EQ(class_aware[1].class_id, 26);
+}
+
+TEST_F(NonMaxSuppressionTest, ClassAwareMatchesLegacyForSingleClassTest) {
+  auto inputs = MakeCrowdedScene(2000, 1, 7);
+
+  auto legacy = NonMaxSuppression::Apply(inputs, 0.45f);
+  auto class_aware = NonMaxSuppression::Apply(
+      inputs, NmsOptions{.iou_threshold = 0.45f, .mode = NmsMode::kClassAware});
+
+  ASSERT_EQ(legacy.size(), class_aware.size());
+  for (size_t i = 0; i < legacy.size(); ++i) {
+    EXPECT_EQ(legacy[i].bbox, class_aware[i].bbox) << "index " << i;
+    EXPECT_EQ(legacy[i].confidence, class_aware[i].confidence) << "index " << i;
+  }
+}
+
+TEST_F(NonMaxSuppressionTest, SpatialBucketingMatchesDenseScanTest) {
+  auto inputs = MakeCrowdedScene(5000, 4, 11);
+
+  auto dense = NonMaxSuppression::Apply(inputs, NmsOptions{});
+  auto bucketed = NonMaxSuppression::Apply(
+      inputs, NmsOptions{.spatial_bucketing = true});
+
+  ASSERT_EQ(dense.size(), bucketed.size());
+  for (size_t i = 0; i < dense.size(); ++i) {
+    EXPECT_EQ(dense[i].bbox, bucketed[i].bbox) << "index " << i;
+    EXPECT_EQ(dense[i].class_id, bucketed[i].class_id) << "index " << i;
+  }
+}
+
+TEST_F(NonMaxSuppressionTest, MaxDetectionsKeepsHighestConfidenceTest) {
+  auto inputs = MakeCrowdedScene(3000, 8, 3);
+
+  auto all = NonMaxSuppression::Apply(inputs, NmsOptions{});
+  ASSERT_GT(all.size(), 10);
+
+  auto capped =
+      NonMaxSuppression::Apply(inputs, NmsOptions{.max_detections = 10});
+  ASSERT_EQ(capped.size(), 10);
+  for (size_t i = 0; i < capped.size(); ++i) {
+    EXPECT_EQ(capped[i].bbox, all[i].bbox) << "index " << i;
+    EXPECT_EQ(capped[i].confidence, all[i].confidence) << "index " << i;
+  }
+}
+
+TEST_F(NonMaxSuppressionTest, ReusedWorkspaceMatchesFreshApplyTest) {
+  NmsWorkspace workspace;
+  std::vector<Detection> result;
+
+  // Shrinking and growing inputs, so stale workspace contents would show.
+  const int counts[] = {3000, 50, 5000, 0, 800};
+  for (NmsMode mode : {NmsMode::kLegacy, NmsMode::kClassAware}) {
+    for (int count : counts) {
+      auto inputs = MakeCrowdedScene(count, 5, count + 1);
+      NmsOptions options{.iou_threshold = 0.5f,
+                         .mode = mode,
+                         .spatial_bucketing = true};
+
+      auto expected = NonMaxSuppression::Apply(inputs, options);
+      NonMaxSuppression::Apply(inputs, options, &workspace, &result);
+
+      ASSERT_EQ(expected.size(), result.size()) << "count " << count;
+      for (size_t i = 0; i < expected.size(); ++i) {
+        EXPECT_EQ(expected[i].bbox, result[i].bbox) << "index " << i;
+        EXPECT_EQ(expected[i].class_id, result[i].class_id) << "index " << i;
+      }
+    }
+  }
+}
+
+TEST_F(NonMaxSuppressionTest, DetectionBatchMatchesDetectionsTest) {
+  NmsWorkspace workspace;
+  DetectionBatch result;
+
+  for (NmsMode mode : {NmsMode::kLegacy, NmsMode::kClassAware}) {
+    auto inputs = MakeCrowdedScene(3000, 5, 17);
+    DetectionBatch candidates;
+    for (const Detection &det : inputs) {
+      candidates.Add(det);
+    }
+    NmsOptions options{.iou_threshold = 0.5f, .mode = mode};
+
+    auto expected = NonMaxSuppression::Apply(inputs, options);
+    NonMaxSuppression::Apply(candidates, options, &workspace, &result);
+
+    ASSERT_EQ(expected.size(), result.Size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+      const Detection det = result.ToDetection(i);
+      EXPECT_EQ(expected[i].bbox, det.bbox) << "index " << i;
+      EXPECT_EQ(expected[i].class_id, det.class_id) << "index " << i;
+      EXPECT_EQ(expected[i].confidence, det.confidence) << "index " << i;
+    }
+  }
+}
+
+TEST_F(NonMaxSuppressionTest, DetectionBatchKeepsSubpixelBoxesTest) {
+  DetectionBatch candidates;
+  candidates.Add(0, 0.9f, 10.25f, 20.5f, 110.75f, 70.125f);
+  candidates.Add(0, 0.8f, 10.5f, 20.5f, 110.5f, 70.5f);
+  candidates.Add(1, 0.7f, 10.5f, 20.5f, 110.5f, 70.5f);
+
+  NmsWorkspace workspace;
+  DetectionBatch result;
+  NonMaxSuppression::Apply(candidates, NmsOptions{}, &workspace, &result);
+
+  ASSERT_EQ(result.Size(), 2u);
+  EXPECT_EQ(result.class_ids[0], 0);
+  EXPECT_EQ(result.x1[0], 10.25f);
+  EXPECT_EQ(result.y1[0], 20.5f);
+  EXPECT_EQ(result.x2[0], 110.75f);
+  EXPECT_EQ(result.y2[0], 70.125f);
+  EXPECT_EQ(result.class_ids[1], 1);
+}
+
 } // namespace
 } // namespace inference
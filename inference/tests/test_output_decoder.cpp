@@ -0,0 +1,195 @@
+#include "inference/output_decoder.h"
+#include "opencv2/core.hpp"
+#include "gtest/gtest.h"
+
+namespace inference {
+namespace {
+class OutputDecoderTest : public ::testing::Test {
+protected:
+  // Builds a random [4 + num_classes, num_anchors] head output. Class scores
+  // sit just around 0.5 so only some anchors pass a 0.5 threshold.
+  static cv::Mat MakeHeadOutput(int num_classes, int num_anchors);
+
+  static void ExpectSameDetections(const std::vector<Detection> &expected,
+                                   const std::vector<Detection> &actual);
+};
+
+cv::Mat OutputDecoderTest::MakeHeadOutput(int num_classes, int num_anchors) {
+  cv::Mat planes(4 + num_classes, num_anchors, CV_32F);
+  cv::RNG rng(1234);
+  rng.fill(planes.rowRange(0, 2), cv::RNG::UNIFORM, 0.0f, 640.0f);
+  rng.fill(planes.rowRange(2, 4), cv::RNG::UNIFORM, 1.0f, 200.0f);
+  rng.fill(planes.rowRange(4, planes.rows), cv::RNG::UNIFORM, 0.0f, 0.501f);
+  return planes;
+}
+
+void OutputDecoderTest::ExpectSameDetections(
+    const std::vector<Detection> &expected,
+    const std::vector<Detection> &actual) {
+  ASSERT_EQ(expected.size(), actual.size());
+  for (size_t i = 0; i < expected.size(); ++i) {
+    EXPECT_EQ(expected[i].class_id, actual[i].class_id) << "index " << i;
+    EXPECT_EQ(expected[i].confidence, actual[i].confidence) << "index " << i;
+    EXPECT_EQ(expected[i].bbox, actual[i].bbox) << "index " << i;
+  }
+}
+
+TEST_F(OutputDecoderTest, ChannelMajorMatchesTransposedReferenceTest) {
+  const cv::Mat planes = MakeHeadOutput(80, 8400);
+  const cv::Mat rows = planes.t();
+
+  for (float threshold : {0.5f, 0.25f, 0.9f}) {
+    auto expected = OutputDecoder::DecodeRowMajor(rows, threshold);
+    auto actual = OutputDecoder::DecodeChannelMajor(planes, threshold);
+    ExpectSameDetections(expected, actual);
+  }
+}
+
+TEST_F(OutputDecoderTest, ChannelMajorHandlesPartialBlocksTest) {
+  // Anchor counts that are not a multiple of the block or vector width, and a
+  // class count that is not a multiple of anything.
+  for (int num_anchors : {1, 7, 65, 8401}) {
+    const cv::Mat planes = MakeHeadOutput(3, num_anchors);
+    auto expected = OutputDecoder::DecodeRowMajor(planes.t(), 0.5f);
+    auto actual = OutputDecoder::DecodeChannelMajor(planes, 0.5f);
+    ExpectSameDetections(expected, actual);
+  }
+}
+
+TEST_F(OutputDecoderTest, ChannelMajorKeepsFirstClassOnTiesTest) {
+  cv::Mat planes = cv::Mat::zeros(4 + 3, 1, CV_32F);
+  planes.at<float>(4 + 1, 0) = 0.75f;
+  planes.at<float>(4 + 2, 0) = 0.75f;
+
+  auto detections = OutputDecoder::DecodeChannelMajor(planes, 0.5f);
+  ASSERT_EQ(detections.size(), 1);
+  EXPECT_EQ(detections[0].class_id, 1);
+  EXPECT_EQ(detections[0].confidence, 0.75f);
+}
+
+TEST_F(OutputDecoderTest, InferLayoutFromShapeTest) {
+  struct Case {
+    std::vector<int> shape;
+    OutputFormat format;
+    int num_classes;
+  };
+  const Case cases[] = {
+      {{1, 84, 8400}, OutputFormat::kChannelMajor, 80},
+      {{4, 5, 8400}, OutputFormat::kChannelMajor, 1},
+      {{1, 8400, 84}, OutputFormat::kRowMajor, 80},
+      // Two classes in a row-major head also end in 6, the anchor count
+      // tells it apart from an end-to-end head.
+      {{1, 8400, 6}, OutputFormat::kRowMajor, 2},
+      {{1, 300, 6}, OutputFormat::kEndToEnd, 0},
+  };
+  for (const Case &c : cases) {
+    const cv::Mat output(c.shape, CV_32F);
+    auto layout =
+        OutputDecoder::InferLayout(output, 640, 640, OutputFormat::kAuto);
+    ASSERT_TRUE(layout.ok()) << layout.status();
+    EXPECT_EQ(layout->format, c.format);
+    EXPECT_EQ(layout->num_classes, c.num_classes);
+    EXPECT_EQ(layout->rows, c.shape[1]);
+    EXPECT_EQ(layout->cols, c.shape[2]);
+  }
+
+  // An explicit format wins over the shape.
+  const cv::Mat output(std::vector<int>{1, 8400, 6}, CV_32F);
+  auto layout =
+      OutputDecoder::InferLayout(output, 640, 640, OutputFormat::kEndToEnd);
+  ASSERT_TRUE(layout.ok());
+  EXPECT_EQ(layout->format, OutputFormat::kEndToEnd);
+
+  EXPECT_FALSE(OutputDecoder::InferLayout(cv::Mat(84, 8400, CV_32F), 640, 640,
+                                          OutputFormat::kAuto)
+                   .ok());
+  EXPECT_FALSE(OutputDecoder::InferLayout(
+                   cv::Mat(std::vector<int>{1, 4, 8400}, CV_32F), 640, 640,
+                   OutputFormat::kAuto)
+                   .ok());
+}
+
+TEST_F(OutputDecoderTest, SpecializedDecodersMatchReferenceTest) {
+  for (int num_classes : {1, 3, 80}) {
+    const cv::Mat planes = MakeHeadOutput(num_classes, 1000);
+    const cv::Mat rows = planes.t();
+    const auto expected = OutputDecoder::DecodeRowMajor(rows, 0.5f);
+
+    std::vector<Detection> actual;
+    OutputDecoder::ForLayout({.format = OutputFormat::kChannelMajor,
+                              .num_classes = num_classes,
+                              .rows = planes.rows,
+                              .cols = planes.cols})(planes, 0.5f, &actual);
+    ExpectSameDetections(expected, actual);
+
+    OutputDecoder::ForLayout({.format = OutputFormat::kRowMajor,
+                              .num_classes = num_classes,
+                              .rows = rows.rows,
+                              .cols = rows.cols})(rows, 0.5f, &actual);
+    ExpectSameDetections(expected, actual);
+  }
+}
+
+TEST_F(OutputDecoderTest, EndToEndKeepsRowsAboveThresholdTest) {
+  // Padding rows of a top-k head carry a zero score.
+  const cv::Mat rows = (cv::Mat_<float>(3, 6) << 10, 20, 110, 70, 0.9f, 2,  //
+                        300, 300, 340, 400, 0.3f, 0,                         //
+                        0, 0, 0, 0, 0, 0);
+
+  std::vector<Detection> detections;
+  OutputDecoder::DecodeEndToEnd(rows, 0.25f, &detections);
+  ASSERT_EQ(detections.size(), 2);
+  EXPECT_EQ(detections[0].class_id, 2);
+  EXPECT_EQ(detections[0].confidence, 0.9f);
+  EXPECT_EQ(detections[0].bbox, cv::Rect(10, 20, 100, 50));
+  EXPECT_EQ(detections[1].bbox, cv::Rect(300, 300, 40, 100));
+
+  OutputDecoder::DecodeEndToEnd(rows, 0.5f, &detections);
+  EXPECT_EQ(detections.size(), 1);
+}
+
+TEST_F(OutputDecoderTest, BatchDecodersKeepFloatBoxesTest) {
+  const cv::Mat planes = MakeHeadOutput(80, 8400);
+  const cv::Mat rows = planes.t();
+  const auto expected = OutputDecoder::DecodeRowMajor(rows, 0.5f);
+  ASSERT_FALSE(expected.empty());
+
+  DetectionBatch batch;
+  OutputDecoder::BatchDecoderForLayout({.format = OutputFormat::kChannelMajor,
+                                        .num_classes = 80,
+                                        .rows = planes.rows,
+                                        .cols = planes.cols})(planes, 0.5f,
+                                                              &batch);
+  ASSERT_EQ(batch.Size(), expected.size());
+  for (size_t i = 0; i < expected.size(); ++i) {
+    EXPECT_EQ(batch.class_ids[i], expected[i].class_id) << "index " << i;
+    EXPECT_EQ(batch.confidences[i], expected[i].confidence) << "index " << i;
+    // Integer boxes truncate, the batch keeps the exact corners.
+    EXPECT_NEAR(batch.x1[i], expected[i].bbox.x, 1.0f) << "index " << i;
+    EXPECT_NEAR(batch.x2[i] - batch.x1[i], expected[i].bbox.width, 1.0f)
+        << "index " << i;
+  }
+
+  DetectionBatch row_major;
+  OutputDecoder::DecodeRowMajor(rows, 0.5f, &row_major);
+  EXPECT_EQ(row_major.x1, batch.x1);
+  EXPECT_EQ(row_major.y2, batch.y2);
+}
+
+TEST_F(OutputDecoderTest, EndToEndBatchKeepsCornersTest) {
+  const cv::Mat rows = (cv::Mat_<float>(2, 6) << 10.5f, 20.25f, 110, 70.75f,
+                        0.9f, 2,  //
+                        0, 0, 0, 0, 0, 0);
+
+  DetectionBatch detections;
+  OutputDecoder::DecodeEndToEnd(rows, 0.25f, &detections);
+  ASSERT_EQ(detections.Size(), 1u);
+  EXPECT_EQ(detections.class_ids[0], 2);
+  EXPECT_EQ(detections.x1[0], 10.5f);
+  EXPECT_EQ(detections.y1[0], 20.25f);
+  EXPECT_EQ(detections.x2[0], 110.0f);
+  EXPECT_EQ(detections.y2[0], 70.75f);
+}
+
+} // namespace
+} // namespace inference
@@ -0,0 +1,106 @@
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "opencv2/core.hpp"
+#include "gtest/gtest.h"
+
+#include "inference/cpu_topology.h"
+#include "inference/pinned_thread_pool.h"
+
+namespace inference {
+namespace {
+class PinnedThreadPoolTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    auto cpus = GetThreadAffinity();
+    ASSERT_TRUE(cpus.ok()) << cpus.status();
+    caller_cpus_ = *cpus;
+  }
+
+  std::vector<int> caller_cpus_;
+};
+
+TEST_F(PinnedThreadPoolTest, RunsEveryTaskOnceTest) {
+  auto pool = PinnedThreadPool::Create({}, 4);
+  ASSERT_TRUE(pool.ok()) << pool.status();
+  EXPECT_EQ((*pool)->num_threads(), 4);
+
+  for (int run = 0; run < 100; ++run) {
+    std::vector<std::atomic<int>> hits(37);
+    (*pool)->Run(
+        static_cast<int>(hits.size()),
+        [](int start, int end, void *data) {
+          auto &hits = *static_cast<std::vector<std::atomic<int>> *>(data);
+          for (int i = start; i < end; ++i) {
+            ++hits[i];
+          }
+        },
+        &hits);
+    for (size_t i = 0; i < hits.size(); ++i) {
+      ASSERT_EQ(hits[i].load(), 1) << "run " << run << " task " << i;
+    }
+  }
+}
+
+TEST_F(PinnedThreadPoolTest, ParallelBackendIsOptInTest) {
+  // Runs before any test installs the backend.
+  auto pool = PinnedThreadPool::Create({caller_cpus_.front()}, 2);
+  ASSERT_TRUE(pool.ok()) << pool.status();
+  EXPECT_FALSE(PinnedThreadPool::ParallelBackendInstalled());
+  {
+    // Still pins the caller, but leaves parallel_for_ to OpenCV's pool.
+    PinnedThreadPool::Scope scope(pool->get());
+    EXPECT_EQ(*GetThreadAffinity(), std::vector<int>{caller_cpus_.front()});
+    EXPECT_NE(std::string(cv::currentParallelFramework()), "inference_pinned");
+  }
+
+  PinnedThreadPool::InstallParallelBackend();
+  PinnedThreadPool::InstallParallelBackend();
+  EXPECT_TRUE(PinnedThreadPool::ParallelBackendInstalled());
+  EXPECT_EQ(std::string(cv::currentParallelFramework()), "inference_pinned");
+}
+
+TEST_F(PinnedThreadPoolTest, ScopeRoutesParallelForToThePoolTest) {
+  PinnedThreadPool::InstallParallelBackend();
+  auto pool = PinnedThreadPool::Create({caller_cpus_.front()}, 2);
+  ASSERT_TRUE(pool.ok()) << pool.status();
+
+  {
+    PinnedThreadPool::Scope scope(pool->get());
+    EXPECT_EQ(*GetThreadAffinity(), std::vector<int>{caller_cpus_.front()});
+    EXPECT_EQ(cv::getNumThreads(), 2);
+
+    std::mutex mutex;
+    std::set<int> threads;
+    cv::parallel_for_(cv::Range(0, 64), [&](const cv::Range &) {
+      std::lock_guard<std::mutex> lock(mutex);
+      threads.insert(cv::getThreadNum());
+    });
+    EXPECT_LE(threads.size(), 2u);
+
+    // Nested scopes of the same pool are free.
+    PinnedThreadPool::Scope nested(pool->get());
+    EXPECT_EQ(cv::getNumThreads(), 2);
+  }
+  EXPECT_EQ(*GetThreadAffinity(), caller_cpus_);
+}
+
+TEST_F(PinnedThreadPoolTest, RejectsInvalidParamsTest) {
+  EXPECT_FALSE(PinnedThreadPool::Create({-1}, 2).ok());
+  EXPECT_FALSE(PinnedThreadPool::Create({caller_cpus_.front()}, -1).ok());
+}
+
+TEST_F(PinnedThreadPoolTest, BudgetOfOneRunsOnTheCallerTest) {
+  auto pool = PinnedThreadPool::Create({caller_cpus_.front()}, 1);
+  ASSERT_TRUE(pool.ok()) << pool.status();
+  int calls = 0;
+  (*pool)->Run(
+      8, [](int, int, void *data) { ++*static_cast<int *>(data); }, &calls);
+  EXPECT_EQ(calls, 1);
+}
+
+} // namespace
+} // namespace inference
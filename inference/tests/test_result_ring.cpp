@@ -0,0 +1,225 @@
+#include <unistd.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "inference/result_ring.h"
+
+namespace inference {
+namespace {
+class ResultRingTest : public ::testing::Test {
+protected:
+  // Shared memory names are global, keep concurrent test runs apart.
+  static std::string RingName() {
+    return "/inference_test_ring_" + std::to_string(getpid());
+  }
+
+  static std::unique_ptr<ResultRingWriter>
+  CreateWriter(const ResultRingOptions &options = ResultRingOptions{}) {
+    auto writer = ResultRingWriter::Create(RingName(), options);
+    EXPECT_TRUE(writer.ok()) << writer.status();
+    return writer.ok() ? std::move(*writer) : nullptr;
+  }
+
+  static std::unique_ptr<ResultRingReader> OpenReader() {
+    auto reader = ResultRingReader::Open(RingName());
+    EXPECT_TRUE(reader.ok()) << reader.status();
+    return reader.ok() ? std::move(*reader) : nullptr;
+  }
+
+  // `count` detections whose coordinates all encode `value`.
+  static DetectionBatch MakeFrame(int count, float value) {
+    DetectionBatch batch;
+    for (int i = 0; i < count; ++i) {
+      batch.Add(i, 1.0f - i * 0.01f, value, value + 0.25f, value + 10.5f,
+                value + 20.75f);
+    }
+    return batch;
+  }
+};
+
+TEST_F(ResultRingTest, ReaderSeesPublishedFramesTest) {
+  auto writer = CreateWriter();
+  ASSERT_NE(writer, nullptr);
+  auto reader = OpenReader();
+  ASSERT_NE(reader, nullptr);
+  EXPECT_EQ(reader->num_slots(), 64);
+  EXPECT_EQ(reader->max_detections(), 300);
+
+  EXPECT_EQ(reader->NextSequence(), 0u);
+  ResultView view;
+  EXPECT_FALSE(reader->Read(0, &view));
+
+  const DetectionBatch frame = MakeFrame(5, 100.5f);
+  EXPECT_EQ(writer->Publish(7, 123456, 1920, 1080, frame), 0u);
+  EXPECT_EQ(reader->NextSequence(), 1u);
+
+  // Zero-copy: the view points into the shared memory.
+  ASSERT_TRUE(reader->Read(0, &view));
+  EXPECT_EQ(view.info.sequence, 0u);
+  EXPECT_EQ(view.info.frame_index, 7);
+  EXPECT_EQ(view.info.timestamp_ns, 123456);
+  EXPECT_EQ(view.info.image_width, 1920);
+  EXPECT_EQ(view.info.image_height, 1080);
+  ASSERT_EQ(view.info.num_detections, 5);
+  EXPECT_EQ(view.info.dropped_detections, 0);
+  for (int i = 0; i < 5; ++i) {
+    EXPECT_EQ(view.class_ids[i], frame.class_ids[i]);
+    EXPECT_EQ(view.confidences[i], frame.confidences[i]);
+    EXPECT_EQ(view.x1[i], frame.x1[i]);
+    EXPECT_EQ(view.y1[i], frame.y1[i]);
+    EXPECT_EQ(view.x2[i], frame.x2[i]);
+    EXPECT_EQ(view.y2[i], frame.y2[i]);
+  }
+  EXPECT_TRUE(reader->Validate(view));
+
+  ResultFrameInfo info;
+  DetectionBatch copy;
+  ASSERT_TRUE(reader->Copy(0, &info, &copy));
+  EXPECT_EQ(info.frame_index, 7);
+  EXPECT_EQ(copy.x2, frame.x2);
+  EXPECT_EQ(copy.class_ids, frame.class_ids);
+}
+
+TEST_F(ResultRingTest, TruncatesLargeFramesTest) {
+  auto writer = CreateWriter(ResultRingOptions{.max_detections = 2});
+  ASSERT_NE(writer, nullptr);
+  auto reader = OpenReader();
+  ASSERT_NE(reader, nullptr);
+
+  const std::vector<Detection> detections = {
+      {.class_id = 1, .confidence = 0.9f, .bbox = cv::Rect(10, 20, 30, 40)},
+      {.class_id = 2, .confidence = 0.8f, .bbox = cv::Rect(50, 60, 70, 80)},
+      {.class_id = 3, .confidence = 0.7f, .bbox = cv::Rect(1, 2, 3, 4)}};
+  writer->Publish(0, 0, 640, 480, detections);
+
+  ResultFrameInfo info;
+  DetectionBatch copy;
+  ASSERT_TRUE(reader->Copy(0, &info, &copy));
+  EXPECT_EQ(info.num_detections, 2);
+  EXPECT_EQ(info.dropped_detections, 1);
+  ASSERT_EQ(copy.Size(), 2u);
+  EXPECT_EQ(copy.ToDetection(1).bbox, cv::Rect(50, 60, 70, 80));
+  EXPECT_EQ(copy.class_ids[1], 2);
+}
+
+TEST_F(ResultRingTest, OverwrittenFramesAreRejectedTest) {
+  auto writer = CreateWriter(ResultRingOptions{.num_slots = 4});
+  ASSERT_NE(writer, nullptr);
+  auto reader = OpenReader();
+  ASSERT_NE(reader, nullptr);
+
+  ResultView view;
+  for (int i = 0; i < 10; ++i) {
+    writer->Publish(i, 0, 640, 480, MakeFrame(3, static_cast<float>(i)));
+  }
+  EXPECT_EQ(writer->published(), 10u);
+  EXPECT_EQ(reader->NextSequence(), 10u);
+
+  for (uint64_t sequence = 0; sequence < 6; ++sequence) {
+    EXPECT_FALSE(reader->Read(sequence, &view)) << sequence;
+  }
+  for (uint64_t sequence = 6; sequence < 10; ++sequence) {
+    ASSERT_TRUE(reader->Read(sequence, &view)) << sequence;
+    EXPECT_EQ(view.info.frame_index, static_cast<int64_t>(sequence));
+    EXPECT_EQ(view.x1[0], static_cast<float>(sequence));
+  }
+  EXPECT_FALSE(reader->Read(10, &view));
+
+  // A view held across the lap no longer validates.
+  ASSERT_TRUE(reader->Read(6, &view));
+  writer->Publish(10, 0, 640, 480, MakeFrame(3, 10.0f));
+  EXPECT_FALSE(reader->Validate(view));
+}
+
+TEST_F(ResultRingTest, ConcurrentReadersNeverSeeTornFramesTest) {
+  auto writer = CreateWriter(ResultRingOptions{.num_slots = 4});
+  ASSERT_NE(writer, nullptr);
+
+  constexpr int kFrames = 20000;
+  std::atomic<bool> done{false};
+  std::atomic<int> torn{0};
+  std::atomic<int> frames_read{0};
+
+  // Every frame encodes its index in every value, a mix of two frames shows
+  // up as a mismatch.
+  auto read = [&]() {
+    auto reader = OpenReader();
+    ASSERT_NE(reader, nullptr);
+    DetectionBatch copy;
+    ResultFrameInfo info;
+    uint64_t next = 0;
+    while (!done.load(std::memory_order_acquire) ||
+           next < reader->NextSequence()) {
+      const uint64_t latest = reader->NextSequence();
+      if (next >= latest) {
+        std::this_thread::yield();
+        continue;
+      }
+      // Catch up when lapped.
+      if (latest - next > static_cast<uint64_t>(reader->num_slots())) {
+        next = latest - reader->num_slots();
+      }
+      if (!reader->Copy(next++, &info, &copy)) {
+        continue;
+      }
+      const float value = static_cast<float>(info.frame_index);
+      if (copy.Size() != static_cast<size_t>(info.frame_index % 7 + 1)) {
+        torn.fetch_add(1);
+        continue;
+      }
+      for (size_t i = 0; i < copy.Size(); ++i) {
+        if (copy.x1[i] != value || copy.y2[i] != value + 20.75f) {
+          torn.fetch_add(1);
+          break;
+        }
+      }
+      frames_read.fetch_add(1);
+    }
+  };
+
+  std::vector<std::thread> readers;
+  for (int i = 0; i < 3; ++i) {
+    readers.emplace_back(read);
+  }
+  std::vector<DetectionBatch> frames;
+  for (int i = 0; i < 7; ++i) {
+    frames.push_back(MakeFrame(i + 1, 0.0f));
+  }
+  for (int frame = 0; frame < kFrames; ++frame) {
+    DetectionBatch &batch = frames[frame % 7];
+    for (size_t i = 0; i < batch.Size(); ++i) {
+      batch.x1[i] = static_cast<float>(frame);
+      batch.y2[i] = static_cast<float>(frame) + 20.75f;
+    }
+    writer->Publish(frame, 0, 640, 480, batch);
+  }
+  done.store(true, std::memory_order_release);
+  for (std::thread &reader : readers) {
+    reader.join();
+  }
+
+  EXPECT_EQ(torn.load(), 0);
+  EXPECT_GT(frames_read.load(), 0);
+}
+
+TEST_F(ResultRingTest, RejectsBadNamesAndMissingRingsTest) {
+  EXPECT_EQ(ResultRingWriter::Create("no_slash", ResultRingOptions{})
+                .status()
+                .code(),
+            absl::StatusCode::kInvalidArgument);
+  EXPECT_EQ(ResultRingWriter::Create(RingName(),
+                                     ResultRingOptions{.num_slots = 0})
+                .status()
+                .code(),
+            absl::StatusCode::kInvalidArgument);
+  EXPECT_EQ(ResultRingReader::Open(RingName()).status().code(),
+            absl::StatusCode::kNotFound);
+}
+
+} // namespace
+} // namespace inference
@@ -0,0 +1,161 @@
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "opencv2/core.hpp"
+#include "gtest/gtest.h"
+
+#include "inference/inference_engine.h"
+#include "inference/shared_model.h"
+
+namespace inference {
+namespace {
+class SharedModelTest : public ::testing::Test {
+protected:
+  static constexpr char kModelPath[] = "/workspace/yolo11n.onnx";
+
+  static InferenceParams MakeParams() {
+    return InferenceParams{.model_path = kModelPath,
+                           .input_image_width = 640,
+                           .input_image_height = 640,
+                           .padding_value = cv::Scalar(114, 114, 114),
+                           .confidence_threshold = 0.25,
+                           .iou_threshold = 0.5};
+  }
+
+  void SetUp() override { ModelCache::Global().Clear(); }
+  void TearDown() override {
+    ModelCache::Global().SetMaxIdleNetworks(
+        ModelCache::kDefaultMaxIdleNetworks);
+    ModelCache::Global().Clear();
+  }
+};
+
+TEST_F(SharedModelTest, MapsModelFileTest) {
+  auto model = SharedModel::Load(kModelPath);
+  ASSERT_TRUE(model.ok()) << model.status();
+  EXPECT_EQ((*model)->ModelBytes(), std::filesystem::file_size(kModelPath));
+  EXPECT_GT((*model)->modification_time_ns(), 0);
+
+  auto net = (*model)->NewNetwork();
+  ASSERT_TRUE(net.ok()) << net.status();
+  EXPECT_FALSE(net->empty());
+}
+
+TEST_F(SharedModelTest, RejectsMissingModelTest) {
+  EXPECT_EQ(SharedModel::Load("/nonexistent.onnx").status().code(),
+            absl::StatusCode::kNotFound);
+  EXPECT_EQ(ModelCache::Global().GetModel("/nonexistent.onnx").status().code(),
+            absl::StatusCode::kNotFound);
+}
+
+TEST_F(SharedModelTest, CacheReturnsSameModelTest) {
+  auto first = ModelCache::Global().GetModel(kModelPath);
+  auto second = ModelCache::Global().GetModel(kModelPath);
+  ASSERT_TRUE(first.ok() && second.ok());
+  EXPECT_EQ(first->get(), second->get());
+}
+
+TEST_F(SharedModelTest, DestroyedEngineNetworkIsReusedTest) {
+  auto engine = InferenceEngine::Create(MakeParams());
+  ASSERT_TRUE(engine.ok()) << engine.status();
+  cv::Mat frame(480, 640, CV_8UC3);
+  cv::randu(frame, cv::Scalar::all(0), cv::Scalar::all(255));
+  auto expected = (*engine)->RunInference(frame);
+  ASSERT_TRUE(expected.ok());
+
+  EXPECT_EQ(ModelCache::Global().NumIdleNetworks(), 0u);
+  engine->reset();
+  EXPECT_EQ(ModelCache::Global().NumIdleNetworks(), 1u);
+
+  auto reused = InferenceEngine::Create(MakeParams());
+  ASSERT_TRUE(reused.ok()) << reused.status();
+  EXPECT_EQ(ModelCache::Global().NumIdleNetworks(), 0u);
+  auto actual = (*reused)->RunInference(frame);
+  ASSERT_TRUE(actual.ok());
+  EXPECT_EQ(actual->size(), expected->size());
+}
+
+TEST_F(SharedModelTest, IdleNetworksAreCappedPerModelTest) {
+  const size_t cap = ModelCache::kDefaultMaxIdleNetworks;
+  std::vector<std::unique_ptr<InferenceEngine>> engines;
+  for (size_t i = 0; i < cap + 3; ++i) {
+    auto engine = InferenceEngine::Create(MakeParams());
+    ASSERT_TRUE(engine.ok()) << engine.status();
+    engines.push_back(std::move(*engine));
+  }
+  engines.clear();
+  EXPECT_EQ(ModelCache::Global().NumIdleNetworks(), cap);
+
+  ModelCache::Global().SetMaxIdleNetworks(1);
+  EXPECT_EQ(ModelCache::Global().NumIdleNetworks(), 1u);
+  ModelCache::Global().SetMaxIdleNetworks(0);
+  EXPECT_EQ(ModelCache::Global().NumIdleNetworks(), 0u);
+  auto engine = InferenceEngine::Create(MakeParams());
+  ASSERT_TRUE(engine.ok()) << engine.status();
+  engine->reset();
+  EXPECT_EQ(ModelCache::Global().NumIdleNetworks(), 0u);
+}
+
+TEST_F(SharedModelTest, DisabledCacheKeepsNoNetworksTest) {
+  InferenceParams params = MakeParams();
+  params.use_model_cache = false;
+  auto engine = InferenceEngine::Create(params);
+  ASSERT_TRUE(engine.ok()) << engine.status();
+  engine->reset();
+  EXPECT_EQ(ModelCache::Global().NumIdleNetworks(), 0u);
+}
+
+TEST_F(SharedModelTest, RewrittenModelIsReadAgainTest) {
+  const std::string path =
+      (std::filesystem::temp_directory_path() / "shared_model_test.onnx")
+          .string();
+  std::filesystem::copy_file(
+      kModelPath, path, std::filesystem::copy_options::overwrite_existing);
+
+  auto before = ModelCache::Global().GetModel(path);
+  ASSERT_TRUE(before.ok()) << before.status();
+  const int64_t before_ns = (*before)->modification_time_ns();
+
+  // A network released for the old file must not be handed out for the new.
+  auto net = ModelCache::Global().AcquireNetwork(*before);
+  ASSERT_TRUE(net.ok());
+  ModelCache::Global().ReleaseNetwork(*before, std::move(*net));
+  EXPECT_EQ(ModelCache::Global().NumIdleNetworks(), 1u);
+
+  std::filesystem::last_write_time(
+      path, std::filesystem::last_write_time(path) + std::chrono::seconds(1));
+  auto after = ModelCache::Global().GetModel(path);
+  ASSERT_TRUE(after.ok()) << after.status();
+  EXPECT_NE(after->get(), before->get());
+  EXPECT_NE((*after)->modification_time_ns(), before_ns);
+  EXPECT_EQ(ModelCache::Global().NumIdleNetworks(), 0u);
+
+  // The old model stays valid for whoever still holds it.
+  EXPECT_EQ((*before)->ModelBytes(), (*after)->ModelBytes());
+  std::filesystem::remove(path);
+}
+
+TEST_F(SharedModelTest, ModelRewrittenInPlaceStillParsesTest) {
+  const std::string path =
+      (std::filesystem::temp_directory_path() / "shared_model_test.onnx")
+          .string();
+  std::filesystem::copy_file(
+      kModelPath, path, std::filesystem::copy_options::overwrite_existing);
+  auto model = SharedModel::Load(path);
+  ASSERT_TRUE(model.ok()) << model.status();
+
+  // Truncated and rewritten through the same inode, as `cp` does. A model
+  // parsed from a mapping of the file would read garbage or fault here.
+  std::ofstream(path, std::ios::binary | std::ios::trunc) << "not a model";
+  auto net = (*model)->NewNetwork();
+  ASSERT_TRUE(net.ok()) << net.status();
+  EXPECT_FALSE(net->empty());
+  std::filesystem::remove(path);
+}
+
+} // namespace
+} // namespace inference
@@ -0,0 +1,71 @@
+#include <thread>
+
+#include "inference/spsc_queue.h"
+#include "gtest/gtest.h"
+
+namespace inference {
+namespace {
+class SpscQueueTest : public ::testing::Test {};
+
+TEST_F(SpscQueueTest, CapacityRoundsUpToPowerOfTwoTest) {
+  SpscQueue<int> queue(5);
+  EXPECT_EQ(queue.Capacity(), 8);
+}
+
+TEST_F(SpscQueueTest, TryPushFailsWhenFullTest) {
+  SpscQueue<int> queue(2);
+  int value = 1;
+  EXPECT_TRUE(queue.TryPush(value));
+  value = 2;
+  EXPECT_TRUE(queue.TryPush(value));
+  value = 3;
+  EXPECT_FALSE(queue.TryPush(value));
+  EXPECT_EQ(queue.Size(), 2);
+
+  int popped = 0;
+  EXPECT_TRUE(queue.TryPop(popped));
+  EXPECT_EQ(popped, 1);
+  EXPECT_TRUE(queue.TryPush(value));
+}
+
+TEST_F(SpscQueueTest, PopDrainsAfterCloseTest) {
+  SpscQueue<int> queue(4);
+  for (int i = 0; i < 3; ++i) {
+    int value = i;
+    ASSERT_TRUE(queue.Push(value));
+  }
+  queue.Close();
+
+  int value = 0;
+  EXPECT_FALSE(queue.TryPush(value));
+  for (int i = 0; i < 3; ++i) {
+    ASSERT_TRUE(queue.Pop(value));
+    EXPECT_EQ(value, i);
+  }
+  EXPECT_FALSE(queue.Pop(value));
+}
+
+TEST_F(SpscQueueTest, PreservesOrderAcrossThreadsTest) {
+  constexpr int kItems = 100000;
+  SpscQueue<int> queue(16);
+
+  std::thread producer([&queue] {
+    for (int i = 0; i < kItems; ++i) {
+      int value = i;
+      ASSERT_TRUE(queue.Push(value));
+    }
+    queue.Close();
+  });
+
+  int expected = 0;
+  int value = 0;
+  while (queue.Pop(value)) {
+    ASSERT_EQ(value, expected);
+    ++expected;
+  }
+  producer.join();
+  EXPECT_EQ(expected, kItems);
+}
+
+} // namespace
+} // namespace inference
@@ -0,0 +1,85 @@
+#include "opencv2/core.hpp"
+#include "gtest/gtest.h"
+
+#include "inference/tiled_inference_engine.h"
+
+namespace inference {
+namespace {
+class TiledInferenceEngineTest : public ::testing::Test {
+protected:
+  static InferenceParams Params() {
+    return InferenceParams{.model_path = "/workspace/yolo11n.onnx",
+                           .input_image_width = 640,
+                           .input_image_height = 640,
+                           .padding_value = cv::Scalar(114, 114, 114),
+                           .confidence_threshold = 0.25,
+                           .iou_threshold = 0.5};
+  }
+};
+
+TEST_F(TiledInferenceEngineTest, TileGridCoversImageWithOverlapTest) {
+  const cv::Size image(3840, 2160);
+  const cv::Size tile(640, 640);
+  const auto tiles = TiledInferenceEngine::TileGrid(image, tile, 128);
+  ASSERT_EQ(tiles.size(), 8u * 4u);
+
+  cv::Mat coverage = cv::Mat::zeros(image, CV_8U);
+  for (const cv::Rect &rect : tiles) {
+    EXPECT_EQ(rect.size(), tile);
+    EXPECT_EQ(rect & cv::Rect(cv::Point(0, 0), image), rect);
+    coverage(rect).setTo(1);
+  }
+  EXPECT_EQ(cv::countNonZero(coverage), image.area());
+
+  // Row-major order, neighbours overlap by at least the requested amount.
+  for (size_t i = 1; i < 8; ++i) {
+    EXPECT_GE(tiles[i - 1].br().x - tiles[i].x, 128);
+  }
+  for (size_t i = 8; i < tiles.size(); i += 8) {
+    EXPECT_GE(tiles[i - 8].br().y - tiles[i].y, 128);
+  }
+}
+
+TEST_F(TiledInferenceEngineTest, TileGridSmallImageTest) {
+  auto tiles = TiledInferenceEngine::TileGrid(cv::Size(500, 300),
+                                              cv::Size(640, 640), 128);
+  ASSERT_EQ(tiles.size(), 1u);
+  EXPECT_EQ(tiles[0], cv::Rect(0, 0, 500, 300));
+
+  // Only the dimension that exceeds the tile is split.
+  tiles = TiledInferenceEngine::TileGrid(cv::Size(1200, 300),
+                                         cv::Size(640, 640), 128);
+  ASSERT_EQ(tiles.size(), 3u);
+  EXPECT_EQ(tiles[0], cv::Rect(0, 0, 640, 300));
+  EXPECT_EQ(tiles[1], cv::Rect(280, 0, 640, 300));
+  EXPECT_EQ(tiles[2], cv::Rect(560, 0, 640, 300));
+}
+
+TEST_F(TiledInferenceEngineTest, DetectionsInSourceCoordinatesTest) {
+  auto engine = TiledInferenceEngine::Create(Params(), TilingOptions{});
+  ASSERT_TRUE(engine.ok()) << engine.status();
+
+  cv::Mat source(1440, 2560, CV_8UC3);
+  cv::randu(source, cv::Scalar::all(0), cv::Scalar::all(255));
+
+  std::vector<Detection> detections;
+  ASSERT_TRUE((*engine)->RunInference(source, &detections).ok());
+  const cv::Rect bounds(0, 0, source.cols, source.rows);
+  for (const Detection &det : detections) {
+    EXPECT_EQ(det.bbox & bounds, det.bbox);
+  }
+
+  // Buffers are reused on the next frame of the same size.
+  auto again = (*engine)->RunInference(source);
+  ASSERT_TRUE(again.ok());
+  EXPECT_EQ(again->size(), detections.size());
+}
+
+TEST_F(TiledInferenceEngineTest, RejectsOverlapLargerThanTileTest) {
+  auto engine =
+      TiledInferenceEngine::Create(Params(), TilingOptions{.overlap = 640});
+  EXPECT_EQ(engine.status().code(), absl::StatusCode::kInvalidArgument);
+}
+
+} // namespace
+} // namespace inference
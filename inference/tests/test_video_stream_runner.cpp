@@ -0,0 +1,151 @@
+#include <chrono>
+#include <filesystem>
+#include <thread>
+
+#include "opencv2/core.hpp"
+#include "opencv2/videoio.hpp"
+#include "gtest/gtest.h"
+
+#include "inference/video_stream_runner.h"
+
+namespace inference {
+namespace {
+class VideoStreamRunnerTest : public ::testing::Test {
+protected:
+  static constexpr int kNumFrames = 24;
+
+  void SetUp() override {
+    video_path_ = (std::filesystem::temp_directory_path() /
+                   "video_stream_runner_test.avi")
+                      .string();
+    cv::VideoWriter writer(video_path_,
+                           cv::VideoWriter::fourcc('M', 'J', 'P', 'G'), 30.0,
+                           cv::Size(320, 240));
+    ASSERT_TRUE(writer.isOpened());
+
+    cv::Mat frame(240, 320, CV_8UC3);
+    for (int i = 0; i < kNumFrames; ++i) {
+      cv::randu(frame, cv::Scalar::all(0), cv::Scalar::all(255));
+      writer.write(frame);
+    }
+  }
+
+  void TearDown() override { std::filesystem::remove(video_path_); }
+
+  static InferenceParams Params() {
+    return InferenceParams{.model_path = "/workspace/yolo11n.onnx",
+                           .input_image_width = 640,
+                           .input_image_height = 640,
+                           .padding_value = cv::Scalar(114, 114, 114),
+                           .confidence_threshold = 0.5,
+                           .iou_threshold = 0.5};
+  }
+
+  std::string video_path_;
+};
+
+TEST_F(VideoStreamRunnerTest, BlockPolicyProcessesEveryFrameInOrderTest) {
+  auto runner = VideoStreamRunner::Open(video_path_, Params(), StreamOptions{});
+  ASSERT_TRUE(runner.ok()) << runner.status();
+  EXPECT_EQ((*runner)->frame_size(), cv::Size(320, 240));
+
+  std::vector<int64_t> indices;
+  auto stats = (*runner)->Run(
+      [&indices](const StreamFrame &frame, const std::vector<Detection> &) {
+        EXPECT_EQ(frame.image.size(), cv::Size(320, 240));
+        EXPECT_GE(frame.latency_ns, 0);
+        indices.push_back(frame.index);
+      });
+  ASSERT_TRUE(stats.ok()) << stats.status();
+
+  EXPECT_EQ(stats->frames_decoded, kNumFrames);
+  EXPECT_EQ(stats->frames_processed, kNumFrames);
+  EXPECT_EQ(stats->frames_dropped, 0);
+  EXPECT_GT(stats->frames_per_second, 0.0);
+  EXPECT_GT(stats->latency_p50_ms, 0.0);
+  ASSERT_EQ(indices.size(), static_cast<size_t>(kNumFrames));
+  for (int i = 0; i < kNumFrames; ++i) {
+    EXPECT_EQ(indices[i], i);
+  }
+
+  // A stream can only be consumed once.
+  EXPECT_FALSE((*runner)->Run(nullptr).ok());
+}
+
+TEST_F(VideoStreamRunnerTest, MaxFramesStopsDecodingTest) {
+  auto runner = VideoStreamRunner::Open(video_path_, Params(),
+                                        StreamOptions{.max_frames = 5});
+  ASSERT_TRUE(runner.ok()) << runner.status();
+
+  auto stats = (*runner)->Run(nullptr);
+  ASSERT_TRUE(stats.ok()) << stats.status();
+  EXPECT_EQ(stats->frames_decoded, 5);
+  EXPECT_EQ(stats->frames_processed, 5);
+}
+
+TEST_F(VideoStreamRunnerTest, DropPoliciesAccountForEveryFrameTest) {
+  for (FrameDropPolicy policy :
+       {FrameDropPolicy::kDropNewest, FrameDropPolicy::kDropOldest}) {
+    auto runner = VideoStreamRunner::Open(
+        video_path_, Params(),
+        StreamOptions{.queue_depth = 1, .drop_policy = policy});
+    ASSERT_TRUE(runner.ok()) << runner.status();
+
+    // A slow consumer makes the decoder run into a full queue.
+    int64_t last_index = -1;
+    auto stats = (*runner)->Run(
+        [&last_index](const StreamFrame &frame,
+                      const std::vector<Detection> &) {
+          EXPECT_GT(frame.index, last_index);
+          last_index = frame.index;
+          std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        });
+    ASSERT_TRUE(stats.ok()) << stats.status();
+
+    EXPECT_EQ(stats->frames_decoded, kNumFrames);
+    EXPECT_GT(stats->frames_dropped, 0);
+    EXPECT_EQ(stats->frames_processed + stats->frames_dropped, kNumFrames);
+    if (policy == FrameDropPolicy::kDropOldest) {
+      // The newest frame is never the one dropped.
+      EXPECT_EQ(last_index, kNumFrames - 1);
+    }
+  }
+}
+
+TEST_F(VideoStreamRunnerTest, TrackingRunsDetectorEveryIntervalTest) {
+  auto runner = VideoStreamRunner::Open(
+      video_path_, Params(),
+      StreamOptions{.tracking = true, .detection_interval = 3});
+  ASSERT_TRUE(runner.ok()) << runner.status();
+
+  std::vector<bool> detected;
+  auto stats = (*runner)->Run(
+      [&detected](const StreamFrame &frame,
+                  const std::vector<Detection> &detections) {
+        EXPECT_EQ(frame.tracks.size(), detections.size());
+        detected.push_back(frame.detected);
+      });
+  ASSERT_TRUE(stats.ok()) << stats.status();
+
+  EXPECT_EQ(stats->frames_processed, kNumFrames);
+  EXPECT_EQ(stats->frames_detected, kNumFrames / 3);
+  ASSERT_EQ(detected.size(), static_cast<size_t>(kNumFrames));
+  for (int i = 0; i < kNumFrames; ++i) {
+    EXPECT_EQ(detected[i], i % 3 == 0) << i;
+  }
+}
+
+TEST_F(VideoStreamRunnerTest, DetectionIntervalNeedsTrackingTest) {
+  auto runner = VideoStreamRunner::Open(
+      video_path_, Params(), StreamOptions{.detection_interval = 3});
+  EXPECT_EQ(runner.status().code(), absl::StatusCode::kInvalidArgument);
+}
+
+TEST_F(VideoStreamRunnerTest, MissingSourceIsNotFoundTest) {
+  auto runner = VideoStreamRunner::Open("/nonexistent/video.avi", Params(),
+                                        StreamOptions{});
+  EXPECT_EQ(runner.status().code(), absl::StatusCode::kNotFound);
+}
+
+} // namespace
+} // namespace inference
@@ -0,0 +1,114 @@
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#include "opencv2/core.hpp"
+#include "gtest/gtest.h"
+
+#include "inference/inference_engine.h"
+
+namespace {
+
+// Counts every operator new call made while `g_counting` is set.
+std::atomic<bool> g_counting{false};
+std::atomic<size_t> g_allocations{0};
+
+} // namespace
+
+void *operator new(std::size_t size) {
+  if (g_counting.load(std::memory_order_relaxed)) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+  }
+  if (void *ptr = std::malloc(size == 0 ? 1 : size)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+
+void operator delete(void *ptr, std::size_t) noexcept { std::free(ptr); }
+
+namespace inference {
+namespace {
+class ZeroAllocationTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    // A single thread keeps preprocessing off the OpenCV thread pool, which
+    // allocates a job object per parallel region.
+    num_threads_ = cv::getNumThreads();
+    cv::setNumThreads(1);
+
+    // A low threshold leaves thousands of candidates for NMS on noise.
+    auto inference_engine = InferenceEngine::Create(
+        InferenceParams{.model_path = "/workspace/yolo11n.onnx",
+                        .input_image_width = 640,
+                        .input_image_height = 640,
+                        .padding_value = cv::Scalar(114, 114, 114),
+                        .confidence_threshold = 0.01,
+                        .iou_threshold = 0.5});
+
+    ASSERT_TRUE(inference_engine.ok());
+    engine_ = std::move(*inference_engine);
+
+    source_.create(1080, 1920, CV_8UC3);
+    cv::randu(source_, cv::Scalar::all(0), cv::Scalar::all(255));
+  }
+
+  void TearDown() override { cv::setNumThreads(num_threads_); }
+
+  int num_threads_ = 0;
+  std::unique_ptr<InferenceEngine> engine_;
+  cv::Mat source_;
+};
+
+TEST_F(ZeroAllocationTest, SteadyStatePreprocessAndPostprocessTest) {
+  cv::Mat blob;
+  std::vector<cv::Mat> network_output;
+  std::vector<Detection> detections;
+
+  // Warmup grows every buffer to its steady-state size.
+  for (int i = 0; i < 3; ++i) {
+    ASSERT_TRUE(engine_->RunInference(source_, &detections).ok());
+  }
+  const auto source_span = absl::MakeConstSpan(&source_, 1);
+  ASSERT_TRUE(engine_->Preprocess(source_span, &blob).ok());
+  ASSERT_TRUE(engine_->Forward(blob, &network_output).ok());
+  ASSERT_TRUE(
+      engine_->Postprocess(network_output, 0, source_, &detections).ok());
+  ASSERT_FALSE(detections.empty());
+
+  // The forward pass allocates inside OpenCV DNN and is not counted.
+  const float *blob_data = blob.ptr<float>();
+  g_allocations = 0;
+  for (int i = 0; i < 10; ++i) {
+    g_counting = true;
+    const bool preprocessed = engine_->Preprocess(source_span, &blob).ok();
+    const bool postprocessed =
+        engine_->Postprocess(network_output, 0, source_, &detections).ok();
+    g_counting = false;
+
+    ASSERT_TRUE(preprocessed);
+    ASSERT_TRUE(postprocessed);
+  }
+
+  EXPECT_EQ(g_allocations.load(), 0u);
+  EXPECT_EQ(blob.ptr<float>(), blob_data) << "input blob was reallocated";
+}
+
+TEST_F(ZeroAllocationTest, OutputParameterMatchesReturnedDetectionsTest) {
+  std::vector<Detection> detections;
+  ASSERT_TRUE(engine_->RunInference(source_, &detections).ok());
+
+  auto expected = engine_->RunInference(source_);
+  ASSERT_TRUE(expected.ok()) << expected.status();
+  ASSERT_EQ(expected->size(), detections.size());
+  for (size_t i = 0; i < detections.size(); ++i) {
+    EXPECT_EQ((*expected)[i].class_id, detections[i].class_id);
+    EXPECT_EQ((*expected)[i].confidence, detections[i].confidence);
+    EXPECT_EQ((*expected)[i].bbox, detections[i].bbox);
+  }
+}
+
+} // namespace
+} // namespace inference
@@ -0,0 +1,175 @@
+#include <algorithm>
+#include <cstdint>
+
+#include "absl/strings/str_format.h"
+
+#include "inference/tiled_inference_engine.h"
+
+namespace inference {
+namespace {
+
+// Start offsets along one axis, see TiledInferenceEngine::TileGrid.
+void AppendTileStarts(int length, int tile, int overlap,
+                      std::vector<int> *starts) {
+  starts->clear();
+  if (length <= tile) {
+    starts->push_back(0);
+    return;
+  }
+
+  // Smallest count whose tiles, overlap apart, span the whole length.
+  const int step = tile - overlap;
+  const int count = (length - overlap + step - 1) / step;
+  for (int i = 0; i < count; ++i) {
+    starts->push_back(static_cast<int>(static_cast<int64_t>(i) *
+                                       (length - tile) / (count - 1)));
+  }
+}
+
+} // namespace
+
+absl::StatusOr<std::unique_ptr<TiledInferenceEngine>>
+TiledInferenceEngine::Create(const InferenceParams &params,
+                             const TilingOptions &options) {
+  const int min_input =
+      std::min(params.input_image_width, params.input_image_height);
+  if (options.overlap < 0 || options.overlap >= min_input) {
+    return absl::InvalidArgumentError(absl::StrFormat(
+        "tile overlap %d must be in [0, %d)", options.overlap, min_input));
+  }
+
+  auto engine = InferenceEngine::Create(params);
+  if (!engine.ok()) {
+    return engine.status();
+  }
+
+  return std::unique_ptr<TiledInferenceEngine>(
+      new TiledInferenceEngine(std::move(*engine), params, options));
+}
+
+TiledInferenceEngine::TiledInferenceEngine(
+    std::unique_ptr<InferenceEngine> engine, const InferenceParams &params,
+    const TilingOptions &options)
+    : engine_(std::move(engine)), options_(options),
+      input_size_(params.input_image_width, params.input_image_height),
+      padding_value_(params.padding_value),
+      nms_options_{.iou_threshold = params.iou_threshold,
+                   .mode = params.nms_mode,
+                   .max_detections = params.max_detections,
+                   .spatial_bucketing = params.nms_spatial_bucketing} {}
+
+std::vector<cv::Rect>
+TiledInferenceEngine::TileGrid(const cv::Size &image_size,
+                               const cv::Size &tile_size, int overlap) {
+  std::vector<int> xs, ys;
+  AppendTileStarts(image_size.width, tile_size.width, overlap, &xs);
+  AppendTileStarts(image_size.height, tile_size.height, overlap, &ys);
+
+  std::vector<cv::Rect> tiles;
+  tiles.reserve(xs.size() * ys.size());
+  for (int y : ys) {
+    for (int x : xs) {
+      tiles.emplace_back(x, y, std::min(tile_size.width, image_size.width),
+                         std::min(tile_size.height, image_size.height));
+    }
+  }
+  return tiles;
+}
+
+absl::StatusOr<std::vector<Detection>>
+TiledInferenceEngine::RunInference(const cv::Mat &source) {
+  std::vector<Detection> detections;
+  auto status = RunInference(source, &detections);
+  if (!status.ok()) {
+    return status;
+  }
+  return detections;
+}
+
+absl::Status
+TiledInferenceEngine::RunInference(const cv::Mat &source,
+                                   std::vector<Detection> *detections) {
+  auto status = PreprocessTiles(source);
+  if (!status.ok()) {
+    return status;
+  }
+
+  status = engine_->Forward(blob_, &network_output_);
+  if (!status.ok()) {
+    return status;
+  }
+
+  // Every view is decoded, suppressed and unscaled on its own, then moved to
+  // source coordinates. The seams are merged by a last NMS over all views.
+  candidates_.clear();
+  for (size_t i = 0; i < views_.size(); ++i) {
+    status = engine_->Postprocess(network_output_, static_cast<int>(i),
+                                  view_info_[i], &view_batch_);
+    if (!status.ok()) {
+      return status;
+    }
+    view_batch_.ToDetections(&view_detections_);
+
+    for (Detection &det : view_detections_) {
+      det.bbox += origins_[i];
+      candidates_.push_back(det);
+    }
+  }
+
+  NonMaxSuppression::Apply(candidates_, nms_options_, &nms_workspace_,
+                           detections);
+  return absl::OkStatus();
+}
+
+absl::Status TiledInferenceEngine::PreprocessTiles(const cv::Mat &source) {
+  if (source.empty() || source.type() != CV_8UC3) {
+    return absl::InvalidArgumentError("source must be a non-empty CV_8UC3");
+  }
+
+  const std::vector<cv::Rect> tiles =
+      TileGrid(source.size(), input_size_, options_.overlap);
+  views_.clear();
+  origins_.clear();
+  for (const cv::Rect &tile : tiles) {
+    views_.push_back(source(tile));
+    origins_.push_back(tile.tl());
+  }
+  // A single tile covering the image already is the full frame.
+  const bool whole_image =
+      tiles.size() == 1 && tiles[0].size() == source.size();
+  if (options_.full_frame_pass && !whole_image) {
+    views_.push_back(source);
+    origins_.emplace_back(0, 0);
+  }
+
+  const int batch_size = static_cast<int>(views_.size());
+  while (preprocessors_.size() < views_.size()) {
+    preprocessors_.emplace_back(padding_value_);
+  }
+  const int sizes[] = {batch_size, 3, input_size_.height, input_size_.width};
+  blob_.create(4, sizes, CV_32F);
+  view_info_.resize(batch_size);
+
+  // Each batch entry has its own preprocessor and output slice. Full-size
+  // tiles need no resampling, so their pixels go from the source view
+  // straight into the blob. The preprocessor's own row parallelism runs
+  // serially inside this loop.
+  std::vector<absl::Status> statuses(batch_size);
+  cv::parallel_for_(cv::Range(0, batch_size), [&](const cv::Range &range) {
+    for (int i = range.start; i < range.end; ++i) {
+      statuses[i] = preprocessors_[i].Run(views_[i], input_size_.width,
+                                          input_size_.height,
+                                          blob_.ptr<float>(i), &view_info_[i]);
+    }
+  });
+
+  for (int i = 0; i < batch_size; ++i) {
+    if (!statuses[i].ok()) {
+      return absl::InvalidArgumentError(absl::StrFormat(
+          "failed to preprocess tile %d: %s", i, statuses[i].message()));
+    }
+  }
+  return absl::OkStatus();
+}
+
+} // namespace inference
@@ -0,0 +1,96 @@
+#ifndef INFERENCE_TILED_INFERENCE_ENGINE_H_
+#define INFERENCE_TILED_INFERENCE_ENGINE_H_
+
+#include <memory>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "opencv2/core.hpp"
+
+#include "inference/blob_preprocessor.h"
+#include "inference/detection.h"
+#include "inference/detection_batch.h"
+#include "inference/image_info.h"
+#include "inference/inference_engine.h"
+#include "inference/inference_params.h"
+#include "inference/non_max_suppression.h"
+
+namespace inference {
+
+struct TilingOptions {
+  // Pixels shared by neighbouring tiles. Objects up to this size lie whole
+  // in at least one tile. Must be smaller than the input size.
+  int overlap = 128;
+  // Also runs the whole frame letterboxed to the input size, in the same
+  // batch, for objects too large for a single tile.
+  bool full_frame_pass = true;
+};
+
+// Runs detection on high-resolution images without downscaling them. The
+// source is split into overlapping tiles the size of the network input,
+// which are inferred at native resolution as one batched forward pass. Tile
+// detections are mapped back to source coordinates and duplicates across
+// seams are merged with NMS.
+//
+// The number of tiles only depends on the image size, so the cost grows
+// linearly with the megapixels of the source.
+class TiledInferenceEngine {
+public:
+  static absl::StatusOr<std::unique_ptr<TiledInferenceEngine>>
+  Create(const InferenceParams &params, const TilingOptions &options);
+
+  // Tiles of `tile_size` covering an image of `image_size`. Neighbouring
+  // tiles overlap by at least `overlap` pixels, the spare overlap is spread
+  // evenly, and tiles never extend past the image. An image dimension
+  // smaller than the tile gets a single, smaller tile.
+  static std::vector<cv::Rect> TileGrid(const cv::Size &image_size,
+                                        const cv::Size &tile_size,
+                                        int overlap);
+
+  absl::StatusOr<std::vector<Detection>> RunInference(const cv::Mat &source);
+
+  // Same as above, but overwrites `detections`. Buffers are reused across
+  // calls while the source resolution stays the same. Not thread-safe.
+  absl::Status RunInference(const cv::Mat &source,
+                            std::vector<Detection> *detections);
+
+  // The engine running the tiles. Its metrics count every tile as a frame.
+  InferenceEngine &engine() const { return *engine_; }
+
+private:
+  TiledInferenceEngine(std::unique_ptr<InferenceEngine> engine,
+                       const InferenceParams &params,
+                       const TilingOptions &options);
+
+  // Builds views_ for `source` and letterboxes them into blob_, one batch
+  // entry per view, in parallel.
+  absl::Status PreprocessTiles(const cv::Mat &source);
+
+  std::unique_ptr<InferenceEngine> engine_;
+  const TilingOptions options_;
+  const cv::Size input_size_;
+  const cv::Scalar padding_value_;
+  NmsOptions nms_options_;
+
+  // Views into the source, tiles first, then the full frame if enabled, and
+  // their origin in the source. Both are views, the pixels are only read
+  // once, by the preprocessor writing the blob.
+  std::vector<cv::Mat> views_;
+  std::vector<cv::Point> origins_;
+  // One per batch entry so tiles are preprocessed concurrently.
+  std::vector<BlobPreprocessor> preprocessors_;
+  // Letterbox geometry of every view in blob_.
+  std::vector<ImageInfo> view_info_;
+
+  cv::Mat blob_;
+  std::vector<cv::Mat> network_output_;
+  DetectionBatch view_batch_;
+  std::vector<Detection> view_detections_;
+  std::vector<Detection> candidates_;
+  NmsWorkspace nms_workspace_;
+};
+
+} // namespace inference
+
+#endif
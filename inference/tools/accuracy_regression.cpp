@@ -0,0 +1,201 @@
+// Runs engine variants over a COCO-format labeled set and checks that none
+// of them loses accuracy against the first one:
+//
+//   bazel run -c opt //inference/tools:accuracy_regression -- \
+//     --annotations=/data/coco/instances_val2017.json \
+//     --images=/data/coco/val2017 \
+//     --variants=baseline,no_fusion,fp16,letterbox32,model:/workspace/int8.onnx
+//
+// Prints mAP@0.5, mAP@0.5:0.95, latency percentiles and serial throughput
+// per variant. A variant whose mAP@0.5:0.95 is more than --map_tolerance
+// below the first variant's fails the run, as does any below --min_map.
+
+#include <algorithm>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/log/log.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/match.h"
+#include "absl/strings/str_format.h"
+#include "opencv2/core.hpp"
+#include "opencv2/imgcodecs.hpp"
+
+#include "inference/coco_evaluator.h"
+#include "inference/detection_batch.h"
+#include "inference/inference_engine.h"
+#include "inference/inference_metrics.h"
+
+ABSL_FLAG(std::string, annotations, "",
+          "COCO instances JSON with the ground truth.");
+ABSL_FLAG(std::string, images, "",
+          "Directory holding the annotated images by file_name.");
+ABSL_FLAG(std::string, model, "/workspace/yolo11n.onnx",
+          "Model of the variants that don't name their own.");
+ABSL_FLAG(std::vector<std::string>, variants, {"baseline"},
+          "Engine variants to compare, the first is the reference: "
+          "baseline, no_fusion, no_winograd, fp16, autotune, letterbox32, "
+          "spatial_nms or model:<path>.");
+ABSL_FLAG(int, input_size, 640, "Network input width and height.");
+ABSL_FLAG(double, confidence_threshold, 0.001,
+          "Detection threshold. COCO mAP is measured over the whole "
+          "precision-recall curve, so keep it low.");
+ABSL_FLAG(int, repeats, 1, "Timed runs per image and variant.");
+ABSL_FLAG(int, max_images, 0, "Evaluate only the first images, 0 for all.");
+ABSL_FLAG(double, map_tolerance, 0.005,
+          "Largest drop in mAP@0.5:0.95 from the first variant that passes.");
+ABSL_FLAG(double, min_map, 0.0,
+          "Fail any variant whose mAP@0.5:0.95 is below this, 0 to skip.");
+
+namespace {
+
+// Params of the engine variant `name`, on top of `base`.
+absl::StatusOr<inference::InferenceParams>
+VariantParams(const std::string &name, inference::InferenceParams base) {
+  if (absl::StartsWith(name, "model:")) {
+    base.model_path = name.substr(6);
+  } else if (name == "no_fusion") {
+    base.enable_fusion = false;
+  } else if (name == "no_winograd") {
+    base.enable_winograd = false;
+  } else if (name == "fp16") {
+    base.use_fp16 = true;
+  } else if (name == "autotune") {
+    base.autotune = true;
+  } else if (name == "letterbox32") {
+    base.letterbox_stride = 32;
+  } else if (name == "spatial_nms") {
+    base.nms_spatial_bucketing = true;
+  } else if (name != "baseline") {
+    return absl::InvalidArgumentError(
+        absl::StrFormat("Unknown variant %s", name));
+  }
+  return base;
+}
+
+// Runs the first `num_images` images of `evaluator` through the variant,
+// recording the latency of the engine alone, and evaluates its detections.
+absl::StatusOr<inference::CocoMetrics>
+RunVariant(const inference::InferenceParams &params,
+           const std::string &images_dir, size_t num_images, int repeats,
+           inference::CocoEvaluator *evaluator, inference::Histogram *latency) {
+  auto engine = inference::InferenceEngine::Create(params);
+  if (!engine.ok()) {
+    return engine.status();
+  }
+
+  inference::DetectionBatch detections;
+  evaluator->Reset();
+  for (size_t i = 0; i < num_images; ++i) {
+    const std::string path =
+        (std::filesystem::path(images_dir) / evaluator->images()[i].file_name)
+            .string();
+    const cv::Mat image = cv::imread(path, cv::IMREAD_COLOR);
+    if (image.empty()) {
+      return absl::NotFoundError(absl::StrFormat("Cannot read %s", path));
+    }
+    for (int r = 0; r < repeats; ++r) {
+      const int64_t start_ns = inference::InferenceMetrics::NowNanos();
+      auto status = (*engine)->RunInference(image, &detections);
+      if (!status.ok()) {
+        return status;
+      }
+      latency->Record(inference::InferenceMetrics::NowNanos() - start_ns);
+    }
+    evaluator->AddDetections(i, detections);
+  }
+  return evaluator->Evaluate();
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  absl::ParseCommandLine(argc, argv);
+
+  const std::string images_dir = absl::GetFlag(FLAGS_images);
+  const std::vector<std::string> variants = absl::GetFlag(FLAGS_variants);
+  if (absl::GetFlag(FLAGS_annotations).empty() || images_dir.empty() ||
+      variants.empty()) {
+    LOG(ERROR) << "--annotations, --images and --variants are required";
+    return 1;
+  }
+
+  auto evaluator =
+      inference::CocoEvaluator::Load(absl::GetFlag(FLAGS_annotations));
+  if (!evaluator.ok()) {
+    LOG(ERROR) << evaluator.status();
+    return 1;
+  }
+  size_t num_images = (*evaluator)->images().size();
+  if (absl::GetFlag(FLAGS_max_images) > 0) {
+    num_images = std::min<size_t>(num_images, absl::GetFlag(FLAGS_max_images));
+  }
+  if (num_images == 0) {
+    LOG(ERROR) << "No images in " << absl::GetFlag(FLAGS_annotations);
+    return 1;
+  }
+
+  const int input_size = absl::GetFlag(FLAGS_input_size);
+  // COCO scores at most 100 detections per image.
+  const inference::InferenceParams base{
+      .model_path = absl::GetFlag(FLAGS_model),
+      .input_image_width = input_size,
+      .input_image_height = input_size,
+      .padding_value = cv::Scalar(114, 114, 114),
+      .confidence_threshold =
+          static_cast<float>(absl::GetFlag(FLAGS_confidence_threshold)),
+      .iou_threshold = 0.7,
+      .max_detections = inference::CocoEvaluator::kMaxDetections};
+
+  const int repeats = std::max(1, absl::GetFlag(FLAGS_repeats));
+  const double tolerance = absl::GetFlag(FLAGS_map_tolerance);
+  const double min_map = absl::GetFlag(FLAGS_min_map);
+  absl::PrintF("%d images, %d runs each\n", num_images, repeats);
+  absl::PrintF("%-28s %8s %10s %8s %9s %9s %8s\n", "variant", "mAP@.5",
+               "mAP@.5:.95", "delta", "p50", "p99", "img/s");
+
+  bool passed = true;
+  double reference_map = 0.0;
+  inference::Histogram latency;
+  for (size_t v = 0; v < variants.size(); ++v) {
+    auto params = VariantParams(variants[v], base);
+    if (!params.ok()) {
+      LOG(ERROR) << params.status();
+      return 1;
+    }
+    latency.Reset();
+    auto metrics = RunVariant(*params, images_dir, num_images, repeats,
+                              evaluator->get(), &latency);
+    if (!metrics.ok()) {
+      absl::PrintF("FAIL %s: %s\n", variants[v], metrics.status().ToString());
+      // Without the reference there is nothing to compare against.
+      if (v == 0) {
+        return 1;
+      }
+      passed = false;
+      continue;
+    }
+
+    if (v == 0) {
+      reference_map = metrics->map_50_95;
+    }
+    const double delta = metrics->map_50_95 - reference_map;
+    absl::PrintF("%-28s %8.4f %10.4f %+8.4f %7.2fms %7.2fms %8.1f\n",
+                 variants[v], metrics->map_50, metrics->map_50_95, delta,
+                 latency.Quantile(0.5) * 1e-6, latency.Quantile(0.99) * 1e-6,
+                 1e9 / std::max(1.0, latency.Mean()));
+    if (delta < -tolerance) {
+      absl::PrintF("FAIL %s mAP@0.5:0.95 dropped %.4f, tolerance %.4f\n",
+                   variants[v], -delta, tolerance);
+      passed = false;
+    }
+    if (metrics->map_50_95 < min_map) {
+      absl::PrintF("FAIL %s mAP@0.5:0.95 below %.4f\n", variants[v], min_map);
+      passed = false;
+    }
+  }
+  return passed ? 0 : 1;
+}
@@ -0,0 +1,176 @@
+// Compares a reference model against a candidate, typically the FP32 model
+// against its INT8 quantization, on a local image set:
+//
+//   bazel run -c opt //inference/tools:compare_models -- \
+//     --reference_model=/workspace/yolo11n.onnx \
+//     --candidate_model=/workspace/yolo11n_int8.onnx --images=/data/val
+//
+// Prints latency percentiles of both models, the speedup, and how well the
+// candidate's detections agree with the reference ones. --min_speedup and
+// --min_recall turn the report into a pass/fail check.
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/log/log.h"
+#include "absl/strings/str_format.h"
+#include "opencv2/core.hpp"
+#include "opencv2/imgcodecs.hpp"
+
+#include "inference/detection_matcher.h"
+#include "inference/inference_engine.h"
+#include "inference/inference_metrics.h"
+
+ABSL_FLAG(std::string, reference_model, "/workspace/yolo11n.onnx",
+          "Model whose detections are taken as ground truth.");
+ABSL_FLAG(std::string, candidate_model, "",
+          "Model to evaluate, e.g. an INT8 quantization of the reference.");
+ABSL_FLAG(std::string, images, "", "Directory of images to run.");
+ABSL_FLAG(int, input_size, 640, "Network input width and height.");
+ABSL_FLAG(double, confidence_threshold, 0.25, "Detection threshold.");
+ABSL_FLAG(double, match_iou, 0.5,
+          "IoU at which a candidate detection matches a reference one.");
+ABSL_FLAG(int, repeats, 5, "Timed runs per image and model.");
+ABSL_FLAG(double, min_speedup, 0.0,
+          "Fail unless the p50 latency speedup reaches this, 0 to skip.");
+ABSL_FLAG(double, min_recall, 0.0,
+          "Fail unless this fraction of reference detections is matched, 0 "
+          "to skip.");
+
+namespace {
+
+std::vector<std::string> ListImages(const std::string &directory) {
+  std::vector<std::string> paths;
+  for (const auto &entry : std::filesystem::directory_iterator(directory)) {
+    std::string extension = entry.path().extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    if (entry.is_regular_file() &&
+        (extension == ".jpg" || extension == ".jpeg" || extension == ".png" ||
+         extension == ".bmp")) {
+      paths.push_back(entry.path().string());
+    }
+  }
+  std::sort(paths.begin(), paths.end());
+  return paths;
+}
+
+// Runs `engine` `repeats` times on `image`, recording every latency, and
+// returns the detections of the last run.
+absl::StatusOr<std::vector<inference::Detection>>
+TimedRun(inference::InferenceEngine &engine, const cv::Mat &image,
+         int repeats, inference::Histogram *latency) {
+  std::vector<inference::Detection> detections;
+  for (int i = 0; i < repeats; ++i) {
+    const int64_t start_ns = inference::InferenceMetrics::NowNanos();
+    auto status = engine.RunInference(image, &detections);
+    if (!status.ok()) {
+      return status;
+    }
+    latency->Record(inference::InferenceMetrics::NowNanos() - start_ns);
+  }
+  return detections;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  absl::ParseCommandLine(argc, argv);
+
+  const std::string images_dir = absl::GetFlag(FLAGS_images);
+  if (absl::GetFlag(FLAGS_candidate_model).empty() || images_dir.empty()) {
+    LOG(ERROR) << "--candidate_model and --images are required";
+    return 1;
+  }
+
+  const int input_size = absl::GetFlag(FLAGS_input_size);
+  inference::InferenceParams params{
+      .input_image_width = input_size,
+      .input_image_height = input_size,
+      .padding_value = cv::Scalar(114, 114, 114),
+      .confidence_threshold =
+          static_cast<float>(absl::GetFlag(FLAGS_confidence_threshold)),
+      .iou_threshold = 0.5};
+
+  params.model_path = absl::GetFlag(FLAGS_reference_model);
+  auto reference = inference::InferenceEngine::Create(params);
+  if (!reference.ok()) {
+    LOG(ERROR) << reference.status();
+    return 1;
+  }
+  params.model_path = absl::GetFlag(FLAGS_candidate_model);
+  auto candidate = inference::InferenceEngine::Create(params);
+  if (!candidate.ok()) {
+    LOG(ERROR) << candidate.status();
+    return 1;
+  }
+
+  const std::vector<std::string> paths = ListImages(images_dir);
+  if (paths.empty()) {
+    LOG(ERROR) << "No images in " << images_dir;
+    return 1;
+  }
+
+  const int repeats = std::max(1, absl::GetFlag(FLAGS_repeats));
+  const float match_iou = static_cast<float>(absl::GetFlag(FLAGS_match_iou));
+  inference::Histogram reference_latency;
+  inference::Histogram candidate_latency;
+  inference::MatchStats agreement;
+  for (const std::string &path : paths) {
+    const cv::Mat image = cv::imread(path, cv::IMREAD_COLOR);
+    if (image.empty()) {
+      LOG(WARNING) << "Skipping unreadable " << path;
+      continue;
+    }
+
+    auto expected = TimedRun(**reference, image, repeats, &reference_latency);
+    auto actual = TimedRun(**candidate, image, repeats, &candidate_latency);
+    if (!expected.ok() || !actual.ok()) {
+      LOG(ERROR) << path << ": "
+                 << (expected.ok() ? actual.status() : expected.status());
+      return 1;
+    }
+    agreement.Add(
+        inference::DetectionMatcher::Match(*expected, *actual, match_iou));
+  }
+
+  auto print_latency = [](const char *name, const std::string &model,
+                          bool quantized,
+                          const inference::Histogram &latency) {
+    absl::PrintF("%-9s %s%s\n", name, model, quantized ? " (int8)" : "");
+    absl::PrintF("          latency mean %.2fms p50 %.2fms p99 %.2fms\n",
+                 latency.Mean() * 1e-6, latency.Quantile(0.5) * 1e-6,
+                 latency.Quantile(0.99) * 1e-6);
+  };
+  print_latency("reference", absl::GetFlag(FLAGS_reference_model),
+                (*reference)->quantized(), reference_latency);
+  print_latency("candidate", absl::GetFlag(FLAGS_candidate_model),
+                (*candidate)->quantized(), candidate_latency);
+
+  const double speedup =
+      static_cast<double>(reference_latency.Quantile(0.5)) /
+      std::max<uint64_t>(1, candidate_latency.Quantile(0.5));
+  absl::PrintF("images    %d, %d runs each\n", paths.size(), repeats);
+  absl::PrintF("speedup   %.2fx at p50\n", speedup);
+  absl::PrintF("agreement recall %.3f precision %.3f mean IoU %.3f "
+               "(%d of %d reference detections)\n",
+               agreement.Recall(), agreement.Precision(), agreement.MeanIoU(),
+               agreement.matched, agreement.reference_count);
+
+  bool passed = true;
+  if (speedup < absl::GetFlag(FLAGS_min_speedup)) {
+    absl::PrintF("FAIL speedup below %.2fx\n",
+                 absl::GetFlag(FLAGS_min_speedup));
+    passed = false;
+  }
+  if (agreement.Recall() < absl::GetFlag(FLAGS_min_recall)) {
+    absl::PrintF("FAIL recall below %.3f\n", absl::GetFlag(FLAGS_min_recall));
+    passed = false;
+  }
+  return passed ? 0 : 1;
+}
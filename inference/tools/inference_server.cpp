@@ -0,0 +1,97 @@
+// Serves a model to local processes over a Unix domain socket, batching
+// concurrent requests into shared forward passes:
+//
+//   bazel run -c opt //inference/tools:inference_server -- \
+//     --model=/workspace/yolo11n.onnx --socket=/tmp/inference.sock \
+//     --max_batch_size=8 --max_batch_delay_us=2000
+//
+// Clients connect with InferenceClient. Request latency percentiles per
+// batch size are printed every --stats_interval_s and on SIGINT or SIGTERM,
+// which also shut the server down.
+
+#include <signal.h>
+
+#include <ctime>
+#include <string>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/log/log.h"
+#include "absl/strings/str_format.h"
+#include "opencv2/core.hpp"
+
+#include "inference/inference_server.h"
+
+ABSL_FLAG(std::string, model, "/workspace/yolo11n.onnx", "Model to serve.");
+ABSL_FLAG(std::string, socket, "/tmp/inference.sock",
+          "Unix domain socket to listen on.");
+ABSL_FLAG(int, input_size, 640, "Network input width and height.");
+ABSL_FLAG(double, confidence_threshold, 0.25, "Detection threshold.");
+ABSL_FLAG(int, max_batch_size, 8,
+          "Most requests coalesced into one forward pass.");
+ABSL_FLAG(int64_t, max_batch_delay_us, 2000,
+          "Longest a request waits for others to fill its batch.");
+ABSL_FLAG(int, queue_capacity, 64,
+          "Requests queued before new ones are rejected.");
+ABSL_FLAG(int, stats_interval_s, 10, "Seconds between stats, 0 for none.");
+
+namespace {
+
+void PrintStats(const inference::ServerStats &stats) {
+  absl::PrintF("requests %d, rejected %d, batches %d\n", stats.requests,
+               stats.rejected, stats.batches);
+  absl::PrintF("batch  batches  requests  p50 ms  p99 ms\n");
+  for (const inference::BatchLatency &row : stats.by_batch_size) {
+    absl::PrintF("%5d  %7d  %8d  %6.2f  %6.2f\n", row.batch_size, row.batches,
+                 row.requests, row.p50_ms, row.p99_ms);
+  }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  absl::ParseCommandLine(argc, argv);
+
+  // Blocked before the server starts its threads, so they inherit the mask
+  // and the signals are only taken by sigtimedwait below.
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+  const int input_size = absl::GetFlag(FLAGS_input_size);
+  const inference::InferenceParams params{
+      .model_path = absl::GetFlag(FLAGS_model),
+      .input_image_width = input_size,
+      .input_image_height = input_size,
+      .padding_value = cv::Scalar(114, 114, 114),
+      .confidence_threshold =
+          static_cast<float>(absl::GetFlag(FLAGS_confidence_threshold)),
+      .iou_threshold = 0.5};
+  auto server = inference::InferenceServer::Create(
+      params,
+      inference::ServerOptions{
+          .socket_path = absl::GetFlag(FLAGS_socket),
+          .max_batch_size = absl::GetFlag(FLAGS_max_batch_size),
+          .max_batch_delay_us = absl::GetFlag(FLAGS_max_batch_delay_us),
+          .queue_capacity = absl::GetFlag(FLAGS_queue_capacity)});
+  if (!server.ok()) {
+    LOG(ERROR) << server.status();
+    return 1;
+  }
+  LOG(INFO) << "Listening on " << (*server)->socket_path();
+
+  const int interval_s = absl::GetFlag(FLAGS_stats_interval_s);
+  const timespec timeout{.tv_sec = interval_s > 0 ? interval_s : 3600};
+  while (sigtimedwait(&signals, nullptr, &timeout) < 0) {
+    if (interval_s > 0) {
+      PrintStats((*server)->stats());
+    }
+  }
+
+  PrintStats((*server)->stats());
+  // Answers the requests already admitted before returning.
+  server->reset();
+  return 0;
+}
@@ -0,0 +1,276 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+
+#include "absl/strings/str_format.h"
+
+#include "inference/video_stream_runner.h"
+
+namespace inference {
+
+absl::StatusOr<std::unique_ptr<VideoStreamRunner>>
+VideoStreamRunner::Open(const std::string &source,
+                        const InferenceParams &params,
+                        const StreamOptions &options) {
+  if (options.queue_depth <= 0) {
+    return absl::InvalidArgumentError("queue_depth must be positive");
+  }
+  if (options.detection_interval <= 0) {
+    return absl::InvalidArgumentError("detection_interval must be positive");
+  }
+  if (options.detection_interval > 1 && !options.tracking) {
+    return absl::InvalidArgumentError(
+        "detection_interval above 1 needs tracking");
+  }
+
+  std::unique_ptr<MultiObjectTracker> tracker;
+  if (options.tracking) {
+    auto created = MultiObjectTracker::Create(options.tracker);
+    if (!created.ok()) {
+      return created.status();
+    }
+    tracker = std::move(*created);
+  }
+
+  std::unique_ptr<InferenceEngine> engine;
+  std::unique_ptr<MotionGatedInferenceEngine> gated_engine;
+  if (options.motion_gating) {
+    auto created =
+        MotionGatedInferenceEngine::Create(params, options.motion_gate);
+    if (!created.ok()) {
+      return created.status();
+    }
+    gated_engine = std::move(*created);
+  } else {
+    auto created = InferenceEngine::Create(params);
+    if (!created.ok()) {
+      return created.status();
+    }
+    engine = std::move(*created);
+  }
+
+  std::unique_ptr<VideoStreamRunner> runner(
+      new VideoStreamRunner(std::move(engine), std::move(gated_engine),
+                            std::move(tracker), options));
+
+  // A bare number selects a camera.
+  char *end = nullptr;
+  const long camera_index = std::strtol(source.c_str(), &end, 10);
+  try {
+    if (!source.empty() && *end == '\0') {
+      runner->capture_.open(static_cast<int>(camera_index));
+    } else {
+      runner->capture_.open(source);
+    }
+  } catch (const cv::Exception &e) {
+    return absl::InternalError(e.what());
+  }
+  if (!runner->capture_.isOpened()) {
+    return absl::NotFoundError(
+        absl::StrFormat("Cannot open video source %s", source));
+  }
+
+  const cv::VideoCapture &capture = runner->capture_;
+  runner->source_fps_ = capture.get(cv::CAP_PROP_FPS);
+  runner->frame_size_ =
+      cv::Size(static_cast<int>(capture.get(cv::CAP_PROP_FRAME_WIDTH)),
+               static_cast<int>(capture.get(cv::CAP_PROP_FRAME_HEIGHT)));
+
+  return runner;
+}
+
+VideoStreamRunner::VideoStreamRunner(
+    std::unique_ptr<InferenceEngine> engine,
+    std::unique_ptr<MotionGatedInferenceEngine> gated_engine,
+    std::unique_ptr<MultiObjectTracker> tracker, const StreamOptions &options)
+    : engine_(std::move(engine)), gated_engine_(std::move(gated_engine)),
+      tracker_(std::move(tracker)), options_(options) {}
+
+VideoStreamRunner::~VideoStreamRunner() {
+  StopDecoding();
+  if (decode_thread_.joinable()) {
+    decode_thread_.join();
+  }
+}
+
+absl::StatusOr<StreamStats>
+VideoStreamRunner::Run(const FrameCallback &callback) {
+  if (decode_thread_.joinable() || !capture_.isOpened()) {
+    return absl::FailedPreconditionError("stream was already run");
+  }
+
+  const int64_t start_ns = InferenceMetrics::NowNanos();
+  decode_thread_ = std::thread(&VideoStreamRunner::DecodeLoop, this);
+
+  StreamStats stats;
+  QueuedFrame frame;
+  std::vector<Detection> detections;
+  std::vector<TrackedObject> tracks;
+  absl::Status status;
+  while (PopFrame(&frame)) {
+    const bool detect =
+        stats.frames_processed % options_.detection_interval == 0;
+    if (detect) {
+      status = Detect(frame.image, &detections);
+      if (!status.ok()) {
+        break;
+      }
+      ++stats.frames_detected;
+    }
+    if (tracker_ != nullptr) {
+      if (detect) {
+        tracker_->Update(detections, &tracks);
+      } else {
+        tracker_->Predict(&tracks);
+      }
+      detections.clear();
+      for (const TrackedObject &track : tracks) {
+        detections.push_back(track.detection);
+      }
+    }
+
+    const int64_t latency_ns = InferenceMetrics::NowNanos() - frame.decoded_ns;
+    latency_.Record(static_cast<uint64_t>(std::max<int64_t>(0, latency_ns)));
+    ++stats.frames_processed;
+
+    if (callback) {
+      callback(StreamFrame{.index = frame.index,
+                           .timestamp_ms = frame.timestamp_ms,
+                           .image = frame.image,
+                           .latency_ns = latency_ns,
+                           .detected = detect,
+                           .tracks = tracks},
+               detections);
+    }
+    RecycleFrame(&frame);
+  }
+
+  StopDecoding();
+  decode_thread_.join();
+  capture_.release();
+  if (!status.ok()) {
+    return status;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats.frames_decoded = frames_decoded_;
+    stats.frames_dropped = frames_dropped_;
+  }
+  stats.elapsed_seconds = (InferenceMetrics::NowNanos() - start_ns) * 1e-9;
+  if (stats.elapsed_seconds > 0.0) {
+    stats.frames_per_second = stats.frames_processed / stats.elapsed_seconds;
+  }
+  stats.latency_mean_ms = latency_.Mean() * 1e-6;
+  stats.latency_p50_ms = latency_.Quantile(0.5) * 1e-6;
+  stats.latency_p90_ms = latency_.Quantile(0.9) * 1e-6;
+  stats.latency_p99_ms = latency_.Quantile(0.99) * 1e-6;
+  if (gated_engine_ != nullptr) {
+    stats.motion_gate = gated_engine_->stats();
+  }
+  return stats;
+}
+
+absl::Status VideoStreamRunner::Detect(const cv::Mat &image,
+                                       std::vector<Detection> *detections) {
+  if (gated_engine_ != nullptr) {
+    return gated_engine_->RunInference(image, detections);
+  }
+  return engine_->RunInference(image, detections);
+}
+
+void VideoStreamRunner::DecodeLoop() {
+  const bool pace = options_.pace_to_source_fps && source_fps_ > 0.0;
+  const auto frame_interval = std::chrono::duration_cast<
+      std::chrono::steady_clock::duration>(
+      std::chrono::duration<double>(pace ? 1.0 / source_fps_ : 0.0));
+  const auto start = std::chrono::steady_clock::now();
+
+  for (int64_t index = 0;
+       options_.max_frames <= 0 || index < options_.max_frames; ++index) {
+    cv::Mat image;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (stopping_) {
+        break;
+      }
+      if (!free_images_.empty()) {
+        image = std::move(free_images_.back());
+        free_images_.pop_back();
+      }
+    }
+
+    if (pace) {
+      std::this_thread::sleep_until(start + index * frame_interval);
+    }
+    // read() decodes into the recycled buffer when the size matches.
+    if (!capture_.read(image) || image.empty()) {
+      break;
+    }
+
+    QueuedFrame frame{.index = index,
+                      .timestamp_ms = capture_.get(cv::CAP_PROP_POS_MSEC),
+                      .decoded_ns = InferenceMetrics::NowNanos(),
+                      .image = std::move(image)};
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    ++frames_decoded_;
+    if (options_.drop_policy == FrameDropPolicy::kBlock) {
+      frame_consumed_.wait(lock, [this] {
+        return stopping_ ||
+               queue_.size() < static_cast<size_t>(options_.queue_depth);
+      });
+      if (stopping_) {
+        break;
+      }
+    } else if (queue_.size() >= static_cast<size_t>(options_.queue_depth)) {
+      ++frames_dropped_;
+      if (options_.drop_policy == FrameDropPolicy::kDropNewest) {
+        free_images_.push_back(std::move(frame.image));
+        continue;
+      }
+      free_images_.push_back(std::move(queue_.front().image));
+      queue_.pop_front();
+    }
+    queue_.push_back(std::move(frame));
+    lock.unlock();
+    frame_queued_.notify_one();
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    decoding_done_ = true;
+  }
+  frame_queued_.notify_one();
+}
+
+bool VideoStreamRunner::PopFrame(QueuedFrame *frame) {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    frame_queued_.wait(lock,
+                       [this] { return decoding_done_ || !queue_.empty(); });
+    if (queue_.empty()) {
+      return false;
+    }
+    *frame = std::move(queue_.front());
+    queue_.pop_front();
+  }
+  frame_consumed_.notify_one();
+  return true;
+}
+
+void VideoStreamRunner::RecycleFrame(QueuedFrame *frame) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  free_images_.push_back(std::move(frame->image));
+}
+
+void VideoStreamRunner::StopDecoding() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  frame_consumed_.notify_all();
+  frame_queued_.notify_all();
+}
+
+} // namespace inference
@@ -0,0 +1,186 @@
+#ifndef INFERENCE_VIDEO_STREAM_RUNNER_H_
+#define INFERENCE_VIDEO_STREAM_RUNNER_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+#include "opencv2/core.hpp"
+#include "opencv2/videoio.hpp"
+
+#include "inference/detection.h"
+#include "inference/inference_engine.h"
+#include "inference/inference_metrics.h"
+#include "inference/inference_params.h"
+#include "inference/motion_gated_inference_engine.h"
+#include "inference/multi_object_tracker.h"
+
+namespace inference {
+
+// What the decode thread does when inference falls behind and the frame
+// queue is full.
+enum class FrameDropPolicy {
+  // Wait for room. Every frame is processed, decoding slows down to the
+  // inference rate. For offline processing of files.
+  kBlock,
+  // Discard the frame just decoded.
+  kDropNewest,
+  // Discard the oldest queued frame, so inference always works on the most
+  // recent frames. For live streams.
+  kDropOldest,
+};
+
+struct StreamOptions {
+  // Decoded frames buffered between the decode and the inference thread.
+  int queue_depth = 4;
+  FrameDropPolicy drop_policy = FrameDropPolicy::kBlock;
+  // Decode no faster than the stream's nominal frame rate, so a file
+  // behaves like a live camera. Ignored if the stream reports no rate.
+  bool pace_to_source_fps = false;
+  // Stop after this many decoded frames, 0 runs to the end of the stream.
+  int64_t max_frames = 0;
+  // Run frames through a MotionGatedInferenceEngine, which skips static
+  // frames and infers only the changed regions of the others. For fixed
+  // cameras.
+  bool motion_gating = false;
+  MotionGateOptions motion_gate;
+  // Follow objects across frames with a MultiObjectTracker. The detections
+  // handed to the FrameCallback are then the confirmed tracks.
+  bool tracking = false;
+  TrackerOptions tracker;
+  // With tracking, run the detector on every this many processed frames
+  // only, the tracker predicts the boxes in between.
+  int detection_interval = 1;
+};
+
+// One decoded frame handed to the FrameCallback.
+struct StreamFrame {
+  // Position in the stream, counting dropped frames.
+  int64_t index;
+  // Presentation time reported by the decoder.
+  double timestamp_ms;
+  cv::Mat image;
+  // Time from the end of decoding to the end of postprocessing, including
+  // the time spent queued.
+  int64_t latency_ns;
+  // Whether the detector ran on this frame, false on the frames in between
+  // detector runs with StreamOptions::detection_interval.
+  bool detected;
+  // With tracking, the track of each detection, in the same order.
+  absl::Span<const TrackedObject> tracks;
+};
+
+struct StreamStats {
+  int64_t frames_decoded = 0;
+  int64_t frames_processed = 0;
+  int64_t frames_dropped = 0;
+  // Processed frames the detector ran on.
+  int64_t frames_detected = 0;
+  double elapsed_seconds = 0.0;
+  // Processed frames per second of wall time, the sustained rate.
+  double frames_per_second = 0.0;
+  // Per-frame latency, see StreamFrame::latency_ns.
+  double latency_mean_ms = 0.0;
+  double latency_p50_ms = 0.0;
+  double latency_p90_ms = 0.0;
+  double latency_p99_ms = 0.0;
+  // How frames went through the motion gate, with
+  // StreamOptions::motion_gating only.
+  MotionGateStats motion_gate;
+};
+
+// Runs an InferenceEngine over a cv::VideoCapture source. Frames are decoded
+// on a dedicated thread while the previous ones go through inference, and
+// queued frames are dropped according to StreamOptions::drop_policy when
+// inference cannot keep up.
+class VideoStreamRunner {
+public:
+  // Called on the thread that calls Run, in stream order. The frame image
+  // is only valid during the call.
+  using FrameCallback = std::function<void(
+      const StreamFrame &frame, const std::vector<Detection> &detections)>;
+
+  // `source` is anything cv::VideoCapture opens: a file, a stream URL, or a
+  // camera index.
+  static absl::StatusOr<std::unique_ptr<VideoStreamRunner>>
+  Open(const std::string &source, const InferenceParams &params,
+       const StreamOptions &options);
+
+  ~VideoStreamRunner();
+
+  // Nominal frame rate and size of the stream, 0 when unknown.
+  double source_fps() const { return source_fps_; }
+  cv::Size frame_size() const { return frame_size_; }
+
+  const InferenceEngine &engine() const {
+    return gated_engine_ != nullptr ? gated_engine_->engine() : *engine_;
+  }
+
+  // Processes the stream until it ends, max_frames is reached or inference
+  // fails. Can only be called once.
+  absl::StatusOr<StreamStats> Run(const FrameCallback &callback);
+
+private:
+  struct QueuedFrame {
+    int64_t index = 0;
+    double timestamp_ms = 0.0;
+    int64_t decoded_ns = 0;
+    cv::Mat image;
+  };
+
+  // Exactly one of `engine` and `gated_engine` is set.
+  VideoStreamRunner(std::unique_ptr<InferenceEngine> engine,
+                    std::unique_ptr<MotionGatedInferenceEngine> gated_engine,
+                    std::unique_ptr<MultiObjectTracker> tracker,
+                    const StreamOptions &options);
+
+  // Runs the detector, gated or not, on `image`.
+  absl::Status Detect(const cv::Mat &image,
+                      std::vector<Detection> *detections);
+
+  void DecodeLoop();
+
+  // Blocks until a frame is queued, returns false once decoding finished
+  // and the queue is drained.
+  bool PopFrame(QueuedFrame *frame);
+
+  // Returns a processed frame's buffer to the decoder.
+  void RecycleFrame(QueuedFrame *frame);
+
+  void StopDecoding();
+
+  std::unique_ptr<InferenceEngine> engine_;
+  std::unique_ptr<MotionGatedInferenceEngine> gated_engine_;
+  std::unique_ptr<MultiObjectTracker> tracker_;
+  const StreamOptions options_;
+  cv::VideoCapture capture_;
+  double source_fps_ = 0.0;
+  cv::Size frame_size_;
+
+  std::mutex mutex_;
+  std::condition_variable frame_queued_;
+  std::condition_variable frame_consumed_;
+  std::deque<QueuedFrame> queue_;
+  // Image buffers of processed or dropped frames, reused by the decoder.
+  std::vector<cv::Mat> free_images_;
+  int64_t frames_decoded_ = 0;
+  int64_t frames_dropped_ = 0;
+  bool decoding_done_ = false;
+  bool stopping_ = false;
+
+  Histogram latency_;
+  std::thread decode_thread_;
+};
+
+} // namespace inference
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef INFERENCE_YUV_IMAGE_H_
+#define INFERENCE_YUV_IMAGE_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace inference {
+
+enum class YuvFormat {
+  // Y plane followed by an interleaved U, V plane at half resolution, as
+  // produced by most hardware video decoders.
+  kNv12,
+  // Y, U and V planes, U and V at half resolution.
+  kI420,
+};
+
+// A 4:2:0 BT.601 video frame in caller-owned memory, viewed without copying.
+// The planes must stay valid and unchanged while the view is in use.
+struct YuvImage {
+  static YuvImage Nv12(int width, int height, const uint8_t *y,
+                       size_t y_stride, const uint8_t *uv, size_t uv_stride) {
+    return YuvImage{.format = YuvFormat::kNv12,
+                    .width = width,
+                    .height = height,
+                    .y = y,
+                    .y_stride = y_stride,
+                    .u = uv,
+                    .u_stride = uv_stride,
+                    .v = uv + 1,
+                    .v_stride = uv_stride};
+  }
+
+  static YuvImage I420(int width, int height, const uint8_t *y,
+                       size_t y_stride, const uint8_t *u, size_t u_stride,
+                       const uint8_t *v, size_t v_stride) {
+    return YuvImage{.format = YuvFormat::kI420,
+                    .width = width,
+                    .height = height,
+                    .y = y,
+                    .y_stride = y_stride,
+                    .u = u,
+                    .u_stride = u_stride,
+                    .v = v,
+                    .v_stride = v_stride};
+  }
+
+  // Bytes between horizontally adjacent chroma samples.
+  int chroma_step() const { return format == YuvFormat::kNv12 ? 2 : 1; }
+
+  YuvFormat format = YuvFormat::kNv12;
+  // Luma resolution, both even.
+  int width = 0;
+  int height = 0;
+  // Strides are in bytes. For NV12, `u` and `v` point at the first U and V
+  // sample of the interleaved plane.
+  const uint8_t *y = nullptr;
+  size_t y_stride = 0;
+  const uint8_t *u = nullptr;
+  size_t u_stride = 0;
+  const uint8_t *v = nullptr;
+  size_t v_stride = 0;
+};
+
+} // namespace inference
+
+#endif